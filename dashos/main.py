@@ -28,6 +28,7 @@ from PySide6.QtQml import QQmlApplicationEngine, qmlRegisterType
 sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
 
 from services.serial_bridge import SerialBridge
+from services.log_sync import LogSync
 from services.meshtastic_service import MeshtasticService
 from services.power_manager import PowerManager
 
@@ -169,6 +170,8 @@ class DashOSApp(QObject):
 
         # Services
         self._serial_bridge = None
+        self._log_sync = None
+        self._log_sync_auto = False
         self._meshtastic = None
         self._power_mgr = None
 
@@ -184,11 +187,22 @@ class DashOSApp(QObject):
 
         self._serial_bridge = SerialBridge(
             port=config.get('serial_port', '/dev/ttyUSB0'),
-            baud=int(config.get('serial_baud', '115200'))
+            baud=int(config.get('serial_baud', '115200')),
+            fmt=config.get('serial_format', 'json'),
+            period_ms=int(config.get('telemetry_period_ms', '500')),
+            native=config.get('native_decoder', 'auto'),
+            link_baud=int(config.get('serial_link_baud', '0')) or None
         )
         self._serial_bridge.data_received.connect(self._on_vehicle_data)
         self._serial_bridge.start()
 
+        # Copy new SD logs off the bridge (parked = automatically when stopped)
+        log_sync = config.get('log_sync', 'parked')
+        if log_sync != 'off':
+            self._log_sync = LogSync(self._serial_bridge, config.get(
+                'log_sync_dir', os.path.join(os.path.dirname(__file__), 'logs')))
+            self._log_sync_auto = log_sync == 'parked'
+
         self._meshtastic = MeshtasticService()
         self._power_mgr = PowerManager()
 
@@ -460,6 +474,8 @@ class DashOSApp(QObject):
         if 'spd' in obd:
             self._speed = obd['spd']
             self.speedChanged.emit()
+            if self._log_sync_auto:
+                self._log_sync.maybe_start(self._speed)
         if 'rpm' in obd:
             self._rpm = obd['rpm']
             self.rpmChanged.emit()
@@ -528,25 +544,37 @@ class DashOSApp(QObject):
         if 'dtc' in data:
             self._active_dtcs = data['dtc']
 
-        # Trip computer update (real mode)
+        # Trip computer update (real mode). Firmware with a trip computer
+        # integrates every OBD reply and keeps the trip across power cycles;
+        # older firmware leaves it to these 2 Hz samples.
         now = time.time()
         dt = now - self._last_tick
         self._last_tick = now
+        trip = data.get('trip')
 
-        self._trip_time_secs = int(now - self._trip_start)
+        if trip:
+            self._trip_time_secs = int(trip.get('eng_s', 0))
+        else:
+            self._trip_time_secs = int(now - self._trip_start)
         h = self._trip_time_secs // 3600
         m = (self._trip_time_secs // 60) % 60
         s = self._trip_time_secs % 60
         self._trip_time = f"{h:02d}:{m:02d}:{s:02d}"
         self.tripTimeChanged.emit()
 
-        if self._speed > 0:
-            self._trip_distance += (self._speed / 3600.0) * dt
+        if trip:
+            self._trip_distance = trip.get('km', 0.0)
+            self._trip_avg_speed = trip.get('avg', 0.0)
             self.tripDistanceChanged.emit()
-
-        if self._trip_time_secs > 0:
-            self._trip_avg_speed = self._trip_distance / (self._trip_time_secs / 3600.0)
             self.tripAvgSpeedChanged.emit()
+        else:
+            if self._speed > 0:
+                self._trip_distance += (self._speed / 3600.0) * dt
+                self.tripDistanceChanged.emit()
+
+            if self._trip_time_secs > 0:
+                self._trip_avg_speed = self._trip_distance / (self._trip_time_secs / 3600.0)
+                self.tripAvgSpeedChanged.emit()
 
         if self._speed > 5 and self._fuel_rate > 0:
             self._fuel_economy = (self._fuel_rate / self._speed) * 100.0
@@ -735,6 +763,17 @@ class DashOSApp(QObject):
         if self._serial_bridge:
             self._serial_bridge.send_command('clear_dtc')
 
+    @Slot()
+    def syncLogs(self):
+        if self._log_sync:
+            self._log_sync.start()
+
+    @Slot(str, int, int)
+    def fetchLogWindow(self, name, from_ms, to_ms):
+        """Fetch one log's rows between two bridge timestamps"""
+        if self._log_sync:
+            self._log_sync.fetch_window(name, from_ms, to_ms)
+
     @Slot(float)
     def setChargeCurrent(self, amps):
         if self._serial_bridge:
@@ -742,7 +781,9 @@ class DashOSApp(QObject):
 
     @Slot()
     def resetTrip(self):
-        """Reset trip computer"""
+        """Reset trip computer (the bridge's too, which the stream follows)"""
+        if self._serial_bridge:
+            self._serial_bridge.send_command('reset_trip')
         self._trip_distance = 0.0
         self._trip_time_secs = 0
         self._trip_time = "00:00:00"
@@ -0,0 +1,817 @@
+/**
+ * @file dashtelem.cpp
+ * Native bridge stream decoder — see dashtelem.h
+ *
+ * Framing follows SerialBridge._drain_buffer(): newline-delimited JSON
+ * until the bridge acknowledges {"format":"binary"}, then 0x00-delimited
+ * COBS frames; a bare JSON line in binary mode means the bridge rebooted.
+ * Binary decoding mirrors services/telemetry_binary.py.
+ *
+ * Only the reader thread writes the region. Table updates are wrapped in
+ * a seqlock, samples are published by advancing head after they are
+ * written, so readers never take a lock.
+ */
+
+#include "dashtelem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define DT_LINE_MAX     8192        // Longest line/frame accepted
+#define DT_HASH_SIZE    512         // Key lookup table, > 2 × DT_MAX_FIELDS
+#define DT_EVENT_MAX    256         // Queued reply lines before dropping
+#define DT_JSON_DEPTH   8
+#define DT_ENUM_NAMES   16
+
+#define MSG_SCHEMA      0x01
+#define MSG_DATA        0x02
+#define MSG_JSON        0x03
+#define FLAG_KEYFRAME   0x01
+
+struct BinField {
+    int16_t field;          // Index into the region's fields, -1 = unused
+    uint8_t type;           // TbType
+    uint8_t decimals;
+    uint8_t nameCount;
+    char names[DT_ENUM_NAMES][DT_STR_LEN];
+};
+
+// A value parsed out of one record, applied under the seqlock
+struct Staged {
+    int16_t field;
+    uint8_t type;
+    double num;
+    const char *str;
+    size_t strLen;
+};
+
+struct dt_decoder {
+    dt_shm *shm = NULL;
+    std::string shmName;
+    int16_t hash[DT_HASH_SIZE];
+
+    // Framing
+    uint8_t line[DT_LINE_MAX];
+    size_t len = 0;
+    bool overflow = false;
+    std::atomic<bool> binary{false};
+
+    // Binary schema / delta state
+    BinField bin[256];
+    uint16_t schemaId = 0;
+    bool haveSchema = false;
+    bool haveState = false;
+    int32_t lastSeq = -1;
+    int64_t lastJsonSeq = -1;       // "seq" of the last JSON record
+    uint8_t frame[DT_LINE_MAX];
+
+    // Record staging
+    Staged staged[DT_MAX_FIELDS];
+    int stagedCount = 0;
+    uint32_t recordTs = 0;
+
+    // Shared with the caller's thread
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::string> events;
+    int pending = 0;
+    int need = 0;
+    dt_stats stats = {};
+
+    // Reader side, handed over by publish()
+    dt_stats local = {};
+    int localPending = 0;
+    int localNeed = 0;
+
+    std::thread reader;
+    std::atomic<bool> running{false};
+    int fd = -1;
+};
+
+/* ══════════════════════════════════════════════════════════════
+ * CRC / COBS — same as mb_crc16() and tb_cobs_decode() in firmware
+ * ══════════════════════════════════════════════════════════════*/
+
+static uint16_t crc16(const uint8_t *p, size_t n) {
+    uint16_t crc = 0xFFFF;
+    while (n--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+static size_t cobs_decode(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        uint8_t code = in[i];
+        if (code == 0 || i + code > len || o + code > cap) return 0;
+        memcpy(out + o, in + i + 1, code - 1);
+        o += code - 1;
+        i += code;
+        if (code != 0xFF && i < len) out[o++] = 0;
+    }
+    return o;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * FIELD TABLE
+ * ══════════════════════════════════════════════════════════════*/
+
+static uint32_t key_hash(const char *k, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) h = (h ^ (uint8_t)k[i]) * 16777619u;
+    return h;
+}
+
+// Index of key, registering it if new; -1 when the table is full
+static int field_index(dt_decoder *d, const char *key, size_t n) {
+    if (n >= DT_KEY_LEN) n = DT_KEY_LEN - 1;
+    uint32_t h = key_hash(key, n) & (DT_HASH_SIZE - 1);
+    for (;;) {
+        int16_t idx = d->hash[h];
+        if (idx < 0) break;
+        const char *k = d->shm->fields[idx].key;
+        if (strncmp(k, key, n) == 0 && k[n] == '\0') return idx;
+        h = (h + 1) & (DT_HASH_SIZE - 1);
+    }
+    uint32_t idx = d->shm->field_count;
+    if (idx >= DT_MAX_FIELDS) return -1;
+    dt_field *f = &d->shm->fields[idx];
+    memcpy(f->key, key, n);
+    f->key[n] = '\0';
+    d->hash[h] = (int16_t)idx;
+    // Readers only look at [0, field_count); count goes up last
+    __atomic_store_n(&d->shm->field_count, idx + 1, __ATOMIC_RELEASE);
+    return idx;
+}
+
+static void stage(dt_decoder *d, const char *key, size_t keyLen, uint8_t type,
+                  double num, const char *str = NULL, size_t strLen = 0) {
+    if (d->stagedCount >= DT_MAX_FIELDS) return;
+    int idx = field_index(d, key, keyLen);
+    if (idx < 0) return;
+    d->staged[d->stagedCount++] = {(int16_t)idx, type, num, str, strLen};
+}
+
+/**
+ * Apply the staged values as one record. A full record (JSON line,
+ * binary keyframe) replaces the present set; a delta only updates.
+ */
+static void commit_record(dt_decoder *d, bool full) {
+    dt_shm *shm = d->shm;
+    uint32_t rec = shm->records + 1;
+
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (full) {
+        for (uint32_t i = 0; i < shm->field_count; i++) shm->fields[i].present = 0;
+    }
+    uint64_t head = shm->head;
+    for (int i = 0; i < d->stagedCount; i++) {
+        const Staged *s = &d->staged[i];
+        dt_field *f = &shm->fields[s->field];
+        f->type = s->type;
+        f->present = 1;
+        f->updated = rec;
+        f->num = s->num;
+        if (s->type == DT_STR) {
+            size_t n = s->strLen < DT_STR_LEN - 1 ? s->strLen : DT_STR_LEN - 1;
+            memcpy(f->str, s->str, n);
+            f->str[n] = '\0';
+        } else if (s->type != DT_EMPTY_LIST) {
+            dt_sample *smp = &shm->ring[head % DT_RING];
+            smp->ts_ms = d->recordTs;
+            smp->field = (uint16_t)s->field;
+            smp->type = s->type;
+            smp->value = s->num;
+            head++;
+        }
+    }
+    shm->records = rec;
+    shm->ts_ms = d->recordTs;
+    __atomic_store_n(&shm->head, head, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+
+    d->stagedCount = 0;
+    d->local.records++;
+    d->localPending |= DT_EV_RECORD;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * JSON — flattened into dotted keys, no allocation
+ * ══════════════════════════════════════════════════════════════*/
+
+struct JsonCursor {
+    const char *p;
+    const char *end;
+    char path[128];
+    size_t pathLen;
+};
+
+static void skip_ws(JsonCursor *c) {
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r')) c->p++;
+}
+
+static double pow10i(int e) {
+    static const double P[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+    return e >= 0 && e < 10 ? P[e] : pow(10.0, e);
+}
+
+// Locale-independent: Qt sets LC_NUMERIC from the environment
+static bool parse_number(JsonCursor *c, double *out, bool *isInt) {
+    const char *p = c->p;
+    bool neg = false;
+    if (p < c->end && *p == '-') { neg = true; p++; }
+    if (p >= c->end || *p < '0' || *p > '9') return false;
+    // Digits as an integer mantissa, divided once: 27.43 → 2743 / 100,
+    // the same double Python's json module produces
+    uint64_t mant = 0;
+    int frac = 0, dropped = 0;
+    while (p < c->end && *p >= '0' && *p <= '9') {
+        if (mant < 100000000000000000ull) mant = mant * 10 + (*p - '0');
+        else dropped++;
+        p++;
+    }
+    *isInt = true;
+    if (p < c->end && *p == '.') {
+        *isInt = false;
+        p++;
+        while (p < c->end && *p >= '0' && *p <= '9') {
+            if (mant < 100000000000000000ull) {
+                mant = mant * 10 + (*p - '0');
+                frac++;
+            }
+            p++;
+        }
+    }
+    double v = (double)mant;
+    if (dropped) v *= pow10i(dropped);
+    if (frac) v /= pow10i(frac);
+    if (p < c->end && (*p == 'e' || *p == 'E')) {
+        *isInt = false;
+        p++;
+        bool eneg = false;
+        if (p < c->end && (*p == '+' || *p == '-')) eneg = *p++ == '-';
+        int e = 0;
+        while (p < c->end && *p >= '0' && *p <= '9') e = e * 10 + (*p++ - '0');
+        v *= pow10i(eneg ? -e : e);
+    }
+    *out = neg ? -v : v;
+    c->p = p;
+    return true;
+}
+
+// String body after the opening quote; escapes are kept verbatim
+static bool parse_string(JsonCursor *c, const char **s, size_t *n) {
+    const char *start = c->p;
+    while (c->p < c->end && *c->p != '"') {
+        if (*c->p == '\\') c->p++;
+        c->p++;
+    }
+    if (c->p >= c->end) return false;
+    *s = start;
+    *n = c->p - start;
+    c->p++;
+    return true;
+}
+
+static bool push_path(JsonCursor *c, const char *part, size_t n) {
+    size_t need = (c->pathLen ? 1 : 0) + n;
+    if (c->pathLen + need >= sizeof(c->path)) return false;
+    if (c->pathLen) c->path[c->pathLen++] = '.';
+    memcpy(c->path + c->pathLen, part, n);
+    c->pathLen += n;
+    return true;
+}
+
+static bool parse_value(dt_decoder *d, JsonCursor *c, int depth) {
+    skip_ws(c);
+    if (c->p >= c->end || depth > DT_JSON_DEPTH) return false;
+    size_t base = c->pathLen;
+    char ch = *c->p;
+
+    if (ch == '{' || ch == '[') {
+        bool obj = ch == '{';
+        c->p++;
+        skip_ws(c);
+        if (c->p < c->end && *c->p == (obj ? '}' : ']')) {
+            c->p++;
+            if (!obj) stage(d, c->path, c->pathLen, DT_EMPTY_LIST, 0);
+            return true;
+        }
+        for (int i = 0;; i++) {
+            skip_ws(c);
+            if (obj) {
+                const char *k;
+                size_t kn;
+                if (c->p >= c->end || *c->p++ != '"' || !parse_string(c, &k, &kn)) return false;
+                skip_ws(c);
+                if (c->p >= c->end || *c->p++ != ':') return false;
+                if (!push_path(c, k, kn)) return false;
+            } else {
+                char idx[12];
+                int n = snprintf(idx, sizeof(idx), "%d", i);
+                if (!push_path(c, idx, n)) return false;
+            }
+            if (!parse_value(d, c, depth + 1)) return false;
+            c->pathLen = base;
+            skip_ws(c);
+            if (c->p >= c->end) return false;
+            char sep = *c->p++;
+            if (sep == ',') continue;
+            return sep == (obj ? '}' : ']');
+        }
+    }
+
+    if (ch == '"') {
+        c->p++;
+        const char *s;
+        size_t n;
+        if (!parse_string(c, &s, &n)) return false;
+        stage(d, c->path, c->pathLen, DT_STR, 0, s, n);
+        return true;
+    }
+    if (c->end - c->p >= 4 && memcmp(c->p, "true", 4) == 0) {
+        c->p += 4;
+        stage(d, c->path, c->pathLen, DT_BOOL, 1);
+        return true;
+    }
+    if (c->end - c->p >= 5 && memcmp(c->p, "false", 5) == 0) {
+        c->p += 5;
+        stage(d, c->path, c->pathLen, DT_BOOL, 0);
+        return true;
+    }
+    if (c->end - c->p >= 4 && memcmp(c->p, "null", 4) == 0) {
+        c->p += 4;
+        return true;
+    }
+    double v;
+    bool isInt;
+    if (!parse_number(c, &v, &isInt)) return false;
+    stage(d, c->path, c->pathLen, isInt ? DT_INT : DT_NUM, v);
+    return true;
+}
+
+static void queue_event(dt_decoder *d, const char *text, size_t n) {
+    // Format switches are acknowledged in the old format; a ready/boot
+    // line means the bridge restarted in JSON
+    std::string line(text, n);
+    if (line.find("\"format\":\"binary\"") != std::string::npos) {
+        d->binary = true;
+    } else if (line.find("\"format\":\"json\"") != std::string::npos ||
+               line.find("\"status\":") != std::string::npos ||
+               line.find("\"boot\":") != std::string::npos) {
+        d->binary = false;
+    }
+
+    std::lock_guard<std::mutex> g(d->lock);
+    if (d->events.size() < DT_EVENT_MAX) d->events.push_back(std::move(line));
+    else d->local.overruns++;
+    d->local.events++;
+    d->localPending |= DT_EV_EVENT;
+}
+
+// One JSON line: a telemetry record ({"obd":...}) or a reply/event
+static void handle_line(dt_decoder *d, const char *text, size_t n) {
+    while (n > 0 && (text[n - 1] == '\r' || text[n - 1] == ' ')) n--;
+    if (n == 0) return;
+    static const char RECORD[] = "{\"obd\":";
+    if (n < sizeof(RECORD) - 1 || memcmp(text, RECORD, sizeof(RECORD) - 1) != 0) {
+        queue_event(d, text, n);
+        return;
+    }
+
+    JsonCursor c = {text, text + n, {0}, 0};
+    d->stagedCount = 0;
+    if (!parse_value(d, &c, 0)) {
+        d->stagedCount = 0;
+        d->local.json_errors++;
+        return;
+    }
+    d->recordTs = 0;
+    for (int i = 0; i < d->stagedCount; i++) {
+        const char *key = d->shm->fields[d->staged[i].field].key;
+        if (strcmp(key, "ts") == 0) {
+            d->recordTs = (uint32_t)d->staged[i].num;
+        } else if (strcmp(key, "seq") == 0) {
+            // A lower seq is a bridge restart, not loss
+            int64_t seq = (int64_t)d->staged[i].num;
+            if (d->lastJsonSeq >= 0 && seq > d->lastJsonSeq + 1) {
+                d->local.lost_frames += seq - d->lastJsonSeq - 1;
+            }
+            d->lastJsonSeq = seq;
+        }
+    }
+    commit_record(d, true);
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * BINARY FRAMES
+ * ══════════════════════════════════════════════════════════════*/
+
+static uint32_t get_le(const uint8_t *p, int n) {
+    uint32_t v = 0;
+    for (int i = n - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static void parse_schema(dt_decoder *d, const uint8_t *p, size_t n) {
+    if (n < 5) return;
+    for (int i = 0; i < 256; i++) d->bin[i].field = -1;
+    uint8_t count = p[4];
+    size_t pos = 5;
+    for (int i = 0; i < count; i++) {
+        if (pos + 4 > n) return;
+        uint8_t fid = p[pos], type = p[pos + 1], dec = p[pos + 2], klen = p[pos + 3];
+        pos += 4;
+        if (pos + klen > n) return;
+        BinField *b = &d->bin[fid];
+        b->field = (int16_t)field_index(d, (const char *)p + pos, klen);
+        b->type = type;
+        b->decimals = dec;
+        b->nameCount = 0;
+        pos += klen;
+        if (type == 7) {
+            if (pos >= n) return;
+            uint8_t nlen = p[pos++];
+            if (pos + nlen > n) return;
+            const char *s = (const char *)p + pos, *end = s + nlen;
+            while (s <= end && b->nameCount < DT_ENUM_NAMES) {
+                const char *bar = (const char *)memchr(s, '|', end - s);
+                if (!bar) bar = end;
+                size_t sl = bar - s < DT_STR_LEN - 1 ? bar - s : DT_STR_LEN - 1;
+                memcpy(b->names[b->nameCount], s, sl);
+                b->names[b->nameCount][sl] = '\0';
+                b->nameCount++;
+                s = bar + 1;
+            }
+            pos += nlen;
+        }
+    }
+    d->schemaId = (uint16_t)get_le(p + 2, 2);
+    d->haveSchema = true;
+    d->haveState = false;
+}
+
+static void parse_data(dt_decoder *d, const uint8_t *p, size_t n) {
+    static const uint8_t WIDTH[] = {0, 1, 1, 2, 2, 4, 4, 1};
+    if (n < 11) return;
+    uint16_t schemaId = (uint16_t)get_le(p + 1, 2);
+    if (!d->haveSchema || schemaId != d->schemaId) {
+        d->localNeed |= DT_NEED_SCHEMA;
+        return;
+    }
+
+    uint16_t seq = (uint16_t)get_le(p + 3, 2);
+    bool keyframe = p[5] & FLAG_KEYFRAME;
+    if (d->lastSeq >= 0 && seq != (uint16_t)(d->lastSeq + 1)) {
+        d->local.lost_frames += (uint16_t)(seq - d->lastSeq - 1);
+        if (!keyframe) d->haveState = false;
+    }
+    d->lastSeq = seq;
+    if (keyframe) {
+        d->haveState = true;
+    } else if (!d->haveState) {
+        d->localNeed |= DT_NEED_KEYFRAME;
+        return;
+    }
+
+    d->recordTs = get_le(p + 6, 4);
+    d->stagedCount = 0;
+    uint8_t count = p[10];
+    size_t pos = 11;
+    for (int i = 0; i < count; i++) {
+        if (pos >= n) break;
+        const BinField *b = &d->bin[p[pos]];
+        if (b->field < 0 || b->type == 0 || b->type > 7) break;
+        uint8_t w = WIDTH[b->type];
+        if (pos + 1 + w > n) break;
+        uint32_t u = get_le(p + pos + 1, w);
+        pos += 1 + w;
+
+        int64_t raw;
+        switch (b->type) {
+            case 3: raw = (int16_t)u; break;
+            case 5: raw = (int32_t)u; break;
+            default: raw = u; break;
+        }
+        if (d->stagedCount >= DT_MAX_FIELDS) break;
+        Staged *s = &d->staged[d->stagedCount++];
+        s->field = b->field;
+        s->str = NULL;
+        s->strLen = 0;
+        if (b->type == 1) {
+            s->type = DT_BOOL;
+            s->num = raw != 0;
+        } else if (b->type == 7 && raw < b->nameCount) {
+            s->type = DT_STR;
+            s->num = (double)raw;
+            s->str = b->names[raw];
+            s->strLen = strlen(b->names[raw]);
+        } else if (b->decimals) {
+            s->type = DT_NUM;
+            s->num = raw / pow10i(b->decimals);
+        } else {
+            s->type = DT_INT;
+            s->num = (double)raw;
+        }
+    }
+    stage(d, "seq", 3, DT_INT, seq);
+    stage(d, "ts", 2, DT_INT, d->recordTs);
+    commit_record(d, keyframe);
+}
+
+static void handle_frame(dt_decoder *d, const uint8_t *in, size_t len) {
+    size_t n = cobs_decode(in, len, d->frame, sizeof(d->frame));
+    if (n < 3 || crc16(d->frame, n - 2) != get_le(d->frame + n - 2, 2)) {
+        d->local.crc_errors++;
+        return;
+    }
+    n -= 2;
+    switch (d->frame[0]) {
+        case MSG_SCHEMA: parse_schema(d, d->frame, n); break;
+        case MSG_DATA:   parse_data(d, d->frame, n); break;
+        case MSG_JSON:   queue_event(d, (const char *)d->frame + 1, n - 1); break;
+        default: break;
+    }
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * BYTE STREAM
+ * ══════════════════════════════════════════════════════════════*/
+
+static void append(dt_decoder *d, const uint8_t *p, size_t n) {
+    if (d->len + n > sizeof(d->line)) {
+        d->overflow = true;
+        return;
+    }
+    memcpy(d->line + d->len, p, n);
+    d->len += n;
+}
+
+// One complete line/frame: straight from the read buffer when nothing is
+// carried over from the previous read, else from the line buffer
+static void dispatch(dt_decoder *d, const uint8_t *p, size_t n, bool isLine) {
+    if (d->len > 0 || d->overflow) {
+        append(d, p, n);
+        p = d->line;
+        n = d->len;
+    }
+    if (d->overflow) d->local.overruns++;
+    else if (n > 0 && isLine) handle_line(d, (const char *)p, n);
+    else if (n > 0) handle_frame(d, p, n);
+    d->len = 0;
+    d->overflow = false;
+}
+
+static void feed_bytes(dt_decoder *d, const uint8_t *buf, size_t n) {
+    d->local.bytes += n;
+    const uint8_t *p = buf, *end = buf + n;
+    while (p < end) {
+        if (!d->binary) {
+            const uint8_t *nl = (const uint8_t *)memchr(p, '\n', end - p);
+            if (!nl) break;
+            dispatch(d, p, nl - p, true);
+            p = nl + 1;
+            continue;
+        }
+
+        const uint8_t *z = (const uint8_t *)memchr(p, 0, end - p);
+        const uint8_t *stop = z ? z : end;
+        // A bare JSON line while in binary mode: the bridge rebooted
+        const uint8_t *nl = (const uint8_t *)memchr(p, '\n', stop - p);
+        if (nl) {
+            uint8_t first = d->len ? d->line[0] : *p;
+            uint8_t last = nl > p ? nl[-1] : d->len ? d->line[d->len - 1] : 0;
+            if (first == '{' && (last == '}' || last == '\r')) {
+                dispatch(d, p, nl - p, true);
+                p = nl + 1;
+                continue;
+            }
+            append(d, p, nl + 1 - p);
+            p = nl + 1;
+            continue;
+        }
+        if (!z) break;
+        dispatch(d, p, z - p, false);
+        p = z + 1;
+    }
+    if (p < end) append(d, p, end - p);
+}
+
+// Make reader-side counters visible and wake dt_wait()
+static void publish(dt_decoder *d) {
+    std::lock_guard<std::mutex> g(d->lock);
+    d->stats = d->local;
+    d->need |= d->localNeed;
+    d->localNeed = 0;
+    if (d->localPending) {
+        d->pending |= d->localPending;
+        d->localPending = 0;
+        d->cv.notify_all();
+    }
+}
+
+static uint64_t thread_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void reader_main(dt_decoder *d) {
+    uint8_t buf[4096];
+    uint64_t cpu0 = thread_cpu_ns();
+    uint64_t cpuBase = d->local.cpu_ns;
+    while (d->running) {
+        struct pollfd pfd = {d->fd, POLLIN, 0};
+        int r = poll(&pfd, 1, 100);
+        if (r < 0 && errno == EINTR) continue;
+        if (r == 0) continue;
+        ssize_t n = r > 0 ? read(d->fd, buf, sizeof(buf)) : -1;
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            std::lock_guard<std::mutex> g(d->lock);
+            d->pending |= DT_EV_CLOSED;
+            d->cv.notify_all();
+            break;
+        }
+        feed_bytes(d, buf, (size_t)n);
+        d->local.cpu_ns = cpuBase + thread_cpu_ns() - cpu0;
+        publish(d);
+    }
+    d->running = false;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * C ABI
+ * ══════════════════════════════════════════════════════════════*/
+
+extern "C" {
+
+dt_decoder *dt_create(const char *shm_name) {
+    dt_decoder *d = new dt_decoder();
+    void *mem = MAP_FAILED;
+    if (shm_name && *shm_name) {
+        int fd = shm_open(shm_name, O_CREAT | O_RDWR, 0644);
+        if (fd >= 0) {
+            if (ftruncate(fd, sizeof(dt_shm)) == 0) {
+                mem = mmap(NULL, sizeof(dt_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+        }
+        if (mem != MAP_FAILED) d->shmName = shm_name;
+    } else {
+        mem = mmap(NULL, sizeof(dt_shm), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    }
+    if (mem == MAP_FAILED) {
+        delete d;
+        return NULL;
+    }
+    d->shm = (dt_shm *)mem;
+    memset(d->shm, 0, sizeof(dt_shm));
+    d->shm->version = DT_VERSION;
+    d->shm->magic = DT_MAGIC;
+    for (int i = 0; i < DT_HASH_SIZE; i++) d->hash[i] = -1;
+    for (int i = 0; i < 256; i++) d->bin[i].field = -1;
+    return d;
+}
+
+void dt_destroy(dt_decoder *d) {
+    if (!d) return;
+    dt_stop(d);
+    munmap(d->shm, sizeof(dt_shm));
+    if (!d->shmName.empty()) shm_unlink(d->shmName.c_str());
+    delete d;
+}
+
+int dt_start(dt_decoder *d, int fd) {
+    dt_stop(d);
+    d->fd = fd;
+    d->len = 0;
+    d->overflow = false;
+    d->binary = false;
+    d->haveSchema = false;
+    d->haveState = false;
+    d->lastSeq = -1;
+    d->lastJsonSeq = -1;
+    d->running = true;
+    try {
+        d->reader = std::thread(reader_main, d);
+    } catch (...) {
+        d->running = false;
+        return -1;
+    }
+    return 0;
+}
+
+void dt_stop(dt_decoder *d) {
+    d->running = false;
+    if (d->reader.joinable()) d->reader.join();
+}
+
+void dt_feed(dt_decoder *d, const uint8_t *buf, size_t len) {
+    feed_bytes(d, buf, len);
+    publish(d);
+}
+
+int dt_wait(dt_decoder *d, int timeout_ms) {
+    std::unique_lock<std::mutex> g(d->lock);
+    if (!d->pending) {
+        d->cv.wait_for(g, std::chrono::milliseconds(timeout_ms), [d] { return d->pending != 0; });
+    }
+    int ev = d->pending;
+    d->pending = 0;
+    return ev;
+}
+
+int dt_next_event(dt_decoder *d, char *buf, int cap) {
+    std::lock_guard<std::mutex> g(d->lock);
+    if (d->events.empty()) return 0;
+    const std::string &line = d->events.front();
+    if ((int)line.size() + 1 > cap) return -1;
+    memcpy(buf, line.data(), line.size());
+    buf[line.size()] = '\0';
+    int n = (int)line.size();
+    d->events.pop_front();
+    return n;
+}
+
+int dt_snapshot(dt_decoder *d, dt_field *out, int max, uint32_t *records) {
+    const dt_shm *shm = d->shm;
+    for (;;) {
+        uint32_t s1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) {
+            sched_yield();
+            continue;
+        }
+        uint32_t count = __atomic_load_n(&shm->field_count, __ATOMIC_ACQUIRE);
+        int n = 0;
+        for (uint32_t i = 0; i < count && n < max; i++) {
+            if (shm->fields[i].present) out[n++] = shm->fields[i];
+        }
+        uint32_t rec = shm->records;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE) == s1) {
+            if (records) *records = rec;
+            return n;
+        }
+    }
+}
+
+int dt_read_samples(dt_decoder *d, uint64_t *cursor, dt_sample *out, int max) {
+    const dt_shm *shm = d->shm;
+    uint64_t head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+    uint64_t from = *cursor;
+    if (head - from > DT_RING) from = head - DT_RING;
+    int n = 0;
+    for (uint64_t i = from; i < head && n < max; i++) out[n++] = shm->ring[i % DT_RING];
+
+    // Anything the writer lapped while we copied is stale
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t now = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+    uint64_t valid = now > DT_RING ? now - DT_RING : 0;
+    int skip = valid > from ? (int)(valid - from) : 0;
+    if (skip > n) skip = n;
+    if (skip) memmove(out, out + skip, (n - skip) * sizeof(dt_sample));
+    *cursor = from + n;
+    return n - skip;
+}
+
+int dt_need(dt_decoder *d) {
+    std::lock_guard<std::mutex> g(d->lock);
+    int n = d->need;
+    d->need = 0;
+    return n;
+}
+
+int dt_binary(dt_decoder *d) {
+    return d->binary ? 1 : 0;
+}
+
+void dt_get_stats(dt_decoder *d, dt_stats *out) {
+    std::lock_guard<std::mutex> g(d->lock);
+    *out = d->stats;
+}
+
+const dt_shm *dt_region(dt_decoder *d) {
+    return d->shm;
+}
+
+}  // extern "C"
@@ -0,0 +1,139 @@
+/**
+ * @file dashtelem.h
+ * Native decoder for the ESP32 bridge stream — C ABI, loaded with ctypes
+ *
+ * A reader thread owns the serial fd (opened and configured by pyserial),
+ * splits it into JSON lines or COBS frames, decodes both formats (see
+ * include/serial_protocol.h and include/telemetry_binary.h) and publishes
+ * the result in one dt_shm region:
+ *   - fields[]: latest value per dotted key ("obd.rpm", "dev.0.v"),
+ *     guarded by a seqlock, so a reader copies a consistent record
+ *   - ring[]:   every numeric value as a typed, timestamped sample
+ * With a name the region is a POSIX shared-memory object other processes
+ * can map read-only; without one it is private to the process.
+ *
+ * Replies and events (anything that isn't a telemetry record) are queued
+ * as JSON text for the caller. Telemetry never crosses into Python per
+ * frame: the caller takes a snapshot when it wants one.
+ */
+
+#ifndef DASHTELEM_H
+#define DASHTELEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DT_MAGIC        0x4D4C5444u     // "DTLM"
+#define DT_VERSION      1
+#define DT_MAX_FIELDS   256
+#define DT_KEY_LEN      32
+#define DT_STR_LEN      16
+#define DT_RING         8192            // Samples, power of two
+
+enum dt_type {
+    DT_INT = 0,
+    DT_NUM,             // Has a fractional part in the stream
+    DT_BOOL,
+    DT_STR,             // Strings and binary enum names; table only
+    DT_EMPTY_LIST,      // "dtc":[] — so the key isn't simply missing
+};
+
+// dt_wait() result bits
+enum dt_event {
+    DT_EV_RECORD = 1,   // New telemetry record in the table
+    DT_EV_EVENT  = 2,   // Reply/event line queued
+    DT_EV_CLOSED = 4,   // Reader stopped: read error or EOF on the fd
+};
+
+// dt_need() result bits — commands the host should send
+enum dt_need_bits {
+    DT_NEED_SCHEMA   = 1,   // {"cmd":"get_schema"}
+    DT_NEED_KEYFRAME = 2,   // {"cmd":"keyframe"}
+};
+
+typedef struct {
+    char key[DT_KEY_LEN];
+    uint8_t type;           // dt_type
+    uint8_t present;        // Part of the latest record
+    uint16_t reserved;
+    uint32_t updated;       // Record number of the last update
+    double num;             // DT_INT / DT_NUM / DT_BOOL
+    char str[DT_STR_LEN];   // DT_STR
+} dt_field;
+
+typedef struct {
+    uint32_t ts_ms;         // Bridge timestamp of the record
+    uint16_t field;         // Index into dt_shm.fields
+    uint8_t type;
+    uint8_t reserved;
+    double value;
+} dt_sample;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    volatile uint32_t seq;          // Seqlock: odd while fields[] changes
+    volatile uint32_t field_count;
+    volatile uint32_t records;      // Telemetry records decoded
+    volatile uint32_t ts_ms;        // "ts" of the latest record
+    dt_field fields[DT_MAX_FIELDS];
+    volatile uint64_t head;         // Samples written since start
+    dt_sample ring[DT_RING];        // Sample i lives at ring[i % DT_RING]
+} dt_shm;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t records;
+    uint64_t events;
+    uint64_t crc_errors;        // Bad COBS/CRC frames
+    uint64_t json_errors;       // Unparseable lines
+    uint64_t lost_frames;       // Record seq gaps (JSON "seq", binary header)
+    uint64_t overruns;          // Oversized lines/frames dropped
+    uint64_t cpu_ns;            // Reader thread CPU time
+} dt_stats;
+
+typedef struct dt_decoder dt_decoder;
+
+// shm_name like "/dashos_telem", or NULL for a private region
+dt_decoder *dt_create(const char *shm_name);
+void dt_destroy(dt_decoder *d);
+
+// Reader thread on fd (not closed by the library). 0 on success.
+int dt_start(dt_decoder *d, int fd);
+void dt_stop(dt_decoder *d);
+
+// Decode bytes in the caller's thread — only while no reader is running
+void dt_feed(dt_decoder *d, const uint8_t *buf, size_t len);
+
+// Block until something happened or timeout; returns and clears dt_event bits
+int dt_wait(dt_decoder *d, int timeout_ms);
+
+// Next reply/event line (NUL-terminated). Length, 0 if none, -1 if cap too small.
+int dt_next_event(dt_decoder *d, char *buf, int cap);
+
+// Consistent copy of the fields in the latest record. Returns the count.
+int dt_snapshot(dt_decoder *d, dt_field *out, int max, uint32_t *records);
+
+// Samples from *cursor on (a sample index, start at 0); advances *cursor.
+// Returns the count; samples already overwritten are skipped.
+int dt_read_samples(dt_decoder *d, uint64_t *cursor, dt_sample *out, int max);
+
+// Returns and clears dt_need_bits
+int dt_need(dt_decoder *d);
+
+// 1 while the stream is in binary framing
+int dt_binary(dt_decoder *d);
+
+void dt_get_stats(dt_decoder *d, dt_stats *out);
+
+const dt_shm *dt_region(dt_decoder *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DASHTELEM_H
@@ -0,0 +1,171 @@
+/**
+ * @file decoder_bench.cpp
+ * Throughput of libdashtelem on a pty, fed with real bridge records
+ *
+ * Usage:
+ *   ./decoder_bench [--records N] [--format json|binary|both] [--dump FILE]
+ *
+ * Records come from the firmware's own serializers (serializeData() and
+ * tb_build_*, built against tools/host), with RPM/speed changing every
+ * record. A writer thread pushes them into the pty master as fast as the
+ * kernel takes them; the decoder reads the slave end exactly as it reads
+ * /dev/ttyUSB0. Reported: records/s and the reader thread's CPU time per
+ * record, which is what the Pi pays per telemetry frame.
+ * --dump also writes the byte stream to FILE for other decoders.
+ */
+
+#include <Arduino.h>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+
+#include "modbus_devices.h"
+#include "serial_protocol.h"
+#include "dashtelem.h"
+
+class StringSink : public Print {
+public:
+    using Print::write;
+    size_t write(const uint8_t *buf, size_t len) override {
+        out.append((const char *)buf, len);
+        return len;
+    }
+    std::string out;
+};
+
+static void fill_vehicle(VehicleData *d, unsigned long i) {
+    d->speed = 40 + i % 80; d->rpm = 800 + (i * 37) % 4000; d->ect = 91;
+    d->throttle = 23; d->load = 41;
+    d->fuelRate = 6.37f; d->fuelLevel = 62.5f; d->maf = 18.42f;
+    d->intakeAirTemp = 34; d->oilTemp = 97; d->timingAdv = 12.5f;
+    d->o2Voltage = 0.455f; d->fuelPressure = 380;
+    d->battV = 27.43f; d->battI = -3.21f; d->setA = 24.5f; d->targetCurrent = 24.5f;
+    d->chargeLimit = "charger_temp";
+    d->tempT1 = 61; d->tempT2 = 38; d->tempAmb = 31;
+    d->canOk = true; d->rs485Ok = true;
+    d->txSeq = i;
+}
+
+// Whole stream up front, so generation isn't part of the measurement
+static std::string build_stream(bool binary, unsigned long records) {
+    VehicleData d;
+    for (int i = 0; i < MB_SLAVE_COUNT; i++) {
+        mb_slaves[i].ok = true;
+        for (int f = 0; f < MB_MAX_FIELDS; f++) mb_slaves[i].values[f] = 27.43f + f * 1.7f;
+    }
+    const char *dtcs[] = {"P0301", "P0420"};
+    StringSink sink;
+    static uint8_t payload[TB_PAYLOAD_MAX + 2], frame[TB_FRAME_MAX];
+    static TbValue values[TB_MAX_VALUES];
+    static TbDeltaState delta;
+    uint16_t schemaId = 0;
+
+    if (binary) sink.print("{\"format\":\"binary\",\"period_ms\":50,\"delta\":true}\n");
+    for (unsigned long i = 0; i < records; i++) {
+        fill_vehicle(&d, i);
+        if (!binary) {
+            serializeData(sink, &d, NULL, dtcs, 2, false, 0, mb_slaves, MB_SLAVE_COUNT);
+            continue;
+        }
+        int n = tb_collect(values, TB_MAX_VALUES, &d, NULL, false, 0, mb_slaves, MB_SLAVE_COUNT);
+        size_t len;
+        if (i == 0) {
+            len = tb_build_schema(payload, TB_PAYLOAD_MAX, values, n, &schemaId);
+            sink.write(frame, tb_frame(payload, len, frame, sizeof(frame)));
+        }
+        len = tb_build_data(payload, TB_PAYLOAD_MAX, values, n, schemaId, i * 50,
+                            &delta, i % 100 == 0);
+        sink.write(frame, tb_frame(payload, len, frame, sizeof(frame)));
+    }
+    return sink.out;
+}
+
+static void run(const char *name, bool binary, unsigned long records, const char *dumpPath) {
+    std::string stream = build_stream(binary, records);
+    if (dumpPath) {
+        FILE *f = fopen(dumpPath, "wb");
+        if (f) {
+            fwrite(stream.data(), 1, stream.size(), f);
+            fclose(f);
+        }
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        perror("posix_openpt");
+        exit(1);
+    }
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    host_set_raw(master);
+    host_set_raw(slave);
+
+    dt_decoder *dec = dt_create(NULL);
+    dt_start(dec, slave);
+
+    uint64_t t0 = host_now_us();
+    std::thread writer([&] {
+        Stream port(master);
+        port.write((const uint8_t *)stream.data(), stream.size());
+    });
+
+    dt_stats st = {};
+    uint64_t idle = host_now_us();
+    uint64_t lastRecords = 0;
+    while (st.records < records && host_now_us() - idle < 1000000) {
+        dt_wait(dec, 100);
+        char ev[512];
+        while (dt_next_event(dec, ev, sizeof(ev)) > 0) {}
+        dt_get_stats(dec, &st);
+        if (st.records != lastRecords) {
+            lastRecords = st.records;
+            idle = host_now_us();
+        }
+    }
+    double secs = (host_now_us() - t0) / 1e6;
+    writer.join();
+
+    static dt_field fields[DT_MAX_FIELDS];
+    int n = dt_snapshot(dec, fields, DT_MAX_FIELDS, NULL);
+    double rpm = -1;
+    for (int i = 0; i < n; i++) {
+        if (strcmp(fields[i].key, "obd.rpm") == 0) rpm = fields[i].num;
+    }
+    VehicleData last;
+    fill_vehicle(&last, records - 1);
+
+    printf("%-6s %lu records, %.1f KB: %.0f records/s, %.2f MB/s, "
+           "reader %.1f us/record, %d fields, crc_err=%llu json_err=%llu lost=%llu, "
+           "last rpm %s\n",
+           name, (unsigned long)st.records, stream.size() / 1024.0,
+           st.records / secs, stream.size() / secs / 1e6,
+           st.records ? st.cpu_ns / 1000.0 / st.records : 0.0, n,
+           (unsigned long long)st.crc_errors, (unsigned long long)st.json_errors,
+           (unsigned long long)st.lost_frames, rpm == last.rpm ? "ok" : "MISMATCH");
+
+    dt_destroy(dec);
+    close(slave);
+    close(master);
+}
+
+int main(int argc, char **argv) {
+    unsigned long records = 20000;
+    std::string format = "both";
+    const char *dumpPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a == "--records" && v)     { records = strtoul(v, NULL, 10); i++; }
+        else if (a == "--format" && v) { format = v; i++; }
+        else if (a == "--dump" && v)   { dumpPath = v; i++; }
+        else {
+            fprintf(stderr, "usage: %s [--records N] [--format json|binary|both] [--dump FILE]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (records == 0) records = 1;
+
+    if (format != "binary") run("json", false, records, dumpPath);
+    if (format != "json") run("binary", true, records, format == "binary" ? dumpPath : NULL);
+    return 0;
+}
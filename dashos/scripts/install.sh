@@ -31,6 +31,7 @@ apt-get install -y -qq \
     bluetooth bluez pulseaudio-module-bluetooth \
     cage weston \
     plymouth \
+    cmake g++ \
     git curl wget
 
 # Install Python packages
@@ -39,6 +40,11 @@ cd "$(dirname "$0")/.."
 pip3 install --break-system-packages -r requirements.txt 2>/dev/null || \
 pip3 install -r requirements.txt
 
+# Native telemetry decoder (optional — SerialBridge falls back to Python)
+cmake -S native -B native/build -DCMAKE_BUILD_TYPE=Release >/dev/null && \
+    cmake --build native/build -j"$(nproc)" --target dashtelem || \
+    echo "[WARN] Native decoder build failed; using the Python decoder"
+
 # Set up Meshtastic daemon
 echo "[4/8] Setting up Meshtastic daemon..."
 pip3 install --break-system-packages meshtastic 2>/dev/null || \
@@ -0,0 +1,116 @@
+"""
+Bridge clock → host clock
+
+The bridge stamps every record with "ts" (millis(), wrapping at 32 bits)
+and answers {"cmd":"time_sync"} with its microsecond clock. ClockSync
+pairs each reply with the host's send/receive times, keeps the exchanges
+with the shortest round trip (least queuing on either side) and fits
+
+    host_monotonic = offset + rate * bridge_seconds
+
+so "ts" can be placed on the Pi's wall clock, the one GPS fixes use.
+The fit is against time.monotonic(); the wall-clock step is applied
+when converting, so an NTP/GPS clock jump on the Pi doesn't disturb it.
+"""
+
+import time
+
+_WRAP = 1 << 32
+
+
+class ClockSync:
+    """Offset/drift estimate from time_sync round trips"""
+
+    def __init__(self, window=64, best=16, min_drift_span=60.0):
+        self._window = window               # Exchanges kept
+        self._best = best                   # Lowest-RTT ones used in the fit
+        self._min_drift_span = min_drift_span   # Seconds before fitting a rate
+        self._pending = {}                  # request id → host send time
+        self._samples = []                  # (bridge s, host mid s, rtt s)
+        self._last_us = None
+        self.offset = None
+        self.rate = 1.0
+        self.rtt = None                     # Best round trip in the fit
+
+    @property
+    def synced(self):
+        return self.offset is not None
+
+    @property
+    def drift_ppm(self):
+        """Bridge clock rate error; positive when it runs fast"""
+        return (1.0 / self.rate - 1.0) * 1e6
+
+    def interval(self):
+        """Seconds until the next time_sync: a quick burst, then slow"""
+        return 0.25 if len(self._samples) < 8 else 5.0
+
+    def sent(self, req_id, now=None):
+        if not req_id:
+            return
+        self._pending[req_id] = time.monotonic() if now is None else now
+        if len(self._pending) > 16:
+            del self._pending[min(self._pending)]
+
+    def received(self, req_id, us, now=None):
+        """A time_sync reply; returns its round trip in seconds or None"""
+        t0 = self._pending.pop(req_id, None)
+        if t0 is None:
+            return None
+        t1 = time.monotonic() if now is None else now
+        if self._last_us is not None and us < self._last_us:
+            self.reset()                    # Bridge rebooted
+        self._last_us = us
+        rtt = t1 - t0
+        self._samples.append((us / 1e6, t0 + rtt / 2, rtt))
+        del self._samples[:-self._window]
+        self._fit()
+        return rtt
+
+    def reset(self):
+        self._samples.clear()
+        self._last_us = None
+        self.offset = None
+        self.rate = 1.0
+        self.rtt = None
+
+    def _fit(self):
+        best = sorted(self._samples, key=lambda s: s[2])[:self._best]
+        n = len(best)
+        mean_b = sum(s[0] for s in best) / n
+        mean_h = sum(s[1] for s in best) / n
+        var = sum((s[0] - mean_b) ** 2 for s in best)
+        span = max(s[0] for s in best) - min(s[0] for s in best)
+        if n >= 4 and span >= self._min_drift_span and var > 0:
+            cov = sum((s[0] - mean_b) * (s[1] - mean_h) for s in best)
+            self.rate = cov / var
+        else:
+            self.rate = 1.0
+        self.offset = mean_h - self.rate * mean_b
+        self.rtt = best[0][2]
+
+    def monotonic(self, ts_ms):
+        """Host time.monotonic() at which the bridge read ts_ms"""
+        if not self.synced:
+            return None
+        ref_ms = self._last_us // 1000
+        diff = (ts_ms - ref_ms) % _WRAP
+        if diff >= _WRAP // 2:
+            diff -= _WRAP
+        return self.offset + self.rate * (ref_ms + diff) / 1000.0
+
+    def wall(self, ts_ms):
+        """Unix time at which the bridge read ts_ms, or None if unsynced"""
+        mono = self.monotonic(ts_ms)
+        if mono is None:
+            return None
+        return mono + (time.time() - time.monotonic())
+
+    def stats(self):
+        return {
+            'synced': self.synced,
+            'offset_s': self.offset,
+            'drift_ppm': round(self.drift_ppm, 2),
+            'rtt_ms': round(self.rtt * 1000, 2) if self.rtt is not None else None,
+            'samples': len(self._samples),
+        }
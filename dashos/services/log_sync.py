@@ -0,0 +1,261 @@
+"""
+SD log sync — pulls the bridge's /logs into a local directory
+
+Uses ls_logs / get_log / log_ack (see include/log_transfer.h). Each
+file is fetched from the size already saved locally, so an interrupted
+sync or a log that has grown since picks up where it left off. Chunks
+are CRC-checked; a bad or missing chunk is NAKed once and the bridge
+resends from there. The bridge only sends chunks when its link is idle,
+so telemetry keeps flowing while this runs.
+
+fetch_window() pulls just a time range of one log. The bridge looks the
+range up in the log's time index and answers with the blocks to send and
+the schema block they need; the schema is fetched after the data and
+the two are saved as NNNN_FROM-TO.dlg, a log file of its own.
+"""
+
+import base64
+import binascii
+import os
+import struct
+import time
+
+from PySide6.QtCore import QObject, Signal
+
+from services.telemetry_binary import crc16
+
+
+class LogSync(QObject):
+    """One sync pass at a time over a SerialBridge"""
+
+    progress = Signal(str, int, int)    # name, bytes saved, size
+    finished = Signal(int)              # files completed this pass
+
+    PARKED_S = 60                       # Speed 0 this long before auto sync
+    INTERVAL_S = 15 * 60                # Between automatic passes
+    STALL_S = 5                         # No reply this long: ask again
+    BLOCK = 4096                        # Log block (log_format.h)
+    INDEX_MAGIC = 0x58444944            # "DIDX", block positions of the whole file
+
+    def __init__(self, bridge, dest_dir, window=8, parent=None):
+        super().__init__(parent)
+        self._bridge = bridge
+        self._dest = dest_dir
+        self._window = window
+        self._list_id = None
+        self._listing = []
+        self._queue = []
+        self._xfer = None
+        self._done = 0
+        self._parked_since = None
+        self._last_pass = 0.0
+        self._last_reply = 0.0
+        self._list_start = 0
+        self.active = False
+        bridge.data_received.connect(self._on_data)
+
+    def start(self):
+        """List the bridge's logs and fetch whatever is new"""
+        if self.active:
+            return False
+        os.makedirs(self._dest, exist_ok=True)
+        self.active = True
+        self._listing = []
+        self._done = 0
+        self._last_pass = time.monotonic()
+        return self._list(0)
+
+    def fetch_window(self, name, from_ms, to_ms):
+        """Fetch the rows of log name between two bridge timestamps (ms)"""
+        if self.active:
+            return False
+        os.makedirs(self._dest, exist_ok=True)
+        self.active = True
+        self._listing = []
+        self._queue = []
+        self._done = 0
+        base = os.path.splitext(os.path.basename(name))[0]
+        path = self._local_path('%s_%d-%d.dlg' % (base, from_ms, to_ms))
+        self._xfer = {'id': None, 'name': name, 'size': 0, 'expected': 0,
+                      'nak': False, 'fh': open(path, 'wb+'),
+                      'window': (from_ms, to_ms), 'located': False,
+                      'end': None, 'schema': None}
+        self._request()
+        return True
+
+    def maybe_start(self, speed):
+        """Start a pass once the vehicle has been parked for a while"""
+        now = time.monotonic()
+        if speed:
+            self._parked_since = None
+            return False
+        if self._parked_since is None:
+            self._parked_since = now
+        if (now - self._parked_since >= self.PARKED_S
+                and now - self._last_pass >= self.INTERVAL_S):
+            return self.start()
+        return False
+
+    def _list(self, start):
+        self._last_reply = time.monotonic()
+        self._list_start = start
+        self._list_id = self._bridge.send_command('ls_logs', val=start)
+        if not self._list_id:
+            self._finish()
+            return False
+        return True
+
+    def _local_path(self, name):
+        return os.path.join(self._dest, os.path.basename(name))
+
+    def _local_size(self, name):
+        try:
+            return os.path.getsize(self._local_path(name))
+        except OSError:
+            return 0
+
+    def _on_data(self, data):
+        if not self.active:
+            return
+        if 'id' not in data:
+            # Telemetry keeps arriving, so it doubles as the stall timer
+            if time.monotonic() - self._last_reply >= self.STALL_S:
+                self._stalled()
+            return
+        if data['id'] == self._list_id:
+            self._on_list(data)
+        elif self._xfer and data['id'] == self._xfer['id']:
+            self._on_transfer(data)
+
+    def _on_list(self, data):
+        self._listing += data.get('logs', [])
+        if data.get('next', -1) > 0:
+            self._list(data['next'])
+            return
+        self._list_id = None
+        self._queue = [(e['name'], e['size']) for e in self._listing
+                       if self._local_size(e['name']) < e['size']]
+        self._next_file()
+
+    def _next_file(self):
+        if self._xfer:
+            self._xfer['fh'].close()
+            self._xfer = None
+        if not self._queue:
+            self._finish()
+            return
+        name, size = self._queue.pop(0)
+        off = self._local_size(name)
+        self._xfer = {'id': None, 'name': name, 'size': size, 'expected': off,
+                      'nak': False, 'fh': open(self._local_path(name), 'ab')}
+        self._request()
+
+    def _request(self):
+        """get_log for the current file from what is saved so far"""
+        x = self._xfer
+        self._last_reply = time.monotonic()
+        x['nak'] = False
+        args = {'name': x['name'], 'win': self._window}
+        if x.get('window') and not x['located']:
+            args['from'], args['to'] = x['window']
+        else:
+            args['off'] = x['expected']
+            if x.get('end') is not None:
+                args['end'] = x['end']
+        x['id'] = self._bridge.send_command('get_log', **args)
+        if not x['id']:
+            self._finish()
+
+    def _stalled(self):
+        """A reply went missing (log_done, the listing or a whole
+        window); the bridge may have given up, so start over from here"""
+        if self._xfer:
+            self._request()
+        elif self._list_id:
+            self._list(self._list_start)
+
+    def _on_transfer(self, data):
+        x = self._xfer
+        self._last_reply = time.monotonic()
+        if 'chunk' in data:
+            chunk = data['chunk']
+            off = chunk.get('off', -1)
+            if off < x['expected']:
+                self._ack()                 # Resent after a lost ack
+                return
+            if off > x['expected']:
+                if not x['nak']:
+                    self._ack(nak=True)     # One before it was lost
+                return
+            try:
+                raw = base64.b64decode(chunk.get('data', ''), validate=True)
+            except (binascii.Error, ValueError):
+                raw = None
+            if raw is None or len(raw) != chunk.get('len') or crc16(raw) != chunk.get('crc'):
+                if not x['nak']:
+                    self._ack(nak=True)
+                return
+            x['fh'].write(raw)
+            x['fh'].flush()
+            x['expected'] += len(raw)
+            self._ack()
+            self.progress.emit(x['name'], x['expected'], x['size'])
+        elif 'log' in data:
+            x['size'] = data.get('size', x['size'])
+            if x.get('window') and not x['located']:
+                self._located(data)
+        elif 'log_done' in data:
+            if x.get('window') and not self._window_done():
+                return
+            self._done += 1
+            self._next_file()
+        elif 'log_abort' in data or 'error' in data:
+            self._next_file()           # Saved part is kept; next pass resumes
+
+    def _located(self, data):
+        """The bridge's answer to a window request: where the data is
+        and which schema block it needs"""
+        x = self._xfer
+        x['located'] = True
+        x['start'] = x['expected'] = data.get('off', 0)
+        x['end'] = data.get('end', x['size'])
+        x['schema'] = data.get('schema', 0)
+        # The schema goes in front, so then the data starts one block in
+        x['fh'].seek(self.BLOCK if x['schema'] < x['start'] else 0)
+
+    def _window_done(self):
+        """The current range of a window is in. Fetch the schema block
+        next if it wasn't part of the data; True once the file is whole."""
+        x = self._xfer
+        if x['schema'] is not None and x['schema'] < x['start']:
+            x['fh'].seek(0)
+            x['expected'] = x['schema']
+            x['end'] = x['schema'] + self.BLOCK
+            x['schema'] = None
+            self._request()
+            return False
+        # A whole-file index at the end would point at the wrong blocks
+        fh = x['fh']
+        size = fh.seek(0, os.SEEK_END)
+        if size >= self.BLOCK:
+            fh.seek(size - self.BLOCK)
+            if struct.unpack('<I', fh.read(4))[0] == self.INDEX_MAGIC:
+                fh.truncate(size - self.BLOCK)
+        return True
+
+    def _ack(self, nak=False):
+        x = self._xfer
+        x['nak'] = nak
+        if nak:
+            self._bridge.send_command('log_ack', off=x['expected'], nak=1)
+        else:
+            self._bridge.send_command('log_ack', off=x['expected'])
+
+    def _finish(self):
+        if self._xfer:
+            self._xfer['fh'].close()
+            self._xfer = None
+        self._queue = []
+        self._list_id = None
+        self.active = False
+        self.finished.emit(self._done)
@@ -0,0 +1,173 @@
+"""
+ctypes binding for dashos/native (libdashtelem.so)
+
+The library reads the serial fd in its own thread, decodes JSON and
+binary telemetry and keeps the latest value of every field in a shared
+table (see dashos/native/dashtelem.h). Python no longer touches every
+frame: it takes a snapshot when the UI wants one, and only replies and
+events (command acks, DTC lists, status lines) are handed over as text.
+
+Build:  cmake -S dashos/native -B dashos/native/build && cmake --build dashos/native/build
+"""
+
+import ctypes
+import json
+import os
+
+from services.telemetry_binary import set_path
+
+DT_KEY_LEN = 32
+DT_STR_LEN = 16
+DT_MAX_FIELDS = 256
+
+DT_INT, DT_NUM, DT_BOOL, DT_STR, DT_EMPTY_LIST = range(5)
+
+DT_EV_RECORD = 1
+DT_EV_EVENT = 2
+DT_EV_CLOSED = 4
+
+DT_NEED_SCHEMA = 1
+DT_NEED_KEYFRAME = 2
+
+_NATIVE_DIR = os.path.join(os.path.dirname(__file__), '..', 'native')
+_SEARCH = (
+    os.path.join(_NATIVE_DIR, 'build', 'libdashtelem.so'),
+    os.path.join(_NATIVE_DIR, 'libdashtelem.so'),
+    'libdashtelem.so',
+)
+
+
+class DtField(ctypes.Structure):
+    _fields_ = [
+        ('key', ctypes.c_char * DT_KEY_LEN),
+        ('type', ctypes.c_uint8),
+        ('present', ctypes.c_uint8),
+        ('reserved', ctypes.c_uint16),
+        ('updated', ctypes.c_uint32),
+        ('num', ctypes.c_double),
+        ('str', ctypes.c_char * DT_STR_LEN),
+    ]
+
+
+class DtSample(ctypes.Structure):
+    _fields_ = [
+        ('ts_ms', ctypes.c_uint32),
+        ('field', ctypes.c_uint16),
+        ('type', ctypes.c_uint8),
+        ('reserved', ctypes.c_uint8),
+        ('value', ctypes.c_double),
+    ]
+
+
+class DtStats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint64) for name in (
+        'bytes', 'records', 'events', 'crc_errors', 'json_errors',
+        'lost_frames', 'overruns', 'cpu_ns')]
+
+
+def load_library(path=None):
+    """libdashtelem.so from path, $DASHOS_NATIVE_LIB or the native build
+    directory; None if it isn't built"""
+    candidates = [path] if path else []
+    if os.environ.get('DASHOS_NATIVE_LIB'):
+        candidates.append(os.environ['DASHOS_NATIVE_LIB'])
+    candidates.extend(_SEARCH)
+    for candidate in candidates:
+        try:
+            lib = ctypes.CDLL(candidate)
+        except OSError:
+            continue
+        _declare(lib)
+        return lib
+    return None
+
+
+def _declare(lib):
+    p = ctypes.c_void_p
+    lib.dt_create.restype = p
+    lib.dt_create.argtypes = [ctypes.c_char_p]
+    lib.dt_destroy.argtypes = [p]
+    lib.dt_start.argtypes = [p, ctypes.c_int]
+    lib.dt_stop.argtypes = [p]
+    lib.dt_wait.argtypes = [p, ctypes.c_int]
+    lib.dt_next_event.argtypes = [p, ctypes.c_char_p, ctypes.c_int]
+    lib.dt_snapshot.argtypes = [p, ctypes.POINTER(DtField), ctypes.c_int,
+                                ctypes.POINTER(ctypes.c_uint32)]
+    lib.dt_read_samples.argtypes = [p, ctypes.POINTER(ctypes.c_uint64),
+                                    ctypes.POINTER(DtSample), ctypes.c_int]
+    lib.dt_need.argtypes = [p]
+    lib.dt_binary.argtypes = [p]
+    lib.dt_get_stats.argtypes = [p, ctypes.POINTER(DtStats)]
+
+
+class NativeDecoder:
+    """One decoder/reader thread; the fd stays owned by pyserial"""
+
+    def __init__(self, lib, shm_name=None):
+        self._lib = lib
+        self._dec = lib.dt_create(shm_name.encode() if shm_name else None)
+        if not self._dec:
+            raise OSError('dt_create failed')
+        self._fields = (DtField * DT_MAX_FIELDS)()
+        self._event_buf = ctypes.create_string_buffer(8192)
+        self._records = ctypes.c_uint32(0)
+        self._last_records = 0
+
+    def start(self, fd):
+        return self._lib.dt_start(self._dec, fd) == 0
+
+    def stop(self):
+        self._lib.dt_stop(self._dec)
+
+    def close(self):
+        if self._dec:
+            self._lib.dt_destroy(self._dec)
+            self._dec = None
+
+    def wait(self, timeout_ms):
+        """Block until a record/event arrives; returns DT_EV_* bits"""
+        return self._lib.dt_wait(self._dec, timeout_ms)
+
+    def events(self):
+        """Queued replies/events, parsed"""
+        while True:
+            n = self._lib.dt_next_event(self._dec, self._event_buf,
+                                        len(self._event_buf))
+            if n <= 0:
+                return
+            try:
+                yield json.loads(self._event_buf.value.decode())
+            except (json.JSONDecodeError, UnicodeDecodeError):
+                continue
+
+    def need(self):
+        """DT_NEED_* bits: commands the bridge should be sent"""
+        return self._lib.dt_need(self._dec)
+
+    def snapshot(self):
+        """Latest record in the same dict shape as the JSON stream, or
+        None if nothing new arrived since the last call"""
+        n = self._lib.dt_snapshot(self._dec, self._fields, DT_MAX_FIELDS,
+                                  ctypes.byref(self._records))
+        if self._records.value == self._last_records:
+            return None
+        self._last_records = self._records.value
+        record = {}
+        for f in self._fields[:n]:
+            if f.type == DT_INT:
+                value = int(f.num)
+            elif f.type == DT_NUM:
+                value = f.num
+            elif f.type == DT_BOOL:
+                value = bool(f.num)
+            elif f.type == DT_STR:
+                value = f.str.decode(errors='replace')
+            else:
+                value = []
+            set_path(record, f.key.decode(), value)
+        return record
+
+    def stats(self):
+        st = DtStats()
+        self._lib.dt_get_stats(self._dec, ctypes.byref(st))
+        return {name: getattr(st, name) for name, _ in DtStats._fields_}
@@ -2,13 +2,40 @@
 Serial Bridge Service — ESP32 ↔ Raspberry Pi communication
 Reads JSON data from ESP32 over USB serial, sends commands back.
 
-Protocol: Newline-delimited JSON, 115200 baud
+Protocol: Newline-delimited JSON, 115200 baud. With fmt='binary' the
+bridge is switched to COBS-framed binary records after connecting
+(see telemetry_binary.py); both formats emit the same dicts.
+
+With native='auto' (default) and libdashtelem.so built, reading and
+decoding run in native code (native_telemetry.py) and records are
+emitted at most emit_hz times per second instead of once per frame.
+
+Records carry "seq" (gaps are frames lost on the way in) and, once the
+time_sync exchange has converged, "wall": the Unix time the bridge read
+them, for lining up with GPS fixes (link_clock.py). link_stats() has the
+loss counters for both directions.
+
+With link_baud set the link is moved off 115200 after connecting:
+set_baud, a test pattern checked both ways, then baud_ok — or both sides
+go back. If nothing decodes for a few seconds (the bridge fell back, or
+kept a faster rate across a Pi restart) the port cycles between the two
+rates until it does.
 """
 
 import json
 import threading
+import time
 from PySide6.QtCore import QObject, Signal, QThread
 
+from services.telemetry_binary import TelemetryDecoder
+from services import native_telemetry
+from services.link_clock import ClockSync
+
+# Same as BRIDGE_BAUD_PATTERN in include/board_config.h
+BAUD_PATTERN = ('UUUUUUUU********~~~~~~~~@@@@@@@@0123456789'
+                'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz')
+RATE_SEARCH_S = 3.0                 # Silence before trying the other rate
+
 
 class SerialBridge(QObject):
     """Manages serial communication with ESP32 bridge firmware"""
@@ -17,13 +44,42 @@ class SerialBridge(QObject):
     connected = Signal(bool)       # Connection status change
     error = Signal(str)            # Error messages
 
-    def __init__(self, port='/dev/ttyUSB0', baud=115200, parent=None):
+    def __init__(self, port='/dev/ttyUSB0', baud=115200, fmt='json',
+                 period_ms=500, native='auto', emit_hz=20, link_baud=None,
+                 parent=None):
         super().__init__(parent)
         self._port = port
-        self._baud = baud
+        self._baud = baud               # Rate the port runs at now
+        self._start_baud = baud         # Bridge boot/fallback rate
+        self._link_baud = link_baud     # Rate to negotiate, None = stay
+        self._baud_trial = None         # (rate, deadline, previous rate)
+        self._baud_failed = False       # Don't retry a rate that failed
+        self._last_rx = 0.0
+        self._fmt = fmt                 # Requested telemetry format
+        self._period_ms = period_ms
         self._serial = None
         self._running = False
         self._thread = None
+        self._binary = False            # Format currently on the wire
+        self._buf = bytearray()
+        self._decoder = TelemetryDecoder()
+        self._rates = None              # OBD subscription, resent on restart
+        self._next_id = 1               # Request id, echoed in replies
+        self._emit_interval = 1.0 / emit_hz if emit_hz > 0 else 0
+        self._clock = ClockSync()
+        self._next_sync = 0.0
+        self._seq = None                # Last JSON record "seq"
+        self._lost = 0                  # JSON records missing from "seq"
+        self._bad_lines = 0
+        self._link = {}                 # Bridge's own counters, last record
+        self._native = None
+        self._native_missing = False
+        if native != 'off':
+            lib = native_telemetry.load_library()
+            if lib:
+                self._native = native_telemetry.NativeDecoder(lib)
+            elif native == 'on':
+                self._native_missing = True
 
     def start(self):
         """Start reading serial data in background thread"""
@@ -36,26 +92,111 @@ class SerialBridge(QObject):
         self._running = False
         if self._thread:
             self._thread.join(timeout=2)
+        if self._native:
+            self._native.stop()
         if self._serial:
             self._serial.close()
 
     def send_command(self, cmd, **kwargs):
-        """Send a command to ESP32"""
+        """Send a command to ESP32. Returns its request id (replies and
+        job events carry it as "id"), or False if it couldn't be sent."""
         if not self._serial or not self._serial.is_open:
             return False
 
-        payload = {"cmd": cmd}
+        req_id = self._next_id
+        self._next_id = self._next_id % 0x7FFFFFFF + 1
+        payload = {"cmd": cmd, "id": req_id}
         payload.update(kwargs)
 
         try:
             line = json.dumps(payload) + '\n'
             self._serial.write(line.encode())
             self._serial.flush()
-            return True
+            return req_id
         except Exception as e:
             self.error.emit(f"Send failed: {e}")
             return False
 
+    def subscribe(self, rates):
+        """Stream only these OBD signals, at these rates in Hz
+        ({'rpm': 20, 'spd': 20, '0x46': 1}); None goes back to the full
+        record at the default rate"""
+        self._rates = rates
+        if rates is None:
+            return self.send_command('unsubscribe')
+        return self.send_command('subscribe', rates=rates)
+
+    def link_stats(self):
+        """Frames lost/garbled in each direction and the clock fit.
+        "down" is bridge → Pi as counted here, "up" is Pi → bridge as
+        counted by the bridge; "drops" are records the bridge skipped
+        because its TX path was busy."""
+        if self._native:
+            st = self._native.stats()
+            down = {'lost': st['lost_frames'],
+                    'bad': st['crc_errors'] + st['json_errors']}
+        else:
+            down = {'lost': self._lost + self._decoder.lost_frames,
+                    'bad': self._bad_lines + self._decoder.crc_errors}
+        link, tx = self._link.get('link', {}), self._link.get('tx', {})
+        return {
+            'down': down,
+            'up': {'sent': self._next_id - 1, 'rx': link.get('rx'),
+                   'lost': link.get('lost'), 'bad': link.get('bad')},
+            'drops': tx.get('drop'),
+            'clock': self._clock.stats(),
+        }
+
+    def _set_port_baud(self, baud):
+        self._baud = baud
+        if self._serial and self._serial.is_open:
+            self._serial.baudrate = baud
+
+    def _check_rate(self):
+        """End a set_baud trial that wasn't confirmed, or look for the
+        bridge at the other rate when nothing has decoded for a while"""
+        now = time.monotonic()
+        if self._baud_trial:
+            rate, deadline, previous = self._baud_trial
+            if now >= deadline:
+                self._baud_trial = None
+                self._baud_failed = True
+                self._set_port_baud(previous)
+                self.error.emit(f"Link test at {rate} baud failed; staying at {previous}")
+            return
+        if now - self._last_rx < RATE_SEARCH_S:
+            return
+        self._last_rx = now
+        if self._link_baud and self._link_baud != self._start_baud:
+            self._set_port_baud(self._start_baud if self._baud == self._link_baud
+                                else self._link_baud)
+
+    def _time_sync(self):
+        """Send time_sync when due; called from the reader thread, so the
+        reply can't be handled before its send time is recorded"""
+        now = time.monotonic()
+        if self._baud_trial:
+            return                      # Only baud_ok while the rate is on trial
+        if now < self._next_sync:
+            return
+        self._next_sync = now + self._clock.interval()
+        sent_at = time.monotonic()
+        req_id = self.send_command('time_sync')
+        self._clock.sent(req_id, sent_at)
+
+    def _negotiate(self):
+        """Format and subscription after (re)connecting to the bridge"""
+        if self._fmt == 'binary':
+            self.send_command('set_format', fmt='binary',
+                              period_ms=self._period_ms)
+        if self._rates:
+            self.send_command('subscribe', rates=self._rates)
+        if self._link_baud and not self._baud_failed and not self._baud_trial:
+            self.send_command('set_baud', baud=self._link_baud)
+        self._seq = None
+        self._clock.reset()
+        self._next_sync = 0.0
+
     def _read_loop(self):
         """Background thread: continuously read serial data"""
         try:
@@ -64,21 +205,26 @@ class SerialBridge(QObject):
             self.error.emit("pyserial not installed. Run: pip install pyserial")
             return
 
+        if self._native_missing:
+            self.error.emit("native_decoder=on but libdashtelem.so isn't built; "
+                            "using the Python decoder")
+        if self._native:
+            self._native_loop(pyserial)
+            return
+
         while self._running:
             try:
                 if not self._serial or not self._serial.is_open:
                     self._connect(pyserial)
                     continue
 
-                line = self._serial.readline()
-                if not line:
+                self._check_rate()
+                self._time_sync()
+                chunk = self._serial.read(self._serial.in_waiting or 1)
+                if not chunk:
                     continue
-
-                try:
-                    data = json.loads(line.decode().strip())
-                    self.data_received.emit(data)
-                except (json.JSONDecodeError, UnicodeDecodeError):
-                    pass  # Skip malformed lines
+                self._buf += chunk
+                self._drain_buffer()
 
             except Exception as e:
                 self.error.emit(f"Serial error: {e}")
@@ -89,19 +235,164 @@ class SerialBridge(QObject):
                     except Exception:
                         pass
                     self._serial = None
-                import time
                 time.sleep(2)  # Retry after 2 seconds
 
+    def _native_loop(self, pyserial):
+        """libdashtelem reads and decodes the port; this thread forwards
+        replies/events and emits the latest record at most emit_hz times
+        per second"""
+        last_emit = 0.0
+        dirty = False
+        while self._running:
+            if not self._serial or not self._serial.is_open:
+                self._connect(pyserial)
+                if self._serial and self._serial.is_open:
+                    self._native.start(self._serial.fileno())
+                continue
+
+            self._check_rate()
+            self._time_sync()
+            wait_ms = 100
+            if dirty:
+                wait_ms = max(1, int((last_emit + self._emit_interval
+                                      - time.monotonic()) * 1000))
+            ev = self._native.wait(min(wait_ms, 100))
+            if ev & (native_telemetry.DT_EV_RECORD | native_telemetry.DT_EV_EVENT):
+                self._last_rx = time.monotonic()
+            if ev & native_telemetry.DT_EV_EVENT:
+                for data in self._native.events():
+                    self._handle(data)
+
+            need = self._native.need()
+            if need & native_telemetry.DT_NEED_SCHEMA:
+                self.send_command('get_schema')
+            elif need & native_telemetry.DT_NEED_KEYFRAME:
+                self.send_command('keyframe')
+
+            dirty |= bool(ev & native_telemetry.DT_EV_RECORD)
+            now = time.monotonic()
+            if dirty and now - last_emit >= self._emit_interval:
+                record = self._native.snapshot()
+                if record is not None:
+                    self._stamp(record)
+                    self.data_received.emit(record)
+                last_emit = now
+                dirty = False
+
+            if ev & native_telemetry.DT_EV_CLOSED:
+                self.error.emit("Serial error: port closed")
+                self.connected.emit(False)
+                self._native.stop()
+                try:
+                    self._serial.close()
+                except Exception:
+                    pass
+                self._serial = None
+                time.sleep(2)  # Retry after 2 seconds
+
+    def _drain_buffer(self):
+        """Split the buffer into lines (JSON) or 0x00-delimited frames"""
+        while True:
+            if self._binary:
+                end = self._buf.find(b'\x00')
+                if end < 0 and self._buf.startswith(b'{'):
+                    end = self._buf.find(b'\n')   # Bridge rebooted into JSON
+                if end < 0:
+                    break
+                frame = bytes(self._buf[:end])
+                del self._buf[:end + 1]
+                if frame.startswith(b'{'):
+                    data = self._parse_line(frame)
+                else:
+                    data = self._decoder.decode_frame(frame)
+                    if self._decoder.need_schema:
+                        self.send_command('get_schema')
+                        self._decoder.need_schema = False
+                    elif self._decoder.need_keyframe:
+                        self.send_command('keyframe')
+                        self._decoder.need_keyframe = False
+            else:
+                end = self._buf.find(b'\n')
+                if end < 0:
+                    break
+                line = bytes(self._buf[:end])
+                del self._buf[:end + 1]
+                data = self._parse_line(line)
+            if data is not None:
+                self._handle(data)
+
+        if len(self._buf) > 8192:
+            self._buf.clear()      # Garbage without delimiters
+
+    def _parse_line(self, line):
+        try:
+            return json.loads(line.decode().strip())
+        except (json.JSONDecodeError, UnicodeDecodeError):
+            self._bad_lines += 1
+            return None  # Skip malformed lines
+
+    def _stamp(self, record):
+        """Keep the bridge's link counters; add "wall" once synced"""
+        self._link = record
+        if 'ts' in record:
+            wall = self._clock.wall(record['ts'])
+            if wall is not None:
+                record['wall'] = wall
+
+    def _handle(self, data):
+        """Track format switches and bridge restarts, then emit"""
+        self._last_rx = time.monotonic()
+        if 'set_baud' in data:
+            # Acked at the old rate; the bridge switches right after
+            rate = data['set_baud']
+            self._baud_trial = (rate, time.monotonic() + data.get('trial_ms', 2000) / 1000.0,
+                                self._baud)
+            self._serial.flush()
+            self._set_port_baud(rate)
+            return
+        if 'baud_test' in data:
+            if self._baud_trial and data['baud_test'] == BAUD_PATTERN:
+                self.send_command('baud_ok', pattern=BAUD_PATTERN)
+            return
+        if 'baud_ok' in data:
+            self._baud_trial = None
+            self._baud = data['baud_ok']
+            self.data_received.emit(data)
+            return
+        if 'time_sync' in data:
+            self._clock.received(data.get('id'), data['time_sync'].get('us', 0))
+            return
+        if 'seq' in data and 'ts' in data:
+            # JSON records; the binary decoder counts its own header seq
+            seq = data['seq']
+            if not self._binary:
+                if self._seq is not None and seq > self._seq + 1:
+                    self._lost += seq - self._seq - 1
+                self._seq = seq
+            self._stamp(data)
+        elif 'format' in data:
+            self._binary = data['format'] == 'binary'
+        elif 'status' in data or 'boot' in data:
+            # Bridge (re)started in JSON mode — negotiate again
+            self._binary = False
+            self._negotiate()
+        self.data_received.emit(data)
+
     def _connect(self, pyserial):
         """Try to connect to serial port"""
-        import time
         try:
             self._serial = pyserial.Serial(
                 self._port,
                 self._baud,
                 timeout=1
             )
+            self._binary = False
+            self._buf.clear()
+            self._baud_trial = None
+            self._baud_failed = False
+            self._last_rx = time.monotonic()
             self.connected.emit(True)
+            self._negotiate()
         except Exception as e:
             self.error.emit(f"Connection failed ({self._port}): {e}")
             self.connected.emit(False)
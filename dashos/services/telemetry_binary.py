@@ -0,0 +1,194 @@
+"""
+Binary telemetry decoder — host side of include/telemetry_binary.h
+
+Frames are COBS( payload | CRC16 ) terminated by 0x00. Payload types:
+  0x01 schema   field id → key, type, decimals (and enum names)
+  0x02 data     (id, value) records, decoded with the current schema;
+                keyframes carry every field, delta frames only the changed
+                ones and are merged into the last known state
+  0x03 json     a reply/event line, same as in JSON mode
+
+Decoded records have the same dict shape as the JSON stream
+({"obd": {...}, "chg": {...}, "dev": [...], ...}).
+"""
+
+import copy
+import json
+import struct
+
+MSG_SCHEMA = 0x01
+MSG_DATA = 0x02
+MSG_JSON = 0x03
+
+# type id → (struct format, width)
+_TYPES = {
+    1: ('<B', 1),   # bool
+    2: ('<B', 1),   # u8
+    3: ('<h', 2),   # i16
+    4: ('<H', 2),   # u16
+    5: ('<i', 4),   # i32
+    6: ('<I', 4),   # u32
+    7: ('<B', 1),   # enum
+}
+_BOOL = 1
+_ENUM = 7
+_FLAG_KEYFRAME = 0x01
+
+
+def _crc16_table():
+    table = []
+    for i in range(256):
+        crc = i
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+        table.append(crc)
+    return table
+
+
+_CRC_TABLE = _crc16_table()
+
+
+def crc16(data):
+    """Modbus CRC16 — same as mb_crc16() in the firmware"""
+    crc = 0xFFFF
+    for b in data:
+        crc = (crc >> 8) ^ _CRC_TABLE[(crc ^ b) & 0xFF]
+    return crc
+
+
+def cobs_decode(data):
+    """Decode one COBS frame (delimiter stripped). Returns None if invalid."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def set_path(root, key, value):
+    """Store value at a dotted key; numeric parts index into lists"""
+    parts = key.split('.')
+    node = root
+    for i, part in enumerate(parts[:-1]):
+        nxt = parts[i + 1]
+        child_default = [] if nxt.isdigit() else {}
+        if isinstance(node, list):
+            idx = int(part)
+            while len(node) <= idx:
+                node.append(child_default.copy())
+            node = node[idx]
+        else:
+            node = node.setdefault(part, child_default)
+    last = parts[-1]
+    if isinstance(node, list):
+        idx = int(last)
+        while len(node) <= idx:
+            node.append(None)
+        node[idx] = value
+    else:
+        node[last] = value
+
+
+class TelemetryDecoder:
+    """Turns binary frames into the dicts SerialBridge emits"""
+
+    def __init__(self):
+        self.schema_id = None
+        self.fields = {}            # id → (key, type, decimals, names)
+        self.need_schema = True
+        self.need_keyframe = False
+        self.crc_errors = 0
+        self.lost_frames = 0
+        self._state = None          # Merged record; None until a keyframe
+        self._seq = None
+
+    def decode_frame(self, frame):
+        """Decode one 0x00-delimited frame. Returns a dict or None."""
+        raw = cobs_decode(frame)
+        if raw is None or len(raw) < 3:
+            self.crc_errors += 1
+            return None
+        payload, crc = raw[:-2], raw[-2] | (raw[-1] << 8)
+        if crc16(payload) != crc:
+            self.crc_errors += 1
+            return None
+
+        kind = payload[0]
+        if kind == MSG_SCHEMA:
+            self._parse_schema(payload)
+            return None
+        if kind == MSG_DATA:
+            return self._parse_data(payload)
+        if kind == MSG_JSON:
+            try:
+                return json.loads(payload[1:].decode())
+            except (json.JSONDecodeError, UnicodeDecodeError):
+                return None
+        return None
+
+    def _parse_schema(self, p):
+        schema_id = struct.unpack_from('<H', p, 2)[0]
+        count = p[4]
+        pos = 5
+        fields = {}
+        for _ in range(count):
+            fid, ftype, dec, klen = p[pos:pos + 4]
+            pos += 4
+            key = p[pos:pos + klen].decode()
+            pos += klen
+            names = None
+            if ftype == _ENUM:
+                nlen = p[pos]
+                names = p[pos + 1:pos + 1 + nlen].decode().split('|')
+                pos += 1 + nlen
+            fields[fid] = (key, ftype, dec, names)
+        self.fields = fields
+        self.schema_id = schema_id
+        self.need_schema = False
+        self._state = None
+
+    def _parse_data(self, p):
+        schema_id, seq, flags, ts, count = struct.unpack_from('<HHBIB', p, 1)
+        if schema_id != self.schema_id:
+            self.need_schema = True
+            return None
+
+        keyframe = bool(flags & _FLAG_KEYFRAME)
+        if self._seq is not None and seq != (self._seq + 1) & 0xFFFF:
+            self.lost_frames += (seq - self._seq - 1) & 0xFFFF
+            if not keyframe:
+                self.need_keyframe = True
+        self._seq = seq
+
+        if keyframe:
+            self._state = {}
+            self.need_keyframe = False
+        elif self._state is None:
+            self.need_keyframe = True
+            return None
+
+        pos = 11
+        for _ in range(count):
+            fid = p[pos]
+            key, ftype, dec, names = self.fields[fid]
+            fmt, width = _TYPES[ftype]
+            raw = struct.unpack_from(fmt, p, pos + 1)[0]
+            pos += 1 + width
+            if ftype == _BOOL:
+                value = bool(raw)
+            elif ftype == _ENUM:
+                value = names[raw] if raw < len(names) else raw
+            elif dec:
+                value = raw / (10 ** dec)
+            else:
+                value = raw
+            set_path(self._state, key, value)
+        self._state['seq'] = seq
+        self._state['ts'] = ts
+        return copy.deepcopy(self._state)
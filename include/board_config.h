@@ -92,7 +92,10 @@
  * ════════════════════════════════════════════════════════════════*/
 #define RS485_TX_PIN    GPIO_NUM_15
 #define RS485_RX_PIN    GPIO_NUM_16
-#define RS485_BAUD      9600
+#define RS485_BAUD      9600        // Default — runtime value lives in NVS
+#define RS485_FALLBACK_ERRORS   8   // Consecutive CRC/frame errors before stepping down
+#define RS485_PROBE_POLLS       5   // Good replies needed to accept a probed rate
+static const uint32_t RS485_BAUD_RATES[] = {38400, 19200, 9600};  // Fastest first
 
 /* ════════════════════════════════════════════════════════════════
  * TF CARD — SPI interface
@@ -113,7 +116,15 @@
  * Uses UART0 (USB-UART bridge) for Pi communication
  * Debug output redirected to SD card when in bridge mode
  * ════════════════════════════════════════════════════════════════*/
-#define BRIDGE_BAUD     115200      // Serial baud for Pi bridge
+#define BRIDGE_BAUD     115200      // Serial baud for Pi bridge — boot/fallback rate
+// set_baud: the CAN mux keeps native USB off the table, so the link stays
+// on UART0 and its USB-UART chip; these are the rates it is offered at
+static const uint32_t BRIDGE_BAUD_RATES[] = {2000000, 921600, 460800, 230400, 115200};
+#define BRIDGE_BAUD_TRIAL_MS    2000    // New rate must be confirmed (baud_ok) within this
+#define BRIDGE_BAUD_GRACE_MS    10000   // No valid command this long above BRIDGE_BAUD: fall back
+#define BRIDGE_BAUD_BAD_LINES   3       // Consecutive unparseable lines: fall back
+// Sent both ways at a trial rate: runs of 0x55/0x2A/0x7E/0x40 and every digit/letter class
+#define BRIDGE_BAUD_PATTERN     "UUUUUUUU********~~~~~~~~@@@@@@@@0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
 
 /* ════════════════════════════════════════════════════════════════
  * IGNITION SENSE — Power management
@@ -145,4 +156,15 @@
 #define REG_STATUS      0x020F  // Status word
 #define REG_SET_CURR    0x081E  // Write: set current (× 100)
 
+/* ════════════════════════════════════════════════════════════════
+ * BMS MODBUS REGISTER MAP — generic layout, adjust for your BMS
+ * ════════════════════════════════════════════════════════════════*/
+#define BMS_REG_PACK_VOLT   0x0000  // × 0.01 = Volts
+#define BMS_REG_PACK_CURR   0x0001  // × 0.01 = Amps (signed, + = charging)
+#define BMS_REG_SOC         0x0002  // %
+#define BMS_REG_CELL_MAX    0x0003  // mV
+#define BMS_REG_CELL_MIN    0x0004  // mV
+#define BMS_REG_TEMP        0x0005  // °C (signed)
+#define BMS_REG_FAULT       0x0006  // Fault flags
+
 #endif // BOARD_CONFIG_H
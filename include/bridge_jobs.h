@@ -0,0 +1,120 @@
+/**
+ * @file bridge_jobs.h
+ * Background jobs for slow bridge commands (BRIDGE_MODE only)
+ *
+ * Reading DTCs (up to 1 s) or clearing them (up to 2 s) blocks on the
+ * CAN bus. processCommand() queues such commands as jobs and answers at
+ * once with {"id":N,"state":"queued"}; a worker task on core 0 runs them
+ * while loop() keeps polling and streaming. loop() also reports progress
+ * and results, so every output line is still written from one task.
+ *
+ * The CAN bus is shared with loop()'s PID polling: the worker holds the
+ * CAN lock for the whole job, loop() skips a poll instead of waiting.
+ */
+
+#ifndef BRIDGE_JOBS_H
+#define BRIDGE_JOBS_H
+
+#include <Arduino.h>
+#include "obd2_dtc.h"
+
+#define JOB_SLOTS          4
+#define JOB_PROGRESS_STEP  25       // Report every 25 %
+#define JOB_CORE           0
+
+enum JobState {
+    JOB_FREE = 0,
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+struct BridgeJob {
+    uint32_t id;                // Host's request id (0 = none given)
+    uint8_t type;               // BridgeCommand
+    volatile uint8_t state;     // JobState, written by the worker
+    volatile uint8_t progress;  // 0–100, written by the worker
+    uint8_t reported;           // Progress last sent to the host
+    int rc;                     // BridgeResult once done
+    DTCResult dtcs;             // scan_dtc result
+};
+
+// Runs one job to completion on the worker task; sets rc and results
+typedef void (*JobRunFn)(BridgeJob *job);
+
+class BridgeJobs {
+public:
+    void begin(JobRunFn run) {
+        _run = run;
+        _queue = xQueueCreate(JOB_SLOTS, sizeof(BridgeJob *));
+        xTaskCreatePinnedToCore(workerTask, "bridge_job", 4096, this, 1, NULL, JOB_CORE);
+    }
+
+    // Queue a job; NULL when all slots are taken
+    BridgeJob *submit(uint32_t id, uint8_t type) {
+        for (int i = 0; i < JOB_SLOTS; i++) {
+            BridgeJob *job = &_jobs[i];
+            if (job->state != JOB_FREE) continue;
+            job->id = id;
+            job->type = type;
+            job->progress = 0;
+            job->reported = 0;
+            job->rc = 0;
+            job->state = JOB_QUEUED;
+            if (xQueueSend(_queue, &job, 0) != pdTRUE) {
+                job->state = JOB_FREE;
+                return NULL;
+            }
+            return job;
+        }
+        return NULL;
+    }
+
+    /**
+     * Next job with news for the host: finished, or progress moved by a
+     * full step. Call from loop(); release() finished jobs once reported.
+     */
+    BridgeJob *poll() {
+        for (int i = 0; i < JOB_SLOTS; i++) {
+            BridgeJob *job = &_jobs[i];
+            if (job->state == JOB_DONE) return job;
+            if (job->state == JOB_RUNNING &&
+                job->progress >= job->reported + JOB_PROGRESS_STEP &&
+                job->progress < 100) {
+                job->reported = job->progress - job->progress % JOB_PROGRESS_STEP;
+                return job;
+            }
+        }
+        return NULL;
+    }
+
+    void release(BridgeJob *job) { job->state = JOB_FREE; }
+
+    // Jobs queued or running
+    int active() const {
+        int n = 0;
+        for (int i = 0; i < JOB_SLOTS; i++) {
+            if (_jobs[i].state == JOB_QUEUED || _jobs[i].state == JOB_RUNNING) n++;
+        }
+        return n;
+    }
+
+private:
+    static void workerTask(void *arg) {
+        BridgeJobs *jobs = (BridgeJobs *)arg;
+        BridgeJob *job;
+        for (;;) {
+            if (xQueueReceive(jobs->_queue, &job, portMAX_DELAY) != pdTRUE) continue;
+            job->state = JOB_RUNNING;
+            jobs->_run(job);
+            job->progress = 100;
+            job->state = JOB_DONE;
+        }
+    }
+
+    BridgeJob _jobs[JOB_SLOTS] = {};
+    QueueHandle_t _queue = NULL;
+    JobRunFn _run = NULL;
+};
+
+#endif // BRIDGE_JOBS_H
@@ -0,0 +1,163 @@
+/**
+ * @file bridge_tx.h
+ * Non-blocking TX path for the bridge stream (BRIDGE_MODE only)
+ *
+ * loop() never waits for the UART. Two queues feed one drain task:
+ *   - Replies/events: a FreeRTOS stream buffer, order preserved. A write
+ *     that doesn't fit whole is dropped and counted (replyDrops) rather
+ *     than blocking the caller, with the rest of its line: a line
+ *     already started is ended there, so the host sees one short line
+ *     instead of two glued together. New lines are then dropped whole
+ *     until a quarter of the ring is free again.
+ *   - Telemetry: a single frame slot. While the previous frame is still
+ *     waiting, new records are skipped and counted (teleDrops). In delta
+ *     mode nothing is lost: deltas are taken against what was last
+ *     queued, so skipped changes roll into the next frame.
+ * The drain task sends pending replies first, then the telemetry frame,
+ * and is the only place that blocks on Serial.
+ */
+
+#ifndef BRIDGE_TX_H
+#define BRIDGE_TX_H
+
+#include <Arduino.h>
+#include <freertos/stream_buffer.h>
+
+#define BRIDGE_TX_RING       8192   // Reply/event bytes in flight
+#define BRIDGE_TX_FRAME_MAX  3200   // Largest telemetry record (JSON or frame)
+#define BRIDGE_TX_CHUNK      256    // Bytes moved per Serial.write()
+#define BRIDGE_TX_CORE       0      // loop() runs on core 1
+
+class BridgeTx : public Print {
+public:
+    uint32_t teleDrops = 0;     // Telemetry records skipped (link busy)
+    uint32_t replyDrops = 0;    // Reply bytes that didn't fit the ring
+
+    void begin(Stream *port) {
+        _port = port;
+        _ring = xStreamBufferCreate(BRIDGE_TX_RING, 1);
+        _lock = xSemaphoreCreateMutex();
+        xTaskCreatePinnedToCore(drainTask, "bridge_tx", 4096, this, 2, &_task, BRIDGE_TX_CORE);
+    }
+
+    // Replies/events — never blocks; excess is dropped and counted
+    size_t write(uint8_t c) override { return write(&c, 1); }
+
+    size_t write(const uint8_t *buf, size_t len) override {
+        if (!_ring) return _port ? _port->write(buf, len) : 0;
+        if (len == 0) return 0;
+        bool ends = buf[len - 1] == '\n';
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        size_t room = xStreamBufferSpacesAvailable(_ring);
+        bool newLine = !_midLine && !_discard;
+        if (newLine && _shed && room >= BRIDGE_TX_RING / 4) _shed = false;
+        // All or nothing; one byte is kept back to end a line cut short
+        if (!_discard && !(_shed && newLine) && room > len) {
+            xStreamBufferSend(_ring, buf, len, 0);
+            _midLine = !ends;
+        } else {
+            replyDrops += len;
+            if (_midLine) xStreamBufferSend(_ring, "\n", 1, 0);
+            _midLine = false;
+            _discard = !ends;
+            _shed = true;
+        }
+        xSemaphoreGive(_lock);
+        xTaskNotifyGive(_task);
+        return len;
+    }
+
+    /**
+     * Telemetry slot. Check busy() first; if free, write one record to
+     * slot() and commit() it. A record that overflowed the slot is discarded.
+     */
+    bool busy() const { return _telePending; }
+
+    Print &slot() {
+        _teleSlot.len = 0;
+        _teleSlot.overflow = false;
+        return _teleSlot;
+    }
+
+    void commit() {
+        if (_teleSlot.overflow || _teleSlot.len == 0) {
+            teleDrops++;
+            return;
+        }
+        _telePending = true;
+        if (_task) xTaskNotifyGive(_task);
+    }
+
+    // Record skipped because the slot was busy
+    void skip() { teleDrops++; }
+
+    // Bytes waiting to go out
+    size_t queued() const {
+        size_t n = _ring ? xStreamBufferBytesAvailable(_ring) : 0;
+        return n + (_telePending ? _teleSlot.len : 0);
+    }
+
+    /**
+     * Wait until everything queued has been handed to the port and the
+     * port has sent it, e.g. before changing its baud rate. The caller
+     * must not queue more meanwhile. False on timeout.
+     */
+    bool flush(uint32_t timeoutMs) {
+        unsigned long start = millis();
+        while (queued() > 0 || _writing) {
+            if (millis() - start >= timeoutMs) return false;
+            delay(1);
+        }
+        if (_port) _port->flush();
+        return true;
+    }
+
+private:
+    struct Slot : public Print {
+        uint8_t buf[BRIDGE_TX_FRAME_MAX];
+        size_t len = 0;
+        bool overflow = false;
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *b, size_t n) override {
+            if (len + n > sizeof(buf)) {
+                overflow = true;
+                return 0;
+            }
+            memcpy(buf + len, b, n);
+            len += n;
+            return n;
+        }
+    };
+
+    static void drainTask(void *arg) {
+        BridgeTx *tx = (BridgeTx *)arg;
+        uint8_t chunk[BRIDGE_TX_CHUNK];
+        for (;;) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+            size_t n;
+            tx->_writing = true;
+            while ((n = xStreamBufferReceive(tx->_ring, chunk, sizeof(chunk), 0)) > 0) {
+                tx->_port->write(chunk, n);
+            }
+            if (tx->_telePending) {
+                tx->_port->write(tx->_teleSlot.buf, tx->_teleSlot.len);
+                tx->_telePending = false;
+            }
+            tx->_writing = false;
+        }
+    }
+
+    Stream *_port = NULL;
+    StreamBufferHandle_t _ring = NULL;
+    SemaphoreHandle_t _lock = NULL;
+    TaskHandle_t _task = NULL;
+    Slot _teleSlot;
+    volatile bool _telePending = false;
+    volatile bool _writing = false;     // Drain task inside _port->write()
+    bool _midLine = false;              // Last byte queued wasn't a newline
+    bool _discard = false;              // Dropping the rest of a line
+    bool _shed = false;                 // Whole lines dropped until a quarter is free
+};
+
+#endif // BRIDGE_TX_H
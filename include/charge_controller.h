@@ -0,0 +1,160 @@
+/**
+ * @file charge_controller.h
+ * Closed-loop charge-current controller (replaces the 12 A / 30 A switch)
+ *
+ * Each update computes a demand — the lowest of several piecewise-linear
+ * derating curves (engine RPM/speed/coolant, charger T1, battery T2,
+ * ambient, battery voltage) — then slews the setpoint toward it at a
+ * limited rate. A new value is only written to the charger when it moved
+ * by at least the deadband, so the charger isn't commanded every tick.
+ * Hard faults bypass the slew and drop straight to the safe minimum.
+ *
+ * Pure logic — no Arduino calls — so tools/charge_loop runs it on the
+ * host against charger_sim.
+ */
+
+#ifndef CHARGE_CONTROLLER_H
+#define CHARGE_CONTROLLER_H
+
+#include <math.h>
+#include "vehicle_data.h"
+
+struct CurvePoint {
+    float x;        // Input (°C, rpm, km/h, V)
+    float y;        // Fraction of the min..max current range (0..1)
+};
+
+struct ChargeControlConfig {
+    float minA = 12.0f;         // Safe floor (also used on faults)
+    float maxA = 30.0f;
+    float rampUpAps = 0.5f;     // Max increase, A per second
+    float rampDownAps = 4.0f;   // Max decrease, A per second
+    float deadbandA = 0.5f;     // Minimum change worth a Modbus write
+};
+
+/* ══════════════════════════════════════════════════════════════
+ * DERATING CURVES — x ascending, y = share of (max - min) allowed
+ * Temperature curves reach the minimum just at the hard limit, so the
+ * current backs off before cc_hard_fault() would cut it; engine curves
+ * are full where the old switch gave 30 A (above ~1000 rpm, 30 km/h).
+ * ══════════════════════════════════════════════════════════════*/
+static const CurvePoint CURVE_RPM[]     = {{900, 0}, {1100, 0.5f}, {1500, 1}};
+static const CurvePoint CURVE_SPEED[]   = {{5, 0}, {15, 0.6f}, {30, 1}};
+static const CurvePoint CURVE_ECT[]     = {{50, 0}, {65, 1}, {100, 1}, {108, 0}};
+static const CurvePoint CURVE_T1[]      = {{70, 1}, {77, 0.5f}, {80, 0}};    // Charger
+static const CurvePoint CURVE_T2[]      = {{48, 1}, {58, 0.5f}, {65, 0}};    // Battery
+static const CurvePoint CURVE_AMB[]     = {{55, 1}, {70, 0.5f}, {78, 0}};
+static const CurvePoint CURVE_BATT_V[]  = {{28.2f, 1}, {28.8f, 0.5f}, {29.4f, 0}};  // Taper near absorption
+
+#define CURVE(c) c, (int)(sizeof(c) / sizeof(c[0]))
+
+// Piecewise-linear lookup, clamped at both ends
+static inline float cc_interp(const CurvePoint *c, int n, float x) {
+    if (x <= c[0].x) return c[0].y;
+    for (int i = 1; i < n; i++) {
+        if (x < c[i].x) {
+            float u = (x - c[i - 1].x) / (c[i].x - c[i - 1].x);
+            return c[i - 1].y + u * (c[i].y - c[i - 1].y);
+        }
+    }
+    return c[n - 1].y;
+}
+
+enum ChargeLimiter {
+    LIMIT_NONE = 0,
+    LIMIT_FAULT,
+    LIMIT_NO_DATA,
+    LIMIT_RPM,
+    LIMIT_SPEED,
+    LIMIT_COOLANT,
+    LIMIT_CHARGER_TEMP,
+    LIMIT_BATT_TEMP,
+    LIMIT_AMBIENT,
+    LIMIT_BATT_VOLT,
+};
+
+static const char *const CHARGE_LIMITER_NAMES[] = {
+    "none", "fault", "no_data", "rpm", "speed", "coolant",
+    "charger_temp", "batt_temp", "ambient", "batt_volt",
+};
+
+struct ChargeController {
+    float demand = 0;           // Target after derating (A)
+    float setpoint = -1;        // Slewed value (A), -1 = not started
+    float commanded = -1;       // Last value handed to the charger (A)
+    ChargeLimiter limiter = LIMIT_NO_DATA;
+};
+
+// Same hard limits the bang-bang logic used — these skip the ramp
+static inline bool cc_hard_fault(const VehicleData *d) {
+    if (d->tempT1 > 80 || d->tempT2 > 80 || d->tempAmb > 80) return true;
+    if (d->battV < 24.0f || d->battV > 29.6f) return true;
+    if (d->fault & 0x0040) return true;
+    if (d->alarm & 0x0003) return true;
+    return false;
+}
+
+/**
+ * Derated demand in amps; *limiter names the curve that bound it.
+ */
+static inline float cc_demand(const ChargeControlConfig *cfg, const VehicleData *d,
+                              ChargeLimiter *limiter) {
+    if (cc_hard_fault(d)) {
+        *limiter = LIMIT_FAULT;
+        return cfg->minA;
+    }
+    if (d->rpm < 0 || d->speed < 0 || d->ect < -40) {
+        *limiter = LIMIT_NO_DATA;
+        return cfg->minA;
+    }
+
+    struct { float share; ChargeLimiter who; } terms[] = {
+        {cc_interp(CURVE(CURVE_RPM),    (float)d->rpm),     LIMIT_RPM},
+        {cc_interp(CURVE(CURVE_SPEED),  (float)d->speed),   LIMIT_SPEED},
+        {cc_interp(CURVE(CURVE_ECT),    (float)d->ect),     LIMIT_COOLANT},
+        {cc_interp(CURVE(CURVE_T1),     (float)d->tempT1),  LIMIT_CHARGER_TEMP},
+        {cc_interp(CURVE(CURVE_T2),     (float)d->tempT2),  LIMIT_BATT_TEMP},
+        {cc_interp(CURVE(CURVE_AMB),    (float)d->tempAmb), LIMIT_AMBIENT},
+        {cc_interp(CURVE(CURVE_BATT_V), d->battV),          LIMIT_BATT_VOLT},
+    };
+
+    float share = 1.0f;
+    *limiter = LIMIT_NONE;
+    for (const auto &t : terms) {
+        if (t.share < share) {
+            share = t.share;
+            *limiter = t.who;
+        }
+    }
+    return cfg->minA + share * (cfg->maxA - cfg->minA);
+}
+
+/**
+ * Advance the controller by dtSec. Returns true when *command holds a
+ * new setpoint (0.1 A resolution) that should be written to the charger.
+ */
+static inline bool cc_update(ChargeController *cc, const ChargeControlConfig *cfg,
+                             const VehicleData *d, float dtSec, float *command) {
+    cc->demand = cc_demand(cfg, d, &cc->limiter);
+
+    if (cc->setpoint < 0 || cc->limiter == LIMIT_FAULT) {
+        cc->setpoint = cc->demand;  // Start at the demand; faults cut immediately
+    } else if (cc->demand > cc->setpoint) {
+        cc->setpoint = fminf(cc->demand, cc->setpoint + cfg->rampUpAps * dtSec);
+    } else {
+        cc->setpoint = fmaxf(cc->demand, cc->setpoint - cfg->rampDownAps * dtSec);
+    }
+
+    float q = roundf(cc->setpoint * 10.0f) / 10.0f;
+    bool atBound = (q <= cfg->minA || q >= cfg->maxA) && q != cc->commanded;
+    if (cc->commanded < 0 || atBound || cc->limiter == LIMIT_FAULT ||
+        fabsf(q - cc->commanded) >= cfg->deadbandA) {
+        if (q == cc->commanded) return false;
+        cc->commanded = q;
+        *command = q;
+        return true;
+    }
+    return false;
+}
+
+#endif // CHARGE_CONTROLLER_H
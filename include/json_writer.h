@@ -0,0 +1,220 @@
+/**
+ * @file json_writer.h
+ * Bounded streaming JSON writer — no heap, no printf
+ *
+ * Output is collected in a small caller-provided chunk. With a sink
+ * (e.g. Serial) a full chunk is handed to sink->write() — straight into
+ * the UART TX ring — and reused, so a record of any length costs only
+ * the chunk. Without a sink the chunk is the whole output: writing stops
+ * at its end and `overflow` is set, it never runs past cap.
+ *
+ * Numbers are formatted by hand: integers digit by digit, decimals as
+ * fixed point (value scaled by 10^decimals and rounded), which keeps
+ * newlib's float printf off the hot path.
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+
+#define JW_MAX_DEPTH 16
+
+struct JsonWriter {
+    char *buf;
+    size_t cap;
+    size_t len;             // Bytes pending in buf
+    size_t total;           // Bytes produced so far (sent + pending)
+    Print *sink;            // NULL = fixed buffer
+    bool overflow;          // Fixed buffer ran out; output truncated
+    uint8_t depth;
+    uint16_t hasItems;      // Bit per depth: container already has a member
+};
+
+static inline void jw_init(JsonWriter *w, char *buf, size_t cap, Print *sink = NULL) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->total = 0;
+    w->sink = sink;
+    w->overflow = false;
+    w->depth = 0;
+    w->hasItems = 0;
+}
+
+static inline void jw_flush(JsonWriter *w) {
+    if (w->sink && w->len > 0) {
+        w->sink->write((const uint8_t *)w->buf, w->len);
+        w->len = 0;
+    }
+}
+
+static inline void jw_raw(JsonWriter *w, const char *s, size_t n) {
+    while (n > 0) {
+        if (w->len == w->cap) {
+            if (!w->sink) {
+                w->overflow = true;
+                return;
+            }
+            jw_flush(w);
+        }
+        size_t k = w->cap - w->len;
+        if (k > n) k = n;
+        memcpy(w->buf + w->len, s, k);
+        w->len += k;
+        w->total += k;
+        s += k;
+        n -= k;
+    }
+}
+
+static inline void jw_char(JsonWriter *w, char c) {
+    jw_raw(w, &c, 1);
+}
+
+static inline void jw_cstr(JsonWriter *w, const char *s) {
+    jw_raw(w, s, strlen(s));
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * NUMBER FORMATTING
+ * ══════════════════════════════════════════════════════════════*/
+
+static inline void jw_put_u64(JsonWriter *w, uint64_t v) {
+    char tmp[20];
+    int i = sizeof(tmp);
+    do {
+        tmp[--i] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    jw_raw(w, tmp + i, sizeof(tmp) - i);
+}
+
+static inline void jw_put_i64(JsonWriter *w, int64_t v) {
+    if (v < 0) {
+        jw_char(w, '-');
+        jw_put_u64(w, (uint64_t)0 - (uint64_t)v);
+    } else {
+        jw_put_u64(w, (uint64_t)v);
+    }
+}
+
+/**
+ * Fixed-point decimal, same digits as printf("%.<decimals>f") for the
+ * ranges used here. Non-finite values are written as -1, the "no data"
+ * value used throughout VehicleData (printf's "nan" isn't valid JSON).
+ */
+static inline void jw_put_fixed(JsonWriter *w, float v, uint8_t decimals) {
+    static const uint32_t POW10[] = {1, 10, 100, 1000, 10000};
+    if (decimals > 4) decimals = 4;
+    if (!isfinite(v)) {
+        jw_raw(w, "-1", 2);
+        return;
+    }
+    bool neg = v < 0;
+    uint64_t scaled = (uint64_t)llroundf(fabsf(v) * POW10[decimals]);
+    if (neg && scaled > 0) jw_char(w, '-');
+    jw_put_u64(w, scaled / POW10[decimals]);
+    if (decimals == 0) return;
+
+    char frac[5];
+    uint32_t f = (uint32_t)(scaled % POW10[decimals]);
+    for (int i = decimals - 1; i >= 0; i--) {
+        frac[i] = (char)('0' + f % 10);
+        f /= 10;
+    }
+    jw_char(w, '.');
+    jw_raw(w, frac, decimals);
+}
+
+static inline void jw_put_string(JsonWriter *w, const char *s) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    jw_char(w, '"');
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        jw_raw(w, run, s - run);
+        run = s + 1;
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char)c};
+            jw_raw(w, esc, 2);
+        } else {
+            char esc[6] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0xF]};
+            jw_raw(w, esc, 6);
+        }
+    }
+    jw_raw(w, run, s - run);
+    jw_char(w, '"');
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * STRUCTURE — key may be NULL for array elements / the root
+ * ══════════════════════════════════════════════════════════════*/
+
+static inline void jw_member(JsonWriter *w, const char *key) {
+    uint16_t bit = (uint16_t)(1u << w->depth);
+    if (w->hasItems & bit) jw_char(w, ',');
+    w->hasItems |= bit;
+    if (key) {
+        jw_put_string(w, key);
+        jw_char(w, ':');
+    }
+}
+
+static inline void jw_open(JsonWriter *w, const char *key, char bracket) {
+    if (w->depth > 0) jw_member(w, key);
+    jw_char(w, bracket);
+    if (w->depth < JW_MAX_DEPTH - 1) w->depth++;
+    w->hasItems &= (uint16_t)~(1u << w->depth);
+}
+
+static inline void jw_close(JsonWriter *w, char bracket) {
+    if (w->depth > 0) w->depth--;
+    jw_char(w, bracket);
+}
+
+static inline void jw_obj(JsonWriter *w, const char *key = NULL) { jw_open(w, key, '{'); }
+static inline void jw_obj_end(JsonWriter *w)                     { jw_close(w, '}'); }
+static inline void jw_arr(JsonWriter *w, const char *key = NULL) { jw_open(w, key, '['); }
+static inline void jw_arr_end(JsonWriter *w)                     { jw_close(w, ']'); }
+
+static inline void jw_int(JsonWriter *w, const char *key, int64_t v) {
+    jw_member(w, key);
+    jw_put_i64(w, v);
+}
+
+static inline void jw_uint(JsonWriter *w, const char *key, uint64_t v) {
+    jw_member(w, key);
+    jw_put_u64(w, v);
+}
+
+static inline void jw_fixed(JsonWriter *w, const char *key, float v, uint8_t decimals) {
+    jw_member(w, key);
+    jw_put_fixed(w, v, decimals);
+}
+
+static inline void jw_bool(JsonWriter *w, const char *key, bool v) {
+    jw_member(w, key);
+    if (v) jw_raw(w, "true", 4);
+    else   jw_raw(w, "false", 5);
+}
+
+static inline void jw_str(JsonWriter *w, const char *key, const char *v) {
+    jw_member(w, key);
+    jw_put_string(w, v);
+}
+
+/**
+ * Finish a record with a newline and push the rest to the sink.
+ * Returns the record length (bytes that fit, for a fixed buffer).
+ */
+static inline size_t jw_end(JsonWriter *w) {
+    jw_char(w, '\n');
+    jw_flush(w);
+    return w->total;
+}
+
+#endif // JSON_WRITER_H
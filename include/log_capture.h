@@ -0,0 +1,408 @@
+/**
+ * @file log_capture.h
+ * Event captures: a pre-trigger ring of every field, frozen to SD when a
+ * rule fires
+ *
+ * The SD log keeps one row per log_interval_ms, too coarse to see what
+ * led up to a fault. A capture works like an oscilloscope instead:
+ * loop() samples the full telemetry record (tb_collect()) every
+ * periodMs, LC_PERIOD_MS by default, the fastest OBD subscription rate,
+ * into a ring in PSRAM. When a trigger rule fires, sampling goes on for
+ * postMs, then the ring is frozen and the writer task (sd_post_job())
+ * saves the preMs before the trigger and everything after it as
+ * /logs/NNNN_cK.dlg, a log_format.h file of its own (NNNN is the
+ * segment being logged, K counts captures). The file goes with its
+ * segment when old segments are deleted. Sampling stops while the file
+ * is being written, and triggers during a capture are counted in missed.
+ *
+ * Rules (comma separated, set_capture "rules"), on full field names as
+ * the schema has them:
+ *   chg.t1>80       the value goes above 80 (in its own units)
+ *   obd.ect<0       the value goes below 0
+ *   chg.fault&0x40  any of these bits gets set
+ *   chg.status~     the value changes
+ *   dtc             a DTC scan finds a code it didn't find before
+ * A rule fires when its condition starts to hold and again only after it
+ * has stopped holding, so a lasting over-temperature is one capture.
+ *
+ * The ring holds LC_RING_BYTES of rows (ts + one int32 per field). With
+ * ~60 fields at 50 ms that is about 100 s; a window longer than the ring
+ * keeps as much before the trigger as fits. A changed field set
+ * (subscribe) empties the ring, and a capture in progress is abandoned.
+ */
+
+#ifndef LOG_CAPTURE_H
+#define LOG_CAPTURE_H
+
+#include <Arduino.h>
+#include "sd_logger.h"
+#include "log_format.h"
+#include "obd2_dtc.h"
+
+#define LC_PERIOD_MS        50          // Default sample period (OBD_MIN_PERIOD_MS)
+#define LC_PERIOD_MIN_MS    10
+#define LC_PRE_S            20          // Default seconds kept before the trigger
+#define LC_POST_S           10          // Default seconds recorded after it
+#define LC_WINDOW_MAX_S     600
+#define LC_RING_BYTES       (512 * 1024)
+#define LC_RULES_MAX        8
+#define LC_RULES_LEN        128         // Rule text, as stored in NVS
+#define LC_RULES_DEFAULT    "chg.fault&0x40,chg.t1>80,chg.t2>80,dtc"
+
+enum LcOp {
+    LC_ABOVE,
+    LC_BELOW,
+    LC_BITS,
+    LC_CHANGE,
+    LC_DTC,
+};
+
+struct LcRule {
+    char key[24];
+    uint8_t op;             // LcOp
+    float threshold;        // LC_ABOVE, LC_BELOW
+    uint32_t mask;          // LC_BITS
+    int field;              // In the sampled record, -1 if it has no such field
+    int32_t raw;            // threshold in the field's fixed point
+    int32_t last;           // LC_CHANGE: previous value
+    bool holds;             // Condition held at the last sample
+};
+
+enum LcState {
+    LC_OFF,                 // No PSRAM: captures are off
+    LC_ARMED,
+    LC_POST,                // Triggered, recording postMs more
+    LC_SAVING,              // Ring frozen, the writer task is saving it
+};
+
+struct LogCapture {
+    uint32_t periodMs;
+    uint32_t preMs;
+    uint32_t postMs;
+    char rulesText[LC_RULES_LEN];
+    LcRule rule[LC_RULES_MAX];
+    int rules;
+
+    // Ring of rows: ts, then one raw value per field
+    int32_t *ring;
+    uint32_t capacity;              // Rows it holds for this field set
+    uint32_t head;                  // Next row written
+    uint32_t count;                 // Rows held
+    TbValue field[TB_MAX_VALUES];   // The field set, values unused
+    int fields;
+    uint32_t fingerprint;
+    unsigned long lastSample;
+
+    // The capture in progress
+    volatile uint8_t state;         // LcState
+    char reason[40];                // The rule that fired
+    uint32_t trigTs;
+    uint32_t pre, post;             // Rows before and after the trigger
+    char path[40];
+    uint32_t saveRow;               // Next row the writer saves
+    uint32_t saveLeft;              // Rows still to save
+    File file;
+    LfWriter *lf;
+    int32_t *stage;
+    bool saved;                     // Writer: the file is complete
+
+    uint32_t captures;
+    uint32_t missed;                // Triggers during a capture
+    uint32_t failed;                // Files that couldn't be written
+    uint16_t seq;                   // K in NNNN_cK.dlg
+};
+
+static inline int32_t *lc_row(const LogCapture *c, uint32_t i) {
+    return c->ring + (size_t)i * (c->fields + 1);
+}
+
+// Index of the row `back` rows before the newest
+static inline uint32_t lc_back(const LogCapture *c, uint32_t back) {
+    return (c->head + c->capacity - 1 - back) % c->capacity;
+}
+
+// Find each rule's field in the sampled record
+static void lc_match_rules(LogCapture *c) {
+    for (int r = 0; r < c->rules; r++) {
+        LcRule *rule = &c->rule[r];
+        rule->field = -1;
+        rule->holds = false;
+        for (int i = 0; i < c->fields && rule->op != LC_DTC; i++) {
+            char key[48];
+            tb_key(&c->field[i], key, sizeof(key));
+            if (strcmp(key, rule->key) != 0) continue;
+            rule->field = i;
+            rule->raw = tb_fixed(rule->threshold, c->field[i].decimals);
+            rule->last = c->count ? lc_row(c, lc_back(c, 0))[i + 1] : c->field[i].raw;
+            break;
+        }
+    }
+}
+
+/**
+ * Parse comma separated rules (see above) into c->rule. Returns false on
+ * a syntax error, leaving the rules as they were.
+ */
+static bool lc_parse_rules(LogCapture *c, const char *text) {
+    LcRule rules[LC_RULES_MAX];
+    int n = 0;
+    const char *p = text;
+    while (*p) {
+        while (*p == ' ' || *p == ',') p++;
+        if (!*p) break;
+        if (n == LC_RULES_MAX) return false;
+        LcRule *r = &rules[n++];
+        memset(r, 0, sizeof(*r));
+        r->field = -1;
+        size_t klen = strcspn(p, "<>&~, ");
+        if (klen == 0 || klen >= sizeof(r->key)) return false;
+        memcpy(r->key, p, klen);
+        p += klen;
+        char *end = (char *)p;
+        switch (*p) {
+            case '>':
+            case '<':
+                r->op = *p == '>' ? LC_ABOVE : LC_BELOW;
+                r->threshold = strtof(p + 1, &end);
+                if (end == p + 1) return false;
+                break;
+            case '&':
+                r->op = LC_BITS;
+                r->mask = strtoul(p + 1, &end, 0);
+                if (end == p + 1 || !r->mask) return false;
+                break;
+            case '~':
+                r->op = LC_CHANGE;
+                end++;
+                break;
+            default:
+                if (strcmp(r->key, "dtc") != 0) return false;
+                r->op = LC_DTC;
+        }
+        p = end;
+        if (*p && *p != ',') return false;
+    }
+    memcpy(c->rule, rules, sizeof(rules[0]) * n);
+    c->rules = n;
+    strncpy(c->rulesText, text, sizeof(c->rulesText) - 1);
+    c->rulesText[sizeof(c->rulesText) - 1] = '\0';
+    lc_match_rules(c);
+    return true;
+}
+
+// Sample period and window (seconds, clamped); applies from the next capture
+static void lc_configure(LogCapture *c, uint32_t periodMs, uint32_t preS, uint32_t postS) {
+    c->periodMs = periodMs < LC_PERIOD_MIN_MS ? LC_PERIOD_MIN_MS : periodMs;
+    c->preMs = (preS > LC_WINDOW_MAX_S ? LC_WINDOW_MAX_S : preS) * 1000;
+    c->postMs = (postS > LC_WINDOW_MAX_S ? LC_WINDOW_MAX_S : postS) * 1000;
+}
+
+// The ring needs PSRAM; without it captures stay off
+static bool lc_begin(LogCapture *c) {
+    if (!psramFound()) {
+        Serial.println("[CAP] No PSRAM: event captures off");
+        c->state = LC_OFF;
+        return false;
+    }
+    c->ring = (int32_t *)ps_malloc(LC_RING_BYTES);
+    c->lf = (LfWriter *)ps_malloc(sizeof(LfWriter));
+    c->stage = (int32_t *)ps_malloc(SD_STAGE_SIZE);
+    if (!c->ring || !c->lf || !c->stage) {
+        Serial.println("[CAP] No memory for the capture ring");
+        c->state = LC_OFF;
+        return false;
+    }
+    c->state = LC_ARMED;
+    return true;
+}
+
+// Seconds of rows the ring holds for the current field set
+static uint32_t lc_ring_seconds(const LogCapture *c) {
+    return (uint32_t)((uint64_t)c->capacity * c->periodMs / 1000);
+}
+
+/**
+ * Fire now (a rule, a DTC or the set_capture command). False if captures
+ * are off or one is already running, which counts as missed.
+ */
+static bool lc_trigger(LogCapture *c, const char *reason, uint32_t ts) {
+    if (c->state == LC_OFF || !sd_initialized || !c->count) return false;
+    if (c->state != LC_ARMED) {
+        c->missed++;
+        return false;
+    }
+    strncpy(c->reason, reason, sizeof(c->reason) - 1);
+    c->reason[sizeof(c->reason) - 1] = '\0';
+    c->trigTs = ts;
+    // Rows back to preMs before, the trigger row included, leaving the
+    // ring room for postMs after it
+    uint32_t postRows = c->postMs / c->periodMs + 1;
+    uint32_t preMax = c->capacity > 2 * postRows ? c->capacity - postRows : c->capacity / 2;
+    c->pre = 0;
+    while (c->pre < c->count && c->pre < preMax &&
+           ts - (uint32_t)lc_row(c, lc_back(c, c->pre))[0] <= c->preMs) c->pre++;
+    c->post = 0;
+    snprintf(c->path, sizeof(c->path), "/logs/%s_c%u.dlg", sd_session, ++c->seq);
+    c->state = LC_POST;
+    sd_stream_printf(SD_CH_DEBUG, "[%lu] capture %s: %s", (unsigned long)ts, c->path + 6, c->reason);
+    return true;
+}
+
+// New field set: empty the ring and match the rules to it
+static void lc_reset(LogCapture *c, const TbValue *v, int n) {
+    if (c->state == LC_POST) {              // Rows before and after wouldn't match
+        c->failed++;
+        c->state = LC_ARMED;
+    }
+    memcpy(c->field, v, sizeof(v[0]) * n);
+    c->fields = n;
+    c->fingerprint = lf_fingerprint(v, n);
+    c->capacity = LC_RING_BYTES / sizeof(int32_t) / (n + 1);
+    c->head = c->count = 0;
+    lc_match_rules(c);
+}
+
+// Check every rule against the row just sampled
+static void lc_check_rules(LogCapture *c, const TbValue *v, uint32_t ts) {
+    for (int r = 0; r < c->rules; r++) {
+        LcRule *rule = &c->rule[r];
+        if (rule->field < 0) continue;
+        int32_t raw = v[rule->field].raw;
+        bool holds = rule->op == LC_ABOVE  ? raw > rule->raw
+                   : rule->op == LC_BELOW  ? raw < rule->raw
+                   : rule->op == LC_BITS   ? ((uint32_t)raw & rule->mask) != 0
+                   : rule->op == LC_CHANGE ? raw != rule->last : false;
+        rule->last = raw;
+        bool fires = holds && (!rule->holds || rule->op == LC_CHANGE);
+        rule->holds = holds;
+        if (!fires) continue;
+        char reason[40];
+        if (rule->op == LC_ABOVE || rule->op == LC_BELOW) {
+            snprintf(reason, sizeof(reason), "%s%c%g", rule->key,
+                     rule->op == LC_ABOVE ? '>' : '<', rule->threshold);
+        } else if (rule->op == LC_BITS) {
+            snprintf(reason, sizeof(reason), "%s&0x%lx", rule->key, (unsigned long)rule->mask);
+        } else {
+            snprintf(reason, sizeof(reason), "%s~", rule->key);
+        }
+        lc_trigger(c, reason, ts);
+    }
+}
+
+// A sample is due (every periodMs); never while the ring is being saved
+static inline bool lc_due(const LogCapture *c, unsigned long now) {
+    return (c->state == LC_ARMED || c->state == LC_POST) && now - c->lastSample >= c->periodMs;
+}
+
+static bool lc_save_step(void *arg);
+
+/**
+ * Add one record (tb_collect() order) to the ring and check the rules.
+ * Once postMs has passed the trigger, or the ring is about to overwrite
+ * the rows before it, the writer task is asked to save the capture.
+ */
+static void lc_sample(LogCapture *c, unsigned long now, const TbValue *v, int n) {
+    c->lastSample = now;
+    if (lf_fingerprint(v, n) != c->fingerprint || n != c->fields) lc_reset(c, v, n);
+    int32_t *row = lc_row(c, c->head);
+    row[0] = (int32_t)now;
+    for (int i = 0; i < n; i++) row[i + 1] = v[i].raw;
+    c->head = (c->head + 1) % c->capacity;
+    if (c->count < c->capacity) c->count++;
+
+    bool armed = c->state == LC_ARMED;
+    lc_check_rules(c, v, now);      // During a capture: counts as missed
+    if (armed) return;
+    c->post++;
+    if (now - c->trigTs >= c->postMs || c->pre + c->post >= c->capacity) {
+        c->saveLeft = c->pre + c->post;
+        c->saveRow = lc_back(c, c->saveLeft - 1);
+        c->saved = false;
+        c->state = LC_SAVING;
+        if (!sd_post_job(lc_save_step, c)) {
+            c->failed++;
+            c->state = LC_ARMED;
+        }
+    }
+}
+
+// A DTC scan finished: fire the dtc rule for a code it didn't have before
+static void lc_dtcs(LogCapture *c, const DTCResult *before, const DTCResult *after, uint32_t ts) {
+    for (int r = 0; r < c->rules; r++) {
+        if (c->rule[r].op != LC_DTC) continue;
+        for (int i = 0; i < after->count; i++) {
+            bool known = false;
+            for (int k = 0; k < before->count && !known; k++) {
+                known = strcmp(before->codes[k].code, after->codes[i].code) == 0;
+            }
+            if (known) continue;
+            char reason[40];
+            snprintf(reason, sizeof(reason), "dtc %s", after->codes[i].code);
+            lc_trigger(c, reason, ts);
+            return;
+        }
+    }
+}
+
+// Writer task: store the block in c->lf, false if the write fell short
+static bool lc_put_block(LogCapture *c) {
+    bool ok = c->file.write(c->lf->block, LF_BLOCK_SIZE) == LF_BLOCK_SIZE;
+    lf_stored(c->lf, ok);
+    return ok;
+}
+
+/**
+ * Writer task job: one block of the capture file per call, the file
+ * opened with its schema on the first call and closed with its block
+ * index on the last.
+ */
+static bool lc_save_step(void *arg) {
+    LogCapture *c = (LogCapture *)arg;
+    LfWriter *w = c->lf;
+    static TbValue row[TB_MAX_VALUES];
+    if (!c->file) {
+        c->file = SD.open(c->path, FILE_WRITE);
+        lf_init(w, c->stage, SD_STAGE_SIZE, esp_random());
+        if (!c->file || !lf_begin_schema(w, c->field, c->fields) || !lc_put_block(c)) {
+            if (c->file) c->file.close();
+            c->failed++;
+            c->state = LC_ARMED;
+            return false;
+        }
+        memcpy(row, c->field, sizeof(row[0]) * c->fields);
+    }
+    bool ok = true, last = false;
+    for (;;) {
+        if (!c->saveLeft) {                 // Every row added: the last blocks
+            if (w->rows) {
+                lf_seal(w);
+                ok = lc_put_block(c);
+            }
+            lf_build_index(w);
+            ok = lc_put_block(c) && ok;
+            last = true;
+            break;
+        }
+        const int32_t *r = lc_row(c, c->saveRow);
+        for (int i = 0; i < c->fields; i++) row[i].raw = r[i + 1];
+        if (!lf_add_row(w, (uint32_t)r[0], row)) {
+            lf_seal(w);
+            ok = lc_put_block(c);
+            break;                          // One block per step; the row goes in next time
+        }
+        c->saveRow = (c->saveRow + 1) % c->capacity;
+        c->saveLeft--;
+    }
+    if (ok && !last) return true;
+    c->file.close();
+    if (ok) {
+        c->captures++;
+        c->saved = true;
+    } else {
+        c->failed++;
+    }
+    c->state = LC_ARMED;
+    return false;
+}
+
+#endif // LOG_CAPTURE_H
@@ -0,0 +1,650 @@
+/**
+ * @file log_format.h
+ * Binary columnar SD log — block layout, writer and reader helpers
+ *
+ * A log file is a sequence of LF_BLOCK_SIZE blocks, each starting with
+ * the same 24-byte header (little-endian):
+ *   magic:u32 | seq:u32 | schema_id:u16 | count:u16 | cap:u16 |
+ *   version:u8 | flags:u8 | t_first:u32 | t_last:u32
+ *
+ *   SCHEMA  "DSCH"  body = a telemetry SCHEMA payload (telemetry_binary.h),
+ *                   count = its length. Fields come from tb_collect(), so
+ *                   keys, widths and decimals match the live stream and
+ *                   the OBD columns follow the PID table. t_first holds
+ *                   the file's nonce (below).
+ *   DATA    "DBLK"  count rows of the schema_id schema, stored column by
+ *                   column, timestamps first. Two layouts:
+ *                   plain (flags 0): ts_ms:u32 × cap, then each field's
+ *                   raw values (tb_type_width() bytes each) × cap; cap
+ *                   depends only on the schema, so columns sit at fixed
+ *                   offsets.
+ *                   packed (LF_FLAG_PACKED, cap 0): a table of
+ *                   fields + 1 column offsets (u16, from the block start),
+ *                   then each column as a bit stream — see PACKING.
+ *   INDEX   "DIDX"  written last, on a clean close: count entries of
+ *                   block:u32 | t_first:u32 (block = position in the
+ *                   file), one per cap data blocks. A file without one
+ *                   (power cut) is read by scanning the block headers.
+ *
+ * Commit marker: blocks with LF_FLAG_CRC end in crc32:u32, the CRC-32 of
+ * everything before it, seeded with the file's nonce. A block is
+ * committed once it is on the card with a matching CRC; anything else at
+ * the end of a file is a write the power cut tore, and lf_block_ok()
+ * tells the two apart without reading the rest of the file. Readers skip
+ * blocks that fail it. The nonce is random per file, so blocks left in
+ * preallocated clusters by a deleted log never pass as this file's.
+ *
+ * Next to each log, NNNN.idx holds a sparse time index that is usable
+ * while the log is still being written: one LF_IDX_ENTRY byte entry
+ *   t_first:u32 | block:u32 | schema_block:u32
+ * for every LF_IDX_EVERY-th data block, appended once the block is on the
+ * card. schema_block is the SCHEMA that block needs, so a reader can
+ * start at any entry without scanning back. Entries are in file order and
+ * t_first never decreases within a session, so lf_idx_find() binary
+ * searches them.
+ *
+ * The first block of a file is a SCHEMA; a new one follows whenever the
+ * field set changes (an OBD subscription). seq counts every block the
+ * logger produced, so a gap means blocks were dropped before reaching
+ * the card. Values are the fixed point raw numbers of the binary stream:
+ * real = raw / 10^decimals.
+ *
+ * No Arduino calls — tools/log_convert reads files with the same code.
+ */
+
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "telemetry_binary.h"
+
+#define LF_BLOCK_SIZE       4096    // 8 per SD writer buffer
+#define LF_HEADER_SIZE      24
+#define LF_VERSION          2       // 2: blocks carry the commit marker
+#define LF_MAGIC_SCHEMA     0x48435344u     // "DSCH"
+#define LF_MAGIC_DATA       0x4B4C4244u     // "DBLK"
+#define LF_MAGIC_INDEX      0x58444944u     // "DIDX"
+#define LF_TRAILER_SIZE     4       // crc32 at the end of the block
+#define LF_BODY_END         (LF_BLOCK_SIZE - LF_TRAILER_SIZE)
+#define LF_INDEX_MAX        ((LF_BODY_END - LF_HEADER_SIZE) / 8)
+#define LF_MAX_FIELDS       (TB_MAX_VALUES + 4)     // A record and log_tiers.h's leading columns
+#define LF_SCHEMA_MAX       255     // Any schema a reader may meet, whatever the build
+
+static_assert(LF_MAX_FIELDS <= LF_SCHEMA_MAX, "a schema counts its fields in a byte");
+#define LF_IDX_ENTRY        12      // Bytes per .idx entry
+#define LF_IDX_EVERY        4       // Data blocks per .idx entry
+
+#define LF_FLAG_PACKED      0x01    // Data block columns are bit packed
+#define LF_FLAG_CRC         0x02    // Block ends in its crc32 (commit marker)
+
+struct LfHeader {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t schemaId;
+    uint16_t count;         // Rows, schema bytes or index entries
+    uint16_t cap;           // Plain data: row capacity; index: block stride
+    uint8_t version;
+    uint8_t flags;
+    uint32_t tFirst;
+    uint32_t tLast;
+};
+
+static inline uint32_t lf_get_le(const uint8_t *p, uint8_t width) {
+    uint32_t v = 0;
+    for (uint8_t i = 0; i < width; i++) v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static inline void lf_put_header(uint8_t *b, const LfHeader *h) {
+    tb_put_le(b, h->magic, 4);
+    tb_put_le(b + 4, h->seq, 4);
+    tb_put_le(b + 8, h->schemaId, 2);
+    tb_put_le(b + 10, h->count, 2);
+    tb_put_le(b + 12, h->cap, 2);
+    b[14] = h->version;
+    b[15] = h->flags;
+    tb_put_le(b + 16, h->tFirst, 4);
+    tb_put_le(b + 20, h->tLast, 4);
+}
+
+static inline void lf_get_header(const uint8_t *b, LfHeader *h) {
+    h->magic = lf_get_le(b, 4);
+    h->seq = lf_get_le(b + 4, 4);
+    h->schemaId = (uint16_t)lf_get_le(b + 8, 2);
+    h->count = (uint16_t)lf_get_le(b + 10, 2);
+    h->cap = (uint16_t)lf_get_le(b + 12, 2);
+    h->version = b[14];
+    h->flags = b[15];
+    h->tFirst = lf_get_le(b + 16, 4);
+    h->tLast = lf_get_le(b + 20, 4);
+}
+
+// CRC-32 (IEEE, reflected), a nibble at a time: one 4 KB block per commit
+// doesn't justify a 1 KB table. seed 0 gives the plain CRC-32.
+static uint32_t lf_crc32(const uint8_t *p, size_t n, uint32_t seed) {
+    static const uint32_t TABLE[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+        0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint32_t crc = ~seed;
+    for (size_t i = 0; i < n; i++) {
+        crc = TABLE[(crc ^ p[i]) & 0x0F] ^ (crc >> 4);
+        crc = TABLE[(crc ^ (p[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+// Seal the finished block b with its commit marker
+static inline void lf_commit(uint8_t *b, uint32_t nonce) {
+    b[15] |= LF_FLAG_CRC;
+    tb_put_le(b + LF_BODY_END, lf_crc32(b, LF_BODY_END, nonce), 4);
+}
+
+/**
+ * A whole block of the file with this nonce: a known magic and a
+ * matching commit marker. Version 1 blocks, from before the marker, pass
+ * on magic.
+ */
+static inline bool lf_block_ok(const uint8_t *b, uint32_t nonce) {
+    uint32_t magic = lf_get_le(b, 4);
+    if (magic != LF_MAGIC_SCHEMA && magic != LF_MAGIC_DATA && magic != LF_MAGIC_INDEX) return false;
+    if (b[14] == 1 && !(b[15] & LF_FLAG_CRC)) return true;
+    return (b[15] & LF_FLAG_CRC) && lf_get_le(b + LF_BODY_END, 4) == lf_crc32(b, LF_BODY_END, nonce);
+}
+
+// The nonce a SCHEMA block carries (0 for anything else)
+static inline uint32_t lf_nonce_of(const uint8_t *b) {
+    return lf_get_le(b, 4) == LF_MAGIC_SCHEMA ? lf_get_le(b + 16, 4) : 0;
+}
+
+// Rows per plain data block for fields whose widths add up to rowBytes
+static inline uint16_t lf_capacity(size_t rowBytes) {
+    return (uint16_t)((LF_BLOCK_SIZE - LF_HEADER_SIZE) / (4 + rowBytes));
+}
+
+// A raw value as the plain layout keeps it: cut to the field's width,
+// sign-extended for the signed types
+static inline int64_t lf_typed(uint8_t type, uint32_t v) {
+    switch (type) {
+        case TB_I16: return (int16_t)v;
+        case TB_I32: return (int32_t)v;
+        case TB_U16: return (uint16_t)v;
+        case TB_U32: return v;
+        default:     return (uint8_t)v;
+    }
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * PACKING — bit streams, most significant bit first
+ *
+ * Timestamps (Gorilla): the first is stored as 32 bits, then each
+ * delta-of-delta d, zigzagged to z:
+ *   d == 0 → 0    z < 128 → 10+7 bits    z < 512 → 110+9 bits
+ *   z < 4096 → 1110+12 bits              else 1111+32 bits
+ * Field values: the delta v - previous (0 before the first row), as
+ *   0 if unchanged, else 1 + zigzag(delta) as a varint of 4-bit groups
+ *   (continuation bit + 3 value bits, low group first).
+ * Slow channels (temperatures, fuel level, flags) cost one bit a row.
+ * All values are fixed point integers, so XOR-coding float bit patterns
+ * would gain nothing here. Each column starts on a byte boundary.
+ * ══════════════════════════════════════════════════════════════*/
+
+static inline uint32_t lf_zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t lf_unzigzag(uint32_t z) {
+    return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+static inline uint8_t lf_dod_bits(uint32_t z) {
+    return z == 0 ? 1 : z < 128 ? 9 : z < 512 ? 12 : z < 4096 ? 16 : 36;
+}
+
+static inline uint8_t lf_delta_bits(uint32_t z) {
+    if (z == 0) return 1;
+    uint8_t groups = 1;
+    while (z >>= 3) groups++;
+    return 1 + 4 * groups;
+}
+
+static inline void lf_put_bits(uint8_t *buf, size_t *pos, uint32_t v, uint8_t n) {
+    while (n) {
+        uint8_t room = 8 - (*pos & 7);
+        uint8_t take = n < room ? n : room;
+        uint8_t bits = (uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+        buf[*pos >> 3] |= bits << (room - take);
+        *pos += take;
+        n -= take;
+    }
+}
+
+// n bits from buf, or 0 past end (a corrupt column reads as zeros)
+static inline uint32_t lf_get_bits(const uint8_t *buf, size_t end, size_t *pos, uint8_t n) {
+    uint32_t v = 0;
+    while (n) {
+        if (*pos >= end) return n >= 32 ? 0 : v << n;
+        uint8_t room = 8 - (*pos & 7);
+        uint8_t take = n < room ? n : room;
+        v = (v << take) | ((buf[*pos >> 3] >> (room - take)) & ((1u << take) - 1));
+        *pos += take;
+        n -= take;
+    }
+    return v;
+}
+
+static inline void lf_put_dod(uint8_t *buf, size_t *pos, uint32_t z) {
+    if (z == 0)         lf_put_bits(buf, pos, 0, 1);
+    else if (z < 128)   { lf_put_bits(buf, pos, 0x2, 2); lf_put_bits(buf, pos, z, 7); }
+    else if (z < 512)   { lf_put_bits(buf, pos, 0x6, 3); lf_put_bits(buf, pos, z, 9); }
+    else if (z < 4096)  { lf_put_bits(buf, pos, 0xE, 4); lf_put_bits(buf, pos, z, 12); }
+    else                { lf_put_bits(buf, pos, 0xF, 4); lf_put_bits(buf, pos, z, 32); }
+}
+
+static inline uint32_t lf_get_dod(const uint8_t *buf, size_t end, size_t *pos) {
+    uint8_t prefix = 0;
+    while (prefix < 4 && lf_get_bits(buf, end, pos, 1)) prefix++;
+    static const uint8_t width[] = {0, 7, 9, 12, 32};
+    return prefix ? lf_get_bits(buf, end, pos, width[prefix]) : 0;
+}
+
+static inline void lf_put_delta(uint8_t *buf, size_t *pos, uint32_t z) {
+    lf_put_bits(buf, pos, z != 0, 1);
+    if (!z) return;
+    do {
+        uint8_t group = z & 0x7;
+        z >>= 3;
+        lf_put_bits(buf, pos, (z ? 0x8 : 0) | group, 4);
+    } while (z);
+}
+
+static inline uint32_t lf_get_delta(const uint8_t *buf, size_t end, size_t *pos) {
+    if (!lf_get_bits(buf, end, pos, 1)) return 0;
+    uint32_t z = 0;
+    for (uint8_t shift = 0; shift < 33; shift += 3) {
+        uint8_t group = (uint8_t)lf_get_bits(buf, end, pos, 4);
+        z |= (uint32_t)(group & 0x7) << shift;
+        if (!(group & 0x8)) break;
+    }
+    return z;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * WRITER — collects rows, packs one block at a time; the caller
+ * stores it
+ * ══════════════════════════════════════════════════════════════*/
+
+struct LfWriter {
+    uint8_t block[LF_BLOCK_SIZE];
+    int32_t *stage;                     // Rows of the open block, column-major
+    size_t stageSize;                   // Bytes at stage
+    uint16_t stageRows;                 // Rows it holds for this schema
+    uint32_t seq;                       // Next block's seq
+    uint32_t nonce;                     // Seeds the commit markers of this file
+    uint32_t stored;                    // Blocks in the file so far
+    uint32_t fingerprint;               // Field set the schema was built from
+    uint16_t schemaId;
+    bool haveSchema;
+    int fields;
+    uint8_t type[LF_MAX_FIELDS];
+    uint16_t rows;
+    uint32_t tFirst, tLast;
+    uint32_t lastDelta;                 // Timestamp column state
+    int32_t last[LF_MAX_FIELDS];        // Previous value of each field
+    uint32_t bits[LF_MAX_FIELDS + 1];   // Packed size of each column so far
+    uint32_t dataBlocks;                // Data blocks stored
+    uint32_t schemaBlock;               // Position of the last SCHEMA stored
+    uint32_t index[LF_INDEX_MAX][2];    // block, t_first
+    uint16_t indexCount;
+    uint16_t indexStride;               // Data blocks per entry, doubles when full
+};
+
+// stage: scratch for the rows of one block; its size caps how far a
+// block can be compressed (rows ≤ stageSize / 4 / (fields + 1)).
+// nonce: random for a new file, the file's own when appending to one.
+static void lf_init(LfWriter *w, int32_t *stage, size_t stageSize, uint32_t nonce) {
+    memset(w, 0, sizeof(*w));
+    w->nonce = nonce;
+    w->stage = stage;
+    w->stageSize = stageSize;
+    w->indexStride = 1;
+}
+
+/**
+ * Identity of the field set: changes when a field is added, removed or
+ * reordered, never with the values themselves.
+ */
+static uint32_t lf_fingerprint(const TbValue *v, int n) {
+    uint32_t h = 2166136261u;
+    auto mix = [&](uint32_t x) { h = (h ^ x) * 16777619u; };
+    auto mixStr = [&](const char *s) { for (; s && *s; s++) mix((uint8_t)*s); mix(0); };
+    for (int i = 0; i < n; i++) {
+        mixStr(v[i].group);
+        mix((uint8_t)v[i].index);
+        mixStr(v[i].key);
+        mix(v[i].type | v[i].decimals << 8 | v[i].nameCount << 16);
+    }
+    return h ^ (uint32_t)n;
+}
+
+static inline bool lf_schema_changed(const LfWriter *w, const TbValue *v, int n) {
+    return !w->haveSchema || lf_fingerprint(v, n) != w->fingerprint;
+}
+
+// Bytes available to the packed columns of a block
+static inline size_t lf_packed_room(int fields) {
+    return LF_BODY_END - LF_HEADER_SIZE - 2 * (size_t)(fields + 1);
+}
+
+/**
+ * Put a SCHEMA block for v[] in w->block. Seal or drop any rows still
+ * pending first. Returns false if the schema doesn't fit a block.
+ */
+static bool lf_begin_schema(LfWriter *w, const TbValue *v, int n) {
+    if (n > LF_MAX_FIELDS) return false;
+    memset(w->block, 0, LF_BLOCK_SIZE);
+    uint16_t id;
+    size_t len = tb_build_schema(w->block + LF_HEADER_SIZE, LF_BODY_END - LF_HEADER_SIZE,
+                                 v, n, &id);
+    size_t stageRows = w->stageSize / sizeof(int32_t) / (n + 1);
+    if (!len || !stageRows) return false;
+
+    w->fields = n;
+    for (int i = 0; i < n; i++) w->type[i] = v[i].type;
+    w->stageRows = stageRows > 0xFFFF ? 0xFFFF : (uint16_t)stageRows;
+    w->schemaId = id;
+    w->fingerprint = lf_fingerprint(v, n);
+    w->haveSchema = true;
+    w->rows = 0;
+
+    LfHeader h = {LF_MAGIC_SCHEMA, w->seq, id, (uint16_t)len, 0, LF_VERSION, 0, w->nonce, 0};
+    lf_put_header(w->block, &h);
+    lf_commit(w->block, w->nonce);
+    return true;
+}
+
+/**
+ * Add one row. False if the block has no room for it: seal and store
+ * the block, then add the row again. Costs the same few operations per
+ * value whatever the data.
+ */
+static bool lf_add_row(LfWriter *w, uint32_t ts, const TbValue *v) {
+    if (!w->rows) {
+        memset(w->bits, 0, sizeof(w->bits[0]) * (w->fields + 1));
+        memset(w->last, 0, sizeof(w->last[0]) * w->fields);
+        w->lastDelta = 0;
+    } else if (w->rows == w->stageRows) {
+        return false;
+    }
+
+    uint8_t add[LF_MAX_FIELDS + 1];
+    uint32_t delta = ts - w->tLast;
+    add[0] = w->rows ? lf_dod_bits(lf_zigzag((int32_t)(delta - w->lastDelta))) : 32;
+    size_t bytes = (w->bits[0] + add[0] + 7) / 8;
+    for (int i = 0; i < w->fields; i++) {
+        int32_t raw = (int32_t)lf_typed(w->type[i], (uint32_t)v[i].raw);
+        add[i + 1] = lf_delta_bits(lf_zigzag((int32_t)((uint32_t)raw - (uint32_t)w->last[i])));
+        bytes += (w->bits[i + 1] + add[i + 1] + 7) / 8;
+    }
+    if (bytes > lf_packed_room(w->fields)) return false;
+
+    int32_t *col = w->stage;
+    col[w->rows] = (int32_t)ts;
+    w->bits[0] += add[0];
+    for (int i = 0; i < w->fields; i++) {
+        col += w->stageRows;
+        col[w->rows] = w->last[i] = (int32_t)lf_typed(w->type[i], (uint32_t)v[i].raw);
+        w->bits[i + 1] += add[i + 1];
+    }
+    if (!w->rows) w->tFirst = ts;
+    else w->lastDelta = delta;
+    w->tLast = ts;
+    w->rows++;
+    return true;
+}
+
+// Pack the collected rows into w->block, which is then ready to store
+static void lf_seal(LfWriter *w) {
+    memset(w->block, 0, LF_BLOCK_SIZE);
+    size_t off = LF_HEADER_SIZE + 2 * (size_t)(w->fields + 1);
+    for (int c = 0; c <= w->fields; c++) {
+        tb_put_le(w->block + LF_HEADER_SIZE + 2 * c, (uint32_t)off, 2);
+        const int32_t *col = w->stage + (size_t)c * w->stageRows;
+        uint8_t *out = w->block + off;
+        size_t pos = 0;
+        if (c == 0) {
+            lf_put_bits(out, &pos, (uint32_t)col[0], 32);
+            uint32_t lastDelta = 0;
+            for (uint16_t r = 1; r < w->rows; r++) {
+                uint32_t delta = (uint32_t)col[r] - (uint32_t)col[r - 1];
+                lf_put_dod(out, &pos, lf_zigzag((int32_t)(delta - lastDelta)));
+                lastDelta = delta;
+            }
+        } else {
+            int32_t last = 0;
+            for (uint16_t r = 0; r < w->rows; r++) {
+                lf_put_delta(out, &pos, lf_zigzag((int32_t)((uint32_t)col[r] - (uint32_t)last)));
+                last = col[r];
+            }
+        }
+        off += (pos + 7) / 8;
+    }
+    LfHeader h = {LF_MAGIC_DATA, w->seq, w->schemaId, w->rows, 0,
+                  LF_VERSION, LF_FLAG_PACKED, w->tFirst, w->tLast};
+    lf_put_header(w->block, &h);
+    lf_commit(w->block, w->nonce);
+}
+
+/**
+ * The block in w->block (schema or sealed data) was stored, or dropped
+ * (ok = false). Either way the writer moves on to the next block.
+ */
+static void lf_stored(LfWriter *w, bool ok) {
+    bool data = lf_get_le(w->block, 4) == LF_MAGIC_DATA;
+    if (ok && lf_get_le(w->block, 4) == LF_MAGIC_SCHEMA) w->schemaBlock = w->stored;
+    if (ok && data) {
+        if (w->indexCount == LF_INDEX_MAX) {
+            for (uint16_t i = 0; i < LF_INDEX_MAX / 2; i++) {
+                w->index[i][0] = w->index[2 * i][0];
+                w->index[i][1] = w->index[2 * i][1];
+            }
+            w->indexCount = LF_INDEX_MAX / 2;
+            w->indexStride *= 2;
+        }
+        if (w->dataBlocks % w->indexStride == 0) {
+            w->index[w->indexCount][0] = w->stored;
+            w->index[w->indexCount][1] = w->tFirst;
+            w->indexCount++;
+        }
+        w->dataBlocks++;
+    }
+    if (ok) w->stored++;
+    if (data) w->rows = 0;
+    w->seq++;
+}
+
+// Put the INDEX block in w->block (call after the last data block)
+static void lf_build_index(LfWriter *w) {
+    memset(w->block, 0, LF_BLOCK_SIZE);
+    for (uint16_t i = 0; i < w->indexCount; i++) {
+        tb_put_le(w->block + LF_HEADER_SIZE + 8 * i, w->index[i][0], 4);
+        tb_put_le(w->block + LF_HEADER_SIZE + 8 * i + 4, w->index[i][1], 4);
+    }
+    LfHeader h = {LF_MAGIC_INDEX, w->seq, w->schemaId, w->indexCount, w->indexStride,
+                  LF_VERSION, 0, w->indexCount ? w->index[0][1] : 0, w->tLast};
+    lf_put_header(w->block, &h);
+    lf_commit(w->block, w->nonce);
+}
+
+// The sealed data block in w->block gets a .idx entry if it is stored
+static inline bool lf_idx_due(const LfWriter *w) {
+    return w->dataBlocks % LF_IDX_EVERY == 0;
+}
+
+// The .idx entry for the block in w->block, stored as block w->stored
+static inline void lf_put_idx(uint8_t *p, const LfWriter *w) {
+    tb_put_le(p, w->tFirst, 4);
+    tb_put_le(p + 4, w->stored, 4);
+    tb_put_le(p + 8, w->schemaBlock, 4);
+}
+
+struct LfIdxEntry {
+    uint32_t tFirst;
+    uint32_t block;
+    uint32_t schemaBlock;
+};
+
+static inline void lf_get_idx(const uint8_t *p, LfIdxEntry *e) {
+    e->tFirst = lf_get_le(p, 4);
+    e->block = lf_get_le(p + 4, 4);
+    e->schemaBlock = lf_get_le(p + 8, 4);
+}
+
+/**
+ * Binary search count .idx entries, read with get(i, &entry): the number
+ * of entries with t_first <= ts, so the answer minus one is the last
+ * block to start at or before ts (none if 0). O(log count) reads, which
+ * matters when each is a seek on the card.
+ */
+template <typename Get>
+static uint32_t lf_idx_find(uint32_t count, uint32_t ts, Get get) {
+    uint32_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        LfIdxEntry e;
+        if (!get(mid, &e)) return lo;
+        if (e.tFirst <= ts) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * READER
+ * ══════════════════════════════════════════════════════════════*/
+
+// One field of a parsed SCHEMA block
+struct LfField {
+    char key[48];
+    uint8_t type;
+    uint8_t decimals;
+    uint8_t width;
+    uint16_t offset;                    // Column start in a plain data block
+    const char *names;                  // TB_ENUM: "a|b|c" (not terminated)
+    uint8_t namesLen;
+};
+
+struct LfSchema {
+    uint16_t id;
+    uint32_t nonce;                     // Data blocks of this schema are sealed with it
+    int fields;
+    uint16_t cap;                       // Rows per plain data block
+    LfField field[LF_SCHEMA_MAX];
+};
+
+/**
+ * Parse the SCHEMA block at b. Names of TB_ENUM fields point into b,
+ * which must stay mapped. Returns false if it is malformed or torn.
+ */
+static bool lf_parse_schema(const uint8_t *b, LfSchema *s) {
+    LfHeader h;
+    lf_get_header(b, &h);
+    if (h.magic != LF_MAGIC_SCHEMA || !lf_block_ok(b, h.tFirst) || h.count < 5 ||
+        h.count > LF_BLOCK_SIZE - LF_HEADER_SIZE) return false;
+    const uint8_t *p = b + LF_HEADER_SIZE, *end = p + h.count;
+    if (p[0] != TB_MSG_SCHEMA) return false;
+    s->id = (uint16_t)lf_get_le(p + 2, 2);
+    s->nonce = h.tFirst;
+    s->fields = p[4];
+    if (s->fields > LF_SCHEMA_MAX) return false;
+    p += 5;
+
+    size_t rowBytes = 0;
+    for (int i = 0; i < s->fields; i++) {
+        LfField *f = &s->field[i];
+        if (end - p < 4 || end - p < 4 + p[3]) return false;
+        f->type = p[1];
+        f->decimals = p[2];
+        uint8_t klen = p[3] < sizeof(f->key) ? p[3] : sizeof(f->key) - 1;
+        memcpy(f->key, p + 4, klen);
+        f->key[klen] = '\0';
+        p += 4 + p[3];
+        f->names = NULL;
+        f->namesLen = 0;
+        if (f->type == TB_ENUM) {
+            if (p >= end || end - p < 1 + p[0]) return false;
+            f->namesLen = p[0];
+            f->names = (const char *)p + 1;
+            p += 1 + p[0];
+        }
+        f->width = tb_type_width(f->type);
+        rowBytes += f->width;
+    }
+    s->cap = lf_capacity(rowBytes);
+    size_t off = LF_HEADER_SIZE + 4 * (size_t)s->cap;
+    for (int i = 0; i < s->fields; i++) {
+        s->field[i].offset = (uint16_t)off;
+        off += (size_t)s->field[i].width * s->cap;
+    }
+    return true;
+}
+
+/**
+ * Decode a DATA block of schema s into out, column-major: out[r] is the
+ * timestamp of row r, out[(k + 1) * rows + r] the raw value of field k.
+ * out needs (s->fields + 1) * count entries. Returns the row count, or
+ * -1 if the block doesn't belong to s or fails its commit marker.
+ */
+static int lf_read_block(const uint8_t *b, const LfSchema *s, int64_t *out) {
+    LfHeader h;
+    lf_get_header(b, &h);
+    if (h.magic != LF_MAGIC_DATA || h.schemaId != s->id || !lf_block_ok(b, s->nonce)) return -1;
+    int rows = h.count;
+
+    if (!(h.flags & LF_FLAG_PACKED)) {
+        if (h.cap != s->cap || rows > h.cap) return -1;
+        for (int r = 0; r < rows; r++) {
+            out[r] = lf_get_le(b + LF_HEADER_SIZE + 4 * r, 4);
+        }
+        for (int k = 0; k < s->fields; k++) {
+            const LfField *f = &s->field[k];
+            for (int r = 0; r < rows; r++) {
+                out[(size_t)(k + 1) * rows + r] =
+                    lf_typed(f->type, lf_get_le(b + f->offset + (size_t)f->width * r, f->width));
+            }
+        }
+        return rows;
+    }
+
+    size_t table = LF_HEADER_SIZE + 2 * (size_t)(s->fields + 1);
+    size_t body = h.flags & LF_FLAG_CRC ? LF_BODY_END : LF_BLOCK_SIZE;
+    for (int c = 0; c <= s->fields; c++) {
+        size_t start = lf_get_le(b + LF_HEADER_SIZE + 2 * c, 2);
+        size_t end = c < s->fields ? lf_get_le(b + LF_HEADER_SIZE + 2 * (c + 1), 2) : body;
+        if (start < table || end < start || end > body) return -1;
+        const uint8_t *in = b + start;
+        size_t bits = (end - start) * 8, pos = 0;
+        int64_t *col = out + (size_t)c * rows;
+        if (c == 0) {
+            uint32_t ts = lf_get_bits(in, bits, &pos, 32), delta = 0;
+            for (int r = 0; r < rows; r++) {
+                if (r) {
+                    delta += (uint32_t)lf_unzigzag(lf_get_dod(in, bits, &pos));
+                    ts += delta;
+                }
+                col[r] = ts;
+            }
+        } else {
+            uint32_t v = 0;
+            for (int r = 0; r < rows; r++) {
+                v += (uint32_t)lf_unzigzag(lf_get_delta(in, bits, &pos));
+                col[r] = lf_typed(s->field[c - 1].type, v);
+            }
+        }
+    }
+    return rows;
+}
+
+#endif // LOG_FORMAT_H
@@ -0,0 +1,504 @@
+/**
+ * @file log_tiers.h
+ * Downsampled log tiers: per-second, per-minute and per-trip aggregates
+ * next to the raw log
+ *
+ * loop() samples the full telemetry record (tb_collect()) every
+ * LG_SAMPLE_MS and folds it into three running aggregates, O(1) per
+ * field and sample: min, max, sum and last. When an interval ends, its
+ * aggregates become four rows of the same block format as the raw log
+ * (log_format.h), told apart by the "agg" column (min, max, mean, last).
+ * "n" is the samples behind them, "span" the ms from the first to the
+ * last, "session" the boot's first segment:
+ *   /logs/NNNN_s.dlg   one interval per second     (NNNN: that segment)
+ *   /logs/NNNN_m.dlg   one interval per minute
+ *   /logs/trips.dlg    one interval per trip, every trip in one file
+ * Rows are stamped with the start of their interval, in the ms of the
+ * boot they belong to. A trip is a boot, as power follows the ignition;
+ * its aggregates go into the trip computer's NVS checkpoint (main.cpp),
+ * and a trip that a power cut ended is written from there at the next
+ * boot, after which the checkpoint is due again so it is written only
+ * once (lg_trip_save_due()). Mean is
+ * meaningless for an enum and holds its last value instead.
+ *
+ * A new field set (an OBD subscription) ends the open second and minute
+ * but not the trip: the trip keeps its fields by full name (LgTripCol)
+ * and a field it hasn't seen yet becomes another column with its own
+ * sample count. A checkpoint carries those names, so last boot's trip is
+ * written whatever field set this boot starts with.
+ *
+ * Blocks reach the card through the SD writer's channels (sd_logger.h),
+ * so nothing here waits for it. The second tier commits within the raw
+ * log's commit window, the minute tier within LG_MINUTE_COMMIT_MS (a
+ * power cut can cost it the last minutes; the second tier has them) and
+ * trips.dlg as soon as a trip is written. Retention (sd_retention())
+ * deletes raw segments first, then second tiers, then minute tiers, and
+ * never trips.dlg, so a card that is full still answers a question about
+ * last month from a few small files. Needs PSRAM, like log_capture.h.
+ */
+
+#ifndef LOG_TIERS_H
+#define LOG_TIERS_H
+
+#include <Arduino.h>
+#include "sd_logger.h"
+#include "log_format.h"
+
+#define LG_SAMPLE_MS        100         // Sample period of every tier
+#define LG_MINUTE_COMMIT_MS 300000      // Minute tier's commit window
+#define LG_STAGE_SECOND     32768       // Stage of the second tier's blocks
+#define LG_STAGE_OTHER      8192
+#define LG_HEAD             4           // agg, n, span, session: ahead of the fields
+#define LG_FIELDS           TB_MAX_VALUES
+#define LG_KEY_LEN          24          // Trip column name, tb_key() ("chg.t1")
+#define LG_TRIP_VERSION     1
+
+static_assert(LG_HEAD + LG_FIELDS <= LF_MAX_FIELDS, "a tier row is the record and its head");
+
+enum LgTier {
+    LG_SECOND,
+    LG_MINUTE,
+    LG_TRIP,
+    LG_TIERS
+};
+static_assert(LG_TIERS == VD_LG_TIERS, "VehicleData has a counter pair per tier");
+
+enum LgAgg {
+    LG_MIN,
+    LG_MAX,
+    LG_MEAN,
+    LG_LAST,
+    LG_AGGS
+};
+
+static const char *const LG_AGG_NAMES[LG_AGGS] = {"min", "max", "mean", "last"};
+
+// Aggregates of one interval, in each field's raw fixed point
+struct LgAcc {
+    uint32_t session;
+    uint32_t count;                 // Samples, 0 = nothing open
+    uint32_t tFirst;
+    uint32_t tLast;
+    int32_t min[LG_FIELDS];
+    int32_t max[LG_FIELDS];
+    int32_t last[LG_FIELDS];
+    int64_t sum[LG_FIELDS];
+};
+
+// One field of the trip, by name, with the samples it has had
+struct LgTripCol {
+    int64_t sum;
+    int32_t min;
+    int32_t max;
+    int32_t last;
+    uint32_t n;
+    char key[LG_KEY_LEN];
+    uint8_t type;
+    uint8_t decimals;
+};
+
+// A trip; the NVS checkpoint holds it up to col[cols] (lg_trip_bytes())
+struct LgTrip {
+    uint16_t version;               // LG_TRIP_VERSION
+    uint16_t cols;
+    uint32_t session;
+    uint32_t count;                 // Samples, 0 = nothing open
+    uint32_t tFirst;
+    uint32_t tLast;
+    LgTripCol col[LG_FIELDS];
+};
+
+struct LgWriter {
+    uint32_t periodMs;              // 0: until the trip ends
+    SdChannel ch;
+    LfWriter *lf;
+    int32_t *stage;
+    LgAcc *acc;                     // Second and minute (the trip has LogTiers::trip)
+    uint32_t intervals;
+    uint32_t dropped;               // Rows lost: channel full; the trip's also
+                                    // counts fields left without a column
+};
+
+struct LogTiers {
+    bool on;                        // PSRAM and a card
+    uint32_t session;
+    TbValue field[TB_MAX_VALUES];   // The field set, values unused
+    int fields;
+    uint32_t fingerprint;
+    int16_t tripCol[LG_FIELDS];     // Trip column of each field, -1: none left
+    TbValue row[LG_HEAD + LG_FIELDS];   // Row being written
+    LgWriter tier[LG_TIERS];
+    LgTrip *trip;                   // The open trip
+    LgTrip *pending;                // Last boot's, from NVS
+    bool pendingWritten;            // ... is in trips.dlg, not yet out of NVS
+    unsigned long lastSample;
+};
+
+// Bytes of the trip worth keeping: the header alone once it is closed
+static inline size_t lg_trip_bytes(const LgTrip *p) {
+    return offsetof(LgTrip, col) + (p->count ? p->cols * sizeof(LgTripCol) : 0);
+}
+
+// Hand the block in w->lf to the writer (a schema, or data which is
+// sealed first)
+static bool lg_put_block(LgWriter *w) {
+    bool data = w->lf->rows > 0;
+    if (data) lf_seal(w->lf);
+    bool ok = sd_stream_put(w->ch, (const char *)w->lf->block, LF_BLOCK_SIZE);
+    if (!ok && data) w->dropped += w->lf->rows;
+    lf_stored(w->lf, ok);
+    return ok;
+}
+
+static void lg_add_row(LgWriter *w, uint32_t ts, const TbValue *v, int n) {
+    LfWriter *lf = w->lf;
+    if (lf_schema_changed(lf, v, n)) {
+        if (lf->rows) lg_put_block(w);
+        if (!lf_begin_schema(lf, v, n)) return;
+        if (!lg_put_block(w)) {
+            lf->haveSchema = false;     // Try again with the next row
+            return;
+        }
+    }
+    if (!lf_add_row(lf, ts, v)) {
+        lg_put_block(w);
+        lf_add_row(lf, ts, v);
+    }
+}
+
+// Head of an interval's rows: agg, n, span, session
+static void lg_head(TbValue *row, uint32_t count, uint32_t span, uint32_t session) {
+    row[0] = {NULL, -1, "agg", TB_ENUM, 0, 0, 0, LG_AGG_NAMES, LG_AGGS};
+    row[1] = {NULL, -1, "n", TB_U32, 0, (int32_t)count, 0, NULL, 0};
+    row[2] = {NULL, -1, "span", TB_U32, 0, (int32_t)span, 0, NULL, 0};
+    row[3] = {NULL, -1, "session", TB_U32, 0, (int32_t)session, 0, NULL, 0};
+}
+
+// One aggregate of a field: mean rounded to nearest, an enum's last value
+static inline int32_t lg_agg(int agg, uint8_t type, int32_t min, int32_t max, int32_t last,
+                             int64_t sum, int64_t n) {
+    if (agg == LG_MIN) return min;
+    if (agg == LG_MAX) return max;
+    if (agg == LG_LAST || type == TB_ENUM) return last;
+    return (int32_t)((sum >= 0 ? sum + n / 2 : sum - n / 2) / n);
+}
+
+// One sample into a field's aggregates; first: the field has none yet
+static inline void lg_fold_value(uint8_t type, int32_t raw, bool first, int32_t *min,
+                                 int32_t *max, int32_t *last, int64_t *sum) {
+    int64_t x = lf_typed(type, (uint32_t)raw);
+    if (first) {
+        *min = *max = raw;
+        *sum = 0;
+    } else if (x < lf_typed(type, (uint32_t)*min)) {
+        *min = raw;
+    } else if (x > lf_typed(type, (uint32_t)*max)) {
+        *max = raw;
+    }
+    *sum += x;
+    *last = raw;
+}
+
+/**
+ * Write a second or minute interval's four rows, stamped with its start
+ * rounded down to the tier's period
+ */
+static void lg_emit(LogTiers *t, int tier, const LgAcc *a) {
+    LgWriter *w = &t->tier[tier];
+    TbValue *row = t->row;
+    lg_head(row, a->count, a->tLast - a->tFirst, a->session);
+    memcpy(row + LG_HEAD, t->field, sizeof(row[0]) * t->fields);
+    for (int agg = 0; agg < LG_AGGS; agg++) {
+        row[0].raw = agg;
+        for (int i = 0; i < t->fields; i++) {
+            row[LG_HEAD + i].raw = lg_agg(agg, t->field[i].type, a->min[i], a->max[i],
+                                          a->last[i], a->sum[i], a->count);
+        }
+        lg_add_row(w, a->tFirst - a->tFirst % w->periodMs, row, LG_HEAD + t->fields);
+    }
+    w->intervals++;
+}
+
+// An enum trip column takes its names from the field of that name, if
+// the field set still has it; otherwise it goes out as its index
+static void lg_enum_names(const LogTiers *t, TbValue *v) {
+    char key[LG_KEY_LEN];
+    for (int i = 0; i < t->fields; i++) {
+        if (t->field[i].type != TB_ENUM) continue;
+        tb_key(&t->field[i], key, sizeof(key));
+        if (strcmp(key, v->key) == 0) {
+            v->names = t->field[i].names;
+            v->nameCount = t->field[i].nameCount;
+            return;
+        }
+    }
+    v->type = TB_U16;
+}
+
+/**
+ * Write a trip's four rows to trips.dlg at once, stamped with its first
+ * sample. Columns mapped but never sampled are left out.
+ */
+static void lg_emit_trip(LogTiers *t, const LgTrip *p) {
+    LgWriter *w = &t->tier[LG_TRIP];
+    TbValue *row = t->row;
+    const LgTripCol *used[LG_FIELDS];
+    int n = 0;
+    lg_head(row, p->count, p->tLast - p->tFirst, p->session);
+    for (int c = 0; c < p->cols; c++) {
+        const LgTripCol *col = &p->col[c];
+        if (!col->n) continue;
+        TbValue *v = &row[LG_HEAD + n];
+        *v = {NULL, -1, col->key, col->type, col->decimals, 0, 0, NULL, 0};
+        if (col->type == TB_ENUM) lg_enum_names(t, v);
+        used[n++] = col;
+    }
+    for (int agg = 0; agg < LG_AGGS; agg++) {
+        row[0].raw = agg;
+        for (int i = 0; i < n; i++) {
+            const LgTripCol *col = used[i];
+            row[LG_HEAD + i].raw = lg_agg(agg, col->type, col->min, col->max, col->last,
+                                          col->sum, col->n);
+        }
+        lg_add_row(w, p->tFirst, row, LG_HEAD + n);
+    }
+    w->intervals++;
+    if (w->lf->rows) lg_put_block(w);
+}
+
+static void lg_fold(LgAcc *a, const TbValue *v, int n, uint32_t now) {
+    for (int i = 0; i < n; i++) {
+        lg_fold_value(v[i].type, v[i].raw, !a->count, &a->min[i], &a->max[i], &a->last[i], &a->sum[i]);
+    }
+    if (!a->count) a->tFirst = now;
+    a->tLast = now;
+    a->count++;
+}
+
+static void lg_fold_trip(LogTiers *t, const TbValue *v, int n, uint32_t now) {
+    LgTrip *p = t->trip;
+    for (int i = 0; i < n; i++) {
+        if (t->tripCol[i] < 0) continue;
+        LgTripCol *c = &p->col[t->tripCol[i]];
+        lg_fold_value(c->type, v[i].raw, !c->n, &c->min, &c->max, &c->last, &c->sum);
+        c->n++;
+    }
+    if (!p->count) {
+        p->session = t->session;
+        p->tFirst = now;
+    }
+    p->tLast = now;
+    p->count++;
+}
+
+/**
+ * The trip column of each field in the set, found by name; a name the
+ * trip hasn't seen is added. Fields past LG_FIELDS columns are left out
+ * and counted in the trip tier's dropped.
+ */
+static void lg_map_trip(LogTiers *t) {
+    LgTrip *p = t->trip;
+    for (int i = 0; i < t->fields; i++) {
+        const TbValue *f = &t->field[i];
+        char key[LG_KEY_LEN];
+        tb_key(f, key, sizeof(key));
+        int c = 0;
+        while (c < p->cols && (strcmp(p->col[c].key, key) != 0 || p->col[c].type != f->type ||
+                               p->col[c].decimals != f->decimals)) {
+            c++;
+        }
+        if (c == p->cols && p->cols < LG_FIELDS) {
+            LgTripCol *col = &p->col[p->cols++];
+            memset(col, 0, sizeof(*col));
+            strcpy(col->key, key);
+            col->type = f->type;
+            col->decimals = f->decimals;
+        }
+        t->tripCol[i] = c < p->cols ? c : -1;
+        if (t->tripCol[i] < 0) t->tier[LG_TRIP].dropped++;
+    }
+}
+
+// Write the open trip and start the next, with no columns yet
+static void lg_end_trip(LogTiers *t) {
+    LgTrip *p = t->trip;
+    if (p->count) lg_emit_trip(t, p);
+    p->version = LG_TRIP_VERSION;
+    p->cols = 0;
+    p->count = 0;
+    lg_map_trip(t);
+}
+
+// Close the open second and minute (new field set, shutdown)
+static void lg_flush(LogTiers *t) {
+    for (int k = 0; k < LG_TRIP; k++) {
+        LgWriter *w = &t->tier[k];
+        if (w->acc->count) lg_emit(t, k, w->acc);
+        w->acc->count = 0;
+    }
+}
+
+/**
+ * Writers and tier files for boot session `session` (the name of its
+ * first segment), after sd_init() and before sd_open_log(), as they use
+ * the raw log's scratch: trips.dlg is recovered from a power cut and
+ * appended to with its own nonce, and last boot's second and minute
+ * files, unless a clean close ended them, are recovered and get their
+ * block index. Without PSRAM the tiers stay off.
+ */
+static bool lg_begin(LogTiers *t, const char *session) {
+    static const uint32_t PERIOD[LG_TIERS] = {1000, 60000, 0};
+    static const SdChannel CH[LG_TIERS] = {SD_CH_TIER_S, SD_CH_TIER_M, SD_CH_TRIPS};
+    static const char *const SUFFIX[LG_TIERS] = {"_s", "_m", NULL};
+    static const SdKind KIND[LG_TIERS] = {SD_KIND_SECONDS, SD_KIND_MINUTES, SD_KIND_RAW};
+    t->on = false;
+    if (!sd_initialized) return false;
+    if (!psramFound()) {
+        Serial.println("[SD] No PSRAM: log tiers off");
+        return false;
+    }
+    t->trip = (LgTrip *)ps_malloc(sizeof(LgTrip));
+    t->pending = (LgTrip *)ps_malloc(sizeof(LgTrip));
+    for (int k = 0; k < LG_TIERS; k++) {
+        LgWriter *w = &t->tier[k];
+        size_t stage = k == LG_SECOND ? LG_STAGE_SECOND : LG_STAGE_OTHER;
+        w->lf = (LfWriter *)ps_malloc(sizeof(LfWriter));
+        w->stage = (int32_t *)ps_malloc(stage);
+        w->acc = k < LG_TRIP ? (LgAcc *)ps_malloc(sizeof(LgAcc)) : NULL;
+        if (!w->lf || !w->stage || (k < LG_TRIP && !w->acc) || !t->trip || !t->pending) {
+            Serial.println("[SD] No memory for log tiers");
+            return false;
+        }
+        w->periodMs = PERIOD[k];
+        w->ch = CH[k];
+        if (w->acc) w->acc->count = 0;
+
+        char path[32];
+        uint32_t nonce = esp_random(), stored = 0, seq = 0;
+        if (SUFFIX[k]) {
+            unsigned long prev = sd_last_session_of(strtoul(session, NULL, 10), KIND[k]);
+            if (prev) {
+                char name[16];
+                snprintf(name, sizeof(name), "%04lu%s", prev, SUFFIX[k]);
+                sd_recover_log(name);
+                sd_index_log(name);
+            }
+            snprintf(path, sizeof(path), "/logs/%s%s.dlg", session, SUFFIX[k]);
+        } else {
+            snprintf(path, sizeof(path), "/logs/trips.dlg");
+            sd_recover_log("trips");
+            File f = SD.open(path, FILE_READ);
+            uint8_t h[LF_HEADER_SIZE];
+            if (f && f.read(h, sizeof(h)) == sizeof(h)) nonce = lf_nonce_of(h);
+            if (f) {
+                stored = f.size() / LF_BLOCK_SIZE;
+                LfHeader last;
+                if (stored && f.seek((stored - 1) * LF_BLOCK_SIZE) && f.read(h, sizeof(h)) == sizeof(h)) {
+                    lf_get_header(h, &last);
+                    seq = last.seq + 1;
+                }
+                f.close();
+            }
+        }
+        lf_init(w->lf, w->stage, stage, nonce);
+        w->lf->stored = stored;
+        w->lf->seq = seq;
+        sd_stream_open(w->ch, path);
+    }
+    t->session = strtoul(session, NULL, 10);
+    t->fingerprint = 0;
+    t->fields = 0;
+    t->trip->count = 0;
+    t->pending->count = 0;
+    t->pendingWritten = false;
+    lg_end_trip(t);
+    t->on = true;
+    return true;
+}
+
+/**
+ * Last boot's trip, `len` bytes of checkpoint from NVS, to be written
+ * with the first sample. False if it isn't a trip this build can read.
+ */
+static bool lg_restore_trip(LogTiers *t, const void *saved, size_t len) {
+    const LgTrip *p = (const LgTrip *)saved;
+    if (!t->on || len < offsetof(LgTrip, col) || p->version != LG_TRIP_VERSION ||
+        p->cols > LG_FIELDS || len != lg_trip_bytes(p)) {
+        return false;
+    }
+    memcpy(t->pending, saved, len);
+    for (int c = 0; c < p->cols; c++) t->pending->col[c].key[LG_KEY_LEN - 1] = 0;
+    return true;
+}
+
+static inline bool lg_due(const LogTiers *t, unsigned long now) {
+    return t->on && now - t->lastSample >= LG_SAMPLE_MS;
+}
+
+/**
+ * Add one record (tb_collect() order) to every tier. An interval whose
+ * period has passed is written first; a changed field set ends the
+ * second and minute, and the trip carries on with the new fields. Blocks
+ * older than their tier's commit window go out part full.
+ */
+static void lg_sample(LogTiers *t, unsigned long now, const TbValue *v, int n) {
+    t->lastSample = now;
+    uint32_t fp = lf_fingerprint(v, n);
+    if (fp != t->fingerprint || n != t->fields) {
+        lg_flush(t);
+        memcpy(t->field, v, sizeof(v[0]) * n);
+        t->fields = n;
+        t->fingerprint = fp;
+        lg_map_trip(t);
+    }
+    if (t->pending->count) {
+        lg_emit_trip(t, t->pending);
+        t->pending->count = 0;
+        t->pendingWritten = true;
+    }
+    for (int k = 0; k < LG_TRIP; k++) {
+        LgWriter *w = &t->tier[k];
+        LgAcc *a = w->acc;
+        if (a->count && now / w->periodMs != a->tFirst / w->periodMs) {
+            lg_emit(t, k, a);
+            a->count = 0;
+        }
+        if (!a->count) a->session = t->session;
+        lg_fold(a, v, n, now);
+        uint32_t commit = k == LG_SECOND ? sd_commit_ms : LG_MINUTE_COMMIT_MS;
+        if (w->lf->rows && now - w->lf->tFirst >= commit) lg_put_block(w);
+    }
+    lg_fold_trip(t, v, n, now);
+}
+
+// The checkpoint still holds a trip already written: replace it now,
+// or a short boot would write that trip again at the next one
+static inline bool lg_trip_save_due(const LogTiers *t) {
+    return t->pendingWritten;
+}
+
+static inline void lg_trip_saved(LogTiers *t) {
+    t->pendingWritten = false;
+}
+
+/**
+ * Before sd_close(): write the open intervals and the trip, and end the
+ * second and minute files with their block index. The trip's NVS
+ * checkpoint is then empty (trip->count == 0).
+ */
+static void lg_close(LogTiers *t) {
+    if (!t->on) return;
+    lg_flush(t);
+    lg_end_trip(t);
+    for (int k = 0; k < LG_TIERS; k++) {
+        LgWriter *w = &t->tier[k];
+        if (w->lf->rows) lg_put_block(w);
+        if (w->periodMs && w->lf->haveSchema) {
+            lf_build_index(w->lf);
+            lg_put_block(w);
+        }
+    }
+    t->on = false;
+}
+
+#endif // LOG_TIERS_H
@@ -0,0 +1,253 @@
+/**
+ * @file log_transfer.h
+ * SD log download over the bridge link (BRIDGE_MODE only)
+ *
+ * The Pi lists /logs with ls_logs and pulls one file at a time with
+ * get_log. The file goes out as JSON chunks tagged with the get_log id:
+ *   {"id":9,"chunk":{"off":1536,"len":192,"crc":41233,"data":"<base64>"}}
+ * crc is mb_crc16() of the raw bytes. At most "win" chunks are sent past
+ * the last acknowledged offset. The host acks what it has stored
+ * ({"cmd":"log_ack","off":N}); after a bad CRC or a gap it sends "nak":1
+ * with the first offset it is missing and the bridge resends from there.
+ * Without an ack for LT_RETRY_MS the bridge goes back to the acked
+ * offset by itself, and after LT_ABORT_MS it gives up (log_abort). An
+ * interrupted download resumes with get_log "off" = bytes already saved.
+ *
+ * Chunks have the lowest priority on the link: at most one per loop()
+ * pass, and only while no telemetry record is waiting and less than
+ * LT_BACKLOG bytes are queued, so live data and replies wait at most
+ * about one backlog (~90 ms at 115200 baud) behind a download.
+ * The size is taken at get_log; a log still being written is sent up to
+ * that point and fetched from there next time. For the live segment that
+ * is what the writer has put in it, not its preallocated size. Rows still in the SD
+ * writer's RAM buffers aren't on the card yet and follow the same way.
+ *
+ * A time window instead of the whole file: get_log with "from"/"to"
+ * (ts ms) is mapped to a block range by binary searching the log's .idx
+ * (log_format.h) with a handful of seeks, and the reply says where the
+ * window's schema block is:
+ *   {"log":"0007.dlg","size":4603904,"off":1228800,"end":1282048,"schema":4096,...}
+ * The host fetches [off, end), then the schema block alone with
+ * "off":schema,"end":schema+4096, and puts the two together as a valid
+ * .dlg. Without an index the window is the whole file.
+ */
+
+#ifndef LOG_TRANSFER_H
+#define LOG_TRANSFER_H
+
+#include <Arduino.h>
+#include "sd_logger.h"
+#include "modbus_rtu.h"
+#include "serial_protocol.h"
+
+#define LT_CHUNK        192     // Raw bytes per chunk (256 base64 characters)
+#define LT_WINDOW_MAX   16      // Chunks in flight
+#define LT_BACKLOG      1024    // TX bytes queued before chunks wait
+#define LT_LIST_MAX     16      // Files per ls_logs reply
+#define LT_NAME_MAX     32
+#define LT_RETRY_MS     2000    // No ack: resend from the acked offset
+#define LT_ABORT_MS     15000   // No ack: give up
+
+struct LogTransfer {
+    File file;
+    char name[LT_NAME_MAX];
+    uint32_t id;            // get_log request id, on every chunk
+    uint32_t size;          // End of the transfer, fixed when it starts
+    uint32_t acked;         // Host has every byte before this
+    uint32_t sent;          // Next byte to send
+    uint8_t window;         // Chunks allowed past acked
+    unsigned long lastAckMs;
+    unsigned long retryMs;
+    bool active;
+};
+
+// Plain file name inside /logs: no paths, no hidden files
+static bool lt_valid_name(const char *name) {
+    if (!name[0] || name[0] == '.' || strlen(name) >= LT_NAME_MAX) return false;
+    for (const char *p = name; *p; p++) {
+        bool ok = (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                  (*p >= '0' && *p <= '9') || *p == '_' || *p == '-' || *p == '.';
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static size_t lt_base64(const uint8_t *in, size_t n, char *out) {
+    static const char ALPHABET[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < n; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < n) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < n) v |= in[i + 2];
+        out[o++] = ALPHABET[(v >> 18) & 0x3F];
+        out[o++] = ALPHABET[(v >> 12) & 0x3F];
+        out[o++] = i + 1 < n ? ALPHABET[(v >> 6) & 0x3F] : '=';
+        out[o++] = i + 2 < n ? ALPHABET[v & 0x3F] : '=';
+    }
+    out[o] = '\0';
+    return o;
+}
+
+/**
+ * One page of the /logs listing:
+ *   {"logs":[{"name":"0007.dlg","size":4603904},...],"next":16}
+ * "next" is the start of the following page, -1 after the last file.
+ */
+static void lt_list(Print &out, int start) {
+    File dir;
+    if (sd_initialized) dir = SD.open("/logs");
+    if (!dir) {
+        out.printf("{\"logs\":[],\"next\":-1,\"error\":\"no sd\",\"rc\":%d}\n", RC_FAILED);
+        return;
+    }
+    out.print("{\"logs\":[");
+    int index = 0, listed = 0;
+    bool more = false;
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        if (f.isDirectory() || index++ < start) continue;
+        if (listed == LT_LIST_MAX) {
+            more = true;
+            break;
+        }
+        const char *name = strrchr(f.name(), '/');
+        name = name ? name + 1 : f.name();
+        out.printf("%s{\"name\":\"%s\",\"size\":%lu}", listed++ ? "," : "",
+                   name, (unsigned long)sd_log_size(name, f.size()));
+    }
+    out.printf("],\"next\":%d}\n", more ? start + listed : -1);
+}
+
+// The data blocks of name.dlg that can hold rows in [from, to], from its
+// .idx: *off and *end in bytes, *schema the schema block in effect at *off.
+// With no usable index the whole file is the window.
+static void lt_window(const char *name, uint32_t from, uint32_t to, uint32_t size,
+                      uint32_t *off, uint32_t *end, uint32_t *schema) {
+    *off = *schema = 0;
+    *end = size;
+    char path[LT_NAME_MAX + 8];
+    const char *dot = strrchr(name, '.');
+    if (!dot || strcmp(dot, ".dlg") != 0) return;
+    snprintf(path, sizeof(path), "/logs/%.*s.idx", (int)(dot - name), name);
+    File idx = SD.open(path, FILE_READ);
+    if (!idx) return;
+
+    uint32_t count = idx.size() / LF_IDX_ENTRY;
+    auto get = [&](uint32_t i, LfIdxEntry *e) {
+        uint8_t buf[LF_IDX_ENTRY];
+        if (!idx.seek((uint32_t)i * LF_IDX_ENTRY) ||
+            idx.read(buf, LF_IDX_ENTRY) != LF_IDX_ENTRY) return false;
+        lf_get_idx(buf, e);
+        return true;
+    };
+    LfIdxEntry e;
+    uint32_t first = lf_idx_find(count, from, get);
+    if (first && get(first - 1, &e) && e.block * LF_BLOCK_SIZE < size) {
+        *off = e.block * LF_BLOCK_SIZE;
+        *schema = e.schemaBlock * LF_BLOCK_SIZE;
+    }
+    uint32_t last = lf_idx_find(count, to, get);    // First entry starting after to
+    if (last < count && get(last, &e) && e.block * LF_BLOCK_SIZE > *off &&
+        e.block * LF_BLOCK_SIZE < size) {
+        *end = e.block * LF_BLOCK_SIZE;
+    }
+    idx.close();
+}
+
+static void lt_close(LogTransfer *t) {
+    if (t->file) t->file.close();
+    t->active = false;
+}
+
+/**
+ * Open /logs/name for download of [off, end) (end <= 0: to the end of
+ * the file); a new get_log replaces the running one. RC_BAD_ARGS for a
+ * bad name or offset, RC_FAILED if there is no card or no such file.
+ */
+static BridgeResult lt_start(LogTransfer *t, uint32_t id, const char *name, long off, long win,
+                             long end) {
+    lt_close(t);
+    if (!lt_valid_name(name) || off < 0) return RC_BAD_ARGS;
+    if (!sd_initialized) return RC_FAILED;
+
+    char path[LT_NAME_MAX + 8];
+    snprintf(path, sizeof(path), "/logs/%s", name);
+    t->file = SD.open(path, FILE_READ);
+    if (!t->file || t->file.isDirectory()) {
+        lt_close(t);
+        return RC_FAILED;
+    }
+    t->size = sd_log_size(name, t->file.size());
+    if (end > 0 && (unsigned long)end < t->size) t->size = end;
+    if ((unsigned long)off > t->size) {
+        lt_close(t);
+        return RC_BAD_ARGS;
+    }
+    strcpy(t->name, name);
+    t->id = id;
+    t->acked = t->sent = off;
+    t->window = win < 1 ? 1 : win > LT_WINDOW_MAX ? LT_WINDOW_MAX : win;
+    t->lastAckMs = t->retryMs = millis();
+    t->active = true;
+    return RC_OK;
+}
+
+/**
+ * The host has every byte before off; with nak it is missing off itself
+ * and everything from there is resent. Stale acks return false.
+ */
+static bool lt_ack(LogTransfer *t, long off, bool nak) {
+    if (!t->active || off < (long)t->acked || off > (long)t->sent) return false;
+    t->acked = off;
+    if (nak) t->sent = off;
+    t->lastAckMs = t->retryMs = millis();
+    return true;
+}
+
+/**
+ * Advance the download: log_done once everything is acked, log_abort
+ * after LT_ABORT_MS of silence, otherwise at most one chunk if the
+ * window has room and canSend (the link is idle enough).
+ */
+static void lt_poll(LogTransfer *t, Print &out, bool canSend) {
+    if (!t->active) return;
+    unsigned long now = millis();
+    if (t->acked >= t->size) {
+        out.printf("{\"log_done\":\"%s\",\"size\":%lu}\n", t->name, (unsigned long)t->size);
+        lt_close(t);
+        return;
+    }
+    if (now - t->lastAckMs >= LT_ABORT_MS) {
+        out.printf("{\"log_abort\":\"%s\",\"off\":%lu,\"rc\":%d}\n",
+                   t->name, (unsigned long)t->acked, RC_FAILED);
+        lt_close(t);
+        return;
+    }
+    if (t->sent > t->acked && now - t->retryMs >= LT_RETRY_MS) {
+        t->sent = t->acked;     // Chunks or acks lost: go back
+        t->retryMs = now;
+    }
+    if (!canSend || t->sent >= t->size ||
+        t->sent - t->acked >= (uint32_t)t->window * LT_CHUNK) return;
+
+    uint8_t buf[LT_CHUNK];
+    size_t n = t->size - t->sent < LT_CHUNK ? t->size - t->sent : LT_CHUNK;
+    if (t->file.position() != t->sent) t->file.seek(t->sent);
+    int got = t->file.read(buf, n);
+    if (got <= 0) {
+        out.printf("{\"log_abort\":\"%s\",\"off\":%lu,\"error\":\"read failed\",\"rc\":%d}\n",
+                   t->name, (unsigned long)t->sent, RC_FAILED);
+        lt_close(t);
+        return;
+    }
+    n = got;
+    char data[(LT_CHUNK + 2) / 3 * 4 + 1];
+    lt_base64(buf, n, data);
+    out.printf("{\"chunk\":{\"off\":%lu,\"len\":%u,\"crc\":%u,\"data\":\"",
+               (unsigned long)t->sent, (unsigned)n, mb_crc16(buf, n));
+    out.print(data);
+    out.println("\"}}");
+    t->sent += n;
+}
+
+#endif // LOG_TRANSFER_H
@@ -0,0 +1,73 @@
+/**
+ * @file modbus_devices.h
+ * Register maps and the slave list for the RS485 bus
+ *
+ * To add a device, append it to mb_slaves[] with its Modbus address,
+ * profile, poll interval and timeout. Every entry shows up as its own
+ * object in the bridge "dev" array.
+ */
+
+#ifndef MODBUS_DEVICES_H
+#define MODBUS_DEVICES_H
+
+#include "board_config.h"
+#include "modbus_master.h"
+
+#define MB_FIELD_COUNT(f) (uint8_t)(sizeof(f) / sizeof(f[0]))
+
+/* ══════════════════════════════════════════════════════════════
+ * WG-BC900M DC-DC CHARGER — 0x0200..0x020F read as one block
+ * ══════════════════════════════════════════════════════════════*/
+static const ModbusField CHARGER_FIELDS[] = {
+    // key      register       scale   signed
+    {"a_v",     REG_A_VOLT,    0.01f,  false},
+    {"a_a",     REG_A_CURR,    0.01f,  false},
+    {"v",       REG_B_VOLT,    0.01f,  false},
+    {"a",       REG_B_CURR,    0.01f,  false},
+    {"t1",      REG_TEMP_T1,   1.0f,   true},
+    {"t2",      REG_TEMP_T2,   1.0f,   true},
+    {"fault",   REG_FAULT,     1.0f,   false},
+    {"alarm",   REG_ALARM,     1.0f,   false},
+    {"amb",     REG_TEMP_AMB,  1.0f,   true},
+    {"status",  REG_STATUS,    1.0f,   false},
+};
+
+static const ModbusProfile PROFILE_WG_BC900M = {
+    "charger", MB_DEV_CHARGER, MB_FC_READ_HOLDING,
+    REG_A_VOLT, REG_STATUS - REG_A_VOLT + 1,
+    CHARGER_FIELDS, MB_FIELD_COUNT(CHARGER_FIELDS),
+};
+
+/* ══════════════════════════════════════════════════════════════
+ * BMS — generic map (see BMS_REG_* in board_config.h)
+ * ══════════════════════════════════════════════════════════════*/
+static const ModbusField BMS_FIELDS[] = {
+    {"v",       BMS_REG_PACK_VOLT,  0.01f,  false},
+    {"a",       BMS_REG_PACK_CURR,  0.01f,  true},
+    {"soc",     BMS_REG_SOC,        1.0f,   false},
+    {"cell_hi", BMS_REG_CELL_MAX,   0.001f, false},
+    {"cell_lo", BMS_REG_CELL_MIN,   0.001f, false},
+    {"temp",    BMS_REG_TEMP,       1.0f,   true},
+    {"fault",   BMS_REG_FAULT,      1.0f,   false},
+};
+
+static const ModbusProfile PROFILE_BMS = {
+    "bms", MB_DEV_BMS, MB_FC_READ_HOLDING,
+    BMS_REG_PACK_VOLT, BMS_REG_FAULT - BMS_REG_PACK_VOLT + 1,
+    BMS_FIELDS, MB_FIELD_COUNT(BMS_FIELDS),
+};
+
+/* ══════════════════════════════════════════════════════════════
+ * SLAVES ON THE BUS — polled round-robin, each at its own rate.
+ * The first charger is the primary one mirrored into VehicleData.
+ * ══════════════════════════════════════════════════════════════*/
+static ModbusSlave mb_slaves[] = {
+    // addr  profile              poll ms  timeout ms
+    {0x01,   &PROFILE_WG_BC900M,  500,     150},
+    // {0x02, &PROFILE_WG_BC900M, 500,     150},   // Second DC-DC charger
+    // {0x10, &PROFILE_BMS,       1000,    150},   // Battery management system
+};
+
+static const int MB_SLAVE_COUNT = sizeof(mb_slaves) / sizeof(mb_slaves[0]);
+
+#endif // MODBUS_DEVICES_H
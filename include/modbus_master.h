@@ -0,0 +1,244 @@
+/**
+ * @file modbus_master.h
+ * Modbus RTU master for the RS485 bus — several slaves, round-robin
+ *
+ * Every slave has a profile (register map) that is read as a single
+ * block per poll, plus its own poll interval and response timeout.
+ * mb_poll() is called from loop() and runs at most one transaction per
+ * call, starting after the slave served last, so a slow or missing
+ * device cannot starve the others. Slaves that stop answering are
+ * polled less often until they come back.
+ */
+
+#ifndef MODBUS_MASTER_H
+#define MODBUS_MASTER_H
+
+#include <Arduino.h>
+#include "modbus_rtu.h"
+
+#define MB_MAX_BLOCK_REGS   32
+#define MB_MAX_FIELDS       16
+#define MB_OFFLINE_AFTER    3       // Consecutive failures before a slave is offline
+#define MB_BACKOFF_FACTOR   4       // Poll interval multiplier while offline
+
+enum ModbusDeviceType {
+    MB_DEV_CHARGER = 0,
+    MB_DEV_BMS,
+};
+
+struct ModbusField {
+    const char *key;        // JSON key in the device section
+    uint16_t reg;           // Register address (inside the profile block)
+    float scale;            // Engineering value = raw × scale
+    bool isSigned;          // Raw register is two's complement
+};
+
+struct ModbusProfile {
+    const char *name;
+    ModbusDeviceType type;
+    uint8_t function;       // MB_FC_READ_HOLDING or MB_FC_READ_INPUT
+    uint16_t blockStart;    // First register read per poll
+    uint16_t blockCount;    // ≤ MB_MAX_BLOCK_REGS
+    const ModbusField *fields;
+    uint8_t fieldCount;     // ≤ MB_MAX_FIELDS
+};
+
+struct ModbusSlave {
+    uint8_t addr;
+    const ModbusProfile *profile;
+    uint16_t pollMs;
+    uint16_t timeoutMs;
+    // Runtime state
+    bool ok = false;
+    uint8_t failStreak = 0;
+    unsigned long lastPoll = 0;
+    uint32_t polls = 0;
+    uint32_t errors = 0;
+    float setA = -1;                        // Last current written (chargers)
+    uint16_t regs[MB_MAX_BLOCK_REGS] = {0}; // Raw block from the last good poll
+    float values[MB_MAX_FIELDS] = {0};      // Decoded fields, profile order
+};
+
+struct ModbusStats {
+    uint32_t ok;
+    uint32_t timeouts;
+    uint32_t crcErrors;
+    uint32_t exceptions;
+    uint32_t frameErrors;
+};
+
+static Stream *mb_port = NULL;
+static uint32_t mb_gap_us = 4010;               // Silent interval between frames
+static unsigned long mb_last_activity_us = 0;   // End of the last frame on the bus
+static uint16_t mb_error_streak = 0;            // Consecutive CRC/frame errors
+static ModbusSlave *mb_slave_list = NULL;
+static int mb_slave_count = 0;
+static int mb_next_slave = 0;
+static ModbusStats mb_stats = {0, 0, 0, 0, 0};
+static uint8_t mb_tx[MB_MAX_ADU];
+static uint8_t mb_rx[MB_MAX_ADU];
+
+static void mb_begin(Stream *port, ModbusSlave *slaves, int count) {
+    mb_port = port;
+    mb_slave_list = slaves;
+    mb_slave_count = count;
+    mb_next_slave = 0;
+}
+
+/**
+ * Set the inter-frame gap for a line rate. gapUs = 0 uses the Modbus
+ * t3.5 rule (3.5 character times, fixed 1750 µs above 19200 baud).
+ */
+static void mb_set_timing(uint32_t baud, bool parity, uint16_t gapUs) {
+    if (gapUs == 0) {
+        uint32_t bitsPerChar = parity ? 11 : 10;
+        gapUs = baud > 19200 ? 1750 : (uint16_t)(3500000UL * bitsPerChar / baud + 1);
+    }
+    mb_gap_us = gapUs;
+}
+
+/**
+ * Send the request in mb_tx and read until the response parses or
+ * the timeout expires. On MB_OK, resp->data points into mb_rx.
+ */
+static ModbusStatus mb_transact(size_t reqLen, uint8_t slave, uint8_t fn,
+                                ModbusFrame *resp, unsigned long timeoutMs) {
+    if (!mb_port || reqLen == 0) return MB_ERR_FRAME;
+
+    // Keep the bus silent for the inter-frame gap before transmitting
+    unsigned long idle = micros() - mb_last_activity_us;
+    if (idle < mb_gap_us) delayMicroseconds(mb_gap_us - idle);
+
+    while (mb_port->available()) mb_port->read();  // Drop stale bytes
+    mb_port->write(mb_tx, reqLen);
+    mb_port->flush();
+
+    size_t len = 0;
+    ModbusStatus st = MB_INCOMPLETE;
+    unsigned long t0 = millis();
+    while (st == MB_INCOMPLETE && millis() - t0 < timeoutMs) {
+        int n = mb_port->available();
+        if (n <= 0) {
+            yield();
+            continue;
+        }
+        if ((size_t)n > sizeof(mb_rx) - len) n = sizeof(mb_rx) - len;
+        len += mb_port->readBytes(mb_rx + len, n);
+        st = mb_parse_response(mb_rx, len, slave, fn, resp);
+        if (st == MB_INCOMPLETE && len == sizeof(mb_rx)) st = MB_ERR_FRAME;
+    }
+    mb_last_activity_us = micros();
+
+    if (st == MB_ERR_CRC || st == MB_ERR_FRAME) {
+        if (mb_error_streak < 0xFFFF) mb_error_streak++;
+    } else if (st != MB_INCOMPLETE) {
+        mb_error_streak = 0;
+    }
+
+    switch (st) {
+        case MB_OK:            mb_stats.ok++;          break;
+        case MB_INCOMPLETE:    mb_stats.timeouts++;    break;
+        case MB_ERR_CRC:       mb_stats.crcErrors++;   break;
+        case MB_ERR_EXCEPTION: mb_stats.exceptions++;  break;
+        default:               mb_stats.frameErrors++; break;
+    }
+    return st;
+}
+
+// Raw value of `reg` from the slave's last block, false if outside it
+static inline bool mb_slave_reg(const ModbusSlave *s, uint16_t reg, uint16_t *out) {
+    const ModbusProfile *p = s->profile;
+    if (reg < p->blockStart || reg >= p->blockStart + p->blockCount) return false;
+    *out = s->regs[reg - p->blockStart];
+    return true;
+}
+
+static void mb_decode_fields(ModbusSlave *s) {
+    const ModbusProfile *p = s->profile;
+    for (uint8_t i = 0; i < p->fieldCount && i < MB_MAX_FIELDS; i++) {
+        uint16_t raw;
+        if (!mb_slave_reg(s, p->fields[i].reg, &raw)) continue;
+        float v = p->fields[i].isSigned ? (float)(int16_t)raw : (float)raw;
+        s->values[i] = v * p->fields[i].scale;
+    }
+}
+
+// Read one slave's register block and update its state
+static bool mb_poll_slave(ModbusSlave *s) {
+    const ModbusProfile *p = s->profile;
+    s->lastPoll = millis();
+    s->polls++;
+
+    size_t n = mb_build_read(mb_tx, sizeof(mb_tx), s->addr, p->function,
+                             p->blockStart, p->blockCount);
+    ModbusFrame resp;
+    if (mb_transact(n, s->addr, p->function, &resp, s->timeoutMs) == MB_OK &&
+        resp.count == p->blockCount) {
+        for (uint16_t i = 0; i < resp.count && i < MB_MAX_BLOCK_REGS; i++) {
+            s->regs[i] = mb_reg(&resp, i);
+        }
+        mb_decode_fields(s);
+        s->ok = true;
+        s->failStreak = 0;
+        return true;
+    }
+
+    s->errors++;
+    if (s->failStreak < 255) s->failStreak++;
+    if (s->failStreak >= MB_OFFLINE_AFTER) s->ok = false;
+    return false;
+}
+
+/**
+ * Poll the next due slave (round-robin). Returns the slave that was
+ * polled, or NULL if none was due.
+ */
+static ModbusSlave *mb_poll() {
+    unsigned long now = millis();
+    for (int k = 0; k < mb_slave_count; k++) {
+        int i = (mb_next_slave + k) % mb_slave_count;
+        ModbusSlave *s = &mb_slave_list[i];
+
+        unsigned long interval = s->pollMs;
+        if (s->failStreak >= MB_OFFLINE_AFTER) interval *= MB_BACKOFF_FACTOR;
+        if (s->polls > 0 && now - s->lastPoll < interval) continue;
+
+        mb_next_slave = (i + 1) % mb_slave_count;
+        mb_poll_slave(s);
+        return s;
+    }
+    return NULL;
+}
+
+// Write a single register on a slave (0x06), verifying the echo
+static bool mb_write_register(uint8_t slave, uint16_t reg, uint16_t value,
+                              unsigned long timeoutMs) {
+    size_t n = mb_build_write_single(mb_tx, sizeof(mb_tx), slave, reg, value);
+    ModbusFrame resp;
+    return mb_transact(n, slave, MB_FC_WRITE_SINGLE, &resp, timeoutMs) == MB_OK &&
+           resp.addr == reg && resp.value == value;
+}
+
+// First slave of a given type (e.g. the primary charger), or NULL
+static ModbusSlave *mb_find(ModbusDeviceType type) {
+    for (int i = 0; i < mb_slave_count; i++) {
+        if (mb_slave_list[i].profile->type == type) return &mb_slave_list[i];
+    }
+    return NULL;
+}
+
+static ModbusSlave *mb_find_addr(uint8_t addr) {
+    for (int i = 0; i < mb_slave_count; i++) {
+        if (mb_slave_list[i].addr == addr) return &mb_slave_list[i];
+    }
+    return NULL;
+}
+
+static bool mb_any_ok() {
+    for (int i = 0; i < mb_slave_count; i++) {
+        if (mb_slave_list[i].ok) return true;
+    }
+    return false;
+}
+
+#endif // MODBUS_MASTER_H
@@ -0,0 +1,334 @@
+/**
+ * @file modbus_rtu.h
+ * Zero-copy Modbus RTU codec (header-only, no Arduino dependency)
+ *
+ * Builders write complete ADUs (address + PDU + CRC) into a caller
+ * buffer and return the frame length, or 0 if it does not fit.
+ * Parsers validate a received ADU in place and fill a ModbusFrame
+ * whose data pointer is a view into the caller's RX buffer.
+ *
+ * Supported functions:
+ *   0x03 Read Holding Registers     0x06 Write Single Register
+ *   0x04 Read Input Registers       0x10 Write Multiple Registers
+ *   + exception responses (function | 0x80)
+ *
+ * CRC16 (poly 0xA001, init 0xFFFF) uses a 256-entry table — one
+ * lookup per byte instead of eight shift/xor rounds.
+ */
+
+#ifndef MODBUS_RTU_H
+#define MODBUS_RTU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MB_FC_READ_HOLDING      0x03
+#define MB_FC_READ_INPUT        0x04
+#define MB_FC_WRITE_SINGLE      0x06
+#define MB_FC_WRITE_MULTIPLE    0x10
+#define MB_EXCEPTION_FLAG       0x80
+
+#define MB_MAX_ADU              256     // 1 addr + 253 PDU + 2 CRC
+#define MB_MAX_READ_REGS        125
+#define MB_MAX_WRITE_REGS       123
+#define MB_EXCEPTION_LEN        5       // addr, fc|0x80, code, crc lo, crc hi
+
+// Standard exception codes
+#define MB_EX_ILLEGAL_FUNCTION  0x01
+#define MB_EX_ILLEGAL_ADDRESS   0x02
+#define MB_EX_ILLEGAL_VALUE     0x03
+#define MB_EX_DEVICE_FAILURE    0x04
+
+enum ModbusStatus {
+    MB_OK = 0,
+    MB_INCOMPLETE,      // Need more bytes before the frame can be judged
+    MB_ERR_CRC,         // Length matched but CRC did not
+    MB_ERR_FRAME,       // Wrong slave/function/length field
+    MB_ERR_EXCEPTION,   // Valid exception response — see frame.exception
+};
+
+/**
+ * Decoded view of a Modbus ADU. No data is copied: `data` points into
+ * the buffer passed to the parser and is only valid as long as it is.
+ */
+struct ModbusFrame {
+    uint8_t slave;
+    uint8_t function;       // Function code without the exception bit
+    uint8_t exception;      // Exception code (0 = none)
+    uint16_t addr;          // Start register (requests, write echoes)
+    uint16_t count;         // Register count (reads, 0x10)
+    uint16_t value;         // Register value (0x06)
+    const uint8_t *data;    // Big-endian register words (reads, 0x10 request)
+};
+
+/* ══════════════════════════════════════════════════════════════
+ * CRC16
+ * ══════════════════════════════════════════════════════════════*/
+static const uint16_t MB_CRC_TABLE[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+// CRC16/MODBUS. The result goes on the wire low byte first.
+static inline uint16_t mb_crc16(const uint8_t *buf, size_t len) {
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc = (crc >> 8) ^ MB_CRC_TABLE[(crc ^ *buf++) & 0xFF];
+    }
+    return crc;
+}
+
+static inline void mb_put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v & 0xFF);
+}
+
+static inline uint16_t mb_get_u16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Append CRC to a frame of `len` bytes, returns the new length
+static inline size_t mb_append_crc(uint8_t *buf, size_t len) {
+    uint16_t crc = mb_crc16(buf, len);
+    buf[len]     = (uint8_t)(crc & 0xFF);
+    buf[len + 1] = (uint8_t)(crc >> 8);
+    return len + 2;
+}
+
+static inline bool mb_check_crc(const uint8_t *buf, size_t len) {
+    if (len < 4) return false;
+    uint16_t crc = mb_crc16(buf, len - 2);
+    return buf[len - 2] == (crc & 0xFF) && buf[len - 1] == (crc >> 8);
+}
+
+// Register i (0-based) of a decoded read response or 0x10 request
+static inline uint16_t mb_reg(const ModbusFrame *f, uint16_t i) {
+    return mb_get_u16(f->data + 2 * i);
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * MASTER SIDE — request builders
+ * ══════════════════════════════════════════════════════════════*/
+
+// 0x03 / 0x04: read `count` registers starting at `addr`
+static inline size_t mb_build_read(uint8_t *buf, size_t cap, uint8_t slave,
+                                   uint8_t fn, uint16_t addr, uint16_t count) {
+    if (cap < 8 || count == 0 || count > MB_MAX_READ_REGS) return 0;
+    if (fn != MB_FC_READ_HOLDING && fn != MB_FC_READ_INPUT) return 0;
+    buf[0] = slave;
+    buf[1] = fn;
+    mb_put_u16(buf + 2, addr);
+    mb_put_u16(buf + 4, count);
+    return mb_append_crc(buf, 6);
+}
+
+// 0x06: write one register
+static inline size_t mb_build_write_single(uint8_t *buf, size_t cap, uint8_t slave,
+                                           uint16_t addr, uint16_t value) {
+    if (cap < 8) return 0;
+    buf[0] = slave;
+    buf[1] = MB_FC_WRITE_SINGLE;
+    mb_put_u16(buf + 2, addr);
+    mb_put_u16(buf + 4, value);
+    return mb_append_crc(buf, 6);
+}
+
+// 0x10: write `count` consecutive registers
+static inline size_t mb_build_write_multiple(uint8_t *buf, size_t cap, uint8_t slave,
+                                             uint16_t addr, const uint16_t *values,
+                                             uint16_t count) {
+    size_t len = 7 + 2 * (size_t)count;
+    if (count == 0 || count > MB_MAX_WRITE_REGS || cap < len + 2) return 0;
+    buf[0] = slave;
+    buf[1] = MB_FC_WRITE_MULTIPLE;
+    mb_put_u16(buf + 2, addr);
+    mb_put_u16(buf + 4, count);
+    buf[6] = (uint8_t)(2 * count);
+    for (uint16_t i = 0; i < count; i++) {
+        mb_put_u16(buf + 7 + 2 * i, values[i]);
+    }
+    return mb_append_crc(buf, len);
+}
+
+// Length of a normal (non-exception) response to a request
+static inline size_t mb_response_length(uint8_t fn, uint16_t count) {
+    switch (fn) {
+        case MB_FC_READ_HOLDING:
+        case MB_FC_READ_INPUT:     return 5 + 2 * (size_t)count;
+        case MB_FC_WRITE_SINGLE:
+        case MB_FC_WRITE_MULTIPLE: return 8;
+        default:                   return 0;
+    }
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * MASTER SIDE — response parser
+ * Call as bytes arrive; MB_INCOMPLETE means keep reading.
+ * ══════════════════════════════════════════════════════════════*/
+static inline ModbusStatus mb_parse_response(const uint8_t *buf, size_t len,
+                                             uint8_t slave, uint8_t fn,
+                                             ModbusFrame *out) {
+    if (len < 2) return MB_INCOMPLETE;
+    if (buf[0] != slave) return MB_ERR_FRAME;
+
+    out->slave = buf[0];
+    out->function = buf[1] & ~MB_EXCEPTION_FLAG;
+    out->exception = 0;
+    out->addr = out->count = out->value = 0;
+    out->data = NULL;
+
+    if (buf[1] == (fn | MB_EXCEPTION_FLAG)) {
+        if (len < MB_EXCEPTION_LEN) return MB_INCOMPLETE;
+        if (!mb_check_crc(buf, MB_EXCEPTION_LEN)) return MB_ERR_CRC;
+        out->exception = buf[2];
+        return MB_ERR_EXCEPTION;
+    }
+    if (buf[1] != fn) return MB_ERR_FRAME;
+
+    switch (fn) {
+        case MB_FC_READ_HOLDING:
+        case MB_FC_READ_INPUT: {
+            if (len < 3) return MB_INCOMPLETE;
+            uint8_t byteCount = buf[2];
+            if (byteCount & 1) return MB_ERR_FRAME;
+            size_t need = 5 + (size_t)byteCount;
+            if (len < need) return MB_INCOMPLETE;
+            if (!mb_check_crc(buf, need)) return MB_ERR_CRC;
+            out->count = byteCount / 2;
+            out->data = buf + 3;
+            return MB_OK;
+        }
+        case MB_FC_WRITE_SINGLE:
+        case MB_FC_WRITE_MULTIPLE:
+            if (len < 8) return MB_INCOMPLETE;
+            if (!mb_check_crc(buf, 8)) return MB_ERR_CRC;
+            out->addr = mb_get_u16(buf + 2);
+            if (fn == MB_FC_WRITE_SINGLE) out->value = mb_get_u16(buf + 4);
+            else                          out->count = mb_get_u16(buf + 4);
+            return MB_OK;
+        default:
+            return MB_ERR_FRAME;
+    }
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * SLAVE SIDE — request parser + response builders
+ * Used by host tools that emulate a charger on the bus.
+ * ══════════════════════════════════════════════════════════════*/
+static inline ModbusStatus mb_parse_request(const uint8_t *buf, size_t len,
+                                            ModbusFrame *out) {
+    if (len < 2) return MB_INCOMPLETE;
+
+    out->slave = buf[0];
+    out->function = buf[1];
+    out->exception = 0;
+    out->addr = out->count = out->value = 0;
+    out->data = NULL;
+
+    size_t need;
+    switch (buf[1]) {
+        case MB_FC_READ_HOLDING:
+        case MB_FC_READ_INPUT:
+        case MB_FC_WRITE_SINGLE:
+            need = 8;
+            break;
+        case MB_FC_WRITE_MULTIPLE:
+            if (len < 7) return MB_INCOMPLETE;
+            need = 9 + (size_t)buf[6];
+            break;
+        default:
+            return MB_ERR_FRAME;
+    }
+    if (len < need) return MB_INCOMPLETE;
+    if (!mb_check_crc(buf, need)) return MB_ERR_CRC;
+
+    out->addr = mb_get_u16(buf + 2);
+    if (buf[1] == MB_FC_WRITE_SINGLE) {
+        out->value = mb_get_u16(buf + 4);
+    } else {
+        out->count = mb_get_u16(buf + 4);
+    }
+    if (buf[1] == MB_FC_WRITE_MULTIPLE) {
+        if (buf[6] != 2 * out->count) return MB_ERR_FRAME;
+        out->data = buf + 7;
+    }
+    return MB_OK;
+}
+
+// Number of bytes a complete request starting at buf occupies (0 = unknown yet)
+static inline size_t mb_request_length(const uint8_t *buf, size_t len) {
+    if (len < 2) return 0;
+    switch (buf[1]) {
+        case MB_FC_READ_HOLDING:
+        case MB_FC_READ_INPUT:
+        case MB_FC_WRITE_SINGLE:   return 8;
+        case MB_FC_WRITE_MULTIPLE: return len < 7 ? 0 : 9 + (size_t)buf[6];
+        default:                   return 0;
+    }
+}
+
+static inline size_t mb_build_read_response(uint8_t *buf, size_t cap, uint8_t slave,
+                                            uint8_t fn, const uint16_t *regs,
+                                            uint16_t count) {
+    size_t len = 3 + 2 * (size_t)count;
+    if (count == 0 || count > MB_MAX_READ_REGS || cap < len + 2) return 0;
+    buf[0] = slave;
+    buf[1] = fn;
+    buf[2] = (uint8_t)(2 * count);
+    for (uint16_t i = 0; i < count; i++) {
+        mb_put_u16(buf + 3 + 2 * i, regs[i]);
+    }
+    return mb_append_crc(buf, len);
+}
+
+// Echo response for 0x06 (value) and 0x10 (count)
+static inline size_t mb_build_write_response(uint8_t *buf, size_t cap, uint8_t slave,
+                                             uint8_t fn, uint16_t addr, uint16_t valueOrCount) {
+    if (cap < 8) return 0;
+    buf[0] = slave;
+    buf[1] = fn;
+    mb_put_u16(buf + 2, addr);
+    mb_put_u16(buf + 4, valueOrCount);
+    return mb_append_crc(buf, 6);
+}
+
+static inline size_t mb_build_exception(uint8_t *buf, size_t cap, uint8_t slave,
+                                        uint8_t fn, uint8_t code) {
+    if (cap < MB_EXCEPTION_LEN) return 0;
+    buf[0] = slave;
+    buf[1] = fn | MB_EXCEPTION_FLAG;
+    buf[2] = code;
+    return mb_append_crc(buf, 3);
+}
+
+#endif // MODBUS_RTU_H
@@ -0,0 +1,125 @@
+/**
+ * @file nvs_settings.h
+ * Runtime settings persisted in NVS (ESP32 Preferences)
+ * Compile-time values in board_config.h are the defaults.
+ * Keys are short because NVS limits them to 15 characters.
+ */
+
+#ifndef NVS_SETTINGS_H
+#define NVS_SETTINGS_H
+
+#include <Preferences.h>
+#include "board_config.h"
+
+#define SETTINGS_NAMESPACE "dashcfg"
+#define TRIP_NAMESPACE     "trip"       // Trip totals (trip_stats.h), written far more often
+
+struct Settings {
+    // RS485 / Modbus
+    uint32_t rs485Baud = RS485_BAUD;
+    char rs485Parity = 'N';         // 'N', 'E' or 'O'
+    uint16_t rs485GapUs = 0;        // Inter-frame delay, 0 = auto (3.5 chars)
+    bool rs485AutoBaud = false;     // Probe at boot + fall back on CRC errors
+    // Charge controller
+    float chargeMinA = 12.0f;
+    float chargeMaxA = 30.0f;
+    float chargeRampUp = 0.5f;      // A/s
+    float chargeRampDown = 4.0f;    // A/s
+    float chargeDeadband = 0.5f;    // A
+    // Logging
+    uint32_t logIntervalMs = 1000;  // SD log row interval
+    uint32_t logCommitMs = 30000;   // Most a power cut may lose (SD_COMMIT_MS)
+    bool logCan = false;            // CAN frames to /logs/NNNN.can
+    uint16_t logSegmentMB = 16;     // Log segment size (SD_SEGMENT_MB)
+    uint16_t logSegmentMin = 60;    // Log segment age (SD_SEGMENT_MIN)
+    uint32_t logMinFreeMB = 512;    // Oldest segments deleted below this (SD_MIN_FREE_MB)
+    // Event captures (log_capture.h)
+    uint16_t capPeriodMs = 50;      // Ring sample period (LC_PERIOD_MS)
+    uint16_t capPreS = 20;          // Seconds kept before a trigger
+    uint16_t capPostS = 10;         // Seconds recorded after it
+    char capRules[128] = "chg.fault&0x40,chg.t1>80,chg.t2>80,dtc";   // LC_RULES_DEFAULT
+    // Bridge link
+    uint32_t bridgeBaud = BRIDGE_BAUD;  // Last rate confirmed with baud_ok
+};
+
+static Settings settings;
+static Preferences prefs;
+
+static void settings_load() {
+    prefs.begin(SETTINGS_NAMESPACE, true);
+    settings.rs485Baud     = prefs.getUInt("rs_baud", RS485_BAUD);
+    settings.rs485Parity   = (char)prefs.getUChar("rs_parity", 'N');
+    settings.rs485GapUs    = prefs.getUShort("rs_gap", 0);
+    settings.rs485AutoBaud = prefs.getBool("rs_auto", false);
+    settings.chargeMinA     = prefs.getFloat("chg_min", 12.0f);
+    settings.chargeMaxA     = prefs.getFloat("chg_max", 30.0f);
+    settings.chargeRampUp   = prefs.getFloat("chg_up", 0.5f);
+    settings.chargeRampDown = prefs.getFloat("chg_down", 4.0f);
+    settings.chargeDeadband = prefs.getFloat("chg_db", 0.5f);
+    settings.logIntervalMs  = prefs.getUInt("log_ms", 1000);
+    settings.logCommitMs    = prefs.getUInt("log_commit", 30000);
+    settings.logCan         = prefs.getBool("log_can", false);
+    settings.logSegmentMB   = prefs.getUShort("log_seg_mb", 16);
+    settings.logSegmentMin  = prefs.getUShort("log_seg_min", 60);
+    settings.logMinFreeMB   = prefs.getUInt("log_min_free", 512);
+    settings.capPeriodMs    = prefs.getUShort("cap_ms", 50);
+    settings.capPreS        = prefs.getUShort("cap_pre", 20);
+    settings.capPostS       = prefs.getUShort("cap_post", 10);
+    if (prefs.isKey("cap_rules")) prefs.getString("cap_rules", settings.capRules, sizeof(settings.capRules));
+    settings.bridgeBaud     = prefs.getUInt("br_baud", BRIDGE_BAUD);
+    prefs.end();
+}
+
+static void settings_save() {
+    prefs.begin(SETTINGS_NAMESPACE, false);
+    prefs.putUInt("rs_baud", settings.rs485Baud);
+    prefs.putUChar("rs_parity", (uint8_t)settings.rs485Parity);
+    prefs.putUShort("rs_gap", settings.rs485GapUs);
+    prefs.putBool("rs_auto", settings.rs485AutoBaud);
+    prefs.putFloat("chg_min", settings.chargeMinA);
+    prefs.putFloat("chg_max", settings.chargeMaxA);
+    prefs.putFloat("chg_up", settings.chargeRampUp);
+    prefs.putFloat("chg_down", settings.chargeRampDown);
+    prefs.putFloat("chg_db", settings.chargeDeadband);
+    prefs.putUInt("log_ms", settings.logIntervalMs);
+    prefs.putUInt("log_commit", settings.logCommitMs);
+    prefs.putBool("log_can", settings.logCan);
+    prefs.putUShort("log_seg_mb", settings.logSegmentMB);
+    prefs.putUShort("log_seg_min", settings.logSegmentMin);
+    prefs.putUInt("log_min_free", settings.logMinFreeMB);
+    prefs.putUShort("cap_ms", settings.capPeriodMs);
+    prefs.putUShort("cap_pre", settings.capPreS);
+    prefs.putUShort("cap_post", settings.capPostS);
+    prefs.putString("cap_rules", settings.capRules);
+    prefs.putUInt("br_baud", settings.bridgeBaud);
+    prefs.end();
+}
+
+/**
+ * A struct stored whole under ns/key. False if it isn't there or has
+ * another size (written by a different build).
+ */
+static bool nvs_load_blob(const char *ns, const char *key, void *out, size_t len) {
+    prefs.begin(ns, true);
+    bool ok = prefs.getBytesLength(key) == len && prefs.getBytes(key, out, len) == len;
+    prefs.end();
+    return ok;
+}
+
+// A blob of any size up to len; its size, 0 if there is none or it is larger
+static size_t nvs_load_blob_upto(const char *ns, const char *key, void *out, size_t len) {
+    prefs.begin(ns, true);
+    size_t size = prefs.getBytesLength(key);
+    bool ok = size && size <= len && prefs.getBytes(key, out, size) == size;
+    prefs.end();
+    return ok ? size : 0;
+}
+
+static bool nvs_save_blob(const char *ns, const char *key, const void *data, size_t len) {
+    prefs.begin(ns, false);
+    bool ok = prefs.putBytes(key, data, len) == len;
+    prefs.end();
+    return ok;
+}
+
+#endif // NVS_SETTINGS_H
@@ -50,7 +50,8 @@ static inline void decodeDTC(uint8_t byte1, uint8_t byte2, char *out) {
 }
 
 // Read DTCs using Mode 03 (stored) or Mode 07 (pending)
-static DTCResult readDTCs(uint8_t mode) {
+// progress (optional) follows the 1 s collection window, 0–100
+static DTCResult readDTCs(uint8_t mode, volatile uint8_t *progress = NULL) {
     DTCResult result;
     result.count = 0;
     result.success = false;
@@ -69,6 +70,7 @@ static DTCResult readDTCs(uint8_t mode) {
     twai_message_t rx;
     unsigned long t0 = millis();
     while (millis() - t0 < 1000 && result.count < MAX_DTCS) {
+        if (progress) *progress = (millis() - t0) / 10;
         if (twai_receive(&rx, pdMS_TO_TICKS(100)) == ESP_OK) {
             if (rx.identifier >= 0x7E8 && rx.identifier <= 0x7EF) {
                 // Response: [num_bytes, mode+0x40, DTC1_hi, DTC1_lo, DTC2_hi, DTC2_lo, ...]
@@ -93,7 +95,8 @@ static DTCResult readDTCs(uint8_t mode) {
 
 // Clear DTCs and reset MIL (Mode 04)
 // WARNING: This clears all stored DTCs and resets monitors!
-static bool clearDTCs() {
+// progress (optional) follows the 2 s confirmation window, 0–100
+static bool clearDTCs(volatile uint8_t *progress = NULL) {
     twai_message_t tx;
     memset(&tx, 0, sizeof(tx));
     tx.identifier = 0x7DF;
@@ -107,6 +110,7 @@ static bool clearDTCs() {
     twai_message_t rx;
     unsigned long t0 = millis();
     while (millis() - t0 < 2000) {
+        if (progress) *progress = (millis() - t0) / 20;
         if (twai_receive(&rx, pdMS_TO_TICKS(100)) == ESP_OK) {
             if (rx.identifier >= 0x7E8 && rx.identifier <= 0x7EF) {
                 if (rx.data[1] == 0x44) return true;  // 0x04 + 0x40
@@ -0,0 +1,294 @@
+/**
+ * @file obd_scheduler.h
+ * Per-PID OBD-II polling schedule, driven by host subscriptions
+ *
+ * Every polled PID has a period; each loop pass queries the single most
+ * overdue one, so CAN bus time follows the rates actually asked for.
+ * A PID's period is the fastest of:
+ *   - the firmware floor (speed/RPM/coolant feed the charge controller,
+ *     load and fuel the trip computer; the standalone dashboard keeps
+ *     every record field at 500 ms),
+ *   - the host subscription ({"cmd":"subscribe","rates":{"rpm":20}}),
+ *   - 500 ms for every record field while the host has no subscription
+ *     (same stream as before subscriptions existed).
+ * PIDs that stop answering back off to OBD_UNSUPPORTED_MS.
+ *
+ * Besides the fixed record fields (OBD_SIGNALS) the host may subscribe
+ * to any Mode 01 PID from obd2_pids.h by hex id ("0x46"); those are
+ * decoded with the table's scale/offset and streamed under that key.
+ */
+
+#ifndef OBD_SCHEDULER_H
+#define OBD_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "obd2_pids.h"
+#include "vehicle_data.h"
+
+#define OBD_MAX_SLOTS        24
+#define OBD_DEFAULT_MS       500     // Record fields when nothing is subscribed
+#define OBD_CHARGE_FLOOR_MS  500     // Inputs of the charge controller
+#define OBD_TRIP_FLOOR_MS    1000    // Inputs of the trip computer (trip_stats.h)
+#define OBD_MIN_PERIOD_MS    50      // Fastest subscription (20 Hz)
+#define OBD_FAILS_UNSUPPORTED 3
+#define OBD_UNSUPPORTED_MS   10000
+
+// Fixed telemetry record fields ("obd" section), in record order
+struct ObdSignal {
+    const char *key;
+    uint8_t pid;
+    uint8_t bytes;
+    uint8_t decimals;       // Digits streamed after the point
+    int16_t deadband;       // Binary delta deadband, in streamed units
+};
+
+static const ObdSignal OBD_SIGNALS[] = {
+    {"spd",       0x0D, 1, 0, 0},
+    {"rpm",       0x0C, 2, 0, 1},
+    {"ect",       0x05, 1, 0, 0},
+    {"thr",       0x11, 1, 0, 0},
+    {"load",      0x04, 1, 0, 0},
+    {"fuel_rate", 0x5E, 2, 2, 5},
+    {"fuel_lvl",  0x2F, 1, 1, 5},
+    {"maf",       0x10, 2, 2, 10},
+    {"iat",       0x0F, 1, 0, 0},
+    {"oil_t",     0x5C, 1, 0, 0},
+    {"timing",    0x0E, 1, 1, 0},
+    {"o2v",       0x14, 2, 3, 5},
+    {"fuel_pres", 0x0A, 1, 0, 0},
+};
+
+static const int OBD_SIGNAL_COUNT = sizeof(OBD_SIGNALS) / sizeof(OBD_SIGNALS[0]);
+
+struct ObdSlot {
+    uint8_t pid;
+    uint8_t bytes;
+    int8_t signal;          // Index into OBD_SIGNALS, -1 = extra PID
+    char key[6];            // "0x46" for extra PIDs
+    uint16_t floorMs;       // Firmware minimum (0 = none)
+    uint16_t subMs;         // Host subscription (0 = none)
+    uint32_t lastPoll;
+    uint8_t fails;
+    float value;            // Decoded value (extra PIDs)
+};
+
+struct ObdScheduler {
+    ObdSlot slots[OBD_MAX_SLOTS];
+    int count;
+    bool subscribed;        // Host has an active subscription set
+    uint32_t lastRxMs;      // Last PID that answered
+};
+
+/* ══════════════════════════════════════════════════════════════
+ * DECODING — raw reply → VehicleData (-1 = no reply)
+ * ══════════════════════════════════════════════════════════════*/
+
+static void obd_apply(VehicleData *d, uint8_t pid, int32_t raw) {
+    bool ok = raw >= 0;
+    switch (pid) {
+        case 0x0D: d->speed = ok ? raw : -1; break;
+        case 0x0C: d->rpm = ok ? raw / 4 : -1; break;
+        case 0x05: d->ect = ok ? raw - 40 : -1; break;
+        case 0x11: d->throttle = ok ? (raw * 100) / 255 : -1; break;
+        case 0x04: d->load = ok ? (raw * 100) / 255 : -1; break;
+        case 0x5E: d->fuelRate = ok ? raw * 0.05f : -1; break;
+        case 0x2F: d->fuelLevel = ok ? (raw * 100.0f) / 255.0f : -1; break;
+        case 0x10: d->maf = ok ? raw * 0.01f : -1; break;
+        case 0x0F: d->intakeAirTemp = ok ? raw - 40 : -40; break;
+        case 0x5C: d->oilTemp = ok ? raw - 40 : -40; break;
+        case 0x0E: d->timingAdv = ok ? raw * 0.5f - 64.0f : 0; break;
+        case 0x14: d->o2Voltage = ok ? (raw >> 8) * 0.005f : -1; break;   // Byte A only
+        case 0x0A: d->fuelPressure = ok ? raw * 3 : -1; break;
+        default: break;
+    }
+}
+
+// Current value of a record field, for the serializers
+static float obd_signal_value(const VehicleData *d, uint8_t pid) {
+    switch (pid) {
+        case 0x0D: return d->speed;
+        case 0x0C: return d->rpm;
+        case 0x05: return d->ect;
+        case 0x11: return d->throttle;
+        case 0x04: return d->load;
+        case 0x5E: return d->fuelRate;
+        case 0x2F: return d->fuelLevel;
+        case 0x10: return d->maf;
+        case 0x0F: return d->intakeAirTemp;
+        case 0x5C: return d->oilTemp;
+        case 0x0E: return d->timingAdv;
+        case 0x14: return d->o2Voltage;
+        case 0x0A: return d->fuelPressure;
+        default:   return -1;
+    }
+}
+
+static const OBD2_PID *obd_pid_info(uint8_t pid) {
+    for (int i = 0; i < MODE01_PID_COUNT; i++) {
+        if (MODE01_PIDS[i].pid == pid) return &MODE01_PIDS[i];
+    }
+    return NULL;
+}
+
+// Decimals worth streaming for a table PID, from its scale
+static uint8_t obd_pid_decimals(const OBD2_PID *info) {
+    if (info->scale < 0.01f) return 3;
+    if (info->scale < 0.1f) return 2;
+    if (info->scale < 1.0f) return 1;
+    return 0;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * SCHEDULE
+ * ══════════════════════════════════════════════════════════════*/
+
+static void obd_sched_init(ObdScheduler *s, bool standalone) {
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; i < OBD_SIGNAL_COUNT; i++) {
+        ObdSlot *slot = &s->slots[s->count++];
+        slot->pid = OBD_SIGNALS[i].pid;
+        slot->bytes = OBD_SIGNALS[i].bytes;
+        slot->signal = (int8_t)i;
+        if (standalone) slot->floorMs = OBD_DEFAULT_MS;
+        if (!standalone && (slot->pid == 0x04 || slot->pid == 0x5E || slot->pid == 0x10)) {
+            slot->floorMs = OBD_TRIP_FLOOR_MS;
+        }
+        if (slot->pid == 0x0D || slot->pid == 0x0C || slot->pid == 0x05) {
+            slot->floorMs = OBD_CHARGE_FLOOR_MS;
+        }
+    }
+}
+
+// Effective poll period in ms, 0 = not polled
+static uint32_t obd_slot_period(const ObdScheduler *s, const ObdSlot *slot) {
+    uint32_t p = 0;
+    uint32_t candidates[] = {
+        slot->floorMs,
+        slot->subMs,
+        (uint32_t)(!s->subscribed && slot->signal >= 0 ? OBD_DEFAULT_MS : 0),
+    };
+    for (uint32_t c : candidates) {
+        if (c && (!p || c < p)) p = c;
+    }
+    if (p && slot->fails >= OBD_FAILS_UNSUPPORTED) p = OBD_UNSUPPORTED_MS;
+    return p;
+}
+
+// Record field i goes out in telemetry (all of them until a subscription)
+static bool obd_signal_streamed(const ObdScheduler *s, int i) {
+    if (!s || !s->subscribed) return true;
+    return s->slots[i].subMs > 0;
+}
+
+/**
+ * Most overdue slot, or NULL if nothing is due yet.
+ * Call obd_sched_result() with the reply before asking again.
+ */
+static ObdSlot *obd_sched_next(ObdScheduler *s, uint32_t now) {
+    ObdSlot *best = NULL;
+    int32_t bestLate = -1;
+    for (int i = 0; i < s->count; i++) {
+        ObdSlot *slot = &s->slots[i];
+        uint32_t period = obd_slot_period(s, slot);
+        if (!period) continue;
+        int32_t late = (int32_t)(now - slot->lastPoll - period);
+        if (late >= 0 && late > bestLate) {
+            bestLate = late;
+            best = slot;
+        }
+    }
+    return best;
+}
+
+static void obd_sched_result(ObdScheduler *s, ObdSlot *slot, int32_t raw,
+                             uint32_t now, VehicleData *d) {
+    slot->lastPoll = now;
+    if (raw < 0) {
+        if (slot->fails < 255) slot->fails++;
+    } else {
+        slot->fails = 0;
+        s->lastRxMs = now;
+    }
+    if (slot->signal >= 0) {
+        obd_apply(d, slot->pid, raw);
+    } else {
+        const OBD2_PID *info = obd_pid_info(slot->pid);
+        slot->value = raw >= 0 && info ? raw * info->scale + info->offset : -1;
+    }
+}
+
+// Record fields that are no longer polled read as "no data", not stale values
+static void obd_sched_clear_idle(ObdScheduler *s, VehicleData *d) {
+    for (int i = 0; i < OBD_SIGNAL_COUNT; i++) {
+        if (!obd_slot_period(s, &s->slots[i])) obd_apply(d, s->slots[i].pid, -1);
+    }
+}
+
+/**
+ * Subscribe one signal: a record key ("rpm") or a Mode 01 PID ("0x46").
+ * hz <= 0 removes it. Returns false for unknown signals or a full table.
+ */
+static bool obd_subscribe(ObdScheduler *s, const char *key, float hz) {
+    uint16_t ms = 0;
+    if (hz > 0) {
+        float p = 1000.0f / hz;
+        ms = p < OBD_MIN_PERIOD_MS ? OBD_MIN_PERIOD_MS : p > 60000 ? 60000 : (uint16_t)p;
+    }
+
+    for (int i = 0; i < OBD_SIGNAL_COUNT; i++) {
+        if (strcmp(OBD_SIGNALS[i].key, key) == 0) {
+            s->slots[i].subMs = ms;
+            s->subscribed = true;
+            return true;
+        }
+    }
+
+    if (strncmp(key, "0x", 2) != 0) return false;
+    uint8_t pid = (uint8_t)strtol(key + 2, NULL, 16);
+    const OBD2_PID *info = obd_pid_info(pid);
+    if (!info) return false;
+
+    // A record field by PID number
+    for (int i = 0; i < s->count; i++) {
+        if (s->slots[i].pid == pid) {
+            s->slots[i].subMs = ms;
+            s->subscribed = true;
+            return true;
+        }
+    }
+    if (!ms) return true;
+    if (s->count >= OBD_MAX_SLOTS) return false;
+
+    ObdSlot *slot = &s->slots[s->count++];
+    memset(slot, 0, sizeof(*slot));
+    slot->pid = pid;
+    slot->bytes = info->bytes > 2 ? 2 : info->bytes;
+    slot->signal = -1;
+    snprintf(slot->key, sizeof(slot->key), "0x%02X", pid);
+    slot->subMs = ms;
+    slot->value = -1;
+    s->subscribed = true;
+    return true;
+}
+
+// Drop every host subscription: back to the default record at 500 ms
+static void obd_unsubscribe_all(ObdScheduler *s) {
+    s->count = OBD_SIGNAL_COUNT;
+    for (int i = 0; i < s->count; i++) s->slots[i].subMs = 0;
+    s->subscribed = false;
+}
+
+// Fastest subscribed period, for the telemetry rate (0 = none)
+static uint32_t obd_fastest_sub_ms(const ObdScheduler *s) {
+    uint32_t best = 0;
+    for (int i = 0; i < s->count; i++) {
+        uint32_t ms = s->slots[i].subMs;
+        if (ms && (!best || ms < best)) best = ms;
+    }
+    return best;
+}
+
+#endif // OBD_SCHEDULER_H
@@ -1,7 +1,59 @@
 /**
  * @file sd_logger.h
- * SD Card initialization and CSV data logging
+ * SD Card initialization and data logging
  * Uses SPI interface with IO expander chip select (EXIO4)
+ *
+ * Records go to /logs/NNNN.dlg in the binary columnar format of
+ * log_format.h: every field of the telemetry record, packed into 4 KB
+ * blocks. Rows never touch the card from loop(): sd_log_data() adds
+ * them to the current log block, and a full block is copied into one of
+ * two SD_BLOCK_SIZE buffers (PSRAM when fitted). A full buffer is handed
+ * to a writer task on core 0, which writes it in one go while loop()
+ * fills the other. If the card stalls long enough for the second buffer
+ * to fill too (wear levelling can take hundreds of ms), blocks are
+ * dropped and their rows counted instead of waiting.
+ *
+ * Power is cut with the ignition, so sd_close() usually never runs. What
+ * a cut can lose is bounded by the commit window (sd_set_commit(),
+ * SD_COMMIT_MS by default): a block is sealed and handed to the writer
+ * when it is full or its first row is that old, whichever comes first,
+ * and every buffer write is followed by a flush, which also updates the
+ * file size in the FAT. A shorter window costs card space, as each
+ * early block leaves the rest of its 4 KB unused. Every block carries a
+ * CRC commit marker (log_format.h); at boot sd_recover_log() checks the
+ * last session's tail and cuts off only what a torn write left there.
+ *
+ * Each buffer also carries the .idx entries (log_format.h) of the data
+ * blocks in it; the writer appends them to /logs/NNNN.idx right after
+ * the buffer itself reached the card, so the index never points past
+ * the end of the log.
+ *
+ * A log is cut into numbered segments: the next one starts once the
+ * current one reaches sd_set_rotation()'s size or age (SD_SEGMENT_MB,
+ * SD_SEGMENT_MIN), and every boot starts a new one. Each segment is
+ * allocated at its full size when it is created, so the FAT chain is
+ * laid down once instead of one cluster per write and stays in one piece
+ * while the card has room; the writer then overwrites it from the start.
+ * sd_log_bytes is how much of it holds blocks. A segment is cut back to
+ * that when it is closed, and sd_recover_log() finds the end by the
+ * commit markers after a power cut. Before each new segment the oldest
+ * segments (.dlg, .idx and .can) are deleted until SD_MIN_FREE_MB plus
+ * one segment is free; once there are none left but the live one, the
+ * downsampled tiers of earlier boots go (log_tiers.h, SdKind). sd_free_mb() is kept current without a FAT scan
+ * per call: the writer takes the real figure at every segment and
+ * subtracts what it appends in between.
+ *
+ * The same task serves the channels (SdChannel): CAN frames (candump
+ * format, /logs/NNNN.can, off unless sd_set_can()), Meshtastic messages
+ * and debug lines, and the blocks of the tier files (log_tiers.h). Each
+ * has a file opened once and kept open, a FreeRTOS stream buffer in RAM
+ * and its own drop counter. Lines go to the card in batches of
+ * SD_STREAM_BATCH bytes, or once the oldest has waited the commit
+ * window, with one flush per batch instead of an open/append/close per
+ * line. Data blocks always go first; between channels the writer checks
+ * for data again. When the card falls behind, debug lines are dropped as
+ * soon as a write takes SD_SLOW_WRITE_MS, the others only once data
+ * blocks are being dropped too.
  */
 
 #ifndef SD_LOGGER_H
@@ -9,17 +61,686 @@
 
 #include <SPI.h>
 #include <SD.h>
+#include <freertos/stream_buffer.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ESP_IOExpander_Library.h>
 #include "board_config.h"
+#include "log_format.h"
+
+#define SD_BLOCK_SIZE       32768   // Bytes per card write, a multiple of the cluster size
+#define SD_BUFFERS          2
+#define SD_COMMIT_MS        30000   // Default commit window: about one 10 Hz block
+#define SD_COMMIT_MIN_MS    1000
+#define SD_COMMIT_MAX_MS    300000
+#define SD_WRITER_CORE      0
+#define SD_WRITER_PRIO      1       // Below bridge TX (2); the card can wait
+#define SD_WRITER_STACK     4096
+#define SD_CLOSE_WAIT_MS    2000    // sd_close(): time allowed to write what's buffered
+#define SD_STAGE_SIZE       65536   // Rows of the log block being packed
+#define SD_STREAM_BATCH     2048    // Channel bytes that wake the writer
+#define SD_STREAM_CHUNK     512     // Bytes per channel read/write
+#define SD_STREAM_POLL_MS   1000    // Writer wakes this often to commit old lines
+#define SD_SLOW_WRITE_MS    100     // A write this long: the card is behind
+#define SD_LINE_MAX         192     // Longest channel line, newline included
+#define SD_SEGMENT_MB       16      // Default segment size
+#define SD_SEGMENT_MIN      60      // Default segment age
+#define SD_MIN_FREE_MB      512     // Default free space kept by deleting old segments
+#define SD_SEGMENT_MAX_MB   2048    // FAT32 files stop at 4 GB
+#ifndef SD_MOUNT_POINT
+#define SD_MOUNT_POINT      "/sd"   // Where SD.begin() mounts the card in the VFS
+#endif
 
 // SD card state
 static bool sd_initialized = false;
 static File log_file;
+static File idx_file;                       // Time index next to log_file
 static char current_log_path[64] = {0};
 static unsigned long last_log_time = 0;
 static unsigned long log_interval_ms = 1000;  // Default: log every 1 second
+static unsigned long sd_commit_ms = SD_COMMIT_MS;  // Most a power cut may lose
+
+// Block buffers: loop() fills sd_buf[sd_active], the writer drains the
+// others in fill order starting at sd_write_next
+struct SdBuffer {
+    uint8_t *data;
+    size_t len;
+    uint8_t idx[SD_BLOCK_SIZE / LF_BLOCK_SIZE][LF_IDX_ENTRY];  // .idx entries of its blocks
+    uint8_t idxCount;
+    bool endsSegment;       // Last blocks of the segment: switch files after it
+    volatile bool full;     // Owned by the writer until it clears this
+};
+static SdBuffer sd_buf[SD_BUFFERS];
+static int sd_active = 0;
+static int sd_write_next = 0;
+static unsigned long sd_active_since = 0;   // First byte in the active buffer
+static TaskHandle_t sd_writer = NULL;
+
+// Writer statistics
+static uint32_t sd_rows_dropped = 0;            // In blocks dropped, both buffers full
+static volatile uint32_t sd_write_errors = 0;   // Short writes
+static volatile uint32_t sd_write_max_ms = 0;   // Slowest block write + flush
+
+static LfWriter sd_lf;                   // Log block being filled
+static int32_t *sd_stage = NULL;        // Its rows until they are packed
+static char sd_session[16] = {0};       // Name of the open log, e.g. "0042"
+static bool sd_log_open = false;         // loop() side: log_file belongs to the writer
+
+// Segments
+static uint32_t sd_segment_bytes = (uint32_t)SD_SEGMENT_MB << 20;
+static unsigned long sd_segment_ms = SD_SEGMENT_MIN * 60000UL;
+static uint32_t sd_min_free_mb = SD_MIN_FREE_MB;
+static unsigned long sd_segment_start = 0;      // millis() the segment was started
+static volatile uint32_t sd_log_bytes = 0;      // Written to log_file; the rest is preallocated
+static uint32_t sd_log_alloc = 0;               // log_file's size on the card
+static unsigned long sd_segment_no = 0;         // Number of the loop() side's segment
+static volatile uint32_t sd_free_kb = 0;        // Card free space, kept by the writer
+static volatile bool sd_rotating = false;       // Writer still to switch segments
+static char sd_next_session[16] = {0};          // The segment it switches to
+static uint32_t sd_segments_deleted = 0;        // Tier files included
+static unsigned long sd_boot_session = 0;       // First segment of this boot
+
+// Card state, for the drop policy
+enum SdBacklog {
+    SD_OK,
+    SD_SLOW,            // A write has taken SD_SLOW_WRITE_MS so far
+    SD_FULL,            // The next data block would be dropped
+};
+static volatile bool sd_busy = false;           // Writer inside a card write
+static volatile unsigned long sd_busy_since = 0;
+static volatile bool sd_drain = false;          // sd_close(): write every channel now
+
+// Channels, in the order the writer serves them after data: text lines,
+// then the 4 KB blocks of the downsampled tiers (log_tiers.h)
+enum SdChannel {
+    SD_CH_CAN,
+    SD_CH_MESH,
+    SD_CH_DEBUG,
+    SD_CH_TIER_S,
+    SD_CH_TIER_M,
+    SD_CH_TRIPS,
+    SD_CHANNELS
+};
+static_assert(SD_CHANNELS == VD_SD_CHANNELS, "VehicleData has a counter pair per channel");
+
+struct SdStream {
+    const char *name;
+    size_t ring;                        // RAM for lines not yet written
+    SdBacklog shedAt;                   // New lines are dropped from here on
+    char path[32];                      // Empty: channel off
+    File file;                          // Writer task only
+    StreamBufferHandle_t buf;
+    SemaphoreHandle_t lock;             // Several tasks log
+    volatile unsigned long since;       // When the ring last went non-empty
+    volatile bool reopen;               // path changed
+    uint32_t lines;
+    uint32_t drops;                     // Lines lost: shed or ring full
+};
+static SdStream sd_streams[SD_CHANNELS] = {
+    {"can",   16384, SD_FULL},
+    {"mesh",  4096,  SD_FULL},
+    {"debug", 4096,  SD_SLOW},
+    {"tier_s", 16384, SD_FULL},
+    {"tier_m", 8192,  SD_FULL},
+    {"trips", 8192,  SD_FULL},
+};
+static bool sd_can_enabled = false;
+
+// One-off work for the writer task (e.g. a capture file, log_capture.h):
+// each call does one step of about a block and returns false once done
+typedef bool (*SdJobFn)(void *arg);
+static volatile SdJobFn sd_job = NULL;
+static void *sd_job_arg = NULL;
+
+/* ═══════════════════════════════════════════════════════════════════
+ *  WRITER TASK
+ * ═══════════════════════════════════════════════════════════════════ */
+
+// Appends outside the preallocated segment use up free space
+static void sd_spend(size_t n) {
+    static uint32_t bytes = 0;
+    bytes += n;
+    uint32_t kb = bytes / 1024;
+    bytes %= 1024;
+    sd_free_kb = sd_free_kb > kb ? sd_free_kb - kb : 0;
+}
+
+static void sd_next_segment();
+
+static SdBacklog sd_backlog() {
+    const SdBuffer *active = &sd_buf[sd_active];
+    if (sd_buf[(sd_active + 1) % SD_BUFFERS].full &&
+        active->len + LF_BLOCK_SIZE >= SD_BLOCK_SIZE) return SD_FULL;
+    return sd_busy && millis() - sd_busy_since >= SD_SLOW_WRITE_MS ? SD_SLOW : SD_OK;
+}
+
+static void sd_write_buffers() {
+    while (sd_buf[sd_write_next].full) {
+        SdBuffer *b = &sd_buf[sd_write_next];
+        unsigned long t0 = millis();
+        sd_busy_since = t0;
+        sd_busy = true;
+        size_t n = log_file ? log_file.write(b->data, b->len) : 0;
+        if (log_file) log_file.flush();
+        sd_busy = false;
+        uint32_t ms = millis() - t0;
+        if (n != b->len) sd_write_errors++;
+        if (ms > sd_write_max_ms) sd_write_max_ms = ms;
+        sd_log_bytes += n;
+        if (sd_log_bytes > sd_log_alloc) {         // Past the preallocation
+            sd_spend(sd_log_bytes - sd_log_alloc);
+            sd_log_alloc = sd_log_bytes;
+        }
+        if (n == b->len && b->idxCount && idx_file) {
+            sd_spend(idx_file.write(&b->idx[0][0], (size_t)b->idxCount * LF_IDX_ENTRY));
+            idx_file.flush();
+        }
+        bool ends = b->endsSegment;
+        b->len = 0;
+        b->idxCount = 0;
+        b->endsSegment = false;
+        b->full = false;
+        sd_write_next = (sd_write_next + 1) % SD_BUFFERS;
+        if (ends) sd_next_segment();
+    }
+}
+
+static bool sd_stream_due(const SdStream *s, unsigned long now) {
+    size_t n = s->buf ? xStreamBufferBytesAvailable(s->buf) : 0;
+    return n && (n >= SD_STREAM_BATCH || sd_drain || now - s->since >= sd_commit_ms);
+}
+
+// Write what a channel holds now (not what arrives meanwhile), one
+// flush; stops early when a data buffer is waiting
+static void sd_write_stream(SdStream *s) {
+    static uint8_t chunk[SD_STREAM_CHUNK];
+    if (s->reopen || !s->file) {
+        if (s->file) s->file.close();
+        s->reopen = false;
+        if (s->path[0]) s->file = SD.open(s->path, FILE_APPEND);
+    }
+    size_t left = xStreamBufferBytesAvailable(s->buf);
+    sd_busy_since = millis();
+    sd_busy = true;
+    while (left && !sd_buf[sd_write_next].full) {
+        size_t n = xStreamBufferReceive(s->buf, chunk, left < sizeof(chunk) ? left : sizeof(chunk), 0);
+        if (!n) break;
+        size_t w = s->file ? s->file.write(chunk, n) : 0;
+        if (s->file && w != n) sd_write_errors++;
+        sd_spend(w);
+        left -= n;
+    }
+    if (s->file) s->file.flush();
+    sd_busy = false;
+}
+
+static void sd_writer_task(void *) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SD_STREAM_POLL_MS));
+        bool wrote;
+        do {
+            sd_write_buffers();
+            wrote = false;
+            for (int c = 0; c < SD_CHANNELS && !wrote; c++) {
+                if (sd_stream_due(&sd_streams[c], millis())) {
+                    sd_write_stream(&sd_streams[c]);
+                    wrote = true;       // Data first again before the next channel
+                }
+            }
+            if (!wrote && sd_job) {     // Jobs last, a step at a time
+                sd_busy_since = millis();
+                sd_busy = true;
+                if (!sd_job(sd_job_arg)) sd_job = NULL;
+                sd_busy = false;
+                wrote = true;
+            }
+        } while (wrote);
+    }
+}
+
+/**
+ * Queue one line on a channel; never waits for the card. The line is
+ * dropped and counted when the card is too far behind for this channel
+ * or its ring is full.
+ */
+static bool sd_stream_put(SdChannel ch, const char *line, size_t len) {
+    SdStream *s = &sd_streams[ch];
+    if (!s->buf || !s->path[0]) return false;
+    bool shed = sd_backlog() >= s->shedAt;
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    bool fits = !shed && xStreamBufferSpacesAvailable(s->buf) >= len;
+    if (fits) {
+        if (xStreamBufferBytesAvailable(s->buf) == 0) s->since = millis();
+        xStreamBufferSend(s->buf, line, len, 0);
+        s->lines++;
+    } else {
+        s->drops++;
+    }
+    size_t pending = xStreamBufferBytesAvailable(s->buf);
+    xSemaphoreGive(s->lock);
+    if (fits && pending >= SD_STREAM_BATCH && sd_writer) xTaskNotifyGive(sd_writer);
+    return fits;
+}
+
+// Give the writer a job; false while one is still running
+static bool sd_post_job(SdJobFn fn, void *arg) {
+    if (!sd_writer || sd_job) return false;
+    sd_job_arg = arg;
+    sd_job = fn;
+    xTaskNotifyGive(sd_writer);
+    return true;
+}
+
+// Point a channel at a file; the writer switches at its next batch
+static void sd_stream_open(SdChannel ch, const char *path) {
+    SdStream *s = &sd_streams[ch];
+    strncpy(s->path, path, sizeof(s->path) - 1);
+    s->reopen = true;
+}
+
+// Hand the active buffer to the writer and move on to the next one.
+// False if that one is still waiting to be written.
+static bool sd_handover() {
+    int next = (sd_active + 1) % SD_BUFFERS;
+    if (sd_buf[sd_active].len == 0) return true;
+    if (sd_buf[next].full) return false;
+    sd_buf[sd_active].full = true;
+    sd_active = next;
+    xTaskNotifyGive(sd_writer);
+    return true;
+}
+
+// Append to the active buffer; data crossing the end is split so every
+// write but the last is exactly SD_BLOCK_SIZE bytes
+static bool sd_append(const uint8_t *p, size_t n) {
+    SdBuffer *b = &sd_buf[sd_active];
+    size_t room = SD_BLOCK_SIZE - b->len;
+    if (n >= room && sd_buf[(sd_active + 1) % SD_BUFFERS].full) return false;
+    if (b->len == 0) sd_active_since = millis();
+    size_t first = n < room ? n : room;
+    memcpy(b->data + b->len, p, first);
+    b->len += first;
+    if (b->len < SD_BLOCK_SIZE) return true;
+
+    sd_handover();
+    b = &sd_buf[sd_active];
+    if (n > first) {
+        sd_active_since = millis();
+        memcpy(b->data, p + first, n - first);
+        b->len = n - first;
+    }
+    return true;
+}
+
+// Buffers and writer task, once per boot
+static bool sd_start_writer() {
+    if (sd_writer) return true;
+    for (int i = 0; i < SD_BUFFERS; i++) {
+        if (!sd_buf[i].data) {
+            sd_buf[i].data = (uint8_t *)(psramFound() ? ps_malloc(SD_BLOCK_SIZE)
+                                                      : malloc(SD_BLOCK_SIZE));
+        }
+        if (!sd_buf[i].data) {
+            Serial.println("[SD] No memory for log buffers");
+            return false;
+        }
+        sd_buf[i].len = 0;
+        sd_buf[i].idxCount = 0;
+        sd_buf[i].endsSegment = false;
+        sd_buf[i].full = false;
+    }
+    if (!sd_stage) {
+        sd_stage = (int32_t *)(psramFound() ? ps_malloc(SD_STAGE_SIZE) : malloc(SD_STAGE_SIZE));
+    }
+    if (!sd_stage) {
+        Serial.println("[SD] No memory for log buffers");
+        return false;
+    }
+    for (int c = 0; c < SD_CHANNELS; c++) {
+        sd_streams[c].buf = xStreamBufferCreate(sd_streams[c].ring, 1);
+        sd_streams[c].lock = xSemaphoreCreateMutex();
+    }
+    sd_active = sd_write_next = 0;
+    xTaskCreatePinnedToCore(sd_writer_task, "sd_writer", SD_WRITER_STACK, NULL,
+                            SD_WRITER_PRIO, &sd_writer, SD_WRITER_CORE);
+    return sd_writer != NULL;
+}
+
+/**
+ * Get free space in MB, as of the last segment start less what has been
+ * appended since (reading it from the card scans the FAT)
+ */
+static uint64_t sd_free_mb() {
+    if (!sd_initialized) return 0;
+    return sd_free_kb / 1024;
+}
+
+static void sd_refresh_free() {
+    sd_free_kb = (uint32_t)((SD.totalBytes() - SD.usedBytes()) / 1024);
+}
+
+// Highest numbered file in /logs, 0 if there is none
+static unsigned long sd_last_session() {
+    unsigned long last = 0;
+    File dir = SD.open("/logs");
+    if (dir) {
+        for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+            const char *name = strrchr(f.name(), '/');
+            unsigned long n = strtoul(name ? name + 1 : f.name(), NULL, 10);
+            if (n > last) last = n;
+        }
+    }
+    return last;
+}
+
+/**
+ * What a /logs file is to retention, which deletes raw segment files
+ * first (.dlg, .idx, .can, captures), then second tiers ("NNNN_s.dlg",
+ * log_tiers.h), then minute tiers ("NNNN_m.dlg")
+ */
+enum SdKind {
+    SD_KIND_RAW,
+    SD_KIND_SECONDS,
+    SD_KIND_MINUTES,
+    SD_KINDS
+};
+
+static const char *const SD_KIND_NAMES[SD_KINDS] = {"segment", "second tier", "minute tier"};
+
+static SdKind sd_file_kind(const char *name) {
+    const char *u = strchr(name, '_');
+    if (u && u[1] == 's' && u[2] == '.') return SD_KIND_SECONDS;
+    if (u && u[1] == 'm' && u[2] == '.') return SD_KIND_MINUTES;
+    return SD_KIND_RAW;
+}
+
+// Lowest numbered file of a kind in /logs below `below`, 0 if there is none
+static unsigned long sd_first_session(unsigned long below, SdKind kind) {
+    unsigned long first = 0;
+    File dir = SD.open("/logs");
+    if (dir) {
+        for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+            const char *name = strrchr(f.name(), '/');
+            name = name ? name + 1 : f.name();
+            unsigned long n = strtoul(name, NULL, 10);
+            if (n && n < below && (!first || n < first) && sd_file_kind(name) == kind) first = n;
+        }
+    }
+    return first;
+}
+
+// Highest numbered file of a kind in /logs below `below`, 0 if there is none
+static unsigned long sd_last_session_of(unsigned long below, SdKind kind) {
+    unsigned long last = 0;
+    File dir = SD.open("/logs");
+    if (dir) {
+        for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+            const char *name = strrchr(f.name(), '/');
+            name = name ? name + 1 : f.name();
+            unsigned long n = strtoul(name, NULL, 10);
+            if (n < below && n > last && sd_file_kind(name) == kind) last = n;
+        }
+    }
+    return last;
+}
+
+/**
+ * Name for this boot's log when there is no date to use: one past the
+ * highest numbered file in /logs, e.g. "0042" → /logs/0042.dlg
+ */
+static void sd_session_name(char *out, size_t size) {
+    snprintf(out, size, "%04lu", sd_last_session() + 1);
+}
+
+// The Arduino File API can't shorten a file; the VFS under it can
+static bool sd_truncate(const char *path, uint32_t len) {
+    char full[80];
+    snprintf(full, sizeof(full), SD_MOUNT_POINT "%s", path);
+    int fd = open(full, O_RDWR);
+    if (fd < 0) return false;
+    bool ok = ftruncate(fd, len) == 0;
+    close(fd);
+    return ok;
+}
+
+// Delete every file of a kind in /logs numbered n (for raw segments
+// .dlg, .idx, .can and whatever else carries the number). False if none
+// could be deleted.
+static bool sd_remove_session(unsigned long n, SdKind kind) {
+    char paths[8][40];
+    int count = 0;
+    File dir = SD.open("/logs");
+    if (dir) {
+        for (File f = dir.openNextFile(); f && count < 8; f = dir.openNextFile()) {
+            const char *name = strrchr(f.name(), '/');
+            name = name ? name + 1 : f.name();
+            if (strtoul(name, NULL, 10) == n && sd_file_kind(name) == kind) {
+                snprintf(paths[count++], sizeof(paths[0]), "/logs/%s", name);
+            }
+        }
+        dir.close();
+    }
+    bool removed = false;
+    for (int i = 0; i < count; i++) removed |= SD.remove(paths[i]);
+    return removed;
+}
+
+/**
+ * Delete the oldest files until sd_min_free_mb plus one segment is free,
+ * and take the free space from the card: segments below live while there
+ * are any, then tiers of earlier boots, oldest kind (SdKind) first
+ */
+static void sd_retention(unsigned long live) {
+    sd_refresh_free();
+    uint32_t needKb = (sd_min_free_mb << 10) + (sd_segment_bytes >> 10);
+    while (sd_free_kb < needKb) {
+        int kind = SD_KIND_RAW;
+        unsigned long oldest = sd_first_session(live, SD_KIND_RAW);
+        // This boot's tiers are open from its first segment on
+        while (!oldest && ++kind < SD_KINDS) oldest = sd_first_session(sd_boot_session, (SdKind)kind);
+        if (!oldest || !sd_remove_session(oldest, (SdKind)kind)) {
+            Serial.printf("[SD] Low on space: %lu MB free, nothing left to delete\n",
+                          (unsigned long)(sd_free_kb / 1024));
+            return;
+        }
+        sd_segments_deleted++;
+        Serial.printf("[SD] Deleted %s %04lu for space\n", SD_KIND_NAMES[kind], oldest);
+        sd_refresh_free();
+    }
+}
+
+// Close the segment's files and give back the preallocation it didn't use
+static void sd_close_files() {
+    if (!log_file) return;
+    log_file.close();
+    if (idx_file) idx_file.close();
+    sd_truncate(current_log_path, sd_log_bytes);
+}
+
+/**
+ * Open /logs/name.dlg at the end of the blocks it holds, allocated to the
+ * segment size, and its .idx; point the CAN channel at its .can. Makes
+ * room first (sd_retention()).
+ */
+static bool sd_open_files(const char *name) {
+    char path[64];
+    sd_retention(strtoul(name, NULL, 10));
+    snprintf(path, sizeof(path), "/logs/%s.dlg", name);
+    log_file = SD.open(path, SD.exists(path) ? "r+" : FILE_WRITE);
+    if (!log_file) {
+        Serial.printf("[SD] Failed to open %s\n", path);
+        return false;
+    }
+
+    // Seeking past the end extends the file: the whole chain in one go.
+    // No room is no error, the file then grows as it is written. The
+    // clusters keep what a deleted segment left there, so a new file's
+    // first magic is cleared: a cut before its first write leaves nothing.
+    uint32_t size = log_file.size(), used = size / LF_BLOCK_SIZE * LF_BLOCK_SIZE;
+    uint8_t zero[4] = {0};
+    if (size < sd_segment_bytes && log_file.seek(sd_segment_bytes - 1)) log_file.write(zero, 1);
+    if (!used && log_file.seek(0)) log_file.write(zero, sizeof(zero));
+    log_file.flush();
+    sd_log_alloc = log_file.size();
+    if (sd_log_alloc > size) sd_spend(sd_log_alloc - size);
+    log_file.seek(used);
+    sd_log_bytes = used;
+    strncpy(current_log_path, path, sizeof(current_log_path) - 1);
+    strncpy(sd_session, name, sizeof(sd_session) - 1);
+
+    // Without the index, windowed downloads fall back to the whole file
+    snprintf(path, sizeof(path), "/logs/%s.idx", name);
+    idx_file = SD.open(path, FILE_APPEND);
+    if (!idx_file) {
+        Serial.printf("[SD] Failed to open %s\n", path);
+    }
+    snprintf(path, sizeof(path), "/logs/%s.can", name);
+    sd_stream_open(SD_CH_CAN, path);
+    return true;
+}
+
+// Writer side of sd_rotate(), once the old segment's last buffer is written
+static void sd_next_segment() {
+    sd_busy_since = millis();
+    sd_busy = true;
+    sd_close_files();
+    sd_open_files(sd_next_session);
+    sd_busy = false;
+    sd_rotating = false;
+}
+
+// Bytes of /logs/name worth reading: the live segment is allocated
+// beyond the blocks written so far
+static uint32_t sd_log_size(const char *name, uint32_t size) {
+    bool live = sd_log_open && strncmp(current_log_path, "/logs/", 6) == 0 &&
+                strcmp(current_log_path + 6, name) == 0;
+    return live && sd_log_bytes < size ? sd_log_bytes : size;
+}
+
+/**
+ * After a power cut: cut /logs/name.dlg back to its last committed block
+ * and its .idx back to the entries for blocks still there. A segment
+ * closed cleanly ends in its block index; otherwise the end is the first
+ * block after the last .idx entry that doesn't pass lf_block_ok() with
+ * the file's nonce, whether a torn write or preallocated space never
+ * written. Uses sd_lf.block as scratch: call it before a log is opened.
+ * Returns the bytes removed from the log.
+ */
+static uint32_t sd_recover_log(const char *name) {
+    char path[64];
+    snprintf(path, sizeof(path), "/logs/%s.idx", name);
+    File f = SD.open(path, FILE_READ);
+    uint32_t entries = 0, idxSize = 0, start = 1;
+    uint8_t e[LF_IDX_ENTRY];
+    if (f) {
+        idxSize = f.size();
+        entries = idxSize / LF_IDX_ENTRY;
+        if (entries && f.seek((entries - 1) * LF_IDX_ENTRY) && f.read(e, LF_IDX_ENTRY) == LF_IDX_ENTRY) {
+            start = lf_get_le(e + 4, 4);        // On the card before its entry was
+        }
+        f.close();
+    }
+
+    snprintf(path, sizeof(path), "/logs/%s.dlg", name);
+    f = SD.open(path, FILE_READ);
+    if (!f) return 0;
+    uint32_t size = f.size(), blocks = size / LF_BLOCK_SIZE;
+    uint8_t *buf = sd_lf.block;
+    auto readBlock = [&](uint32_t i) {
+        return f.seek(i * LF_BLOCK_SIZE) && f.read(buf, LF_BLOCK_SIZE) == LF_BLOCK_SIZE;
+    };
+    if (blocks && !readBlock(0)) {
+        f.close();
+        return 0;           // A read error isn't a torn block: leave the file alone
+    }
+    uint32_t nonce = blocks ? lf_nonce_of(buf) : 0, keep = 0;
+    auto scan = [&](uint32_t from) {    // keep = first bad block from here; false: read error
+        for (keep = from; keep < blocks; keep++) {
+            if (!readBlock(keep)) return false;
+            if (!lf_block_ok(buf, nonce)) break;
+        }
+        return true;
+    };
+    bool read = true;
+    if (!blocks || !lf_block_ok(buf, nonce)) {
+        keep = 0;
+    } else if (readBlock(blocks - 1) && lf_get_le(buf, 4) == LF_MAGIC_INDEX && lf_block_ok(buf, nonce)) {
+        keep = blocks;
+    } else if (start < blocks && start > 1) {
+        read = scan(start) && (keep > start || scan(1));   // Index entry not backed: from the top
+    } else {
+        read = scan(1);
+    }
+    f.close();
+    if (!read) return 0;
+    uint32_t cut = size - keep * LF_BLOCK_SIZE;
+    if (cut && !sd_truncate(path, keep * LF_BLOCK_SIZE)) {
+        Serial.printf("[SD] Can't truncate %s\n", path);
+        return 0;
+    }
 
-// Forward declare VehicleData (defined in ui_dashboard.h or bridge code)
-struct VehicleData;
+    snprintf(path, sizeof(path), "/logs/%s.idx", name);
+    f = SD.open(path, FILE_READ);
+    if (f) {
+        while (entries && f.seek((entries - 1) * LF_IDX_ENTRY) &&
+               f.read(e, LF_IDX_ENTRY) == LF_IDX_ENTRY && lf_get_le(e + 4, 4) >= keep) {
+            entries--;
+        }
+        f.close();
+        if (entries * LF_IDX_ENTRY != idxSize) sd_truncate(path, entries * LF_IDX_ENTRY);
+    }
+    if (cut) {
+        Serial.printf("[SD] Recovered /logs/%s.dlg: %lu bytes kept, %lu torn or unwritten cut\n",
+                      name, (unsigned long)(keep * LF_BLOCK_SIZE), (unsigned long)cut);
+    }
+    return cut;
+}
+
+/**
+ * After sd_recover_log(), for a log with no .idx (the log tiers): end it
+ * with the block index it would have got from a clean close, rebuilt
+ * from the headers of its blocks, so readers don't have to scan it. Uses
+ * sd_lf as scratch: call it before a log is opened.
+ */
+static bool sd_index_log(const char *name) {
+    char path[40];
+    snprintf(path, sizeof(path), "/logs/%s.dlg", name);
+    File f = SD.open(path, FILE_READ);
+    if (!f) return false;
+    uint32_t blocks = f.size() / LF_BLOCK_SIZE;
+    LfWriter *w = &sd_lf;
+    uint8_t *buf = w->block;
+    auto readBlock = [&](uint32_t i) {
+        return f.seek(i * LF_BLOCK_SIZE) && f.read(buf, LF_BLOCK_SIZE) == LF_BLOCK_SIZE;
+    };
+    if (!blocks || !readBlock(blocks - 1) || lf_get_le(buf, 4) == LF_MAGIC_INDEX || !readBlock(0)) {
+        f.close();
+        return false;       // Empty, closed cleanly, or unreadable
+    }
+    lf_init(w, NULL, 0, lf_nonce_of(buf));
+    for (uint32_t i = 0; i < blocks; i++) {
+        LfHeader h;
+        if (!f.seek(i * LF_BLOCK_SIZE) || f.read(buf, LF_HEADER_SIZE) != LF_HEADER_SIZE) {
+            f.close();
+            return false;
+        }
+        lf_get_header(buf, &h);
+        if (h.magic == LF_MAGIC_SCHEMA) w->schemaId = h.schemaId;
+        if (h.magic == LF_MAGIC_DATA) {
+            w->tFirst = h.tFirst;
+            w->tLast = h.tLast;
+        }
+        w->seq = h.seq;
+        lf_stored(w, true);
+    }
+    f.close();
+    lf_build_index(w);
+    f = SD.open(path, FILE_APPEND);
+    bool ok = f && f.write(w->block, LF_BLOCK_SIZE) == LF_BLOCK_SIZE;
+    if (f) f.close();
+    Serial.printf("[SD] Indexed /logs/%s.dlg: %u entries%s\n", name, w->indexCount, ok ? "" : " (write failed)");
+    return ok;
+}
 
 /**
  * Initialize SD card on SPI bus
@@ -47,123 +768,226 @@ static bool sd_init(ESP_IOExpander *io_exp) {
     uint64_t cardSize = SD.cardSize() / (1024 * 1024);
     Serial.printf("[SD] Card mounted: %lluMB\n", cardSize);
     sd_initialized = true;
+    sd_refresh_free();
 
     // Create logs directory
     if (!SD.exists("/logs")) {
         SD.mkdir("/logs");
     }
 
-    return true;
-}
+    sd_start_writer();
+    sd_stream_open(SD_CH_DEBUG, "/logs/debug.log");
+    sd_stream_open(SD_CH_MESH, "/logs/meshtastic.log");
 
-/**
- * Get free space in MB
- */
-static uint64_t sd_free_mb() {
-    if (!sd_initialized) return 0;
-    return (SD.totalBytes() - SD.usedBytes()) / (1024 * 1024);
+    // The last session may have ended in a power cut
+    unsigned long last = sd_last_session();
+    if (last) {
+        char name[16];
+        snprintf(name, sizeof(name), "%04lu", last);
+        sd_recover_log(name);
+    }
+    return true;
 }
 
 /**
- * Open or rotate log file based on date
- * File naming: /logs/YYYY-MM-DD_obd2.csv
+ * Start logging to segment /logs/name.dlg (with name.idx and name.can);
+ * later segments are numbered on from it. An earlier session's file is
+ * recovered and appended to. The writer task owns the files afterwards:
+ * call this before logging starts.
  */
-static bool sd_open_log(const char *date_str) {
+static bool sd_open_log(const char *name) {
     char path[64];
-    snprintf(path, sizeof(path), "/logs/%s_obd2.csv", date_str);
+    snprintf(path, sizeof(path), "/logs/%s.dlg", name);
 
-    // Check if we need to rotate
     if (strcmp(path, current_log_path) == 0 && log_file) {
         return true;  // Same file, still open
     }
+    sd_close_files();
+    if (!sd_boot_session) sd_boot_session = strtoul(name, NULL, 10);
 
-    // Close old file
-    if (log_file) {
-        log_file.close();
+    // Appending keeps the file's nonce, from its first schema block
+    uint32_t nonce = esp_random();
+    if (SD.exists(path)) {
+        sd_recover_log(name);
+        File f = SD.open(path, FILE_READ);
+        uint8_t h[LF_HEADER_SIZE];
+        if (f && f.read(h, sizeof(h)) == sizeof(h)) nonce = lf_nonce_of(h);
+        if (f) f.close();
     }
+    if (!sd_open_files(name)) return false;
 
-    // Open new file (append mode)
-    bool is_new = !SD.exists(path);
-    log_file = SD.open(path, FILE_APPEND);
-    if (!log_file) {
-        Serial.printf("[SD] Failed to open %s\n", path);
-        return false;
-    }
+    lf_init(&sd_lf, sd_stage, sd_stage ? SD_STAGE_SIZE : 0, nonce);
+    sd_lf.stored = sd_log_bytes / LF_BLOCK_SIZE;    // Appending to an earlier session
+    sd_segment_no = strtoul(name, NULL, 10);
+    sd_segment_start = millis();
+    sd_log_open = true;
+    return true;
+}
 
-    strncpy(current_log_path, path, sizeof(current_log_path) - 1);
+// Store the block in sd_lf (a schema, or data which is sealed first).
+// Blocks never straddle two buffers, so its .idx entry rides in the
+// active one; it is added first, before the writer can take the buffer.
+static bool sd_put_block() {
+    bool data = sd_lf.rows > 0;
+    if (data) lf_seal(&sd_lf);
+    SdBuffer *b = &sd_buf[sd_active];
+    bool indexed = data && lf_idx_due(&sd_lf);
+    if (indexed) lf_put_idx(b->idx[b->idxCount++], &sd_lf);
+    bool ok = sd_append(sd_lf.block, LF_BLOCK_SIZE);
+    if (!ok && indexed) b->idxCount--;
+    if (!ok && data) sd_rows_dropped += sd_lf.rows;
+    lf_stored(&sd_lf, ok);
+    return ok;
+}
 
-    // Write CSV header if new file
-    if (is_new) {
-        log_file.println("timestamp_ms,speed,rpm,ect,throttle,load,"
-                         "batt_v,batt_i,temp_t1,temp_t2,temp_amb,"
-                         "charge_rate,fault,alarm");
+/**
+ * End the segment with its block index and start the next one. Its last
+ * blocks get a buffer to themselves, marked endsSegment, and the writer
+ * switches files once that is written; rows from here on go to the new
+ * segment. False while the buffers can't take that yet (the active one
+ * is then handed over if it can be); sd_log_due() tries again.
+ */
+static bool sd_rotate(unsigned long now) {
+    if (sd_buf[(sd_active + 1) % SD_BUFFERS].full) return false;
+    if (sd_buf[sd_active].len + 2 * LF_BLOCK_SIZE > SD_BLOCK_SIZE) {
+        sd_handover();
+        return false;
     }
-
+    snprintf(sd_next_session, sizeof(sd_next_session), "%04lu", ++sd_segment_no);
+    sd_rotating = true;
+    int last = sd_active;
+    sd_buf[last].endsSegment = true;
+    if (sd_lf.rows) sd_put_block();
+    lf_build_index(&sd_lf);
+    sd_put_block();
+    if (sd_active == last) sd_handover();
+    lf_init(&sd_lf, sd_stage, sd_stage ? SD_STAGE_SIZE : 0, esp_random());
+    sd_segment_start = now;
     return true;
 }
 
 /**
- * Log a data row to CSV
+ * A row is due (every log_interval_ms). Also starts the next segment
+ * when this one is full or old enough, and commits what has waited
+ * sd_commit_ms: the open block, or a buffer that isn't full yet.
  */
-static void sd_log_data(unsigned long timestamp_ms, VehicleData *d) {
-    if (!sd_initialized || !log_file) return;
+static bool sd_log_due(unsigned long now) {
+    if (!sd_initialized || !sd_log_open || !sd_writer) return false;
+    if (!sd_rotating && sd_lf.haveSchema &&
+        ((sd_lf.stored + 2) * LF_BLOCK_SIZE >= sd_segment_bytes ||
+         now - sd_segment_start >= sd_segment_ms)) {
+        sd_rotate(now);         // Size or age: on to the next segment
+    } else if (sd_lf.rows && now - sd_lf.tFirst >= sd_commit_ms) {
+        sd_put_block();         // Commit window: the block goes out part full
+        sd_handover();
+    } else if (sd_buf[sd_active].len && now - sd_active_since >= sd_commit_ms) {
+        sd_handover();
+    }
+    return now - last_log_time >= log_interval_ms;
+}
 
-    // Throttle logging rate
-    if (timestamp_ms - last_log_time < log_interval_ms) return;
+/**
+ * Log one record (tb_collect() order). Only copies into RAM; never
+ * waits for the card. A changed field set starts a new schema block.
+ */
+static void sd_log_data(unsigned long timestamp_ms, const TbValue *values, int n) {
     last_log_time = timestamp_ms;
 
-    char buf[256];
-    snprintf(buf, sizeof(buf),
-             "%lu,%d,%d,%d,%d,%d,%.2f,%.2f,%d,%d,%d,%.1f,%u,%u",
-             timestamp_ms,
-             d->speed, d->rpm, d->ect, d->throttle, d->load,
-             d->battV, d->battI, d->tempT1, d->tempT2, d->tempAmb,
-             d->targetCurrent, d->fault, d->alarm);
-
-    log_file.println(buf);
-
-    // Flush periodically (every 10 writes)
-    static int write_count = 0;
-    if (++write_count >= 10) {
-        log_file.flush();
-        write_count = 0;
+    if (lf_schema_changed(&sd_lf, values, n)) {
+        if (sd_lf.rows) sd_put_block();
+        if (!lf_begin_schema(&sd_lf, values, n)) return;
+        if (!sd_put_block()) {
+            sd_lf.haveSchema = false;   // Schema lost: send it again with the next row
+            return;
+        }
+    }
+    if (!lf_add_row(&sd_lf, timestamp_ms, values)) {
+        sd_put_block();
+        lf_add_row(&sd_lf, timestamp_ms, values);
     }
 }
 
+// Format a line for a channel, cut to SD_LINE_MAX with its newline kept
+static bool sd_stream_printf(SdChannel ch, const char *fmt, ...) {
+    if (!sd_initialized) return false;
+    char line[SD_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+    if (n < 0) return false;
+    if ((size_t)n > sizeof(line) - 2) n = sizeof(line) - 2;
+    line[n++] = '\n';
+    return sd_stream_put(ch, line, n);
+}
+
 /**
- * Log a debug/error message to a separate log file
+ * Log a debug/error message to /logs/debug.log (the first lines dropped
+ * when the card is slow)
  */
 static void sd_log_debug(const char *msg) {
-    if (!sd_initialized) return;
-
-    File f = SD.open("/logs/debug.log", FILE_APPEND);
-    if (f) {
-        f.printf("[%lu] %s\n", millis(), msg);
-        f.close();
-    }
+    sd_stream_printf(SD_CH_DEBUG, "[%lu] %s", millis(), msg);
 }
 
 /**
  * Log a Meshtastic message
  */
 static void sd_log_mesh(const char *sender, const char *message) {
-    if (!sd_initialized) return;
+    sd_stream_printf(SD_CH_MESH, "[%lu] %s: %s", millis(), sender, message);
+}
 
-    File f = SD.open("/logs/meshtastic.log", FILE_APPEND);
-    if (f) {
-        f.printf("[%lu] %s: %s\n", millis(), sender, message);
-        f.close();
-    }
+/**
+ * Log a CAN frame to the session's .can file, candump -l style:
+ *   (1234.567000) can0 7E8#03410D32AAAAAAAA
+ * Only while sd_set_can() is on; OBD polling would otherwise add ~5 MB/h.
+ */
+static void sd_log_can(uint32_t id, const uint8_t *data, uint8_t len) {
+    if (!sd_can_enabled) return;
+    char hex[17];
+    if (len > 8) len = 8;
+    for (uint8_t i = 0; i < len; i++) snprintf(hex + 2 * i, 3, "%02X", data[i]);
+    hex[2 * len] = '\0';
+    unsigned long ms = millis();
+    sd_stream_printf(SD_CH_CAN, id > 0x7FF ? "(%lu.%03lu000) can0 %08lX#%s" : "(%lu.%03lu000) can0 %03lX#%s",
+                     ms / 1000, ms % 1000, (unsigned long)id, hex);
 }
 
 /**
- * Close all open files (call before power down)
+ * Close all open files (call before power down). The partial block, the
+ * block index and every channel's pending lines are handed to the
+ * writer first and given SD_CLOSE_WAIT_MS to reach the card.
  */
 static void sd_close() {
-    if (log_file) {
-        log_file.flush();
-        log_file.close();
+    bool idle = true;
+    if (sd_writer && sd_log_open) {
+        if (sd_lf.rows) sd_put_block();
+        if (sd_lf.haveSchema) {
+            lf_build_index(&sd_lf);
+            sd_put_block();
+        }
+        sd_handover();
+        sd_drain = true;
+        xTaskNotifyGive(sd_writer);
+        unsigned long start = millis();
+        for (int i = 0; i < SD_BUFFERS; i++) {
+            while (sd_buf[i].full && millis() - start < SD_CLOSE_WAIT_MS) delay(5);
+            if (sd_buf[i].full) idle = false;
+        }
+        for (int c = 0; c < SD_CHANNELS; c++) {
+            SdStream *st = &sd_streams[c];
+            while (st->buf && xStreamBufferBytesAvailable(st->buf) &&
+                   millis() - start < SD_CLOSE_WAIT_MS) delay(5);
+        }
+        while ((sd_busy || sd_rotating) && millis() - start < SD_CLOSE_WAIT_MS) delay(5);
+        if (sd_busy || sd_rotating) idle = false;
     }
+    if (log_file && idle) {     // Never close under a write the card is stuck in
+        sd_close_files();
+        for (int c = 0; c < SD_CHANNELS; c++) {
+            if (sd_streams[c].file) sd_streams[c].file.close();
+        }
+    }
+    sd_log_open = false;
     sd_initialized = false;
 }
 
@@ -174,4 +998,32 @@ static void sd_set_interval(unsigned long ms) {
     log_interval_ms = ms;
 }
 
+// CAN frame logging on or off (sd_log_can)
+static void sd_set_can(bool on) {
+    sd_can_enabled = on;
+}
+
+/**
+ * Set the commit window: the longest a row waits in RAM before it is
+ * written, so the most a power cut can lose (clamped to
+ * SD_COMMIT_MIN_MS..SD_COMMIT_MAX_MS)
+ */
+static void sd_set_commit(unsigned long ms) {
+    sd_commit_ms = ms < SD_COMMIT_MIN_MS ? SD_COMMIT_MIN_MS
+                 : ms > SD_COMMIT_MAX_MS ? SD_COMMIT_MAX_MS : ms;
+}
+
+/**
+ * Segment size (MB, 1..SD_SEGMENT_MAX_MB) and age (minutes), and the
+ * free space (MB) to keep by deleting the oldest segments. The size is
+ * allocated from the next segment on; a smaller size or age can also end
+ * the current one.
+ */
+static void sd_set_rotation(uint32_t segMB, uint32_t segMin, uint32_t minFreeMB) {
+    segMB = segMB < 1 ? 1 : segMB > SD_SEGMENT_MAX_MB ? SD_SEGMENT_MAX_MB : segMB;
+    sd_segment_bytes = segMB << 20;
+    sd_segment_ms = (segMin < 1 ? 1 : segMin) * 60000UL;
+    sd_min_free_mb = minFreeMB;
+}
+
 #endif // SD_LOGGER_H
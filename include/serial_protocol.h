@@ -2,18 +2,71 @@
  * @file serial_protocol.h
  * JSON-based serial protocol for ESP32 ↔ Raspberry Pi communication
  *
- * Protocol: Newline-delimited JSON over UART (115200 baud)
+ * Protocol: Newline-delimited JSON over UART (115200 baud), or after
+ * set_format the binary framing in telemetry_binary.h
  *
- * ESP32 → Pi (data stream, every 500ms):
- *   {"obd":{...},"chg":{...},"dtc":[...],"sd":{...},"ts":12345}
+ * ESP32 → Pi (data stream, every 500ms or as negotiated/subscribed):
+ *   {"obd":{...},"chg":{...},"dev":[...],"dtc":[...],"trip":{...},"sd":{...},
+ *    "tx":{...},"link":{...},"seq":812,"ts":12345}
+ *   "chg" is the primary charger; "dev" has one object per RS485 slave:
+ *   {"addr":1,"type":"charger","ok":true,"v":27.40,...}
+ *   After "subscribe", "obd" carries only the subscribed signals.
+ *   "sd" has "lines"/"lost" per SD channel (can, mesh, debug, tier_s,
+ *   tier_m, trips): lines (tier blocks) queued, and lost to a full ring
+ *   or a card too far behind. "tier_n"/"tier_lost" count, per log tier
+ *   (second, minute, trip), the intervals closed and the rows lost.
+ *   "seq" counts records sent (binary DATA frames carry their own u16 seq);
+ *   "link" counts command lines received, unknown ones, and ids skipped
+ *   in the host's sequence — commands lost on the way in.
  *
- * Pi → ESP32 (commands):
+ * Pi → ESP32 (commands, optional "id" echoed in the reply):
  *   {"cmd":"scan_dtc"}
  *   {"cmd":"clear_dtc"}
- *   {"cmd":"set_current","val":30.0}
- *   {"cmd":"set_log_interval","val":1000}
+ *   {"cmd":"set_current","val":30.0}            (all chargers)
+ *   {"cmd":"set_current","val":30.0,"dev":2}    (charger at address 2)
+ *   {"cmd":"set_log_interval","val":1000,"commit_ms":30000,"can":0}   (commit_ms, can optional)
+ *   {"cmd":"set_log_rotation","seg_mb":16,"seg_min":60,"min_free_mb":512}   (any; none = query)
+ *   {"cmd":"set_capture","period_ms":50,"pre_s":20,"post_s":10,"rules":"chg.t1>80,dtc"}
+ *                                   (any; none = query; "trigger":1 captures now, see log_capture.h)
+ *   {"cmd":"get_trip"}         → {"id":N,"trip":{"km":..,"stats":{...},"hist":{...}}}
+ *   {"cmd":"reset_trip"}
  *   {"cmd":"get_supported_pids"}
+ *   {"cmd":"set_rs485","baud":19200,"parity":"N","gap_us":0,"auto":1}
+ *   {"cmd":"probe_rs485"}
+ *   {"cmd":"set_charging","min":12,"max":30,"up":0.5,"down":4,"db":0.5}
+ *   {"cmd":"set_format","fmt":"binary","period_ms":50,"delta":1,"key_ms":5000}
+ *   {"cmd":"set_format","fmt":"json"}
+ *   {"cmd":"get_schema"}                                (binary mode)
+ *   {"cmd":"keyframe"}                                  (binary mode)
+ *   {"cmd":"subscribe","rates":{"rpm":20,"spd":20,"0x46":1}}   (Hz; 0 drops)
+ *   {"cmd":"unsubscribe"}
+ *   {"cmd":"time_sync"}        → {"id":N,"time_sync":{"us":12345678901}}
+ *   {"cmd":"ls_logs","val":0}                       (SD logs, see log_transfer.h)
+ *   {"cmd":"get_log","name":"0007.dlg","off":0,"win":8}   ("end":N stops early)
+ *   {"cmd":"get_log","name":"0007.dlg","from":600000,"to":660000,"win":8}
+ *   {"cmd":"log_ack","off":4096}          ("nak":1 resends from off, -1 cancels)
+ *   {"cmd":"set_baud","baud":921600}
+ *   {"cmd":"baud_ok","pattern":"UUUU..."}          (at the new rate)
  *   {"cmd":"shutdown"}
+ *
+ * Replies to a command with "id":N start with {"id":N,...}. Unknown
+ * commands get {"id":N,"error":"unknown_command","cmd":"...","rc":3}.
+ * scan_dtc/clear_dtc run as background jobs: queued → running (progress)
+ * → done, e.g. {"id":7,"job":"scan_dtc","state":"done","rc":0,"dtc_scan":{...}}
+ *
+ * time_sync returns the bridge's microsecond clock, which "ts" is derived
+ * from (ts == us / 1000, wrapping at 32 bits). The host sends a few per
+ * minute, keeps the replies with the shortest round trip and fits
+ * offset and drift to map "ts" onto its own wall clock.
+ *
+ * set_baud is acked at the current rate, then the bridge switches and,
+ * with telemetry paused, sends {"baud_test":BRIDGE_BAUD_PATTERN} every
+ * 200 ms. The host switches too and answers baud_ok with the same
+ * pattern; the bridge stores the rate in NVS and replies {"baud_ok":N}.
+ * Without a matching baud_ok in BRIDGE_BAUD_TRIAL_MS both sides go back
+ * ({"baud_fail":N,"baud":old}). A stored rate above BRIDGE_BAUD that
+ * sees no valid command for BRIDGE_BAUD_GRACE_MS, or a run of garbage
+ * lines, drops back to BRIDGE_BAUD ({"baud_fallback":115200}).
  */
 
 #ifndef SERIAL_PROTOCOL_H
@@ -21,10 +74,15 @@
 
 #include <Arduino.h>
 #include "obd2_pids.h"
+#include "vehicle_data.h"
+#include "modbus_master.h"
+#include "telemetry_binary.h"
+#include "json_writer.h"
+#include "obd_scheduler.h"
+#include "trip_stats.h"
 
-// Maximum JSON output buffer size
-#define JSON_BUF_SIZE 1536
-#define CMD_BUF_SIZE  256
+// Maximum command line length
+#define CMD_BUF_SIZE  512
 
 // Command types from Pi
 enum BridgeCommand {
@@ -33,74 +91,374 @@ enum BridgeCommand {
     CMD_CLEAR_DTC,
     CMD_SET_CURRENT,
     CMD_SET_LOG_INTERVAL,
+    CMD_SET_LOG_ROTATION,
+    CMD_SET_CAPTURE,
+    CMD_GET_TRIP,
+    CMD_RESET_TRIP,
     CMD_GET_SUPPORTED_PIDS,
     CMD_SHUTDOWN,
+    CMD_SET_RS485,
+    CMD_PROBE_RS485,
+    CMD_SET_CHARGING,
+    CMD_SET_FORMAT,
+    CMD_GET_SCHEMA,
+    CMD_KEYFRAME,
+    CMD_SUBSCRIBE,
+    CMD_UNSUBSCRIBE,
+    CMD_TIME_SYNC,
+    CMD_LS_LOGS,
+    CMD_GET_LOG,
+    CMD_LOG_ACK,
+    CMD_SET_BAUD,
+    CMD_BAUD_OK,
+    CMD_UNKNOWN,            // Unrecognised name or no "cmd" field
+};
+
+static const struct {
+    const char *name;
+    BridgeCommand type;
+} BRIDGE_COMMANDS[] = {
+    {"scan_dtc",           CMD_SCAN_DTC},
+    {"clear_dtc",          CMD_CLEAR_DTC},
+    {"set_current",        CMD_SET_CURRENT},
+    {"set_log_interval",   CMD_SET_LOG_INTERVAL},
+    {"set_log_rotation",   CMD_SET_LOG_ROTATION},
+    {"set_capture",        CMD_SET_CAPTURE},
+    {"get_trip",           CMD_GET_TRIP},
+    {"reset_trip",         CMD_RESET_TRIP},
+    {"get_supported_pids", CMD_GET_SUPPORTED_PIDS},
+    {"shutdown",           CMD_SHUTDOWN},
+    {"set_rs485",          CMD_SET_RS485},
+    {"probe_rs485",        CMD_PROBE_RS485},
+    {"set_charging",       CMD_SET_CHARGING},
+    {"set_format",         CMD_SET_FORMAT},
+    {"get_schema",         CMD_GET_SCHEMA},
+    {"keyframe",           CMD_KEYFRAME},
+    {"subscribe",          CMD_SUBSCRIBE},
+    {"unsubscribe",        CMD_UNSUBSCRIBE},
+    {"time_sync",          CMD_TIME_SYNC},
+    {"ls_logs",            CMD_LS_LOGS},
+    {"get_log",            CMD_GET_LOG},
+    {"log_ack",            CMD_LOG_ACK},
+    {"set_baud",           CMD_SET_BAUD},
+    {"baud_ok",            CMD_BAUD_OK},
+};
+
+// Result codes in replies ("rc") and job results
+enum BridgeResult {
+    RC_OK = 0,
+    RC_FAILED,          // Ran, but the device/bus said no
+    RC_BUSY,            // No free job slot
+    RC_UNKNOWN_CMD,
+    RC_BAD_ARGS,
+};
+
+enum TelemetryFormat {
+    FMT_JSON = 0,
+    FMT_BINARY,
 };
 
 struct ParsedCommand {
     BridgeCommand type;
     float floatVal;
     int intVal;
+    uint8_t dev;        // Target Modbus address (0 = all)
+    uint32_t id;        // Request id echoed in replies (0 = none)
+    char name[24];      // "cmd" as sent, for error replies
+    const char *raw;    // Full command line, for command-specific fields
 };
 
-// Forward declare
-struct VehicleData;
+static const char *commandName(uint8_t type) {
+    for (size_t i = 0; i < sizeof(BRIDGE_COMMANDS) / sizeof(BRIDGE_COMMANDS[0]); i++) {
+        if (BRIDGE_COMMANDS[i].type == type) return BRIDGE_COMMANDS[i].name;
+    }
+    return "?";
+}
+
+/**
+ * Look up a numeric field ("key":123) in a flat JSON line
+ * Returns false if the key is absent
+ */
+static bool jsonFindLong(const char *json, const char *key, long *out) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(json, pat);
+    if (!p) return false;
+    p += strlen(pat);
+    while (*p == ' ') p++;
+    if (*p == '"') p++;  // Tolerate quoted numbers
+    char *end;
+    long v = strtol(p, &end, 10);
+    if (end == p) return false;
+    *out = v;
+    return true;
+}
+
+static bool jsonFindFloat(const char *json, const char *key, float *out) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(json, pat);
+    if (!p) return false;
+    p += strlen(pat);
+    char *end;
+    float v = strtof(p, &end);
+    if (end == p) return false;
+    *out = v;
+    return true;
+}
+
+/**
+ * Walk the members of a flat numeric object ("key":{"a":1,"b":2.5}),
+ * calling fn(name, value, ctx) for each. Returns the member count,
+ * -1 if the object is absent.
+ */
+static int jsonForEachNumber(const char *json, const char *key,
+                             void (*fn)(const char *name, float val, void *ctx),
+                             void *ctx) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(json, pat);
+    if (!p) return -1;
+    p += strlen(pat);
+    while (*p == ' ') p++;
+    if (*p++ != '{') return -1;
+
+    int n = 0;
+    for (;;) {
+        while (*p == ' ' || *p == ',') p++;
+        if (*p != '"') break;
+        const char *name = ++p;
+        const char *q = strchr(name, '"');
+        if (!q) break;
+        char tmp[16];
+        size_t len = q - name < (long)sizeof(tmp) - 1 ? q - name : sizeof(tmp) - 1;
+        memcpy(tmp, name, len);
+        tmp[len] = '\0';
+        p = q + 1;
+        while (*p == ' ' || *p == ':') p++;
+        char *end;
+        float v = strtof(p, &end);
+        if (end == p) break;
+        p = end;
+        fn(tmp, v, ctx);
+        n++;
+    }
+    return n;
+}
+
+// First character of a string field ("key":"E"), or def if absent
+static char jsonFindChar(const char *json, const char *key, char def) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(json, pat);
+    if (!p) return def;
+    p += strlen(pat);
+    while (*p == ' ' || *p == '"') p++;
+    return *p ? *p : def;
+}
+
+// String field ("key":"abc") into out; false if absent, escaped or too long
+static bool jsonFindStr(const char *json, const char *key, char *out, size_t size) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(json, pat);
+    if (!p) return false;
+    p += strlen(pat);
+    while (*p == ' ') p++;
+    if (*p++ != '"') return false;
+    size_t len = 0;
+    while (p[len] && p[len] != '"' && p[len] != '\\' && len < size - 1) len++;
+    if (p[len] != '"') return false;
+    memcpy(out, p, len);
+    out[len] = '\0';
+    return true;
+}
 
 /**
- * Serialize vehicle data to JSON string
- * Writes to provided buffer, returns length
+ * Serialize vehicle data as one JSON line, streamed to out in small
+ * chunks (see json_writer.h). Returns the number of bytes written.
  */
-static int serializeData(char *buf, int bufSize, VehicleData *d,
-                          const char *dtcCodes[], int dtcCount,
-                          bool sdOk, uint64_t sdFreeMB) {
-    int len = snprintf(buf, bufSize,
-        "{\"obd\":{"
-            "\"spd\":%d,\"rpm\":%d,\"ect\":%d,"
-            "\"thr\":%d,\"load\":%d,"
-            "\"fuel_rate\":%.2f,\"fuel_lvl\":%.1f,"
-            "\"maf\":%.2f,\"iat\":%d,\"oil_t\":%d,"
-            "\"timing\":%.1f,\"o2v\":%.3f,\"fuel_pres\":%d"
-        "},"
-        "\"chg\":{"
-            "\"v\":%.2f,\"a\":%.2f,\"set\":%.1f,"
-            "\"t1\":%d,\"t2\":%d,\"amb\":%d,"
-            "\"rate\":%.1f,\"fault\":%u,\"alarm\":%u,\"status\":%u"
-        "}",
-        d->speed, d->rpm, d->ect,
-        d->throttle, d->load,
-        d->fuelRate, d->fuelLevel,
-        d->maf, d->intakeAirTemp, d->oilTemp,
-        d->timingAdv, d->o2Voltage, d->fuelPressure,
-        d->battV, d->battI, d->setA,
-        d->tempT1, d->tempT2, d->tempAmb,
-        d->targetCurrent, d->fault, d->alarm, d->status);
+static size_t serializeData(Print &out, const VehicleData *d, const ObdScheduler *obd,
+                            const char *dtcCodes[], int dtcCount,
+                            bool sdOk, uint64_t sdFreeMB,
+                            const ModbusSlave *slaves, int slaveCount) {
+    char chunk[128];
+    JsonWriter w;
+    jw_init(&w, chunk, sizeof(chunk), &out);
+
+    jw_obj(&w);
+    // Record fields the host wants (all without a subscription), then
+    // extra subscribed PIDs under their hex id
+    jw_obj(&w, "obd");
+    for (int i = 0; i < OBD_SIGNAL_COUNT; i++) {
+        if (!obd_signal_streamed(obd, i)) continue;
+        jw_fixed(&w, OBD_SIGNALS[i].key, obd_signal_value(d, OBD_SIGNALS[i].pid),
+                 OBD_SIGNALS[i].decimals);
+    }
+    for (int i = OBD_SIGNAL_COUNT; obd && i < obd->count; i++) {
+        const ObdSlot *slot = &obd->slots[i];
+        const OBD2_PID *info = obd_pid_info(slot->pid);
+        if (!slot->subMs || !info) continue;
+        jw_fixed(&w, slot->key, slot->value, obd_pid_decimals(info));
+    }
+    jw_obj_end(&w);
+
+    jw_obj(&w, "chg");
+    jw_fixed(&w, "v", d->battV, 2);
+    jw_fixed(&w, "a", d->battI, 2);
+    jw_fixed(&w, "set", d->setA, 1);
+    jw_int(&w, "t1", d->tempT1);
+    jw_int(&w, "t2", d->tempT2);
+    jw_int(&w, "amb", d->tempAmb);
+    jw_fixed(&w, "rate", d->targetCurrent, 1);
+    jw_str(&w, "lim", d->chargeLimit);
+    jw_uint(&w, "fault", d->fault);
+    jw_uint(&w, "alarm", d->alarm);
+    jw_uint(&w, "status", d->status);
+    jw_obj_end(&w);
+
+    // Per-device section, one object per RS485 slave
+    if (slaveCount > 0) {
+        jw_arr(&w, "dev");
+        for (int i = 0; i < slaveCount; i++) {
+            const ModbusSlave *s = &slaves[i];
+            const ModbusProfile *p = s->profile;
+            jw_obj(&w);
+            jw_uint(&w, "addr", s->addr);
+            jw_str(&w, "type", p->name);
+            jw_bool(&w, "ok", s->ok);
+            for (uint8_t f = 0; f < p->fieldCount && f < MB_MAX_FIELDS; f++) {
+                jw_fixed(&w, p->fields[f].key, s->values[f], p->fields[f].scale < 1.0f ? 2 : 0);
+            }
+            if (p->type == MB_DEV_CHARGER && s->setA >= 0) {
+                jw_fixed(&w, "set", s->setA, 1);
+            }
+            jw_obj_end(&w);
+        }
+        jw_arr_end(&w);
+    }
 
     // Add DTCs if any
     if (dtcCount > 0) {
-        len += snprintf(buf + len, bufSize - len, ",\"dtc\":[");
+        jw_arr(&w, "dtc");
         for (int i = 0; i < dtcCount && i < 32; i++) {
-            if (i > 0) len += snprintf(buf + len, bufSize - len, ",");
-            len += snprintf(buf + len, bufSize - len, "\"%s\"", dtcCodes[i]);
+            jw_str(&w, NULL, dtcCodes[i]);
         }
-        len += snprintf(buf + len, bufSize - len, "]");
+        jw_arr_end(&w);
     }
 
+    // Trip computer (trip_stats.h)
+    jw_obj(&w, "trip");
+    jw_fixed(&w, "km", d->tripKm, 2);
+    jw_fixed(&w, "l", d->tripFuelL, 2);
+    jw_fixed(&w, "l100", d->tripLPer100, 1);
+    jw_fixed(&w, "avg", d->tripAvgKmh, 1);
+    jw_fixed(&w, "ah", d->tripAh, 2);
+    jw_fixed(&w, "wh", d->tripWh, 0);
+    jw_uint(&w, "eng_s", d->tripEngineS);
+    jw_obj_end(&w);
+
     // SD status
-    len += snprintf(buf + len, bufSize - len,
-        ",\"sd\":{\"ok\":%s,\"free_mb\":%llu}",
-        sdOk ? "true" : "false", sdFreeMB);
+    jw_obj(&w, "sd");
+    jw_bool(&w, "ok", sdOk);
+    jw_uint(&w, "free_mb", sdFreeMB);
+    jw_uint(&w, "drop", d->sdDrops);
+    jw_uint(&w, "wr_ms", d->sdWriteMs);
+    jw_arr(&w, "lines");
+    for (int i = 0; i < VD_SD_CHANNELS; i++) jw_uint(&w, NULL, d->sdLines[i]);
+    jw_arr_end(&w);
+    jw_arr(&w, "lost");
+    for (int i = 0; i < VD_SD_CHANNELS; i++) jw_uint(&w, NULL, d->sdLost[i]);
+    jw_arr_end(&w);
+    jw_arr(&w, "tier_n");
+    for (int i = 0; i < VD_LG_TIERS; i++) jw_uint(&w, NULL, d->tierRows[i]);
+    jw_arr_end(&w);
+    jw_arr(&w, "tier_lost");
+    for (int i = 0; i < VD_LG_TIERS; i++) jw_uint(&w, NULL, d->tierLost[i]);
+    jw_arr_end(&w);
+    jw_obj_end(&w);
 
     // Connectivity status
-    len += snprintf(buf + len, bufSize - len,
-        ",\"can\":%s,\"rs485\":%s",
-        d->canOk ? "true" : "false",
-        d->rs485Ok ? "true" : "false");
+    jw_bool(&w, "can", d->canOk);
+    jw_bool(&w, "rs485", d->rs485Ok);
+    jw_uint(&w, "trunc", d->tbTruncated);
 
-    // Timestamp
-    len += snprintf(buf + len, bufSize - len,
-        ",\"ts\":%lu}\n", millis());
+    // Bridge TX path: queue depth (bytes) and drops
+    jw_obj(&w, "tx");
+    jw_uint(&w, "q", d->txQueued);
+    jw_uint(&w, "drop", d->txDrops);
+    jw_uint(&w, "rdrop", d->txReplyDrops);
+    jw_obj_end(&w);
 
-    return len;
+    // Host → bridge: command lines, unknown commands, ids lost in transit
+    jw_obj(&w, "link");
+    jw_uint(&w, "rx", d->rxLines);
+    jw_uint(&w, "bad", d->rxBad);
+    jw_uint(&w, "lost", d->rxLost);
+    jw_obj_end(&w);
+
+    // Record sequence number and timestamp
+    jw_uint(&w, "seq", d->txSeq);
+    jw_uint(&w, "ts", millis());
+    jw_obj_end(&w);
+    return jw_end(&w);
+}
+
+/**
+ * get_trip reply: the headline figures, then per signal the time-weighted
+ * mean, deviation and range, and the histograms in seconds per bin
+ */
+static size_t serializeTrip(Print &out, const TripStats *t) {
+    char chunk[128];
+    JsonWriter w;
+    jw_init(&w, chunk, sizeof(chunk), &out);
+    const TsMoments *m = t->tot.m;
+    const char *src;
+    double fuel = ts_fuel_l(t, &src);
+
+    jw_obj(&w);
+    jw_obj(&w, "trip");
+    jw_fixed(&w, "km", (float)ts_km(t), 3);
+    jw_fixed(&w, "l", (float)fuel, 3);
+    jw_str(&w, "fuel_src", src);
+    jw_fixed(&w, "l100", ts_l_per_100km(t), 2);
+    jw_fixed(&w, "avg", ts_avg_kmh(t), 1);
+    jw_fixed(&w, "ah", (float)(m[TS_AMPS].integral / 3600.0), 3);
+    jw_fixed(&w, "wh", (float)(m[TS_WATTS].integral / 3600.0), 1);
+    jw_uint(&w, "eng_s", (uint64_t)m[TS_RPM].active);
+    jw_uint(&w, "drive_s", (uint64_t)m[TS_SPEED].active);
+    jw_uint(&w, "chg_s", (uint64_t)m[TS_AMPS].active);
+
+    jw_obj(&w, "stats");
+    for (int s = 0; s < TS_SIGNALS; s++) {
+        if (!m[s].n) continue;
+        jw_obj(&w, TS_KEYS[s]);
+        jw_uint(&w, "n", m[s].n);
+        jw_fixed(&w, "s", (float)m[s].w, 1);
+        jw_fixed(&w, "mean", (float)m[s].mean, 2);
+        jw_fixed(&w, "sd", (float)ts_stddev(&m[s]), 2);
+        jw_fixed(&w, "min", m[s].min, 2);
+        jw_fixed(&w, "max", m[s].max, 2);
+        jw_obj_end(&w);
+    }
+    jw_obj_end(&w);
+
+    jw_obj(&w, "hist");
+    for (int h = 0; h < TS_HIST_COUNT; h++) {
+        const TsHistDef *def = &TS_HISTS[h];
+        jw_obj(&w, TS_KEYS[def->signal]);
+        jw_fixed(&w, "w", def->width, 0);
+        jw_arr(&w, "s");
+        for (int b = 0; b < def->bins; b++) {
+            jw_fixed(&w, NULL, t->tot.hist[def->first + b] / 1000.0f, 1);
+        }
+        jw_arr_end(&w);
+        jw_obj_end(&w);
+    }
+    jw_obj_end(&w);
+    jw_obj_end(&w);
+    jw_obj_end(&w);
+    return jw_end(&w);
 }
 
 /**
@@ -112,47 +470,122 @@ static ParsedCommand parseCommand(const char *json) {
     cmd.type = CMD_NONE;
     cmd.floatVal = 0;
     cmd.intVal = 0;
+    cmd.dev = 0;
+    cmd.id = 0;
+    cmd.name[0] = '\0';
+    cmd.raw = json;
+
+    long id;
+    if (jsonFindLong(json, "id", &id) && id > 0) cmd.id = (uint32_t)id;
 
-    // Find "cmd" field
+    // Command name, matched exactly
     const char *cmdStr = strstr(json, "\"cmd\":");
-    if (!cmdStr) return cmd;
+    if (!cmdStr) {
+        cmd.type = CMD_UNKNOWN;
+        return cmd;
+    }
     cmdStr += 6;  // Skip "cmd":
-
-    // Skip whitespace and opening quote
     while (*cmdStr == ' ' || *cmdStr == '"') cmdStr++;
+    size_t len = 0;
+    while (cmdStr[len] && cmdStr[len] != '"' && cmdStr[len] != '\\' &&
+           len < sizeof(cmd.name) - 1) len++;
+    memcpy(cmd.name, cmdStr, len);
+    cmd.name[len] = '\0';
 
-    if (strncmp(cmdStr, "scan_dtc", 8) == 0) {
-        cmd.type = CMD_SCAN_DTC;
-    } else if (strncmp(cmdStr, "clear_dtc", 9) == 0) {
-        cmd.type = CMD_CLEAR_DTC;
-    } else if (strncmp(cmdStr, "set_current", 11) == 0) {
-        cmd.type = CMD_SET_CURRENT;
-        // Find "val" field
-        const char *valStr = strstr(json, "\"val\":");
-        if (valStr) {
-            valStr += 6;
-            cmd.floatVal = atof(valStr);
-        }
-    } else if (strncmp(cmdStr, "set_log_interval", 16) == 0) {
-        cmd.type = CMD_SET_LOG_INTERVAL;
-        const char *valStr = strstr(json, "\"val\":");
-        if (valStr) {
-            valStr += 6;
-            cmd.intVal = atoi(valStr);
+    cmd.type = CMD_UNKNOWN;
+    for (size_t i = 0; i < sizeof(BRIDGE_COMMANDS) / sizeof(BRIDGE_COMMANDS[0]); i++) {
+        if (strcmp(cmd.name, BRIDGE_COMMANDS[i].name) == 0) {
+            cmd.type = BRIDGE_COMMANDS[i].type;
+            break;
         }
-    } else if (strncmp(cmdStr, "get_supported_pids", 18) == 0) {
-        cmd.type = CMD_GET_SUPPORTED_PIDS;
-    } else if (strncmp(cmdStr, "shutdown", 8) == 0) {
-        cmd.type = CMD_SHUTDOWN;
     }
 
+    float f;
+    if (jsonFindFloat(json, "val", &f)) {
+        cmd.floatVal = f;
+        cmd.intVal = (int)f;
+    }
+    long dev;
+    if (jsonFindLong(json, "dev", &dev)) cmd.dev = (uint8_t)dev;
+
     return cmd;
 }
 
+/**
+ * Output for replies and events. In JSON mode bytes pass straight to the
+ * port; in binary mode each line is held until its newline and sent as
+ * one TB_MSG_JSON frame, so the host only has to split on 0x00.
+ */
+class BridgeOut : public Print {
+public:
+    explicit BridgeOut(Print &port) : _port(port) {}
+
+    TelemetryFormat format = FMT_JSON;
+    uint32_t overflows = 0;     // Reply lines too long for one frame
+
+    size_t write(uint8_t c) override {
+        if (_replyId && c == '{') {
+            char tag[20];
+            int n = snprintf(tag, sizeof(tag), "{\"id\":%lu,", (unsigned long)_replyId);
+            _replyId = 0;
+            write((const uint8_t *)tag, n);
+            return 1;
+        }
+        if (format == FMT_JSON) return _port.write(c);
+        if (c == '\n') {
+            flushLine();
+        } else if (c != '\r') {
+            if (_len < sizeof(_line)) _line[_len++] = (char)c;
+            else _overflow = true;
+        }
+        return 1;
+    }
+
+    size_t write(const uint8_t *buf, size_t size) override {
+        if (format == FMT_JSON && !_replyId) return _port.write(buf, size);
+        for (size_t i = 0; i < size; i++) write(buf[i]);
+        return size;
+    }
+
+    // Tag the next reply line with a request id: {"id":N,...}. 0 clears.
+    void replyTo(uint32_t id) { _replyId = id; }
+
+    void setFormat(TelemetryFormat fmt) {
+        flushLine();
+        format = fmt;
+    }
+
+    // Frame a payload built by a tb_build_* function; dst defaults to the port
+    void sendPayload(uint8_t *payload, size_t len, Print *dst = NULL) {
+        size_t n = tb_frame(payload, len, _frame, sizeof(_frame));
+        if (n) (dst ? *dst : _port).write(_frame, n);
+    }
+
+private:
+    void flushLine() {
+        if (_overflow) {
+            overflows++;
+        } else if (_len > 0) {
+            size_t n = tb_build_json(_payload, sizeof(_payload), _line, _len);
+            if (n) sendPayload(_payload, n);
+        }
+        _len = 0;
+        _overflow = false;
+    }
+
+    Print &_port;
+    uint32_t _replyId = 0;
+    char _line[TB_PAYLOAD_MAX - 1];
+    size_t _len = 0;
+    bool _overflow = false;
+    uint8_t _payload[TB_PAYLOAD_MAX + 2];
+    uint8_t _frame[TB_FRAME_MAX];
+};
+
 /**
  * Send supported PIDs list as JSON
  */
-static void sendSupportedPIDs(Stream &serial) {
+static void sendSupportedPIDs(Print &serial) {
     serial.print("{\"supported_pids\":[");
     for (int i = 0; i < MODE01_PID_COUNT; i++) {
         if (i > 0) serial.print(",");
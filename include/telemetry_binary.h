@@ -0,0 +1,379 @@
+/**
+ * @file telemetry_binary.h
+ * Compact binary telemetry — negotiated alternative to the JSON stream
+ *
+ * Frame on the wire:   COBS( payload | CRC16 ) 0x00
+ *   CRC16 is the Modbus CRC (mb_crc16) over the payload, low byte first.
+ *   COBS removes every 0x00 from the frame, so 0x00 only ever marks a
+ *   frame boundary and a receiver resyncs after one corrupt frame.
+ *
+ * Payloads (first byte = message type, multi-byte values little-endian):
+ *   SCHEMA  01 | ver | schema_id:u16 | n | n × descriptor
+ *           descriptor = id | type | decimals | klen | key[klen]
+ *                        [TB_ENUM only: nlen | "name|name|..."]
+ *   DATA    02 | schema_id:u16 | seq:u16 | flags | ts_ms:u32 | n | n × (id | value)
+ *   JSON    03 | one JSON reply/event line, without the newline
+ *
+ * Values are fixed point: real = raw / 10^decimals, width set by the
+ * field type. Keys are dotted paths into the JSON shape ("obd.spd",
+ * "dev.0.v") so the host decodes both formats to the same dict.
+ * schema_id is a CRC of the descriptors; a DATA frame whose id the host
+ * doesn't know means it should send get_schema.
+ *
+ * Delta mode: a keyframe (flags bit 0) carries every field; frames in
+ * between carry only fields that moved more than their deadband since
+ * they were last sent, and go out even when empty as a heartbeat. seq
+ * counts every DATA frame, so a gap tells the host to send keyframe.
+ *
+ * No Arduino calls — tools/ can build and decode frames on the host.
+ */
+
+#ifndef TELEMETRY_BINARY_H
+#define TELEMETRY_BINARY_H
+
+#include <math.h>
+#include <string.h>
+#include "modbus_rtu.h"
+#include "vehicle_data.h"
+#include "modbus_devices.h"
+#include "charge_controller.h"
+#include "obd_scheduler.h"
+
+#define TB_VERSION      2
+#define TB_PAYLOAD_MAX  3072            // Largest payload (a JSON reply line)
+#define TB_FRAME_MAX    (TB_PAYLOAD_MAX + 2 + TB_PAYLOAD_MAX / 254 + 3)
+
+// Most fields tb_collect() can produce in this build: every OBD slot
+// (signals and subscriptions), each slave's addr/type/ok/set and its
+// fields, and the fixed ones (chg 11, trip 7, sd 4 plus the per-channel
+// and per-tier counters, can/rs485/trunc 3, tx 3, link 3)
+#define TB_DEV_VALUES   (4 + MB_MAX_FIELDS)
+#define TB_FIXED_VALUES (11 + 7 + 4 + 2 * VD_SD_CHANNELS + 2 * VD_LG_TIERS + 3 + 3 + 3)
+#define TB_MAX_VALUES   (OBD_MAX_SLOTS + MB_SLAVE_COUNT * TB_DEV_VALUES + TB_FIXED_VALUES)
+static_assert(TB_MAX_VALUES <= 255, "SCHEMA and DATA count their fields in a byte");
+
+enum TbMessage : uint8_t {
+    TB_MSG_SCHEMA = 0x01,
+    TB_MSG_DATA   = 0x02,
+    TB_MSG_JSON   = 0x03,
+};
+
+#define TB_FLAG_KEYFRAME 0x01
+
+enum TbType : uint8_t {
+    TB_BOOL = 1,    // 1 byte, 0/1
+    TB_U8,
+    TB_I16,
+    TB_U16,
+    TB_I32,
+    TB_U32,
+    TB_ENUM,        // 1 byte index into the names sent with the schema
+};
+
+static inline uint8_t tb_type_width(uint8_t type) {
+    switch (type) {
+        case TB_I16: case TB_U16: return 2;
+        case TB_I32: case TB_U32: return 4;
+        default:                  return 1;
+    }
+}
+
+// One telemetry value, in schema order (id = position)
+struct TbValue {
+    const char *group;              // "obd", "chg", "sd", "dev" or NULL (top level)
+    int8_t index;                   // Slot within "dev", -1 otherwise
+    const char *key;                // NULL: element `index` of the list `group`
+    uint8_t type;
+    uint8_t decimals;
+    int32_t raw;
+    int32_t deadband;               // Delta frames skip changes within ±deadband (raw units)
+    const char *const *names;       // TB_ENUM only
+    uint8_t nameCount;
+};
+
+/* ══════════════════════════════════════════════════════════════
+ * COBS
+ * ══════════════════════════════════════════════════════════════*/
+
+// Encode len bytes into dst (no trailing delimiter), returns encoded length
+static inline size_t tb_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst) {
+    size_t out = 1, code_pos = 0;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        } else {
+            dst[out++] = src[i];
+            if (++code == 0xFF) {
+                dst[code_pos] = code;
+                code_pos = out++;
+                code = 1;
+            }
+        }
+    }
+    dst[code_pos] = code;
+    return out;
+}
+
+// Decode one frame (delimiter already stripped), returns length or 0 on error
+static inline size_t tb_cobs_decode(const uint8_t *src, size_t len, uint8_t *dst) {
+    size_t in = 0, out = 0;
+    while (in < len) {
+        uint8_t code = src[in++];
+        if (code == 0 || in + code - 1 > len) return 0;
+        for (uint8_t i = 1; i < code; i++) dst[out++] = src[in++];
+        if (code != 0xFF && in < len) dst[out++] = 0;
+    }
+    return out;
+}
+
+/**
+ * Wrap a payload into a complete wire frame. payload must have 2 spare
+ * bytes after len for the CRC. Returns frame length or 0 if cap is short.
+ */
+static inline size_t tb_frame(uint8_t *payload, size_t len, uint8_t *out, size_t cap) {
+    if (cap < len + 2 + len / 254 + 3) return 0;
+    len = mb_append_crc(payload, len);
+    size_t n = tb_cobs_encode(payload, len, out);
+    out[n++] = 0x00;
+    return n;
+}
+
+/**
+ * Check and strip the CRC of a decoded frame.
+ * Returns payload length, or 0 if the frame is corrupt.
+ */
+static inline size_t tb_unframe(const uint8_t *src, size_t len, uint8_t *dst) {
+    size_t n = tb_cobs_decode(src, len, dst);
+    if (n < 3 || !mb_check_crc(dst, n)) return 0;
+    return n - 2;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * FIELD TABLE — same fields, keys and precision as serializeData()
+ * ══════════════════════════════════════════════════════════════*/
+
+static inline void tb_put_le(uint8_t *p, uint32_t v, uint8_t width) {
+    for (uint8_t i = 0; i < width; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline int32_t tb_fixed(float v, uint8_t decimals) {
+    static const float scale[] = {1, 10, 100, 1000};
+    return (int32_t)lroundf(v * scale[decimals]);
+}
+
+static inline uint8_t tb_limiter_index(const char *name) {
+    for (uint8_t i = 0; i < sizeof(CHARGE_LIMITER_NAMES) / sizeof(CHARGE_LIMITER_NAMES[0]); i++) {
+        if (strcmp(CHARGE_LIMITER_NAMES[i], name) == 0) return i;
+    }
+    return LIMIT_NO_DATA;
+}
+
+/**
+ * Flatten the current state into out[] in schema order.
+ * The order depends only on the build (slave list) and the OBD
+ * subscription, never on values; a new subscription needs a new schema.
+ * Returns the number of fields in the record, like snprintf(): more
+ * than max means only the first max were written.
+ */
+static int tb_collect(TbValue *out, int max, const VehicleData *d,
+                      const ObdScheduler *obd, bool sdOk, uint64_t sdFreeMB,
+                      const ModbusSlave *slaves, int slaveCount) {
+    int n = 0;
+    auto add = [&](const char *group, int8_t index, const char *key,
+                   uint8_t type, uint8_t decimals, int32_t raw, int32_t band) -> TbValue * {
+        if (n++ >= max) return NULL;
+        TbValue *v = &out[n - 1];
+        *v = {group, index, key, type, decimals, raw, band, NULL, 0};
+        return v;
+    };
+
+    // Width from the PID's range, so e.g. MAF (655.35 g/s) gets 32 bits
+    auto obdType = [](uint8_t pid, uint8_t dec) -> uint8_t {
+        const OBD2_PID *info = obd_pid_info(pid);
+        float span = info ? fmaxf(fabsf(info->minVal), fabsf(info->maxVal)) : 32767;
+        return span * powf(10, dec) > 32767 ? TB_I32 : TB_I16;
+    };
+    for (int i = 0; i < OBD_SIGNAL_COUNT; i++) {
+        if (!obd_signal_streamed(obd, i)) continue;
+        const ObdSignal *sig = &OBD_SIGNALS[i];
+        add("obd", -1, sig->key, obdType(sig->pid, sig->decimals), sig->decimals,
+            tb_fixed(obd_signal_value(d, sig->pid), sig->decimals), sig->deadband);
+    }
+    for (int i = OBD_SIGNAL_COUNT; obd && i < obd->count; i++) {
+        const ObdSlot *slot = &obd->slots[i];
+        const OBD2_PID *info = obd_pid_info(slot->pid);
+        if (!slot->subMs || !info) continue;
+        uint8_t dec = obd_pid_decimals(info);
+        add("obd", -1, slot->key, obdType(slot->pid, dec), dec, tb_fixed(slot->value, dec), 0);
+    }
+
+    add("chg", -1, "v",         TB_U16, 2, tb_fixed(d->battV, 2), 1);
+    add("chg", -1, "a",         TB_I16, 2, tb_fixed(d->battI, 2), 2);
+    add("chg", -1, "set",       TB_I16, 1, tb_fixed(d->setA, 1), 0);
+    add("chg", -1, "t1",        TB_I16, 0, d->tempT1, 0);
+    add("chg", -1, "t2",        TB_I16, 0, d->tempT2, 0);
+    add("chg", -1, "amb",       TB_I16, 0, d->tempAmb, 0);
+    add("chg", -1, "rate",      TB_I16, 1, tb_fixed(d->targetCurrent, 1), 0);
+    TbValue *lim = add("chg", -1, "lim", TB_ENUM, 0, tb_limiter_index(d->chargeLimit), 0);
+    if (lim) {
+        lim->names = CHARGE_LIMITER_NAMES;
+        lim->nameCount = sizeof(CHARGE_LIMITER_NAMES) / sizeof(CHARGE_LIMITER_NAMES[0]);
+    }
+    add("chg", -1, "fault",     TB_U16, 0, d->fault, 0);
+    add("chg", -1, "alarm",     TB_U16, 0, d->alarm, 0);
+    add("chg", -1, "status",    TB_U16, 0, d->status, 0);
+
+    for (int i = 0; i < slaveCount; i++) {
+        const ModbusSlave *s = &slaves[i];
+        const ModbusProfile *p = s->profile;
+        add("dev", i, "addr", TB_U8, 0, s->addr, 0);
+        TbValue *type = add("dev", i, "type", TB_ENUM, 0, 0, 0);
+        if (type) {
+            type->names = &p->name;
+            type->nameCount = 1;
+        }
+        add("dev", i, "ok", TB_BOOL, 0, s->ok, 0);
+        for (uint8_t f = 0; f < p->fieldCount && f < MB_MAX_FIELDS; f++) {
+            uint8_t dec = p->fields[f].scale < 1.0f ? 2 : 0;
+            add("dev", i, p->fields[f].key, TB_I32, dec, tb_fixed(s->values[f], dec), dec ? 1 : 0);
+        }
+        if (p->type == MB_DEV_CHARGER) {
+            add("dev", i, "set", TB_I16, 1, tb_fixed(s->setA, 1), 0);
+        }
+    }
+
+    add("trip", -1, "km",     TB_U32,  2, tb_fixed(d->tripKm, 2), 1);
+    add("trip", -1, "l",      TB_U32,  2, tb_fixed(d->tripFuelL, 2), 1);
+    add("trip", -1, "l100",   TB_I16,  1, tb_fixed(d->tripLPer100, 1), 1);
+    add("trip", -1, "avg",    TB_U16,  1, tb_fixed(d->tripAvgKmh, 1), 1);
+    add("trip", -1, "ah",     TB_U32,  2, tb_fixed(d->tripAh, 2), 1);
+    add("trip", -1, "wh",     TB_U32,  0, tb_fixed(d->tripWh, 0), 1);
+    add("trip", -1, "eng_s",  TB_U32,  0, (int32_t)d->tripEngineS, 0);
+    add("sd", -1, "ok",       TB_BOOL, 0, sdOk, 0);
+    add("sd", -1, "free_mb",  TB_U32,  0, (int32_t)sdFreeMB, 1);
+    add("sd", -1, "drop",     TB_U32,  0, (int32_t)d->sdDrops, 0);
+    add("sd", -1, "wr_ms",    TB_U32,  0, (int32_t)d->sdWriteMs, 0);
+    for (int i = 0; i < VD_SD_CHANNELS; i++) {
+        add("sd.lines", i, NULL, TB_U32, 0, (int32_t)d->sdLines[i], 64);
+        add("sd.lost", i, NULL,  TB_U32, 0, (int32_t)d->sdLost[i], 0);
+    }
+    for (int i = 0; i < VD_LG_TIERS; i++) {
+        add("sd.tier_n", i, NULL,    TB_U32, 0, (int32_t)d->tierRows[i], 1);
+        add("sd.tier_lost", i, NULL, TB_U32, 0, (int32_t)d->tierLost[i], 0);
+    }
+    add(NULL, -1, "can",      TB_BOOL, 0, d->canOk, 0);
+    add(NULL, -1, "rs485",    TB_BOOL, 0, d->rs485Ok, 0);
+    add(NULL, -1, "trunc",    TB_U32,  0, (int32_t)d->tbTruncated, 0);
+    add("tx", -1, "q",        TB_U32,  0, (int32_t)d->txQueued, 64);
+    add("tx", -1, "drop",     TB_U32,  0, (int32_t)d->txDrops, 0);
+    add("tx", -1, "rdrop",    TB_U32,  0, (int32_t)d->txReplyDrops, 0);
+    add("link", -1, "rx",     TB_U32,  0, (int32_t)d->rxLines, 0);
+    add("link", -1, "bad",    TB_U32,  0, (int32_t)d->rxBad, 0);
+    add("link", -1, "lost",   TB_U32,  0, (int32_t)d->rxLost, 0);
+    return n;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * MESSAGE BUILDERS — return payload length (CRC not yet added)
+ * ══════════════════════════════════════════════════════════════*/
+
+// Full field name as the schema carries it: "can", "chg.t1", "dev.0.v",
+// "sd.lines.0"
+static int tb_key(const TbValue *v, char *out, size_t size) {
+    return v->group == NULL ? snprintf(out, size, "%s", v->key)
+         : v->key == NULL   ? snprintf(out, size, "%s.%d", v->group, v->index)
+         : v->index < 0     ? snprintf(out, size, "%s.%s", v->group, v->key)
+         : snprintf(out, size, "%s.%d.%s", v->group, v->index, v->key);
+}
+
+static size_t tb_build_schema(uint8_t *buf, size_t cap, const TbValue *v, int n,
+                              uint16_t *schemaId) {
+    if (cap < 5) return 0;
+    size_t len = 5;
+    buf[0] = TB_MSG_SCHEMA;
+    buf[1] = TB_VERSION;
+    buf[4] = (uint8_t)n;
+
+    for (int i = 0; i < n; i++) {
+        char key[48];
+        int klen = tb_key(&v[i], key, sizeof(key));
+        if (klen >= (int)sizeof(key)) klen = sizeof(key) - 1;
+        if (len + 4 + klen + 2 > cap) return 0;
+        buf[len++] = (uint8_t)i;
+        buf[len++] = v[i].type;
+        buf[len++] = v[i].decimals;
+        buf[len++] = (uint8_t)klen;
+        memcpy(buf + len, key, klen);
+        len += klen;
+
+        if (v[i].type == TB_ENUM) {
+            size_t nlenPos = len++;
+            for (uint8_t k = 0; k < v[i].nameCount; k++) {
+                size_t sl = strlen(v[i].names[k]);
+                if (len + sl + 3 > cap || len - nlenPos + sl > 255) return 0;
+                if (k > 0) buf[len++] = '|';
+                memcpy(buf + len, v[i].names[k], sl);
+                len += sl;
+            }
+            buf[nlenPos] = (uint8_t)(len - nlenPos - 1);
+        }
+    }
+
+    uint16_t id = mb_crc16(buf + 4, len - 4);
+    tb_put_le(buf + 2, id, 2);
+    *schemaId = id;
+    return len;
+}
+
+// Sender side of delta mode: what the host was last told, per field id
+struct TbDeltaState {
+    int32_t sent[TB_MAX_VALUES];
+    uint16_t seq = 0;
+    bool keyDue = true;
+    uint32_t lastKeyMs = 0;
+};
+
+/**
+ * Data record. With keyframe every field is written; otherwise only
+ * fields outside their deadband relative to st->sent. Advances st->seq.
+ */
+static size_t tb_build_data(uint8_t *buf, size_t cap, const TbValue *v, int n,
+                            uint16_t schemaId, uint32_t tsMs,
+                            TbDeltaState *st, bool keyframe) {
+    if (cap < 11) return 0;
+    buf[0] = TB_MSG_DATA;
+    tb_put_le(buf + 1, schemaId, 2);
+    tb_put_le(buf + 3, st->seq, 2);
+    buf[5] = keyframe ? TB_FLAG_KEYFRAME : 0;
+    tb_put_le(buf + 6, tsMs, 4);
+    size_t len = 11;
+    uint8_t count = 0;
+    for (int i = 0; i < n && i < TB_MAX_VALUES; i++) {
+        if (!keyframe) {
+            int32_t diff = v[i].raw - st->sent[i];
+            if (diff <= v[i].deadband && diff >= -v[i].deadband) continue;
+        }
+        uint8_t w = tb_type_width(v[i].type);
+        if (len + 1 + w + 2 > cap) return 0;
+        buf[len++] = (uint8_t)i;
+        tb_put_le(buf + len, (uint32_t)v[i].raw, w);
+        len += w;
+        st->sent[i] = v[i].raw;
+        count++;
+    }
+    buf[10] = count;
+    st->seq++;
+    return len;
+}
+
+static size_t tb_build_json(uint8_t *buf, size_t cap, const char *text, size_t textLen) {
+    if (textLen + 1 + 2 > cap) return 0;
+    buf[0] = TB_MSG_JSON;
+    memcpy(buf + 1, text, textLen);
+    return textLen + 1;
+}
+
+#endif // TELEMETRY_BINARY_H
@@ -0,0 +1,228 @@
+/**
+ * @file trip_stats.h
+ * Trip computer: running statistics, histograms and integrals on device
+ *
+ * Every sample that arrives (each OBD reply, each charger poll) updates
+ * the trip in O(1) time and fixed memory, at whatever rate the signal is
+ * polled. A value counts for the time until the next sample of the same
+ * signal:
+ *   - mean and variance are time weighted (weighted Welford update, West
+ *     1979), so a signal polled faster doesn't weigh more,
+ *   - histograms hold milliseconds spent in each fixed-width bin,
+ *   - integrals (distance, fuel, Ah, Wh) use the trapezoid between two
+ *     samples.
+ * A missed reply just makes one interval longer. Gaps over TS_GAP_MS
+ * (engine off, bus lost) are not bridged, so nothing drifts while there
+ * is no data.
+ *
+ * TripTotals is what NVS keeps (nvs_save_blob(), see nvs_settings.h);
+ * the rest is rebuilt from the next samples after a reboot. Pure logic,
+ * no Arduino calls.
+ */
+
+#ifndef TRIP_STATS_H
+#define TRIP_STATS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "vehicle_data.h"
+
+#define TS_VERSION          1
+#define TS_GAP_MS           5000        // Longest interval integrated across
+#define TS_SAVE_MS          300000      // NVS write interval while driving
+#define TS_MAF_G_PER_L      (14.7f * 745.0f)    // Air per litre of petrol (stoichiometric)
+
+// Tracked signals, in TripTotals order
+enum TsSignal {
+    TS_SPEED,               // km/h
+    TS_RPM,
+    TS_LOAD,                // %
+    TS_FUEL_RATE,           // L/h (PID 0x5E)
+    TS_MAF,                 // g/s (PID 0x10): fuel when there's no fuel rate
+    TS_AMPS,                // Charger output, A
+    TS_WATTS,               // Charger output, W
+    TS_SIGNALS
+};
+
+static const char *const TS_KEYS[TS_SIGNALS] = {
+    "spd", "rpm", "load", "fuel_rate", "maf", "a", "w",
+};
+
+// Fixed-width histograms; the last bin takes everything above
+struct TsHistDef {
+    uint8_t signal;
+    float width;
+    uint8_t bins;
+    uint8_t first;          // Offset in TripTotals::hist
+};
+
+static const TsHistDef TS_HISTS[] = {
+    {TS_SPEED, 10,  20, 0},     // 0..190+ km/h
+    {TS_RPM,   500, 16, 20},    // 0..7500+ rpm
+    {TS_LOAD,  10,  10, 36},    // 0..90+ %
+};
+
+#define TS_HIST_COUNT   (int)(sizeof(TS_HISTS) / sizeof(TS_HISTS[0]))
+#define TS_HIST_BINS    46
+
+struct TsMoments {
+    uint32_t n;             // Samples
+    float min;
+    float max;
+    double w;               // Seconds covered
+    double mean;            // Time-weighted
+    double m2;              // Sum of weighted squared deviations
+    double integral;        // Value × seconds
+    double active;          // Seconds with the value above zero
+};
+
+struct TripTotals {
+    uint16_t version;
+    uint16_t size;
+    TsMoments m[TS_SIGNALS];
+    uint32_t hist[TS_HIST_BINS];    // ms per bin
+};
+
+struct TripStats {
+    TripTotals tot;
+    float last[TS_SIGNALS];         // Previous sample
+    uint32_t lastMs[TS_SIGNALS];
+    bool have[TS_SIGNALS];
+    bool dirty;                     // Driven since the last save (engine on or moving)
+    bool saveNow;                   // Engine just stopped: save without waiting
+    uint32_t savedMs;
+};
+
+static void ts_reset(TripStats *t) {
+    memset(t, 0, sizeof(*t));
+    t->tot.version = TS_VERSION;
+    t->tot.size = sizeof(TripTotals);
+    t->dirty = true;
+}
+
+// Totals read back from NVS; false if they are from another build
+static bool ts_restore(TripStats *t, const TripTotals *saved) {
+    if (saved->version != TS_VERSION || saved->size != sizeof(TripTotals)) return false;
+    memset(t, 0, sizeof(*t));
+    t->tot = *saved;
+    return true;
+}
+
+static inline void ts_moment(TsMoments *m, float x, double dt) {
+    double w = m->w + dt;
+    double delta = x - m->mean;
+    m->mean += delta * dt / w;
+    m->m2 += dt * delta * (x - m->mean);
+    m->w = w;
+    if (x > 0) m->active += dt;
+}
+
+static inline double ts_stddev(const TsMoments *m) {
+    return m->w > 0 ? sqrt(m->m2 / m->w) : 0;
+}
+
+/**
+ * One sample of signal s at now (ms). The previous sample is credited
+ * with the interval up to now; the area under both goes to the integral.
+ */
+static void ts_sample(TripStats *t, int s, uint32_t now, float x) {
+    TsMoments *m = &t->tot.m[s];
+    if (!m->n || x < m->min) m->min = x;
+    if (!m->n || x > m->max) m->max = x;
+    m->n++;
+
+    uint32_t gap = now - t->lastMs[s];
+    if (t->have[s] && gap && gap <= TS_GAP_MS) {
+        float x0 = t->last[s];
+        double dt = gap / 1000.0;
+        ts_moment(m, x0, dt);
+        m->integral += (x0 + x) * 0.5 * dt;
+        for (int h = 0; h < TS_HIST_COUNT; h++) {
+            const TsHistDef *def = &TS_HISTS[h];
+            if (def->signal != s || x0 < 0) continue;
+            int bin = (int)(x0 / def->width);
+            uint32_t *b = &t->tot.hist[def->first + (bin < def->bins ? bin : def->bins - 1)];
+            *b = *b + gap < *b ? UINT32_MAX : *b + gap;     // Saturate, ~49 days
+        }
+    }
+    if (s == TS_RPM && t->have[s] && t->last[s] > 0 && x <= 0) t->saveNow = true;
+    t->last[s] = x;
+    t->lastMs[s] = now;
+    t->have[s] = true;
+    // Only driving makes a save worth its flash wear: charger polls while
+    // parked add up until the next drive or engine stop saves them
+    if ((s == TS_RPM || s == TS_SPEED) && x > 0) t->dirty = true;
+}
+
+// A valid OBD reply for pid, already decoded into d (obd_sched_result())
+static void ts_obd(TripStats *t, uint8_t pid, uint32_t now, const VehicleData *d) {
+    switch (pid) {
+        case 0x0D: ts_sample(t, TS_SPEED, now, d->speed); break;
+        case 0x0C: ts_sample(t, TS_RPM, now, d->rpm); break;
+        case 0x04: ts_sample(t, TS_LOAD, now, d->load); break;
+        case 0x5E: ts_sample(t, TS_FUEL_RATE, now, d->fuelRate); break;
+        case 0x10: ts_sample(t, TS_MAF, now, d->maf); break;
+        default: break;
+    }
+}
+
+// A good poll of the primary charger
+static void ts_charger(TripStats *t, uint32_t now, float volts, float amps) {
+    ts_sample(t, TS_AMPS, now, amps);
+    ts_sample(t, TS_WATTS, now, volts * amps);
+}
+
+static inline double ts_km(const TripStats *t) {
+    return t->tot.m[TS_SPEED].integral / 3600.0;
+}
+
+/**
+ * Litres burnt: from the fuel rate PID where the ECU has it, otherwise
+ * from MAF at the stoichiometric ratio. *src names the one used.
+ */
+static double ts_fuel_l(const TripStats *t, const char **src) {
+    const TsMoments *rate = &t->tot.m[TS_FUEL_RATE], *maf = &t->tot.m[TS_MAF];
+    if (rate->w > 0 && rate->w >= maf->w) {
+        if (src) *src = "rate";
+        return rate->integral / 3600.0;
+    }
+    if (src) *src = maf->w > 0 ? "maf" : "none";
+    return maf->integral / TS_MAF_G_PER_L;
+}
+
+// L/100 km, -1 until there is a kilometre to divide by
+static inline float ts_l_per_100km(const TripStats *t) {
+    double km = ts_km(t);
+    return km >= 1.0 ? (float)(ts_fuel_l(t, NULL) / km * 100.0) : -1;
+}
+
+// Average while moving, km/h
+static inline float ts_avg_kmh(const TripStats *t) {
+    double h = t->tot.m[TS_SPEED].active / 3600.0;
+    return h > 0 ? (float)(ts_km(t) / h) : 0;
+}
+
+// Headline figures for the dashboard and the telemetry record
+static void ts_summary(const TripStats *t, VehicleData *d) {
+    d->tripKm = (float)ts_km(t);
+    d->tripFuelL = (float)ts_fuel_l(t, NULL);
+    d->tripLPer100 = ts_l_per_100km(t);
+    d->tripAvgKmh = ts_avg_kmh(t);
+    d->tripAh = (float)(t->tot.m[TS_AMPS].integral / 3600.0);
+    d->tripWh = (float)(t->tot.m[TS_WATTS].integral / 3600.0);
+    d->tripEngineS = (uint32_t)t->tot.m[TS_RPM].active;
+}
+
+// Worth writing to NVS now: every TS_SAVE_MS while driving, and once the engine stops
+static inline bool ts_save_due(const TripStats *t, uint32_t now) {
+    return t->dirty && (t->saveNow || now - t->savedMs >= TS_SAVE_MS);
+}
+
+static inline void ts_saved(TripStats *t, uint32_t now) {
+    t->dirty = false;
+    t->saveNow = false;
+    t->savedMs = now;
+}
+
+#endif // TRIP_STATS_H
@@ -3,8 +3,8 @@
  * LVGL Dashboard UI for Vehicle + Charger Monitor
  * Layout: 1024×600 dark industrial theme
  * 
- * Left panel:  OBD-II gauges (Speed, RPM, Coolant, Throttle)
- * Right panel: Charger data (Battery V, Current, Temps, Faults)
+ * Left panel:  OBD-II gauges (Speed, RPM, Coolant, Throttle), trip
+ * Right panel: Charger data (Battery V, Current, Temps, Charged, Faults)
  * Top bar:     CAN/RS485 status LEDs, title, uptime
  */
 
@@ -12,32 +12,8 @@
 #define UI_DASHBOARD_H
 
 #include <lvgl.h>
-
-/* ══════════════════════════════════════════════════════════════
- * DATA STRUCTURE — shared between main.cpp and UI
- * ══════════════════════════════════════════════════════════════*/
-struct VehicleData {
-    // OBD-II
-    int speed    = -1;
-    int rpm      = -1;
-    int ect      = -1;
-    int throttle = -1;
-    int load     = -1;
-    // Charger
-    float battV  = 0;
-    float battI  = 0;
-    float setA   = 12.0f;
-    float targetCurrent = 12.0f;
-    int tempT1   = 0;
-    int tempT2   = 0;
-    int tempAmb  = 0;
-    uint16_t fault  = 0;
-    uint16_t alarm  = 0;
-    uint16_t status = 0;
-    // Status
-    bool canOk   = false;
-    bool rs485Ok = false;
-};
+#include <string.h>
+#include "vehicle_data.h"
 
 /* ══════════════════════════════════════════════════════════════
  * COLOR PALETTE — Dark Industrial Theme
@@ -61,6 +37,9 @@ struct VehicleData {
 static lv_obj_t *arc_speed, *arc_rpm, *arc_ect, *arc_throttle;
 static lv_obj_t *lbl_speed_val, *lbl_rpm_val, *lbl_ect_val, *lbl_throttle_val;
 static lv_obj_t *lbl_load;
+static lv_obj_t *lbl_trip, *lbl_trip_fuel;
+
+static lv_obj_t *lbl_charged;
 
 static lv_obj_t *lbl_battV, *lbl_battI, *lbl_setA;
 static lv_obj_t *lbl_t1, *lbl_t2, *lbl_amb;
@@ -69,6 +48,12 @@ static lv_obj_t *lbl_fault_status;
 static lv_obj_t *led_can, *led_rs485;
 static lv_obj_t *lbl_uptime;
 
+static bool ui_trip_reset = false;     // Long press on the trip rows; main resets it
+
+static void on_trip_long_press(lv_event_t *e) {
+    ui_trip_reset = true;
+}
+
 /* ══════════════════════════════════════════════════════════════
  * STYLES
  * ══════════════════════════════════════════════════════════════*/
@@ -289,6 +274,15 @@ void ui_dashboard_create() {
     lv_obj_set_style_text_color(lbl_load, C_CYAN, 0);
     lv_obj_set_style_text_font(lbl_load, &lv_font_montserrat_20, 0);
 
+    // Trip computer; hold to reset
+    lbl_trip      = create_data_row(left, "TRIP", C_TEXT);
+    lbl_trip_fuel = create_data_row(left, "FUEL", C_ACCENT);
+    lv_obj_t *trip_rows[] = {lv_obj_get_parent(lbl_trip), lv_obj_get_parent(lbl_trip_fuel)};
+    for (lv_obj_t *row : trip_rows) {
+        lv_obj_add_flag(row, LV_OBJ_FLAG_CLICKABLE);
+        lv_obj_add_event_cb(row, on_trip_long_press, LV_EVENT_LONG_PRESSED, NULL);
+    }
+
     /* ─── RIGHT PANEL: CHARGER ───────────────────────────── */
     lv_obj_t *right = lv_obj_create(main_row);
     lv_obj_set_flex_grow(right, 2);
@@ -310,6 +304,7 @@ void ui_dashboard_create() {
     lbl_t1    = create_data_row(right, "TEMP T1",  C_CYAN);
     lbl_t2    = create_data_row(right, "TEMP T2",  C_CYAN);
     lbl_amb   = create_data_row(right, "AMBIENT",  C_DIM);
+    lbl_charged = create_data_row(right, "CHARGED", C_GREEN);
 
     // Fault / status box at bottom
     lv_obj_t *status_box = lv_obj_create(right);
@@ -332,7 +327,7 @@ void ui_dashboard_create() {
  * UPDATE THE DASHBOARD WITH LIVE DATA
  * ══════════════════════════════════════════════════════════════*/
 void ui_dashboard_update(VehicleData *d) {
-    char buf[48];
+    char buf[64];
 
     // ── OBD-II Gauges ──
     int spd = d->speed >= 0 ? d->speed : 0;
@@ -359,6 +354,18 @@ void ui_dashboard_update(VehicleData *d) {
     snprintf(buf, sizeof(buf), "%d%%", d->load >= 0 ? d->load : 0);
     lv_label_set_text(lbl_load, buf);
 
+    // ── Trip ──
+    unsigned long eng = d->tripEngineS;
+    snprintf(buf, sizeof(buf), "%.1f km  %.0f km/h  %lu:%02lu", d->tripKm, d->tripAvgKmh,
+             eng / 3600, (eng / 60) % 60);
+    lv_label_set_text(lbl_trip, buf);
+    if (d->tripLPer100 >= 0) {
+        snprintf(buf, sizeof(buf), "%.1f L  %.1f L/100km", d->tripFuelL, d->tripLPer100);
+    } else {
+        snprintf(buf, sizeof(buf), "%.1f L", d->tripFuelL);
+    }
+    lv_label_set_text(lbl_trip_fuel, buf);
+
     // ── Charger Data ──
     snprintf(buf, sizeof(buf), "%.2f V", d->battV);
     lv_label_set_text(lbl_battV, buf);
@@ -378,6 +385,9 @@ void ui_dashboard_update(VehicleData *d) {
     snprintf(buf, sizeof(buf), "%d \xC2\xB0""C", d->tempAmb);
     lv_label_set_text(lbl_amb, buf);
 
+    snprintf(buf, sizeof(buf), "%.1f Ah  %.0f Wh", d->tripAh, d->tripWh);
+    lv_label_set_text(lbl_charged, buf);
+
     // ── Status LEDs ──
     if (d->canOk)   lv_led_on(led_can);   else lv_led_off(led_can);
     if (d->rs485Ok) lv_led_on(led_rs485); else lv_led_off(led_rs485);
@@ -404,13 +414,15 @@ void ui_dashboard_update(VehicleData *d) {
         lv_obj_set_style_text_color(lbl_fault_status, C_ACCENT, 0);
         lv_obj_set_style_bg_color(box, lv_color_hex(0x451a03), 0);
         lv_obj_set_style_border_color(box, lv_color_hex(0x92400e), 0);
-    } else if (d->targetCurrent >= 30.0f) {
-        lv_label_set_text(lbl_fault_status, LV_SYMBOL_OK " CHARGING FULL RATE\n30A — All systems normal");
+    } else if (strcmp(d->chargeLimit, "none") == 0) {
+        snprintf(buf, sizeof(buf), LV_SYMBOL_OK " CHARGING FULL RATE\n%.0fA — All systems normal", d->setA);
+        lv_label_set_text(lbl_fault_status, buf);
         lv_obj_set_style_text_color(lbl_fault_status, C_GREEN, 0);
         lv_obj_set_style_bg_color(box, lv_color_hex(0x052e16), 0);
         lv_obj_set_style_border_color(box, lv_color_hex(0x166534), 0);
     } else {
-        lv_label_set_text(lbl_fault_status, LV_SYMBOL_OK " CHARGING REDUCED\n12A — Waiting for conditions");
+        snprintf(buf, sizeof(buf), LV_SYMBOL_OK " CHARGING %.1fA\nLimited by %s", d->setA, d->chargeLimit);
+        lv_label_set_text(lbl_fault_status, buf);
         lv_obj_set_style_text_color(lbl_fault_status, C_ACCENT, 0);
         lv_obj_set_style_bg_color(box, lv_color_hex(0x451a03), 0);
         lv_obj_set_style_border_color(box, lv_color_hex(0x78350f), 0);
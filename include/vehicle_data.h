@@ -0,0 +1,72 @@
+/**
+ * @file vehicle_data.h
+ * Live vehicle + charger data model shared by both build modes,
+ * the LVGL dashboard, the bridge serializer and the SD logger.
+ */
+
+#ifndef VEHICLE_DATA_H
+#define VEHICLE_DATA_H
+
+#include <stdint.h>
+
+#define VD_SD_CHANNELS 6        // sd_logger.h SdChannel: can, mesh, debug, tier_s, tier_m, trips
+#define VD_LG_TIERS 3           // log_tiers.h LgTier: second, minute, trip
+
+struct VehicleData {
+    // OBD-II
+    int speed    = -1;
+    int rpm      = -1;
+    int ect      = -1;
+    int throttle = -1;
+    int load     = -1;
+    // Charger (mirrors the primary charger on the RS485 bus)
+    float battV  = 0;
+    float battI  = 0;
+    float setA   = 12.0f;
+    float targetCurrent = 12.0f;       // Controller demand after derating
+    const char *chargeLimit = "no_data"; // What is limiting the demand
+    int tempT1   = 0;
+    int tempT2   = 0;
+    int tempAmb  = 0;
+    uint16_t fault  = 0;
+    uint16_t alarm  = 0;
+    uint16_t status = 0;
+    // Status
+    bool canOk   = false;
+    bool rs485Ok = false;
+    uint32_t tbTruncated = 0;   // Records cut short at TB_MAX_VALUES fields
+    // Bridge link (BRIDGE_MODE)
+    uint32_t txQueued = 0;      // Bytes waiting in the TX path
+    uint32_t txDrops = 0;       // Telemetry records skipped, link busy
+    uint32_t txReplyDrops = 0;  // Reply bytes dropped, TX ring full
+    uint32_t txSeq = 0;         // JSON records sent ("seq")
+    uint32_t rxLines = 0;       // Command lines received
+    uint32_t rxBad = 0;         // Lines that weren't a known command
+    uint32_t rxLost = 0;        // Ids missing from the host's sequence
+    // SD log writer
+    uint32_t sdDrops = 0;       // Rows dropped, both buffers waiting on the card
+    uint32_t sdWriteMs = 0;     // Slowest block write so far
+    uint32_t sdLines[VD_SD_CHANNELS] = {};  // Per SD channel: lines (tier blocks) queued
+    uint32_t sdLost[VD_SD_CHANNELS] = {};   // and lost, shed or ring full
+    uint32_t tierRows[VD_LG_TIERS] = {};    // Per tier: intervals (trips) closed
+    uint32_t tierLost[VD_LG_TIERS] = {};    // and rows lost, channel full
+    // Extended OBD fields
+    float fuelRate = -1;       // L/h (PID 0x5E)
+    float fuelLevel = -1;      // % (PID 0x2F)
+    float maf = -1;            // g/s (PID 0x10)
+    int intakeAirTemp = -40;   // °C (PID 0x0F)
+    int oilTemp = -40;         // °C (PID 0x5C)
+    float timingAdv = 0;       // degrees (PID 0x0E)
+    float o2Voltage = -1;      // V (PID 0x14)
+    int fuelPressure = -1;     // kPa (PID 0x0A)
+    // Trip computer (trip_stats.h)
+    float tripKm = 0;
+    float tripFuelL = 0;
+    float tripLPer100 = -1;    // -1 before the first km
+    float tripAvgKmh = 0;      // While moving
+    float tripAh = 0;          // Charger output
+    float tripWh = 0;
+    uint32_t tripEngineS = 0;  // Engine running
+};
+
+#endif // VEHICLE_DATA_H
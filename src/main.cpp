@@ -23,6 +23,15 @@
 #include "board_config.h"
 #include "obd2_pids.h"
 #include "obd2_dtc.h"
+#include "vehicle_data.h"
+#include "modbus_devices.h"
+#include "nvs_settings.h"
+#include "sd_logger.h"
+#include "log_capture.h"
+#include "log_tiers.h"
+#include "charge_controller.h"
+#include "obd_scheduler.h"
+#include "trip_stats.h"
 
 #ifndef BRIDGE_MODE
 #define BRIDGE_MODE 0
@@ -43,63 +52,62 @@ static ESP_Panel *panel = NULL;
 
 #if BRIDGE_MODE
 // ─── Bridge mode — serial protocol ──────────────────
+#include <esp_timer.h>
 #include "serial_protocol.h"
-static char json_buf[JSON_BUF_SIZE];
+#include "bridge_tx.h"
+#include "bridge_jobs.h"
+#include "log_transfer.h"
 static char cmd_buf[CMD_BUF_SIZE];
 
-// DTC storage for bridge mode
-static DTCResult stored_dtcs;
-static bool dtc_scan_requested = false;
-static bool dtc_clear_requested = false;
+// Replies/events go through bridgeOut so they follow the negotiated format;
+// everything reaches the UART via bridgeTx's drain task, never from loop()
+static BridgeTx bridgeTx;
+static BridgeOut bridgeOut(bridgeTx);
+static BridgeJobs bridgeJobs;           // scan_dtc / clear_dtc off loop()
+static LogTransfer logXfer;             // get_log download in progress
+static uint8_t tele_buf[TB_PAYLOAD_MAX + 2];
+static TbValue tele_values[TB_MAX_VALUES];
+static uint16_t tele_schema_id = 0;
+static bool tele_schema_due = false;
+static uint32_t tele_period_ms = 500;
+static TbDeltaState tele_delta;
+static bool tele_delta_on = true;       // Binary mode: changed fields only
+static uint32_t tele_key_ms = 5000;     // Keyframe interval in delta mode
+static bool dtc_dirty = false;      // Binary mode: resend DTC list
+
+// Link rate: set_baud puts a rate on trial until the host confirms it
+static uint32_t bridge_baud = BRIDGE_BAUD;  // Rate Serial runs at now
+static uint32_t baud_trial = 0;             // Rate awaiting baud_ok, 0 = none
+static uint32_t baud_prev = BRIDGE_BAUD;    // Rate to go back to
+static unsigned long baud_trial_ms = 0;
+static unsigned long last_good_cmd_ms = 0;  // Last line that parsed as a command
+static uint8_t bad_lines = 0;               // Unparseable lines in a row
 #endif
 
 // ─── IO Expander (needed in both modes for CAN mux) ──
 #include <ESP_IOExpander_Library.h>
 static ESP_IOExpander *io_expander = NULL;
+static TbValue log_values[TB_MAX_VALUES];   // Record being logged to SD
+static LogCapture capture;                  // Pre-trigger ring for event captures
+static TbValue cap_values[TB_MAX_VALUES];   // Record being sampled into it
+static LogTiers tiers;                      // Second, minute and trip aggregates
+static TbValue tier_values[TB_MAX_VALUES];  // Record being folded into them
+static DTCResult stored_dtcs;               // Last good DTC read
 
 /* ══════════════════════════════════════════════════════════════
  * GLOBAL VEHICLE + CHARGER DATA
  * ══════════════════════════════════════════════════════════════*/
-#if BRIDGE_MODE
-// Minimal VehicleData for bridge mode (no LVGL dependency)
-struct VehicleData {
-    int speed = -1, rpm = -1, ect = -1, throttle = -1, load = -1;
-    float battV = 0, battI = 0, setA = 12.0f, targetCurrent = 12.0f;
-    int tempT1 = 0, tempT2 = 0, tempAmb = 0;
-    uint16_t fault = 0, alarm = 0, status = 0;
-    bool canOk = false, rs485Ok = false;
-    // Extended OBD fields
-    float fuelRate = -1;       // L/h (PID 0x5E)
-    float fuelLevel = -1;      // % (PID 0x2F)
-    float maf = -1;            // g/s (PID 0x10)
-    int intakeAirTemp = -40;   // °C (PID 0x0F)
-    int oilTemp = -40;         // °C (PID 0x5C)
-    float timingAdv = 0;       // degrees (PID 0x0E)
-    float o2Voltage = -1;      // V (PID 0x14)
-    int fuelPressure = -1;     // kPa (PID 0x0A)
-};
-#endif
 
 VehicleData vdata;
-
-/* ══════════════════════════════════════════════════════════════
- * MODBUS CRC16 CALCULATION
- * ══════════════════════════════════════════════════════════════*/
-uint16_t modbusCRC(uint8_t *buf, uint16_t len) {
-    uint16_t crc = 0xFFFF;
-    for (uint16_t i = 0; i < len; i++) {
-        crc ^= buf[i];
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 1) crc = (crc >> 1) ^ 0xA001;
-            else crc >>= 1;
-        }
-    }
-    return (crc >> 8) | (crc << 8);
-}
+static ObdScheduler obd;
+static TripStats trip;
 
 /* ══════════════════════════════════════════════════════════════
  * OBD-II VIA CAN (TWAI)
  * ══════════════════════════════════════════════════════════════*/
+// Held for each CAN exchange; bridge jobs hold it for a whole DTC read
+static SemaphoreHandle_t can_lock = NULL;
+
 int queryOBD(uint8_t pid, int responseBytes) {
     twai_message_t tx;
     memset(&tx, 0, sizeof(tx));
@@ -110,13 +118,14 @@ int queryOBD(uint8_t pid, int responseBytes) {
     tx.data[2] = pid;
 
     if (twai_transmit(&tx, pdMS_TO_TICKS(80)) != ESP_OK) return -1;
+    sd_log_can(tx.identifier, tx.data, tx.data_length_code);
 
     twai_message_t rx;
     unsigned long t0 = millis();
     while (millis() - t0 < 200) {
         if (twai_receive(&rx, pdMS_TO_TICKS(50)) == ESP_OK) {
+            sd_log_can(rx.identifier, rx.data, rx.data_length_code);
             if (rx.identifier >= 0x7E8 && rx.identifier <= 0x7EF && rx.data[2] == pid) {
-                vdata.canOk = true;
                 if (responseBytes == 1) return rx.data[3];
                 if (responseBytes == 2) return (rx.data[3] << 8) | rx.data[4];
             }
@@ -125,154 +134,171 @@ int queryOBD(uint8_t pid, int responseBytes) {
     return -1;
 }
 
-// Read core OBD2 PIDs (fast — for dashboard display)
-void readCoreOBD() {
-    vdata.speed = queryOBD(PID_SPEED, 1);
-
-    int rawRPM = queryOBD(PID_RPM, 2);
-    vdata.rpm = rawRPM >= 0 ? rawRPM / 4 : -1;
-
-    int rawECT = queryOBD(PID_COOLANT, 1);
-    vdata.ect = rawECT >= 0 ? rawECT - 40 : -1;
-
-    int rawThrot = queryOBD(PID_THROTTLE, 1);
-    vdata.throttle = rawThrot >= 0 ? (rawThrot * 100) / 255 : -1;
-
-    int rawLoad = queryOBD(PID_LOAD, 1);
-    vdata.load = rawLoad >= 0 ? (rawLoad * 100) / 255 : -1;
+/**
+ * Query the most overdue PID (see obd_scheduler.h) — one CAN round trip
+ * per call, so subscribed signals are polled at their own rates.
+ */
+void pollOBD() {
+    ObdSlot *slot = obd_sched_next(&obd, millis());
+    if (!slot) return;
+    if (xSemaphoreTake(can_lock, 0) != pdTRUE) return;   // A job has the bus
+    int raw = queryOBD(slot->pid, slot->bytes);
+    xSemaphoreGive(can_lock);
+    obd_sched_result(&obd, slot, raw, millis(), &vdata);
+    if (raw >= 0) ts_obd(&trip, slot->pid, millis(), &vdata);
 }
 
-// Read extended OBD2 PIDs (for trip computer, fuel, diagnostics)
-void readExtendedOBD() {
-    // Fuel Rate (PID 0x5E) — 2 bytes, scale 0.05
-    int rawFuelRate = queryOBD(0x5E, 2);
-    vdata.fuelRate = rawFuelRate >= 0 ? rawFuelRate * 0.05f : -1;
-
-    // Fuel Level (PID 0x2F) — 1 byte, scale 100/255
-    int rawFuelLvl = queryOBD(0x2F, 1);
-    vdata.fuelLevel = rawFuelLvl >= 0 ? (rawFuelLvl * 100.0f) / 255.0f : -1;
-
-    // MAF Air Flow (PID 0x10) — 2 bytes, scale 0.01
-    int rawMAF = queryOBD(0x10, 2);
-    vdata.maf = rawMAF >= 0 ? rawMAF * 0.01f : -1;
-
-    // Intake Air Temp (PID 0x0F) — 1 byte, offset -40
-    int rawIAT = queryOBD(0x0F, 1);
-    vdata.intakeAirTemp = rawIAT >= 0 ? rawIAT - 40 : -40;
-
-    // Engine Oil Temp (PID 0x5C) — 1 byte, offset -40
-    int rawOilT = queryOBD(0x5C, 1);
-    vdata.oilTemp = rawOilT >= 0 ? rawOilT - 40 : -40;
-
-    // Timing Advance (PID 0x0E) — 1 byte, scale 0.5, offset -64
-    int rawTiming = queryOBD(0x0E, 1);
-    vdata.timingAdv = rawTiming >= 0 ? rawTiming * 0.5f - 64.0f : 0;
+// A DTC read is done: codes the last read didn't have fire the "dtc" capture rule
+void storeDTCs(const DTCResult *dtcs) {
+    lc_dtcs(&capture, &stored_dtcs, dtcs, millis());
+    stored_dtcs = *dtcs;
+}
 
-    // O2 Voltage B1S1 (PID 0x14) — 2 bytes, scale 0.005
-    int rawO2 = queryOBD(0x14, 2);
-    vdata.o2Voltage = rawO2 >= 0 ? (rawO2 >> 8) * 0.005f : -1;
+#if !BRIDGE_MODE
+/**
+ * With no host to send scan_dtc, a task on core 0 reads the stored DTCs
+ * every DTC_WATCH_MS while the engine runs, holding the CAN lock for
+ * the read as a bridge job does. loop() takes the result (dtcWatchPoll());
+ * the first read of a boot is only the baseline, so a code that was
+ * already set doesn't fire a capture on every boot.
+ */
+#define DTC_WATCH_MS    60000
+#define DTC_WATCH_CORE  0
+static DTCResult dtc_watch;
+static volatile bool dtc_watch_ready = false;   // Set by the task, cleared by loop()
+
+static void dtcWatchTask(void *arg) {
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(DTC_WATCH_MS));
+        if (dtc_watch_ready || vdata.rpm <= 0) continue;
+        xSemaphoreTake(can_lock, portMAX_DELAY);
+        dtc_watch = readDTCs(0x03);
+        xSemaphoreGive(can_lock);
+        dtc_watch_ready = dtc_watch.success;
+    }
+}
 
-    // Fuel Pressure (PID 0x0A) — 1 byte, scale 3
-    int rawFuelPres = queryOBD(0x0A, 1);
-    vdata.fuelPressure = rawFuelPres >= 0 ? rawFuelPres * 3 : -1;
+void dtcWatchPoll() {
+    static bool baseline = false;
+    if (!dtc_watch_ready) return;
+    if (baseline) storeDTCs(&dtc_watch);
+    else stored_dtcs = dtc_watch;
+    baseline = true;
+    dtc_watch_ready = false;
 }
+#endif
 
 /* ══════════════════════════════════════════════════════════════
  * MODBUS RS485 — CHARGER COMMUNICATION
  * ══════════════════════════════════════════════════════════════*/
-bool readRegister(uint16_t addr, uint16_t *val) {
-    uint8_t req[8] = {
-        0x01, 0x03,
-        (uint8_t)(addr >> 8), (uint8_t)(addr & 0xFF),
-        0x00, 0x01,
-        0, 0
-    };
-    uint16_t crc = modbusCRC(req, 6);
-    req[6] = crc & 0xFF;
-    req[7] = crc >> 8;
-
-    Serial1.write(req, 8);
-    Serial1.flush();
-
-    uint8_t resp[7] = {0};
-    int len = 0;
-    unsigned long t0 = millis();
-    while (len < 7 && millis() - t0 < 200) {
-        if (Serial1.available()) resp[len++] = Serial1.read();
-    }
-
-    if (len != 7 || resp[0] != 0x01 || resp[1] != 0x03 || resp[2] != 0x02) return false;
-
-    crc = modbusCRC(resp, 5);
-    if (resp[5] != (crc & 0xFF) || resp[6] != (crc >> 8)) return false;
-
-    *val = (resp[3] << 8) | resp[4];
-    vdata.rs485Ok = true;
+// Write the charge current setpoint on one charger
+bool setCurrent(ModbusSlave *chg, float amp) {
+    uint16_t val = (uint16_t)(amp * 100 + 0.5f);
+    if (!mb_write_register(chg->addr, REG_SET_CURR, val, chg->timeoutMs)) return false;
+    chg->setA = amp;
     return true;
 }
 
-bool setCurrent(float amp) {
-    uint16_t val = (uint16_t)(amp * 100 + 0.5f);
-    uint8_t buf[8] = {
-        0x01, 0x06,
-        (uint8_t)(REG_SET_CURR >> 8), (uint8_t)(REG_SET_CURR & 0xFF),
-        (uint8_t)(val >> 8), (uint8_t)(val & 0xFF),
-        0, 0
-    };
-    uint16_t crc = modbusCRC(buf, 6);
-    buf[6] = crc & 0xFF;
-    buf[7] = crc >> 8;
-
-    Serial1.write(buf, 8);
-    Serial1.flush();
-
-    uint8_t resp[8] = {0};
-    int len = 0;
-    unsigned long t0 = millis();
-    while (len < 8 && millis() - t0 < 200) {
-        if (Serial1.available()) resp[len++] = Serial1.read();
-    }
-    return (len == 8 && resp[0] == 0x01 && resp[1] == 0x06);
-}
+// Mirror the primary charger's registers into the flat VehicleData view
+void syncChargerData() {
+    ModbusSlave *chg = mb_find(MB_DEV_CHARGER);
+    vdata.rs485Ok = mb_any_ok();
+    if (!chg || chg->polls == 0 || !chg->ok) return;
 
-void readAllCharger() {
     uint16_t v;
-    if (readRegister(REG_B_VOLT, &v))    vdata.battV   = v * 0.01f;
-    if (readRegister(REG_B_CURR, &v))    vdata.battI   = v * 0.01f;
-    if (readRegister(REG_TEMP_T1, &v))   vdata.tempT1  = v;
-    if (readRegister(REG_TEMP_T2, &v))   vdata.tempT2  = v;
-    if (readRegister(REG_TEMP_AMB, &v))  vdata.tempAmb = v;
-    readRegister(REG_FAULT, &vdata.fault);
-    readRegister(REG_ALARM, &vdata.alarm);
-    readRegister(REG_STATUS, &vdata.status);
+    if (mb_slave_reg(chg, REG_B_VOLT, &v))   vdata.battV   = v * 0.01f;
+    if (mb_slave_reg(chg, REG_B_CURR, &v))   vdata.battI   = v * 0.01f;
+    if (mb_slave_reg(chg, REG_TEMP_T1, &v))  vdata.tempT1  = (int16_t)v;
+    if (mb_slave_reg(chg, REG_TEMP_T2, &v))  vdata.tempT2  = (int16_t)v;
+    if (mb_slave_reg(chg, REG_TEMP_AMB, &v)) vdata.tempAmb = (int16_t)v;
+    mb_slave_reg(chg, REG_FAULT, &vdata.fault);
+    mb_slave_reg(chg, REG_ALARM, &vdata.alarm);
+    mb_slave_reg(chg, REG_STATUS, &vdata.status);
+    if (chg->setA >= 0) vdata.setA = chg->setA;
 }
 
 /* ══════════════════════════════════════════════════════════════
  * SMART CHARGING LOGIC
  * ══════════════════════════════════════════════════════════════*/
-static float lastSetCurrent = -1;
+static ChargeController chargeCtrl;
+static ChargeControlConfig chargeCfg;
+
+void applyChargeConfig() {
+    chargeCfg.minA = settings.chargeMinA;
+    chargeCfg.maxA = settings.chargeMaxA;
+    chargeCfg.rampUpAps = settings.chargeRampUp;
+    chargeCfg.rampDownAps = settings.chargeRampDown;
+    chargeCfg.deadbandA = settings.chargeDeadband;
+}
 
 void updateChargingLogic() {
-    bool safe = true;
-    if (vdata.tempT1 > 80 || vdata.tempT2 > 80 || vdata.tempAmb > 80) safe = false;
-    if (vdata.battV < 24.0f || vdata.battV > 29.6f) safe = false;
-    if (vdata.fault & 0x0040) safe = false;
-    if (vdata.alarm & 0x0003) safe = false;
-
-    float target = 12.0f;
-    if (vdata.speed > 30 && vdata.rpm > 1000 &&
-        vdata.ect >= 60 && vdata.ect <= 100 && safe) {
-        target = 30.0f;
+    static unsigned long lastRun = 0;
+    unsigned long now = millis();
+    float dt = lastRun ? (now - lastRun) / 1000.0f : 0;
+    lastRun = now;
+
+    float command;
+    bool changed = cc_update(&chargeCtrl, &chargeCfg, &vdata, dt, &command);
+    vdata.targetCurrent = chargeCtrl.demand;
+    vdata.chargeLimit = CHARGE_LIMITER_NAMES[chargeCtrl.limiter];
+
+    // Every charger on the bus follows the same setpoint; chargers that
+    // missed a write (offline, manual override) are brought back in line
+    for (int i = 0; i < MB_SLAVE_COUNT; i++) {
+        ModbusSlave *chg = &mb_slaves[i];
+        if (chg->profile->type != MB_DEV_CHARGER || !chg->ok) continue;
+        if (changed || chg->setA != chargeCtrl.commanded) {
+            setCurrent(chg, chargeCtrl.commanded);
+        }
     }
+    syncChargerData();
+}
 
-    vdata.targetCurrent = target;
+/* ══════════════════════════════════════════════════════════════
+ * TRIP COMPUTER (trip_stats.h)
+ * ══════════════════════════════════════════════════════════════*/
+// The open trip is one NVS blob, "trip": the trip computer's totals, then
+// the log tiers' trip (log_tiers.h), so both are saved by one write
+static uint8_t *trip_blob = NULL;
+static size_t trip_tier_len = 0;    // Tiers' part; kept as loaded while they are off
+
+void initTrip() {
+    size_t cap = sizeof(TripTotals) + (psramFound() ? sizeof(LgTrip) : 0);
+    trip_blob = (uint8_t *)(psramFound() ? ps_malloc(cap) : malloc(cap));
+    size_t len = trip_blob ? nvs_load_blob_upto(TRIP_NAMESPACE, "trip", trip_blob, cap) : 0;
+    if (len < sizeof(TripTotals) || !ts_restore(&trip, (const TripTotals *)trip_blob)) {
+        ts_reset(&trip);
+    }
+    trip_tier_len = len > sizeof(TripTotals) ? len - sizeof(TripTotals) : 0;
+    ts_summary(&trip, &vdata);
+}
 
-    if (target != lastSetCurrent) {
-        if (setCurrent(target)) {
-            lastSetCurrent = target;
-            vdata.setA = target;
+void saveTrip() {
+    size_t len = sizeof(TripTotals);
+    if (trip_blob) {
+        memcpy(trip_blob, &trip.tot, sizeof(TripTotals));
+        if (tiers.on && !tiers.pending->count) {    // Last boot's trip stays until written
+            trip_tier_len = lg_trip_bytes(tiers.trip);
+            memcpy(trip_blob + sizeof(TripTotals), tiers.trip, trip_tier_len);
         }
+        len += trip_tier_len;
     }
+    nvs_save_blob(TRIP_NAMESPACE, "trip", trip_blob ? (const void *)trip_blob : &trip.tot, len);
+    ts_saved(&trip, millis());
+    lg_trip_saved(&tiers);
+}
+
+void resetTrip() {
+    ts_reset(&trip);
+    saveTrip();
+    ts_summary(&trip, &vdata);
+}
+
+// Headline figures into vdata. To NVS every TS_SAVE_MS of driving, when the
+// engine stops, and once last boot's tier trip is in trips.dlg
+void updateTrip() {
+    if (ts_save_due(&trip, millis()) || lg_trip_save_due(&tiers)) saveTrip();
+    ts_summary(&trip, &vdata);
 }
 
 /* ══════════════════════════════════════════════════════════════
@@ -293,6 +319,28 @@ void initIOExpander() {
     Serial.println("[INIT] CAN/USB mux set to CAN mode");
 }
 
+/* ══════════════════════════════════════════════════════════════
+ * INIT: SD CARD LOGGING (both modes)
+ * ══════════════════════════════════════════════════════════════*/
+void initSD() {
+    sd_set_interval(settings.logIntervalMs);
+    sd_set_commit(settings.logCommitMs);
+    sd_set_can(settings.logCan);
+    sd_set_rotation(settings.logSegmentMB, settings.logSegmentMin, settings.logMinFreeMB);
+    lc_configure(&capture, settings.capPeriodMs, settings.capPreS, settings.capPostS);
+    if (!lc_parse_rules(&capture, settings.capRules)) lc_parse_rules(&capture, LC_RULES_DEFAULT);
+    if (!sd_init(io_expander)) return;
+    lc_begin(&capture);
+
+    // No RTC: each boot logs to the next numbered segment
+    char session[8];
+    sd_session_name(session, sizeof(session));
+    if (lg_begin(&tiers, session) && trip_tier_len) {
+        lg_restore_trip(&tiers, trip_blob + sizeof(TripTotals), trip_tier_len);
+    }
+    sd_open_log(session);
+}
+
 #if !BRIDGE_MODE
 /* ══════════════════════════════════════════════════════════════
  * STANDALONE MODE: DISPLAY + LVGL
@@ -362,6 +410,7 @@ void initDisplay() {
  * INIT: CAN BUS (TWAI)
  * ══════════════════════════════════════════════════════════════*/
 void initCAN() {
+    can_lock = xSemaphoreCreateMutex();
     twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(CAN_TX_PIN, CAN_RX_PIN, TWAI_MODE_NORMAL);
     twai_timing_config_t t_config = CAN_SPEED;
     twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
@@ -378,77 +427,724 @@ void initCAN() {
 /* ══════════════════════════════════════════════════════════════
  * INIT: RS485 (UART1)
  * ══════════════════════════════════════════════════════════════*/
+// (Re)open UART1 with the baud/parity/gap from settings
+void applyRS485Config() {
+    uint32_t cfg = SERIAL_8N1;
+    if (settings.rs485Parity == 'E') cfg = SERIAL_8E1;
+    else if (settings.rs485Parity == 'O') cfg = SERIAL_8O1;
+
+    Serial1.end();
+    Serial1.begin(settings.rs485Baud, cfg, RS485_RX_PIN, RS485_TX_PIN);
+    mb_set_timing(settings.rs485Baud, settings.rs485Parity != 'N', settings.rs485GapUs);
+    mb_error_streak = 0;
+}
+
+void reportRS485(const char *event) {
+    char line[96];
+    snprintf(line, sizeof(line), "RS485 %s: %lu baud, parity %c, gap %lu us", event,
+             (unsigned long)settings.rs485Baud, settings.rs485Parity, (unsigned long)mb_gap_us);
+    sd_log_debug(line);
+#if BRIDGE_MODE
+    bridgeOut.printf("{\"rs485\":{\"event\":\"%s\",\"baud\":%lu,\"parity\":\"%c\","
+                  "\"gap_us\":%lu,\"auto\":%s}}\n",
+                  event, (unsigned long)settings.rs485Baud, settings.rs485Parity,
+                  (unsigned long)mb_gap_us, settings.rs485AutoBaud ? "true" : "false");
+#else
+    Serial.printf("[RS485] %s: %lu baud, parity %c, gap %lu us\n", event,
+                  (unsigned long)settings.rs485Baud, settings.rs485Parity,
+                  (unsigned long)mb_gap_us);
+#endif
+}
+
+/**
+ * Find the fastest rate the primary slave answers reliably.
+ * Tries RS485_BAUD_RATES fastest first; keeps the old rate if none work.
+ */
+bool probeRS485Baud() {
+    if (MB_SLAVE_COUNT == 0) return false;
+    ModbusSlave *ref = mb_find(MB_DEV_CHARGER);
+    if (!ref) ref = &mb_slaves[0];
+
+    uint32_t original = settings.rs485Baud;
+    for (uint32_t rate : RS485_BAUD_RATES) {
+        settings.rs485Baud = rate;
+        applyRS485Config();
+        int good = 0;
+        while (good < RS485_PROBE_POLLS && mb_poll_slave(ref)) good++;
+        if (good == RS485_PROBE_POLLS) {
+            settings_save();
+            return true;
+        }
+    }
+    settings.rs485Baud = original;
+    applyRS485Config();
+    return false;
+}
+
+// Step down one rate after repeated CRC/frame errors (auto mode only)
+void checkRS485Fallback() {
+    if (!settings.rs485AutoBaud || mb_error_streak < RS485_FALLBACK_ERRORS) return;
+
+    for (uint32_t rate : RS485_BAUD_RATES) {
+        if (rate < settings.rs485Baud) {
+            settings.rs485Baud = rate;
+            applyRS485Config();
+            settings_save();
+            reportRS485("fallback");
+            return;
+        }
+    }
+    mb_error_streak = 0;  // Already at the slowest rate
+}
+
 void initRS485() {
-    Serial1.begin(RS485_BAUD, SERIAL_8N1, RS485_RX_PIN, RS485_TX_PIN);
-    Serial.println("[INIT] RS485 started (9600 baud, auto-dir)");
+    applyRS485Config();
+    mb_begin(&Serial1, mb_slaves, MB_SLAVE_COUNT);
+    Serial.printf("[INIT] RS485 started (%lu baud, auto-dir, %d slaves)\n",
+                  (unsigned long)settings.rs485Baud, MB_SLAVE_COUNT);
+    if (settings.rs485AutoBaud) {
+        reportRS485(probeRS485Baud() ? "probe_ok" : "probe_failed");
+    }
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * TELEMETRY RECORD (telemetry_binary.h)
+ * ══════════════════════════════════════════════════════════════*/
+/**
+ * The full record in tb_collect() order, for the bridge, the SD log, the
+ * capture ring and the tiers. A record with more fields than
+ * TB_MAX_VALUES keeps the first ones; it is counted in "trunc" and
+ * noted in the debug log the first time.
+ */
+int collectRecord(TbValue *out) {
+    int n = tb_collect(out, TB_MAX_VALUES, &vdata, &obd, sd_initialized, sd_free_mb(),
+                       mb_slaves, MB_SLAVE_COUNT);
+    if (n <= TB_MAX_VALUES) return n;
+    if (vdata.tbTruncated++ == 0) {
+        char line[80];
+        snprintf(line, sizeof(line), "Telemetry record has %d fields, only %d kept", n, TB_MAX_VALUES);
+        sd_log_debug(line);
+    }
+    return TB_MAX_VALUES;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * EVENT CAPTURES (log_capture.h)
+ * ══════════════════════════════════════════════════════════════*/
+// A capture file is complete: the debug log in both modes, and the host or console
+void reportCapture() {
+    if (!capture.saved) return;
+    capture.saved = false;
+    char line[96];
+    snprintf(line, sizeof(line), "Capture %s saved: %s", capture.path + 6, capture.reason);
+    sd_log_debug(line);
+#if BRIDGE_MODE
+    bridgeOut.printf("{\"capture_saved\":{\"name\":\"%s\",\"reason\":\"%s\",\"ts\":%lu,"
+                     "\"pre\":%lu,\"post\":%lu}}\n",
+                     capture.path + 6, capture.reason, (unsigned long)capture.trigTs,
+                     (unsigned long)capture.pre, (unsigned long)capture.post);
+#else
+    Serial.printf("[CAPTURE] %s saved: %s\n", capture.path + 6, capture.reason);
+#endif
 }
 
 #if BRIDGE_MODE
 /* ══════════════════════════════════════════════════════════════
  * BRIDGE MODE: Process commands from Pi
  * ══════════════════════════════════════════════════════════════*/
+struct SubscribeReply {
+    int ok;
+    char unknown[96];   // Quoted names that matched no signal
+};
+
+static void subscribeOne(const char *name, float hz, void *ctx) {
+    SubscribeReply *rep = (SubscribeReply *)ctx;
+    if (obd_subscribe(&obd, name, hz)) {
+        rep->ok++;
+        return;
+    }
+    size_t len = strlen(rep->unknown);
+    snprintf(rep->unknown + len, sizeof(rep->unknown) - len, "%s\"%s\"",
+             len ? "," : "", name);
+}
+
+// Worker task: runs one DTC job with the CAN bus to itself
+static void runJob(BridgeJob *job) {
+    xSemaphoreTake(can_lock, portMAX_DELAY);
+    if (job->type == CMD_SCAN_DTC) {
+        job->dtcs = readDTCs(0x03, &job->progress);
+        job->rc = job->dtcs.success ? RC_OK : RC_FAILED;
+    } else if (job->type == CMD_CLEAR_DTC) {
+        job->rc = clearDTCs(&job->progress) ? RC_OK : RC_FAILED;
+    } else {
+        job->rc = RC_UNKNOWN_CMD;
+    }
+    xSemaphoreGive(can_lock);
+}
+
+// Hand a slow command to the worker; the reply only confirms the queueing
+static void queueJob(ParsedCommand &cmd) {
+    if (!bridgeJobs.submit(cmd.id, cmd.type)) {
+        bridgeOut.printf("{\"job\":\"%s\",\"error\":\"busy\",\"rc\":%d}\n",
+                         cmd.name, RC_BUSY);
+        return;
+    }
+    bridgeOut.printf("{\"job\":\"%s\",\"state\":\"queued\"}\n", cmd.name);
+}
+
+// Progress and results of background jobs, tagged with their request id
+void reportJobs() {
+    BridgeJob *job;
+    while ((job = bridgeJobs.poll()) != NULL) {
+        const char *name = commandName(job->type);
+        bridgeOut.replyTo(job->id);
+        if (job->state != JOB_DONE) {
+            bridgeOut.printf("{\"job\":\"%s\",\"state\":\"running\",\"progress\":%u}\n",
+                             name, job->reported);
+            continue;
+        }
+
+        bridgeOut.printf("{\"job\":\"%s\",\"state\":\"done\",\"rc\":%d", name, job->rc);
+        if (job->type == CMD_SCAN_DTC && job->rc == RC_OK) {
+            storeDTCs(&job->dtcs);
+            bridgeOut.printf(",\"dtc_scan\":{\"count\":%d,\"codes\":[", stored_dtcs.count);
+            for (int i = 0; i < stored_dtcs.count; i++) {
+                if (i > 0) bridgeOut.print(",");
+                bridgeOut.printf("\"%s\"", stored_dtcs.codes[i].code);
+            }
+            bridgeOut.print("]}");
+            dtc_dirty = true;
+        } else if (job->type == CMD_CLEAR_DTC) {
+            bridgeOut.printf(",\"dtc_clear\":\"%s\"", job->rc == RC_OK ? "ok" : "failed");
+            if (job->rc == RC_OK) {
+                stored_dtcs.count = 0;
+                dtc_dirty = true;
+            }
+        }
+        bridgeOut.println("}");
+        bridgeJobs.release(job);
+    }
+    bridgeOut.replyTo(0);
+}
+
+/* ── Bridge link rate (set_baud / baud_ok) ── */
+static bool bridgeBaudAllowed(long baud) {
+    for (size_t i = 0; i < sizeof(BRIDGE_BAUD_RATES) / sizeof(BRIDGE_BAUD_RATES[0]); i++) {
+        if ((long)BRIDGE_BAUD_RATES[i] == baud) return true;
+    }
+    return false;
+}
+
+// Whatever is queued still goes out at the old rate
+void setBridgeBaud(uint32_t baud) {
+    bridgeTx.flush(500);
+    Serial.begin(baud);
+    bridge_baud = baud;
+}
+
+/**
+ * During a set_baud trial: the test pattern every 200 ms, and back to
+ * the previous rate if no baud_ok arrives in time. Otherwise, at a rate
+ * above BRIDGE_BAUD, fall back when nothing valid gets through (host
+ * restarted at 115200, bad cable). Returns true while a trial holds the
+ * link — no telemetry or log chunks then.
+ */
+bool checkBridgeBaud() {
+    if (baud_trial) {
+        static unsigned long lastTest = 0;
+        if (millis() - baud_trial_ms >= BRIDGE_BAUD_TRIAL_MS) {
+            uint32_t failed = baud_trial;
+            baud_trial = 0;
+            setBridgeBaud(baud_prev);
+            bridgeOut.printf("{\"baud_fail\":%lu,\"baud\":%lu}\n",
+                             (unsigned long)failed, (unsigned long)bridge_baud);
+            return false;
+        }
+        if (millis() - lastTest >= 200) {
+            lastTest = millis();
+            bridgeOut.println("{\"baud_test\":\"" BRIDGE_BAUD_PATTERN "\"}");
+        }
+        return true;
+    }
+    if (bridge_baud != BRIDGE_BAUD && (bad_lines >= BRIDGE_BAUD_BAD_LINES ||
+                                       millis() - last_good_cmd_ms >= BRIDGE_BAUD_GRACE_MS)) {
+        setBridgeBaud(BRIDGE_BAUD);
+        settings.bridgeBaud = BRIDGE_BAUD;
+        settings_save();
+        bad_lines = 0;
+        last_good_cmd_ms = millis();
+        bridgeOut.printf("{\"baud_fallback\":%lu}\n", (unsigned long)BRIDGE_BAUD);
+    }
+    return false;
+}
+
 void processCommand(ParsedCommand &cmd) {
     switch (cmd.type) {
         case CMD_SCAN_DTC:
-            stored_dtcs = readDTCs(0x03);
-            Serial.printf("{\"dtc_scan\":{\"count\":%d,\"codes\":[", stored_dtcs.count);
-            for (int i = 0; i < stored_dtcs.count; i++) {
-                if (i > 0) Serial.print(",");
-                Serial.printf("\"%s\"", stored_dtcs.codes[i].code);
-            }
-            Serial.println("]}}");
+        case CMD_CLEAR_DTC:
+            queueJob(cmd);
             break;
 
-        case CMD_CLEAR_DTC:
-            if (clearDTCs()) {
-                Serial.println("{\"dtc_clear\":\"ok\"}");
-                stored_dtcs.count = 0;
+        case CMD_SET_CURRENT: {
+            // "dev" selects one charger by address, otherwise all chargers
+            int written = 0, failed = 0;
+            for (int i = 0; i < MB_SLAVE_COUNT; i++) {
+                ModbusSlave *chg = &mb_slaves[i];
+                if (chg->profile->type != MB_DEV_CHARGER) continue;
+                if (cmd.dev && chg->addr != cmd.dev) continue;
+                if (setCurrent(chg, cmd.floatVal)) written++;
+                else failed++;
+            }
+            syncChargerData();
+            if (written > 0 && failed == 0) {
+                bridgeOut.printf("{\"set_current\":\"ok\",\"val\":%.1f}\n", cmd.floatVal);
             } else {
-                Serial.println("{\"dtc_clear\":\"failed\"}");
+                bridgeOut.println("{\"set_current\":\"failed\"}");
+            }
+            break;
+        }
+
+        case CMD_GET_SUPPORTED_PIDS:
+            sendSupportedPIDs(bridgeOut);
+            break;
+
+        case CMD_GET_TRIP:
+            serializeTrip(bridgeOut, &trip);
+            break;
+
+        case CMD_RESET_TRIP:
+            resetTrip();
+            bridgeOut.println("{\"trip_reset\":true}");
+            break;
+
+        case CMD_SET_LOG_INTERVAL: {
+            long commit = -1, can = -1;
+            jsonFindLong(cmd.raw, "commit_ms", &commit);
+            jsonFindLong(cmd.raw, "can", &can);
+            if (cmd.intVal < 100 || cmd.intVal > 60000 ||
+                (commit >= 0 && (commit < SD_COMMIT_MIN_MS || commit > SD_COMMIT_MAX_MS))) {
+                bridgeOut.printf("{\"error\":\"log_interval out of range\",\"rc\":%d}\n",
+                                 RC_BAD_ARGS);
+                break;
+            }
+            settings.logIntervalMs = cmd.intVal;
+            if (commit >= 0) settings.logCommitMs = commit;
+            if (can >= 0) settings.logCan = can != 0;
+            settings_save();
+            sd_set_interval(settings.logIntervalMs);
+            sd_set_commit(settings.logCommitMs);
+            sd_set_can(settings.logCan);
+            bridgeOut.printf("{\"log_interval\":%lu,\"commit_ms\":%lu,\"can\":%d}\n",
+                             (unsigned long)settings.logIntervalMs,
+                             (unsigned long)settings.logCommitMs, settings.logCan);
+            break;
+        }
+
+        case CMD_SET_LOG_ROTATION: {
+            // Only the fields present are changed; no fields = query
+            long v;
+            bool changed = false;
+            if (jsonFindLong(cmd.raw, "seg_mb", &v) && v >= 1 && v <= SD_SEGMENT_MAX_MB) {
+                settings.logSegmentMB = v;
+                changed = true;
+            }
+            if (jsonFindLong(cmd.raw, "seg_min", &v) && v >= 1 && v <= 1440) {
+                settings.logSegmentMin = v;
+                changed = true;
+            }
+            if (jsonFindLong(cmd.raw, "min_free_mb", &v) && v >= 0) {
+                settings.logMinFreeMB = v;
+                changed = true;
+            }
+            if (changed) {
+                settings_save();
+                sd_set_rotation(settings.logSegmentMB, settings.logSegmentMin, settings.logMinFreeMB);
+            }
+            bridgeOut.printf("{\"log_rotation\":{\"seg_mb\":%u,\"seg_min\":%u,\"min_free_mb\":%lu,"
+                             "\"free_mb\":%lu,\"segment\":\"%s\",\"deleted\":%lu}}\n",
+                             settings.logSegmentMB, settings.logSegmentMin,
+                             (unsigned long)settings.logMinFreeMB, (unsigned long)sd_free_mb(),
+                             sd_session, (unsigned long)sd_segments_deleted);
+            break;
+        }
+
+        case CMD_SET_CAPTURE: {
+            // Only the fields present are changed; no fields = query
+            long v;
+            bool changed = false, ok = true;
+            char rules[sizeof(settings.capRules)];
+            if (jsonFindLong(cmd.raw, "period_ms", &v) && v >= LC_PERIOD_MIN_MS && v <= 1000) {
+                settings.capPeriodMs = v;
+                changed = true;
+            }
+            if (jsonFindLong(cmd.raw, "pre_s", &v) && v >= 0 && v <= LC_WINDOW_MAX_S) {
+                settings.capPreS = v;
+                changed = true;
+            }
+            if (jsonFindLong(cmd.raw, "post_s", &v) && v >= 0 && v <= LC_WINDOW_MAX_S) {
+                settings.capPostS = v;
+                changed = true;
+            }
+            if (jsonFindStr(cmd.raw, "rules", rules, sizeof(rules))) {
+                ok = lc_parse_rules(&capture, rules);
+                if (ok) {
+                    strcpy(settings.capRules, rules);
+                    changed = true;
+                }
+            }
+            if (changed) {
+                settings_save();
+                lc_configure(&capture, settings.capPeriodMs, settings.capPreS, settings.capPostS);
+            }
+            if (!ok) {
+                bridgeOut.printf("{\"error\":\"bad capture rules\",\"rc\":%d}\n", RC_BAD_ARGS);
+                break;
+            }
+            if (jsonFindLong(cmd.raw, "trigger", &v) && v) lc_trigger(&capture, "manual", millis());
+            static const char *const STATES[] = {"off", "armed", "post", "saving"};
+            bridgeOut.printf("{\"capture\":{\"period_ms\":%u,\"pre_s\":%u,\"post_s\":%u,"
+                             "\"rules\":\"%s\",\"state\":\"%s\",\"ring_s\":%lu,"
+                             "\"count\":%lu,\"missed\":%lu,\"failed\":%lu}}\n",
+                             settings.capPeriodMs, settings.capPreS, settings.capPostS,
+                             capture.rulesText, STATES[capture.state],
+                             (unsigned long)lc_ring_seconds(&capture),
+                             (unsigned long)capture.captures, (unsigned long)capture.missed,
+                             (unsigned long)capture.failed);
+            break;
+        }
+
+        case CMD_SET_RS485: {
+            // Only the fields present are changed; no fields = query
+            long v;
+            bool changed = false;
+            if (jsonFindLong(cmd.raw, "baud", &v) && v >= 1200 && v <= 115200) {
+                settings.rs485Baud = v;
+                changed = true;
+            }
+            char parity = jsonFindChar(cmd.raw, "parity", settings.rs485Parity);
+            if (parity == 'N' || parity == 'E' || parity == 'O') {
+                changed |= parity != settings.rs485Parity;
+                settings.rs485Parity = parity;
+            }
+            if (jsonFindLong(cmd.raw, "gap_us", &v) && v >= 0 && v <= 50000) {
+                settings.rs485GapUs = v;
+                changed = true;
+            }
+            if (jsonFindLong(cmd.raw, "auto", &v)) {
+                settings.rs485AutoBaud = v != 0;
+                changed = true;
+            }
+            if (changed) {
+                applyRS485Config();
+                settings_save();
+            }
+            reportRS485(changed ? "set" : "get");
+            break;
+        }
+
+        case CMD_PROBE_RS485:
+            reportRS485(probeRS485Baud() ? "probe_ok" : "probe_failed");
+            break;
+
+        case CMD_SET_CHARGING: {
+            float v;
+            bool changed = false;
+            if (jsonFindFloat(cmd.raw, "min", &v) && v >= 0 && v <= 50)    { settings.chargeMinA = v; changed = true; }
+            if (jsonFindFloat(cmd.raw, "max", &v) && v >= 0 && v <= 50)    { settings.chargeMaxA = v; changed = true; }
+            if (jsonFindFloat(cmd.raw, "up", &v) && v > 0 && v <= 50)      { settings.chargeRampUp = v; changed = true; }
+            if (jsonFindFloat(cmd.raw, "down", &v) && v > 0 && v <= 50)    { settings.chargeRampDown = v; changed = true; }
+            if (jsonFindFloat(cmd.raw, "db", &v) && v >= 0.1f && v <= 10)  { settings.chargeDeadband = v; changed = true; }
+            if (settings.chargeMaxA < settings.chargeMinA) settings.chargeMaxA = settings.chargeMinA;
+            if (changed) {
+                applyChargeConfig();
+                settings_save();
             }
+            bridgeOut.printf("{\"charging\":{\"min\":%.1f,\"max\":%.1f,\"up\":%.2f,"
+                          "\"down\":%.2f,\"db\":%.2f}}\n",
+                          chargeCfg.minA, chargeCfg.maxA, chargeCfg.rampUpAps,
+                          chargeCfg.rampDownAps, chargeCfg.deadbandA);
             break;
+        }
 
-        case CMD_SET_CURRENT:
-            if (setCurrent(cmd.floatVal)) {
-                lastSetCurrent = cmd.floatVal;
-                vdata.setA = cmd.floatVal;
-                Serial.printf("{\"set_current\":\"ok\",\"val\":%.1f}\n", cmd.floatVal);
+        case CMD_SET_FORMAT: {
+            // Ack goes out in the old format, everything after in the new one
+            long v;
+            if (jsonFindLong(cmd.raw, "period_ms", &v) && v >= 20 && v <= 5000) {
+                tele_period_ms = v;
+            }
+            if (jsonFindLong(cmd.raw, "delta", &v)) tele_delta_on = v != 0;
+            if (jsonFindLong(cmd.raw, "key_ms", &v) && v >= 500 && v <= 60000) {
+                tele_key_ms = v;
+            }
+            TelemetryFormat fmt = bridgeOut.format;
+            char f = jsonFindChar(cmd.raw, "fmt", 0);
+            if (f == 'b') fmt = FMT_BINARY;
+            else if (f == 'j') fmt = FMT_JSON;
+            bridgeOut.printf("{\"format\":\"%s\",\"period_ms\":%lu,"
+                             "\"delta\":%s,\"key_ms\":%lu}\n",
+                             fmt == FMT_BINARY ? "binary" : "json",
+                             (unsigned long)tele_period_ms,
+                             tele_delta_on ? "true" : "false",
+                             (unsigned long)tele_key_ms);
+            bridgeOut.setFormat(fmt);
+            tele_schema_due = dtc_dirty = fmt == FMT_BINARY;
+            break;
+        }
+
+        case CMD_GET_SCHEMA:
+            tele_schema_due = true;
+            break;
+
+        case CMD_KEYFRAME:
+            tele_delta.keyDue = true;
+            break;
+
+        case CMD_SUBSCRIBE: {
+            // Record keys or "0xNN" PIDs → Hz; the stream follows the fastest
+            SubscribeReply rep = {};
+            if (jsonForEachNumber(cmd.raw, "rates", subscribeOne, &rep) < 0) {
+                bridgeOut.println("{\"error\":\"subscribe needs rates\"}");
+                break;
+            }
+            obd_sched_clear_idle(&obd, &vdata);
+            uint32_t fastest = obd_fastest_sub_ms(&obd);
+            tele_period_ms = fastest < 20 ? 500 : fastest > 5000 ? 5000 : fastest;
+            tele_schema_due = bridgeOut.format == FMT_BINARY;
+            bridgeOut.printf("{\"subscribed\":%d,\"unknown\":[%s],\"period_ms\":%lu}\n",
+                             rep.ok, rep.unknown, (unsigned long)tele_period_ms);
+            break;
+        }
+
+        case CMD_UNSUBSCRIBE:
+            obd_unsubscribe_all(&obd);
+            tele_period_ms = 500;
+            tele_schema_due = bridgeOut.format == FMT_BINARY;
+            bridgeOut.println("{\"subscribed\":0,\"period_ms\":500}");
+            break;
+
+        case CMD_TIME_SYNC:
+            // Sampled when the command is handled; the host discards slow round trips
+            bridgeOut.printf("{\"time_sync\":{\"us\":%llu}}\n",
+                             (unsigned long long)esp_timer_get_time());
+            break;
+
+        case CMD_LS_LOGS:
+            lt_list(bridgeOut, cmd.intVal > 0 ? cmd.intVal : 0);
+            break;
+
+        case CMD_GET_LOG: {
+            char name[LT_NAME_MAX];
+            long off = 0, win = 8, end = 0, from = -1, to = -1;
+            jsonFindLong(cmd.raw, "off", &off);
+            jsonFindLong(cmd.raw, "win", &win);
+            jsonFindLong(cmd.raw, "end", &end);
+            jsonFindLong(cmd.raw, "from", &from);
+            jsonFindLong(cmd.raw, "to", &to);
+            BridgeResult rc = jsonFindStr(cmd.raw, "name", name, sizeof(name))
+                ? lt_start(&logXfer, cmd.id, name, off, win, end) : RC_BAD_ARGS;
+            if (rc != RC_OK) {
+                bridgeOut.printf("{\"error\":\"get_log failed\",\"rc\":%d}\n", rc);
+                break;
+            }
+            uint32_t fileSize = sd_log_size(name, logXfer.file.size()), schema = 0;
+            if (from >= 0 || to >= 0) {
+                // Time window: the .idx picks the blocks, replacing off/end
+                uint32_t wOff, wEnd;
+                lt_window(name, from < 0 ? 0 : from, to < 0 ? UINT32_MAX : to,
+                          logXfer.size, &wOff, &wEnd, &schema);
+                logXfer.acked = logXfer.sent = wOff;
+                logXfer.size = wEnd;
+            }
+            bridgeOut.printf("{\"log\":\"%s\",\"size\":%lu,\"off\":%lu,\"end\":%lu,"
+                             "\"schema\":%lu,\"chunk\":%d,\"win\":%d}\n",
+                             logXfer.name, (unsigned long)fileSize, (unsigned long)logXfer.sent,
+                             (unsigned long)logXfer.size, (unsigned long)schema, LT_CHUNK,
+                             logXfer.window);
+            break;
+        }
+
+        case CMD_LOG_ACK: {
+            // Acks in range aren't answered: the next chunk is the reply
+            long off = -1, nak = 0;
+            jsonFindLong(cmd.raw, "off", &off);
+            jsonFindLong(cmd.raw, "nak", &nak);
+            if (!logXfer.active) {
+                bridgeOut.printf("{\"error\":\"no log transfer\",\"rc\":%d}\n", RC_FAILED);
+            } else if (off < 0) {
+                bridgeOut.printf("{\"log_abort\":\"%s\",\"off\":%lu,\"rc\":%d}\n",
+                                 logXfer.name, (unsigned long)logXfer.acked, RC_OK);
+                lt_close(&logXfer);
             } else {
-                Serial.println("{\"set_current\":\"failed\"}");
+                lt_ack(&logXfer, off, nak != 0);
             }
             break;
+        }
 
-        case CMD_GET_SUPPORTED_PIDS:
-            sendSupportedPIDs(Serial);
+        case CMD_SET_BAUD: {
+            // Ack at the current rate, then switch and wait for baud_ok
+            long baud = 0;
+            jsonFindLong(cmd.raw, "baud", &baud);
+            if (!bridgeBaudAllowed(baud) || baud_trial) {
+                bridgeOut.printf("{\"error\":\"%s\",\"baud\":%lu,\"rc\":%d}\n",
+                                 baud_trial ? "baud trial running" : "unsupported baud",
+                                 (unsigned long)bridge_baud, RC_BAD_ARGS);
+                break;
+            }
+            if ((uint32_t)baud == bridge_baud) {
+                bridgeOut.printf("{\"baud_ok\":%lu}\n", (unsigned long)bridge_baud);
+                break;
+            }
+            bridgeOut.printf("{\"set_baud\":%ld,\"trial_ms\":%d}\n", baud, BRIDGE_BAUD_TRIAL_MS);
+            baud_prev = bridge_baud;
+            setBridgeBaud(baud);
+            baud_trial = baud;
+            baud_trial_ms = millis();
             break;
+        }
 
-        case CMD_SET_LOG_INTERVAL:
-            Serial.printf("{\"log_interval\":%d}\n", cmd.intVal);
+        case CMD_BAUD_OK: {
+            // The host's copy of the pattern checks the other direction
+            char pattern[sizeof(BRIDGE_BAUD_PATTERN)];
+            if (!baud_trial) {
+                bridgeOut.printf("{\"error\":\"no baud trial\",\"rc\":%d}\n", RC_FAILED);
+                break;
+            }
+            if (!jsonFindStr(cmd.raw, "pattern", pattern, sizeof(pattern)) ||
+                strcmp(pattern, BRIDGE_BAUD_PATTERN) != 0) {
+                bridgeOut.printf("{\"error\":\"baud pattern mismatch\",\"rc\":%d}\n",
+                                 RC_BAD_ARGS);
+                break;
+            }
+            baud_trial = 0;
+            settings.bridgeBaud = bridge_baud;
+            settings_save();
+            bridgeOut.printf("{\"baud_ok\":%lu}\n", (unsigned long)bridge_baud);
             break;
+        }
 
         case CMD_SHUTDOWN:
-            Serial.println("{\"shutdown\":\"acknowledged\"}");
+            bridgeOut.println("{\"shutdown\":\"acknowledged\"}");
+            lg_close(&tiers);
+            saveTrip();             // The tiers' trip is in trips.dlg now
+            sd_close();
             delay(100);
             esp_deep_sleep_start();
             break;
 
+        case CMD_UNKNOWN:
         default:
+            bridgeOut.printf("{\"error\":\"unknown_command\",\"cmd\":\"%s\",\"rc\":%d}\n",
+                             cmd.name, RC_UNKNOWN_CMD);
             break;
     }
 }
+
+/**
+ * Host → bridge accounting for the "link" section. The host numbers its
+ * commands; a jump in "id" means lines were lost or garbled on the way
+ * in, a smaller id means the host restarted its count.
+ */
+void countCommand(const ParsedCommand &cmd) {
+    static uint32_t lastId = 0;
+    vdata.rxLines++;
+    if (cmd.type == CMD_UNKNOWN) {
+        vdata.rxBad++;
+        if (bad_lines < 255) bad_lines++;
+    } else {
+        bad_lines = 0;
+        last_good_cmd_ms = millis();
+    }
+    if (!cmd.id) return;
+    if (lastId && cmd.id > lastId + 1) vdata.rxLost += cmd.id - lastId - 1;
+    lastId = cmd.id;
+}
+
+/**
+ * One telemetry record in the negotiated format. Binary mode sends the
+ * schema first when due, a keyframe or delta record, and the DTC list
+ * (as a JSON frame) only when it changed — it isn't part of the record.
+ * If the previous record hasn't left yet this one is skipped, not queued.
+ */
+void sendTelemetry() {
+    if (bridgeTx.busy()) {
+        bridgeTx.skip();
+        return;
+    }
+    vdata.txQueued = bridgeTx.queued();
+    vdata.txDrops = bridgeTx.teleDrops;
+    vdata.txReplyDrops = bridgeTx.replyDrops;
+    vdata.sdDrops = sd_rows_dropped;
+    vdata.sdWriteMs = sd_write_max_ms;
+    for (int i = 0; i < SD_CHANNELS; i++) {
+        vdata.sdLines[i] = sd_streams[i].lines;
+        vdata.sdLost[i] = sd_streams[i].drops;
+    }
+    for (int k = 0; k < LG_TIERS; k++) {
+        vdata.tierRows[k] = tiers.tier[k].intervals;
+        vdata.tierLost[k] = tiers.tier[k].dropped;
+    }
+
+    if (bridgeOut.format == FMT_JSON) {
+        const char *dtcPtrs[MAX_DTCS];
+        for (int i = 0; i < stored_dtcs.count; i++) {
+            dtcPtrs[i] = stored_dtcs.codes[i].code;
+        }
+        serializeData(bridgeTx.slot(), &vdata, &obd, dtcPtrs, stored_dtcs.count,
+                      sd_initialized, sd_free_mb(), mb_slaves, MB_SLAVE_COUNT);
+        bridgeTx.commit();
+        vdata.txSeq++;
+        return;
+    }
+
+    int n = collectRecord(tele_values);
+    size_t len;
+    if (tele_schema_due) {
+        len = tb_build_schema(tele_buf, TB_PAYLOAD_MAX, tele_values, n, &tele_schema_id);
+        if (len) bridgeOut.sendPayload(tele_buf, len);
+        tele_schema_due = false;
+        tele_delta.keyDue = true;
+    }
+    bool key = !tele_delta_on || tele_delta.keyDue ||
+               millis() - tele_delta.lastKeyMs >= tele_key_ms;
+    if (key) {
+        tele_delta.keyDue = false;
+        tele_delta.lastKeyMs = millis();
+    }
+    len = tb_build_data(tele_buf, TB_PAYLOAD_MAX, tele_values, n, tele_schema_id,
+                        millis(), &tele_delta, key);
+    if (len) {
+        bridgeOut.sendPayload(tele_buf, len, &bridgeTx.slot());
+        bridgeTx.commit();
+    }
+
+    if (dtc_dirty) {
+        bridgeOut.print("{\"dtc\":[");
+        for (int i = 0; i < stored_dtcs.count; i++) {
+            bridgeOut.printf("%s\"%s\"", i > 0 ? "," : "", stored_dtcs.codes[i].code);
+        }
+        bridgeOut.println("]}");
+        dtc_dirty = false;
+    }
+}
 #endif
 
 /* ══════════════════════════════════════════════════════════════
  * SETUP
  * ══════════════════════════════════════════════════════════════*/
 void setup() {
-    Serial.begin(BRIDGE_BAUD);
-    delay(300);
+    // Persisted runtime settings (RS485, charging, logging, bridge rate)
+    settings_load();
 
 #if BRIDGE_MODE
+    if (bridgeBaudAllowed(settings.bridgeBaud)) bridge_baud = settings.bridgeBaud;
+    Serial.begin(bridge_baud);
+    delay(300);
     Serial.println("{\"boot\":\"DashOS ESP32 Bridge v1.0\"}");
-    Serial.println("{\"mode\":\"bridge\",\"baud\":115200}");
+    Serial.printf("{\"mode\":\"bridge\",\"baud\":%lu}\n", (unsigned long)bridge_baud);
 #else
+    Serial.begin(BRIDGE_BAUD);
+    delay(300);
+
     Serial.println("\n==============================================");
     Serial.println("  ESP32-S3-LCD-7B Vehicle Dashboard");
     Serial.println("  OBD-II + Charger Monitor + LVGL GUI");
@@ -463,16 +1159,27 @@ void setup() {
     initDisplay();
 #endif
 
+    applyChargeConfig();
+    initTrip();
+    initSD();
+
     // Init CAN bus + RS485 (both modes)
+    obd_sched_init(&obd, !BRIDGE_MODE);
     initCAN();
     initRS485();
+#if !BRIDGE_MODE
+    xTaskCreatePinnedToCore(dtcWatchTask, "dtc_watch", 4096, NULL, 1, NULL, DTC_WATCH_CORE);
+#endif
 
 #if !BRIDGE_MODE
     // Build LVGL UI
     ui_dashboard_create();
     Serial.println("\n[OK] Dashboard ready!\n");
 #else
-    Serial.println("{\"status\":\"ready\",\"can\":true,\"rs485\":true}");
+    // Init prints above went straight to Serial; from here on the TX task owns it
+    bridgeTx.begin(&Serial);
+    bridgeJobs.begin(runJob);
+    bridgeOut.println("{\"status\":\"ready\",\"can\":true,\"rs485\":true}");
 #endif
 }
 
@@ -480,42 +1187,91 @@ void setup() {
  * MAIN LOOP
  * ══════════════════════════════════════════════════════════════*/
 void loop() {
-    // ── Poll data every 500ms ──
+    // ── OBD: at most one PID per pass, at its scheduled rate ──
+    pollOBD();
+    vdata.canOk = obd.lastRxMs && millis() - obd.lastRxMs < 2000;
+
+    // ── Charging + display every 500ms ──
     static unsigned long lastPoll = 0;
     if (millis() - lastPoll >= 500) {
         lastPoll = millis();
 
-        vdata.canOk = false;
-        vdata.rs485Ok = false;
-
-        readCoreOBD();
-        readExtendedOBD();
-        readAllCharger();
         updateChargingLogic();
+        updateTrip();
 
-#if BRIDGE_MODE
-        // Send JSON data to Pi
-        const char *dtcPtrs[MAX_DTCS];
-        for (int i = 0; i < stored_dtcs.count; i++) {
-            dtcPtrs[i] = stored_dtcs.codes[i].code;
+#if !BRIDGE_MODE
+        // Update LVGL labels; a long press on the trip rows resets the trip
+        if (ui_trip_reset) {
+            ui_trip_reset = false;
+            resetTrip();
         }
-        serializeData(json_buf, JSON_BUF_SIZE, &vdata,
-                      dtcPtrs, stored_dtcs.count, false, 0);
-        Serial.print(json_buf);
-#else
-        // Update LVGL labels
         ui_dashboard_update(&vdata);
 #endif
     }
 
+#if BRIDGE_MODE
+    // ── Telemetry to Pi, on its own (negotiable) period ──
+    bool baudTrial = checkBridgeBaud();
+    static unsigned long lastTelemetry = 0;
+    if (!baudTrial && millis() - lastTelemetry >= tele_period_ms) {
+        lastTelemetry = millis();
+        sendTelemetry();
+    }
+#endif
+
+    // ── SD log record, at settings.logIntervalMs ──
+    if (sd_log_due(millis())) {
+        int n = collectRecord(log_values);
+        sd_log_data(millis(), log_values, n);
+    }
+
+    // ── Event capture ring, at settings.capPeriodMs ──
+    if (lc_due(&capture, millis())) {
+        int n = collectRecord(cap_values);
+        lc_sample(&capture, millis(), cap_values, n);
+    }
+
+    // ── Downsampled log tiers, every LG_SAMPLE_MS ──
+    if (lg_due(&tiers, millis())) {
+        int n = collectRecord(tier_values);
+        lg_sample(&tiers, millis(), tier_values, n);
+    }
+
+    // ── RS485: at most one Modbus transaction per pass ──
+    ModbusSlave *polled = mb_poll();
+    if (polled) {
+        syncChargerData();
+        if (polled->failStreak == 0 && polled == mb_find(MB_DEV_CHARGER)) {
+            ts_charger(&trip, millis(), vdata.battV, vdata.battI);
+        }
+    }
+    checkRS485Fallback();
+
+    // ── DTCs read in the background, captures saved by the writer task ──
+#if !BRIDGE_MODE
+    dtcWatchPoll();
+#endif
+    reportCapture();
+
 #if BRIDGE_MODE
     // ── Check for commands from Pi ──
     if (readCommandLine(Serial, cmd_buf, CMD_BUF_SIZE)) {
         ParsedCommand cmd = parseCommand(cmd_buf);
+        countCommand(cmd);
         if (cmd.type != CMD_NONE) {
+            bridgeOut.replyTo(cmd.id);
             processCommand(cmd);
+            bridgeOut.replyTo(0);
         }
     }
+    reportJobs();
+
+    // ── SD log download: lowest priority, only into an idle link ──
+    if (logXfer.active && !baud_trial) {
+        bridgeOut.replyTo(logXfer.id);
+        lt_poll(&logXfer, bridgeOut, !bridgeTx.busy() && bridgeTx.queued() < LT_BACKLOG);
+        bridgeOut.replyTo(0);
+    }
     delay(1);  // Minimal delay in bridge mode
 #else
     // ── LVGL timer handler ──
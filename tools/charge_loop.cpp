@@ -0,0 +1,156 @@
+/**
+ * @file charge_loop.cpp
+ * Runs the firmware charge controller (charge_controller.h) in closed
+ * loop against charger_sim over a synthetic drive cycle
+ *
+ * Usage:
+ *   ./charger_sim --link /tmp/ttyCHG --time-scale 20 &
+ *   ./charge_loop /tmp/ttyCHG --time-scale 20 [options]
+ *     --mode closed|bangbang   Controller under test (default closed)
+ *     --duration S             Simulated seconds to run (default 1200)
+ *     --tick MS                Control period in simulated ms (default 500)
+ *     --csv                    Print one trace line per tick
+ *
+ * --time-scale must match the simulator so both sides share one clock.
+ * The summary reports charge delivered, Modbus writes and peak charger
+ * temperature, so the two controllers can be compared on the same drive.
+ */
+
+#include <Arduino.h>
+#include <cmath>
+#include <string>
+
+#include "modbus_devices.h"
+#include "charge_controller.h"
+
+/* ══════════════════════════════════════════════════════════════
+ * DRIVE CYCLE — 10 min loop: idle, town, motorway, stop
+ * ══════════════════════════════════════════════════════════════*/
+static void drive_cycle(double t, VehicleData *d) {
+    double c = fmod(t, 600.0);
+    double speed;
+    if (c < 60)       speed = 0;
+    else if (c < 120) speed = (c - 60) / 60.0 * 50;
+    else if (c < 300) speed = 40 + 10 * sin(c / 15.0);
+    else if (c < 480) speed = 100;
+    else if (c < 540) speed = 100 - (c - 480) / 60.0 * 100;
+    else              speed = 0;
+
+    d->speed = (int)speed;
+    d->rpm = speed < 1 ? 800 : (int)(900 + speed * 22);
+    d->ect = (int)(20 + 70 * (1 - exp(-t / 240.0)));
+    d->throttle = speed < 1 ? 0 : 20;
+    d->load = speed < 1 ? 15 : 40;
+}
+
+// Legacy 12 A / 30 A logic, kept here as the comparison baseline
+static float bang_bang(const VehicleData *d) {
+    bool safe = !cc_hard_fault(d);
+    if (d->speed > 30 && d->rpm > 1000 && d->ect >= 60 && d->ect <= 100 && safe) return 30.0f;
+    return 12.0f;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s PORT [--mode closed|bangbang] [--duration S] "
+                        "[--tick MS] [--time-scale K] [--csv]\n", argv[0]);
+        return 1;
+    }
+    std::string mode = "closed";
+    double duration = 1200, tickMs = 500, timeScale = 1;
+    bool csv = false;
+
+    for (int i = 2; i < argc; i++) {
+        std::string a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a == "--mode" && v)            { mode = v; i++; }
+        else if (a == "--duration" && v)   { duration = atof(v); i++; }
+        else if (a == "--tick" && v)       { tickMs = atof(v); i++; }
+        else if (a == "--time-scale" && v) { timeScale = atof(v); i++; }
+        else if (a == "--csv")             { csv = true; }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    int fd = open(argv[1], O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    host_set_raw(fd);
+
+    ModbusSlave chg;
+    chg.addr = 0x01;
+    chg.profile = &PROFILE_WG_BC900M;
+    chg.pollMs = 0;
+    chg.timeoutMs = 150;
+    Stream port(fd);
+    mb_begin(&port, &chg, 1);
+    mb_set_timing(115200, false, 0);
+
+    VehicleData vd;
+    ChargeController cc;
+    ChargeControlConfig cfg;
+    float commanded = -1;
+
+    double ah = 0, wh = 0, peakT1 = 0;
+    unsigned long writes = 0, ticks = 0;
+    uint64_t start = host_now_us();
+
+    if (csv) printf("t,speed,rpm,ect,demand,set,current,t1,t2,limit\n");
+
+    for (double t = 0; t < duration; t += tickMs / 1000.0) {
+        // Pace to the shared (scaled) clock
+        uint64_t due = start + (uint64_t)(t / timeScale * 1e6);
+        uint64_t now = host_now_us();
+        if (due > now) usleep(due - now);
+
+        drive_cycle(t, &vd);
+        if (mb_poll_slave(&chg)) {
+            uint16_t v;
+            if (mb_slave_reg(&chg, REG_B_VOLT, &v))   vd.battV = v * 0.01f;
+            if (mb_slave_reg(&chg, REG_B_CURR, &v))   vd.battI = v * 0.01f;
+            if (mb_slave_reg(&chg, REG_TEMP_T1, &v))  vd.tempT1 = (int16_t)v;
+            if (mb_slave_reg(&chg, REG_TEMP_T2, &v))  vd.tempT2 = (int16_t)v;
+            if (mb_slave_reg(&chg, REG_TEMP_AMB, &v)) vd.tempAmb = (int16_t)v;
+            mb_slave_reg(&chg, REG_FAULT, &vd.fault);
+            mb_slave_reg(&chg, REG_ALARM, &vd.alarm);
+        }
+
+        float target;
+        bool write;
+        if (mode == "bangbang") {
+            target = bang_bang(&vd);
+            write = target != commanded;
+            cc.demand = target;
+        } else {
+            write = cc_update(&cc, &cfg, &vd, ticks ? tickMs / 1000.0f : 0, &target);
+        }
+        if (write && mb_write_register(chg.addr, REG_SET_CURR,
+                                       (uint16_t)(target * 100 + 0.5f), chg.timeoutMs)) {
+            commanded = target;
+            writes++;
+        }
+
+        double dtH = tickMs / 3600000.0;
+        ah += vd.battI * dtH;
+        wh += vd.battI * vd.battV * dtH;
+        peakT1 = fmax(peakT1, vd.tempT1);
+        ticks++;
+
+        if (csv) {
+            printf("%.1f,%d,%d,%d,%.2f,%.1f,%.2f,%d,%d,%s\n", t, vd.speed, vd.rpm, vd.ect,
+                   cc.demand, commanded, vd.battI, vd.tempT1, vd.tempT2,
+                   mode == "bangbang" ? "-" : CHARGE_LIMITER_NAMES[cc.limiter]);
+        }
+    }
+
+    printf("%s: %.0f s simulated, %.2f Ah / %.1f Wh delivered, %lu setpoint writes, "
+           "peak T1 %.0f C, %u Modbus errors\n",
+           mode.c_str(), duration, ah, wh, writes, peakT1,
+           mb_stats.timeouts + mb_stats.crcErrors + mb_stats.frameErrors);
+    close(fd);
+    return 0;
+}
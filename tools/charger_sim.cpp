@@ -0,0 +1,357 @@
+/**
+ * @file charger_sim.cpp
+ * Host Modbus RTU charger simulator on a pseudo-terminal
+ *
+ * Emulates one or more WG-BC900M chargers (REG_* map from board_config.h)
+ * so charger polling and the charging logic can be exercised without
+ * hardware. Values come from a simple thermal/electrical model that
+ * follows the current setpoint, optionally overridden by a profile
+ * script, and faults can be injected on the link.
+ *
+ * Usage:
+ *   ./charger_sim [options]
+ *     --addr N          Slave address to answer (repeatable, default 1)
+ *     --link PATH       Create a symlink to the pty slave (e.g. /tmp/ttyCHG)
+ *     --profile FILE    Scripted values: lines of "<t_sec> <field> <value>"
+ *     --baud B          Emulate line time at B baud (default: instant)
+ *     --latency MS      Extra response latency
+ *     --jitter MS       Random extra latency 0..MS
+ *     --crc-rate P      Probability of corrupting a response CRC
+ *     --drop-rate P     Probability of not answering at all
+ *     --time-scale K    Run the model K times faster than real time
+ *     --trace           Print model state once per second
+ *
+ * Profile fields: a_v a_a v a t1 t2 amb (linear between keyframes),
+ * fault alarm status (stepped). A scripted field overrides the model.
+ *   0    amb   25
+ *   120  amb   45
+ *   60   fault 0x0040
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "board_config.h"
+#include "modbus_rtu.h"
+
+#define REG_SPACE   0x1000
+
+/* ══════════════════════════════════════════════════════════════
+ * PROFILE SCRIPT — per-field keyframes
+ * ══════════════════════════════════════════════════════════════*/
+struct Keyframe {
+    double t;
+    double value;
+};
+
+struct FieldDef {
+    const char *name;
+    uint16_t reg;
+    double scale;       // Register = value / scale
+    bool stepped;       // No interpolation between keyframes
+};
+
+static const FieldDef FIELDS[] = {
+    {"a_v",    REG_A_VOLT,   0.01, false},
+    {"a_a",    REG_A_CURR,   0.01, false},
+    {"v",      REG_B_VOLT,   0.01, false},
+    {"a",      REG_B_CURR,   0.01, false},
+    {"t1",     REG_TEMP_T1,  1.0,  false},
+    {"t2",     REG_TEMP_T2,  1.0,  false},
+    {"amb",    REG_TEMP_AMB, 1.0,  false},
+    {"fault",  REG_FAULT,    1.0,  true},
+    {"alarm",  REG_ALARM,    1.0,  true},
+    {"status", REG_STATUS,   1.0,  true},
+};
+static const int FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+static std::map<std::string, std::vector<Keyframe>> profile;
+
+static bool load_profile(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        double t;
+        char name[16], val[32];
+        if (line[0] == '#' || sscanf(line, "%lf %15s %31s", &t, name, val) != 3) continue;
+        bool hex = val[0] == '0' && (val[1] == 'x' || val[1] == 'X');
+        profile[name].push_back({t, hex ? (double)strtol(val, NULL, 16) : strtod(val, NULL)});
+    }
+    fclose(f);
+    for (auto &kv : profile) {
+        std::sort(kv.second.begin(), kv.second.end(),
+                  [](const Keyframe &a, const Keyframe &b) { return a.t < b.t; });
+    }
+    return true;
+}
+
+static bool profile_value(const FieldDef &fd, double t, double *out) {
+    auto it = profile.find(fd.name);
+    if (it == profile.end() || it->second.empty()) return false;
+    const std::vector<Keyframe> &k = it->second;
+    if (t <= k.front().t) { *out = k.front().value; return true; }
+    for (size_t i = 1; i < k.size(); i++) {
+        if (t < k[i].t) {
+            if (fd.stepped) { *out = k[i - 1].value; return true; }
+            double u = (t - k[i - 1].t) / (k[i].t - k[i - 1].t);
+            *out = k[i - 1].value + u * (k[i].value - k[i - 1].value);
+            return true;
+        }
+    }
+    *out = k.back().value;
+    return true;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * CHARGER MODEL
+ * Output current follows the setpoint (1 s lag), T1 heats with I²,
+ * battery voltage rises slightly with charge current.
+ * ══════════════════════════════════════════════════════════════*/
+struct Charger {
+    uint8_t addr;
+    uint16_t regs[REG_SPACE];
+    double setA = 12.0;
+    double current = 0;
+    double t1 = 25, t2 = 25;
+};
+
+static std::vector<Charger> chargers;
+
+static void model_step(Charger &c, double t, double dt) {
+    double amb = 25;
+    profile_value(FIELDS[6], t, &amb);
+
+    bool faulted = (c.regs[REG_FAULT] & 0x0040) != 0;
+    double target = faulted ? 0 : c.setA;
+    c.current += (target - c.current) * std::min(1.0, dt / 1.0);
+
+    // T1: charger heatsink, ~90 s time constant, +45 °C above ambient at 30 A
+    double t1Eq = amb + 0.05 * c.current * c.current;
+    c.t1 += (t1Eq - c.t1) * std::min(1.0, dt / 90.0);
+    // T2: battery, slow
+    double t2Eq = amb + 0.01 * c.current * c.current;
+    c.t2 += (t2Eq - c.t2) * std::min(1.0, dt / 600.0);
+
+    double model[FIELD_COUNT] = {
+        13.8, c.current * 27.0 / 13.8 / 0.92,   // Terminal A (alternator side)
+        26.4 + 0.03 * c.current, c.current,     // Terminal B (battery)
+        c.t1, c.t2, amb,
+        (double)c.regs[REG_FAULT], (double)c.regs[REG_ALARM],
+        c.current > 0.5 ? 2.0 : 0.0,            // Status: CC while charging
+    };
+
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        double v = model[i];
+        profile_value(FIELDS[i], t, &v);
+        long raw = lround(v / FIELDS[i].scale);
+        c.regs[FIELDS[i].reg] = (uint16_t)(int16_t)raw;
+    }
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * MODBUS SLAVE
+ * ══════════════════════════════════════════════════════════════*/
+struct Options {
+    unsigned long baud = 0;
+    double latencyMs = 0, jitterMs = 0;
+    double crcRate = 0, dropRate = 0;
+    double timeScale = 1.0;
+    bool trace = false;
+};
+
+static Options opt;
+static volatile bool running = true;
+static unsigned long stat_requests = 0, stat_replies = 0;
+static unsigned long stat_dropped = 0, stat_corrupted = 0, stat_bad = 0;
+
+static double rnd() { return (double)rand() / RAND_MAX; }
+
+static void line_delay(size_t bytes) {
+    if (opt.baud) delayMicroseconds((unsigned)(bytes * 10 * 1000000ULL / opt.baud));
+}
+
+static Charger *find_charger(uint8_t addr) {
+    for (Charger &c : chargers) {
+        if (c.addr == addr) return &c;
+    }
+    return NULL;
+}
+
+static size_t handle_request(Charger &c, const ModbusFrame &req, uint8_t *out, size_t cap) {
+    switch (req.function) {
+        case MB_FC_READ_HOLDING:
+        case MB_FC_READ_INPUT:
+            if (req.count == 0 || req.count > MB_MAX_READ_REGS) {
+                return mb_build_exception(out, cap, c.addr, req.function, MB_EX_ILLEGAL_VALUE);
+            }
+            if (req.addr + req.count > REG_SPACE) {
+                return mb_build_exception(out, cap, c.addr, req.function, MB_EX_ILLEGAL_ADDRESS);
+            }
+            return mb_build_read_response(out, cap, c.addr, req.function,
+                                          &c.regs[req.addr], req.count);
+        case MB_FC_WRITE_SINGLE:
+            if (req.addr >= REG_SPACE) {
+                return mb_build_exception(out, cap, c.addr, req.function, MB_EX_ILLEGAL_ADDRESS);
+            }
+            c.regs[req.addr] = req.value;
+            if (req.addr == REG_SET_CURR) c.setA = req.value / 100.0;
+            return mb_build_write_response(out, cap, c.addr, req.function, req.addr, req.value);
+        case MB_FC_WRITE_MULTIPLE:
+            if (req.addr + req.count > REG_SPACE) {
+                return mb_build_exception(out, cap, c.addr, req.function, MB_EX_ILLEGAL_ADDRESS);
+            }
+            for (uint16_t i = 0; i < req.count; i++) {
+                c.regs[req.addr + i] = mb_reg(&req, i);
+                if (req.addr + i == REG_SET_CURR) c.setA = c.regs[REG_SET_CURR] / 100.0;
+            }
+            return mb_build_write_response(out, cap, c.addr, req.function, req.addr, req.count);
+        default:
+            return mb_build_exception(out, cap, c.addr, req.function, MB_EX_ILLEGAL_FUNCTION);
+    }
+}
+
+static void on_signal(int) { running = false; }
+
+int main(int argc, char *argv[]) {
+    const char *link = NULL;
+    std::vector<uint8_t> addrs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a == "--addr" && v)            { addrs.push_back((uint8_t)strtol(v, NULL, 0)); i++; }
+        else if (a == "--link" && v)       { link = v; i++; }
+        else if (a == "--profile" && v)    {
+            if (!load_profile(v)) { fprintf(stderr, "Cannot read profile %s\n", v); return 1; }
+            i++;
+        }
+        else if (a == "--baud" && v)       { opt.baud = strtoul(v, NULL, 10); i++; }
+        else if (a == "--latency" && v)    { opt.latencyMs = atof(v); i++; }
+        else if (a == "--jitter" && v)     { opt.jitterMs = atof(v); i++; }
+        else if (a == "--crc-rate" && v)   { opt.crcRate = atof(v); i++; }
+        else if (a == "--drop-rate" && v)  { opt.dropRate = atof(v); i++; }
+        else if (a == "--time-scale" && v) { opt.timeScale = atof(v); i++; }
+        else if (a == "--trace")           { opt.trace = true; }
+        else {
+            fprintf(stderr, "Unknown option %s (see header of charger_sim.cpp)\n", argv[i]);
+            return 1;
+        }
+    }
+    if (addrs.empty()) addrs.push_back(0x01);
+
+    chargers.resize(addrs.size());
+    for (size_t i = 0; i < addrs.size(); i++) {
+        memset(chargers[i].regs, 0, sizeof(chargers[i].regs));
+        chargers[i].addr = addrs[i];
+    }
+
+    // ── Pseudo-terminal ──
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    const char *slavePath = ptsname(master);
+    int keepOpen = open(slavePath, O_RDWR | O_NOCTTY);  // Avoid EIO while no client
+    host_set_raw(keepOpen);
+    host_set_raw(master);
+
+    if (link) {
+        unlink(link);
+        if (symlink(slavePath, link) < 0) perror("symlink");
+    }
+    printf("Charger simulator on %s%s%s (%zu slave%s)\n", slavePath,
+           link ? " -> " : "", link ? link : "", chargers.size(),
+           chargers.size() > 1 ? "s" : "");
+    fflush(stdout);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    Stream port(master);
+    uint8_t rx[MB_MAX_ADU], tx[MB_MAX_ADU];
+    size_t rxLen = 0;
+    uint64_t lastByteUs = 0;
+    uint64_t t0 = host_now_us(), lastStep = t0, lastTrace = t0;
+
+    for (Charger &c : chargers) model_step(c, 0, 0);
+
+    while (running) {
+        struct pollfd pfd = {master, POLLIN, 0};
+        poll(&pfd, 1, 10);
+        uint64_t now = host_now_us();
+
+        // ── Model ──
+        double dt = (now - lastStep) / 1e6;
+        if (dt >= 0.05) {
+            double simT = (now - t0) / 1e6 * opt.timeScale;
+            for (Charger &c : chargers) model_step(c, simT, dt * opt.timeScale);
+            lastStep = now;
+        }
+        if (opt.trace && now - lastTrace >= 1000000) {
+            lastTrace = now;
+            for (Charger &c : chargers) {
+                printf("[%7.1fs] addr %u set=%.1fA I=%.2fA T1=%.1fC T2=%.1fC\n",
+                       (now - t0) / 1e6 * opt.timeScale, c.addr, c.setA, c.current, c.t1, c.t2);
+            }
+            fflush(stdout);
+        }
+
+        // ── Receive; a silent gap > 5 ms ends a partial frame (t3.5) ──
+        if (rxLen > 0 && now - lastByteUs > 5000) {
+            stat_bad++;
+            rxLen = 0;
+        }
+        int n = port.available();
+        if (n <= 0) continue;
+        rxLen += port.readBytes(rx + rxLen, std::min((size_t)n, sizeof(rx) - rxLen));
+        lastByteUs = now;
+
+        while (rxLen >= 2) {
+            ModbusFrame req;
+            ModbusStatus st = mb_parse_request(rx, rxLen, &req);
+            if (st == MB_INCOMPLETE) break;
+
+            size_t used = st == MB_OK ? mb_request_length(rx, rxLen) : 1;  // Resync on error
+            if (st == MB_OK) {
+                stat_requests++;
+                line_delay(used);
+                Charger *c = find_charger(req.slave);
+                if (c) {
+                    size_t outLen = handle_request(*c, req, tx, sizeof(tx));
+                    if (rnd() < opt.dropRate) {
+                        stat_dropped++;
+                    } else {
+                        double wait = opt.latencyMs + rnd() * opt.jitterMs;
+                        if (wait > 0) delayMicroseconds((unsigned)(wait * 1000));
+                        if (rnd() < opt.crcRate) {
+                            tx[outLen - 1] ^= 0x5A;
+                            stat_corrupted++;
+                        }
+                        line_delay(outLen);
+                        port.write(tx, outLen);
+                        stat_replies++;
+                    }
+                }
+            } else {
+                stat_bad++;
+            }
+            memmove(rx, rx + used, rxLen - used);
+            rxLen -= used;
+        }
+        if (rxLen == sizeof(rx)) rxLen = 0;
+    }
+
+    printf("\nrequests=%lu replies=%lu dropped=%lu corrupted=%lu bad_frames=%lu\n",
+           stat_requests, stat_replies, stat_dropped, stat_corrupted, stat_bad);
+    if (link) unlink(link);
+    close(keepOpen);
+    close(master);
+    return 0;
+}
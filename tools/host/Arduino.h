@@ -0,0 +1,113 @@
+/**
+ * @file Arduino.h
+ * Host (Linux) stand-in for the Arduino core, so firmware headers such
+ * as modbus_master.h compile unchanged in the tools/ programs.
+ * Only the calls those headers use are provided.
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+static inline uint64_t host_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static inline unsigned long millis() { return (unsigned long)(host_now_us() / 1000); }
+static inline unsigned long micros() { return (unsigned long)host_now_us(); }
+static inline void delay(unsigned long ms) { usleep(ms * 1000); }
+static inline void delayMicroseconds(unsigned int us) { usleep(us); }
+static inline void yield() { sched_yield(); }
+
+// Output half of Arduino's Print: write() plus print/println/printf
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) { return write(&c, 1); }
+    virtual size_t write(const uint8_t *buf, size_t len) = 0;
+    size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(const char *s) { return write(s); }
+    size_t println(const char *s = "") { return write(s) + write("\n"); }
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+        char buf[512];
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        if (n < 0) return 0;
+        return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+};
+
+/**
+ * Byte stream over a file descriptor (pty or tty), matching the
+ * subset of Arduino's Stream used by the firmware headers.
+ */
+class Stream : public Print {
+public:
+    explicit Stream(int fd = -1) : fd_(fd) {}
+    using Print::write;
+
+    int available() {
+        int n = 0;
+        if (fd_ < 0 || ioctl(fd_, FIONREAD, &n) < 0) return 0;
+        return n;
+    }
+    int read() {
+        uint8_t c;
+        return ::read(fd_, &c, 1) == 1 ? c : -1;
+    }
+    size_t readBytes(uint8_t *buf, size_t len) {
+        ssize_t n = ::read(fd_, buf, len);
+        return n > 0 ? (size_t)n : 0;
+    }
+    size_t write(const uint8_t *buf, size_t len) override {
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = ::write(fd_, buf + done, len - done);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EINTR) continue;
+                break;
+            }
+            done += n;
+        }
+        return done;
+    }
+    void flush() { if (isatty(fd_)) tcdrain(fd_); }
+
+    int fd() const { return fd_; }
+
+protected:
+    int fd_;
+};
+
+// Put a tty/pty into raw 8N1 mode
+static inline bool host_set_raw(int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) < 0) return false;
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,8 @@
+/**
+ * @file gpio.h
+ * Host stand-in for <driver/gpio.h>. board_config.h only uses
+ * GPIO_NUM_* inside pin macros, which the tools never expand.
+ */
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+#endif // HOST_DRIVER_GPIO_H
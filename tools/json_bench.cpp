@@ -0,0 +1,230 @@
+/**
+ * @file json_bench.cpp
+ * Host benchmark: serializeData() on the streaming JsonWriter against
+ * the previous snprintf-based implementation
+ *
+ * Usage:
+ *   ./json_bench [--iterations N] [--dtcs N]
+ *
+ * Both serializers format the same VehicleData and slave list. The
+ * outputs are compared byte for byte (minus the timestamp), then each is
+ * timed over N records. Host numbers only show the relative cost; the
+ * gap is wider on the ESP32, where float printf is software emulated.
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "modbus_devices.h"
+#include "serial_protocol.h"
+
+// Previous implementation, kept verbatim for comparison
+static int legacy_serialize(char *buf, int bufSize, VehicleData *d,
+                            const char *dtcCodes[], int dtcCount,
+                            bool sdOk, uint64_t sdFreeMB,
+                            const ModbusSlave *slaves, int slaveCount) {
+    int len = snprintf(buf, bufSize,
+        "{\"obd\":{"
+            "\"spd\":%d,\"rpm\":%d,\"ect\":%d,"
+            "\"thr\":%d,\"load\":%d,"
+            "\"fuel_rate\":%.2f,\"fuel_lvl\":%.1f,"
+            "\"maf\":%.2f,\"iat\":%d,\"oil_t\":%d,"
+            "\"timing\":%.1f,\"o2v\":%.3f,\"fuel_pres\":%d"
+        "},"
+        "\"chg\":{"
+            "\"v\":%.2f,\"a\":%.2f,\"set\":%.1f,"
+            "\"t1\":%d,\"t2\":%d,\"amb\":%d,"
+            "\"rate\":%.1f,\"lim\":\"%s\",\"fault\":%u,\"alarm\":%u,\"status\":%u"
+        "}",
+        d->speed, d->rpm, d->ect,
+        d->throttle, d->load,
+        d->fuelRate, d->fuelLevel,
+        d->maf, d->intakeAirTemp, d->oilTemp,
+        d->timingAdv, d->o2Voltage, d->fuelPressure,
+        d->battV, d->battI, d->setA,
+        d->tempT1, d->tempT2, d->tempAmb,
+        d->targetCurrent, d->chargeLimit, d->fault, d->alarm, d->status);
+
+    // Per-device section, one object per RS485 slave
+    if (slaveCount > 0) {
+        len += snprintf(buf + len, bufSize - len, ",\"dev\":[");
+        for (int i = 0; i < slaveCount; i++) {
+            const ModbusSlave *s = &slaves[i];
+            const ModbusProfile *p = s->profile;
+            len += snprintf(buf + len, bufSize - len,
+                              "%s{\"addr\":%u,\"type\":\"%s\",\"ok\":%s",
+                              i > 0 ? "," : "", s->addr, p->name,
+                              s->ok ? "true" : "false");
+            for (uint8_t f = 0; f < p->fieldCount && f < MB_MAX_FIELDS; f++) {
+                len += snprintf(buf + len, bufSize - len,
+                                  p->fields[f].scale < 1.0f ? ",\"%s\":%.2f" : ",\"%s\":%.0f",
+                                  p->fields[f].key, s->values[f]);
+            }
+            if (p->type == MB_DEV_CHARGER && s->setA >= 0) {
+                len += snprintf(buf + len, bufSize - len, ",\"set\":%.1f", s->setA);
+            }
+            len += snprintf(buf + len, bufSize - len, "}");
+        }
+        len += snprintf(buf + len, bufSize - len, "]");
+    }
+
+    // Add DTCs if any
+    if (dtcCount > 0) {
+        len += snprintf(buf + len, bufSize - len, ",\"dtc\":[");
+        for (int i = 0; i < dtcCount && i < 32; i++) {
+            if (i > 0) len += snprintf(buf + len, bufSize - len, ",");
+            len += snprintf(buf + len, bufSize - len, "\"%s\"", dtcCodes[i]);
+        }
+        len += snprintf(buf + len, bufSize - len, "]");
+    }
+
+    // Trip computer
+    len += snprintf(buf + len, bufSize - len,
+        ",\"trip\":{\"km\":%.2f,\"l\":%.2f,\"l100\":%.1f,\"avg\":%.1f,"
+        "\"ah\":%.2f,\"wh\":%.0f,\"eng_s\":%lu}",
+        d->tripKm, d->tripFuelL, d->tripLPer100, d->tripAvgKmh,
+        d->tripAh, d->tripWh, (unsigned long)d->tripEngineS);
+
+    // SD status
+    len += snprintf(buf + len, bufSize - len,
+        ",\"sd\":{\"ok\":%s,\"free_mb\":%llu,\"drop\":%lu,\"wr_ms\":%lu",
+        sdOk ? "true" : "false", (unsigned long long)sdFreeMB,
+        (unsigned long)d->sdDrops, (unsigned long)d->sdWriteMs);
+    for (int i = 0; i < VD_SD_CHANNELS; i++) {
+        len += snprintf(buf + len, bufSize - len, "%s%lu", i ? "," : ",\"lines\":[",
+                        (unsigned long)d->sdLines[i]);
+    }
+    for (int i = 0; i < VD_SD_CHANNELS; i++) {
+        len += snprintf(buf + len, bufSize - len, "%s%lu", i ? "," : "],\"lost\":[",
+                        (unsigned long)d->sdLost[i]);
+    }
+    for (int i = 0; i < VD_LG_TIERS; i++) {
+        len += snprintf(buf + len, bufSize - len, "%s%lu", i ? "," : "],\"tier_n\":[",
+                        (unsigned long)d->tierRows[i]);
+    }
+    for (int i = 0; i < VD_LG_TIERS; i++) {
+        len += snprintf(buf + len, bufSize - len, "%s%lu", i ? "," : "],\"tier_lost\":[",
+                        (unsigned long)d->tierLost[i]);
+    }
+    len += snprintf(buf + len, bufSize - len, "]}");
+
+    // Connectivity status
+    len += snprintf(buf + len, bufSize - len,
+        ",\"can\":%s,\"rs485\":%s,\"trunc\":%lu",
+        d->canOk ? "true" : "false",
+        d->rs485Ok ? "true" : "false",
+        (unsigned long)d->tbTruncated);
+
+    // Timestamp
+    len += snprintf(buf + len, bufSize - len,
+        ",\"ts\":%lu}\n", millis());
+
+    return len;
+}
+
+// Collects the streamed output, like Serial's TX buffer would
+class StringSink : public Print {
+public:
+    using Print::write;
+    size_t write(const uint8_t *buf, size_t len) override {
+        out.append((const char *)buf, len);
+        return len;
+    }
+    std::string out;
+};
+
+// Compare up to the fields the old version didn't have
+static std::string strip_ts(const std::string &s) {
+    size_t p = std::min(s.rfind(",\"tx\":"), s.rfind(",\"ts\":"));
+    return p == std::string::npos ? s : s.substr(0, p);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long iterations = 200000;
+    int dtcCount = 3;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a == "--iterations" && v) { iterations = strtoul(v, NULL, 10); i++; }
+        else if (a == "--dtcs" && v)  { dtcCount = atoi(v); i++; }
+        else {
+            fprintf(stderr, "usage: %s [--iterations N] [--dtcs N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (dtcCount > 32) dtcCount = 32;
+
+    VehicleData d;
+    d.speed = 87; d.rpm = 2450; d.ect = 91; d.throttle = 23; d.load = 41;
+    d.fuelRate = 6.37f; d.fuelLevel = 62.5f; d.maf = 18.42f;
+    d.intakeAirTemp = 34; d.oilTemp = 97; d.timingAdv = 12.5f;
+    d.o2Voltage = 0.455f; d.fuelPressure = 380;
+    d.battV = 27.43f; d.battI = -3.21f; d.setA = 24.5f; d.targetCurrent = 24.5f;
+    d.chargeLimit = "charger_temp";
+    d.tempT1 = 61; d.tempT2 = 38; d.tempAmb = 31;
+    d.canOk = true; d.rs485Ok = true;
+    d.tripKm = 143.27f; d.tripFuelL = 9.81f; d.tripLPer100 = 6.87f; d.tripAvgKmh = 61.4f;
+    d.tripAh = 12.36f; d.tripWh = 338; d.tripEngineS = 8420;
+    for (int i = 0; i < VD_SD_CHANNELS; i++) {
+        d.sdLines[i] = 1200 * (i + 1);
+        d.sdLost[i] = i == 2 ? 17 : 0;
+    }
+    d.tierRows[0] = 3600; d.tierRows[1] = 60; d.tierRows[2] = 1;
+    d.tierLost[0] = 4;
+    for (int i = 0; i < MB_SLAVE_COUNT; i++) {
+        mb_slaves[i].ok = true;
+        mb_slaves[i].setA = 24.5f;
+        for (int f = 0; f < MB_MAX_FIELDS; f++) mb_slaves[i].values[f] = 27.43f + f * 1.7f;
+    }
+    std::vector<std::string> codes;
+    const char *dtcs[32];
+    for (int i = 0; i < dtcCount; i++) {
+        char c[12];
+        snprintf(c, sizeof(c), "P%04d", 100 + i);
+        codes.push_back(c);
+    }
+    for (int i = 0; i < dtcCount; i++) dtcs[i] = codes[i].c_str();
+
+    // Same output?
+    static char buf[1536];
+    legacy_serialize(buf, sizeof(buf), &d, dtcs, dtcCount, false, 0, mb_slaves, MB_SLAVE_COUNT);
+    StringSink sink;
+    serializeData(sink, &d, NULL, dtcs, dtcCount, false, 0, mb_slaves, MB_SLAVE_COUNT);
+    bool same = strip_ts(buf) == strip_ts(sink.out);
+    printf("record: %zu bytes, outputs %s\n", sink.out.size(), same ? "identical" : "DIFFER");
+    if (!same) printf("  old: %s  new: %s", buf, sink.out.c_str());
+
+    uint64_t t0 = host_now_us();
+    size_t sum = 0;
+    for (unsigned long n = 0; n < iterations; n++) {
+        sum += legacy_serialize(buf, sizeof(buf), &d, dtcs, dtcCount, false, 0,
+                                mb_slaves, MB_SLAVE_COUNT);
+    }
+    double oldNs = (host_now_us() - t0) * 1000.0 / iterations;
+
+    t0 = host_now_us();
+    for (unsigned long n = 0; n < iterations; n++) {
+        sink.out.clear();
+        sum += serializeData(sink, &d, NULL, dtcs, dtcCount, false, 0, mb_slaves, MB_SLAVE_COUNT);
+    }
+    double newNs = (host_now_us() - t0) * 1000.0 / iterations;
+
+    printf("snprintf:   %8.0f ns/record\n", oldNs);
+    printf("JsonWriter: %8.0f ns/record  (%.1fx)\n", newNs, oldNs / newNs);
+
+    // Bounded: a fixed buffer stops at its end instead of overrunning it
+    char small[256];
+    JsonWriter w;
+    jw_init(&w, small, sizeof(small));
+    jw_obj(&w);
+    jw_arr(&w, "dtc");
+    for (int i = 0; i < 64; i++) jw_str(&w, NULL, "P0000");
+    jw_arr_end(&w);
+    jw_obj_end(&w);
+    size_t n = jw_end(&w);
+    printf("fixed %zu-byte buffer, 64 DTCs: %zu bytes written, overflow=%s\n",
+           sizeof(small), n, w.overflow ? "yes" : "no");
+    return sum ? 0 : 1;
+}
@@ -0,0 +1,437 @@
+/**
+ * @file log_bench.cpp
+ * Host round-trip checks and compression numbers for the packed SD log
+ * (log_format.h)
+ *
+ * Usage:
+ *   ./log_bench [FILE.dlg ...] [--hours H] [--hz N]
+ *
+ * First the packer runs over synthetic edge cases — constant and noisy
+ * channels, full-range values of every type, millis() wrapping,
+ * irregular and backwards timestamps, one-row blocks, a schema change —
+ * and every block must decode to exactly the rows that went in, and
+ * fail its commit marker once damaged, torn or read as another file's;
+ * any mismatch exits with status 1. Then each FILE (a drive recorded by the
+ * logger, plain or packed) is repacked and checked the same way, or a
+ * simulated drive built with tb_collect() when no file is given. For
+ * each it prints the size against the plain layout and the CSV the
+ * logger used to write, and the packing cost per value.
+ */
+
+#include <Arduino.h>
+#include <sys/stat.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "modbus_devices.h"
+#include "log_format.h"
+
+// Rows of one field set, as the logger would have collected them
+struct Segment {
+    std::vector<TbValue> fields;        // raw unused; keys/types/names only
+    std::vector<uint32_t> ts;
+    std::vector<std::vector<int32_t>> rows;
+};
+
+// Keeps keys and enum names of parsed schemas alive for TbValue
+static std::vector<std::unique_ptr<std::string>> g_strings;
+static std::vector<std::unique_ptr<std::vector<const char *>>> g_names;
+
+static const char *keep(const std::string &s) {
+    g_strings.emplace_back(new std::string(s));
+    return g_strings.back()->c_str();
+}
+
+struct Packed {
+    std::vector<uint8_t> file;
+    double packNs = 0;                  // lf_add_row + lf_seal
+    unsigned long values = 0;
+};
+
+static const uint32_t NONCE = 0x5EED1234;  // Stands in for the logger's esp_random()
+
+// Log segs through LfWriter the way sd_log_data() does
+static Packed pack(const std::vector<Segment> &segs, size_t stageSize, uint32_t nonce = NONCE) {
+    Packed p;
+    std::vector<int32_t> stage(stageSize / sizeof(int32_t));
+    std::unique_ptr<LfWriter> w(new LfWriter);
+    lf_init(w.get(), stage.data(), stageSize, nonce);
+    auto store = [&]() {
+        if (w->rows) lf_seal(w.get());
+        p.file.insert(p.file.end(), w->block, w->block + LF_BLOCK_SIZE);
+        lf_stored(w.get(), true);
+    };
+    for (const Segment &s : segs) {
+        std::vector<TbValue> v = s.fields;
+        int n = (int)v.size();
+        if (w->rows) store();
+        if (!lf_begin_schema(w.get(), v.data(), n)) {
+            fprintf(stderr, "schema doesn't fit a block\n");
+            exit(1);
+        }
+        store();
+        for (size_t r = 0; r < s.ts.size(); r++) {
+            for (int k = 0; k < n; k++) v[k].raw = s.rows[r][k];
+            auto t0 = std::chrono::steady_clock::now();
+            bool ok = lf_add_row(w.get(), s.ts[r], v.data());
+            if (!ok) {
+                lf_seal(w.get());
+                p.packNs += std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - t0).count();
+                store();
+                t0 = std::chrono::steady_clock::now();
+                ok = lf_add_row(w.get(), s.ts[r], v.data());
+            }
+            p.packNs += std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - t0).count();
+            p.values += n + 1;
+            if (!ok) {
+                fprintf(stderr, "row doesn't fit an empty block\n");
+                exit(1);
+            }
+        }
+    }
+    if (w->rows) {
+        auto t0 = std::chrono::steady_clock::now();
+        lf_seal(w.get());
+        p.packNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        store();
+    }
+    lf_build_index(w.get());
+    store();
+    return p;
+}
+
+/**
+ * Read a log back into segments (typed as the plain layout stores
+ * values). Returns false on a block that doesn't decode.
+ */
+static bool unpack(const uint8_t *data, size_t size, std::vector<Segment> *segs, double *ns = NULL) {
+    std::unique_ptr<LfSchema> schema(new LfSchema);
+    bool have = false;
+    std::vector<int64_t> values;
+    for (size_t off = 0; off + LF_BLOCK_SIZE <= size; off += LF_BLOCK_SIZE) {
+        const uint8_t *b = data + off;
+        uint32_t magic = lf_get_le(b, 4);
+        if (magic == LF_MAGIC_SCHEMA) {
+            if (!lf_parse_schema(b, schema.get())) return false;
+            have = true;
+            segs->emplace_back();
+            for (int k = 0; k < schema->fields; k++) {
+                const LfField *f = &schema->field[k];
+                TbValue v = {NULL, -1, keep(f->key), f->type, f->decimals, 0, 0, NULL, 0};
+                if (f->type == TB_ENUM) {
+                    g_names.emplace_back(new std::vector<const char *>);
+                    std::string all(f->names, f->namesLen);
+                    for (size_t p = 0;;) {
+                        size_t bar = all.find('|', p);
+                        g_names.back()->push_back(keep(all.substr(p, bar - p)));
+                        if (bar == std::string::npos) break;
+                        p = bar + 1;
+                    }
+                    v.names = g_names.back()->data();
+                    v.nameCount = (uint8_t)g_names.back()->size();
+                }
+                segs->back().fields.push_back(v);
+            }
+        } else if (magic == LF_MAGIC_DATA) {
+            if (!have) return false;
+            values.resize((size_t)(schema->fields + 1) * lf_get_le(b + 10, 2));
+            auto t0 = std::chrono::steady_clock::now();
+            int n = lf_read_block(b, schema.get(), values.data());
+            if (ns) *ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+            if (n < 0) return false;
+            Segment &s = segs->back();
+            for (int r = 0; r < n; r++) {
+                s.ts.push_back((uint32_t)values[r]);
+                std::vector<int32_t> row(schema->fields);
+                for (int k = 0; k < schema->fields; k++) row[k] = (int32_t)values[(size_t)(k + 1) * n + r];
+                s.rows.push_back(row);
+            }
+        }
+    }
+    return true;
+}
+
+// What the plain layout keeps of each value, for comparison
+static std::vector<Segment> typed(std::vector<Segment> segs) {
+    for (Segment &s : segs) {
+        for (auto &row : s.rows) {
+            for (size_t k = 0; k < row.size(); k++) {
+                row[k] = (int32_t)lf_typed(s.fields[k].type, (uint32_t)row[k]);
+            }
+        }
+    }
+    return segs;
+}
+
+static bool same(const std::vector<Segment> &a, const std::vector<Segment> &b, std::string *why) {
+    char buf[160];
+    if (a.size() != b.size()) {
+        snprintf(buf, sizeof(buf), "%zu segments, expected %zu", b.size(), a.size());
+        *why = buf;
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].ts.size() != b[i].ts.size()) {
+            snprintf(buf, sizeof(buf), "segment %zu: %zu rows, expected %zu", i, b[i].ts.size(), a[i].ts.size());
+            *why = buf;
+            return false;
+        }
+        for (size_t r = 0; r < a[i].ts.size(); r++) {
+            if (a[i].ts[r] != b[i].ts[r]) {
+                snprintf(buf, sizeof(buf), "segment %zu row %zu: ts %u, expected %u", i, r, b[i].ts[r], a[i].ts[r]);
+                *why = buf;
+                return false;
+            }
+            for (size_t k = 0; k < a[i].rows[r].size(); k++) {
+                if (a[i].rows[r][k] != b[i].rows[r][k]) {
+                    char key[48];
+                    tb_key(&a[i].fields[k], key, sizeof(key));
+                    snprintf(buf, sizeof(buf), "segment %zu row %zu field %s: %d, expected %d", i, r,
+                             key, b[i].rows[r][k], a[i].rows[r][k]);
+                    *why = buf;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * ROUND-TRIP CASES
+ * ══════════════════════════════════════════════════════════════*/
+
+static Segment every_type() {
+    static const char *const STATES[] = {"off", "on", "fault"};
+    Segment s;
+    s.fields = {
+        {NULL, -1, "b", TB_BOOL, 0, 0, 0, NULL, 0},
+        {NULL, -1, "u8", TB_U8, 0, 0, 0, NULL, 0},
+        {NULL, -1, "i16", TB_I16, 1, 0, 0, NULL, 0},
+        {NULL, -1, "u16", TB_U16, 2, 0, 0, NULL, 0},
+        {NULL, -1, "i32", TB_I32, 3, 0, 0, NULL, 0},
+        {NULL, -1, "u32", TB_U32, 0, 0, 0, NULL, 0},
+        {NULL, -1, "e", TB_ENUM, 0, 0, 0, STATES, 3},
+    };
+    return s;
+}
+
+static bool run_case(const char *name, const std::vector<Segment> &in, size_t stageSize) {
+    Packed p = pack(in, stageSize);
+    std::vector<Segment> out;
+    std::string why = "block doesn't decode";
+    bool ok = unpack(p.file.data(), p.file.size(), &out) && same(typed(in), out, &why);
+    printf("  %-28s %s", name, ok ? "ok" : "FAILED: ");
+    if (!ok) printf("%s", why.c_str());
+    printf("\n");
+    return ok;
+}
+
+static bool self_test() {
+    std::mt19937 rng(42);
+    bool ok = true;
+    printf("round trip:\n");
+
+    auto fill = [&](Segment s, size_t rows, uint32_t t0, auto tsStep, auto value) {
+        uint32_t t = t0;
+        for (size_t r = 0; r < rows; r++) {
+            s.ts.push_back(t);
+            std::vector<int32_t> row(s.fields.size());
+            for (size_t k = 0; k < row.size(); k++) row[k] = value(r, k);
+            s.rows.push_back(row);
+            t += tsStep(r);
+        }
+        return s;
+    };
+    auto every100 = [](size_t) { return 100u; };
+
+    ok &= run_case("constant", {fill(every_type(), 5000, 0, every100,
+                                     [](size_t, size_t k) { return (int32_t)k; })}, 65536);
+    ok &= run_case("ramps", {fill(every_type(), 5000, 1000, every100,
+                                  [](size_t r, size_t k) { return (int32_t)(r * (k + 1)); })}, 65536);
+    ok &= run_case("full-range noise", {fill(every_type(), 5000, 0,
+                                             [&](size_t) { return (uint32_t)rng() % 5000; },
+                                             [&](size_t, size_t) { return (int32_t)rng(); })}, 65536);
+    ok &= run_case("extremes", {fill(every_type(), 2000, 0, every100,
+                                     [](size_t r, size_t) { return r & 1 ? INT32_MIN : INT32_MAX; })}, 65536);
+    ok &= run_case("millis() wrap", {fill(every_type(), 3000, 0xFFFFF000u, every100,
+                                          [&](size_t, size_t) { return (int32_t)(rng() % 3); })}, 65536);
+    ok &= run_case("jumps and backwards ts", {fill(every_type(), 3000, 500000,
+                                                   [&](size_t r) { return r % 97 == 0 ? (uint32_t)rng()
+                                                                                      : 95 + rng() % 10; },
+                                                   [&](size_t r, size_t) { return (int32_t)(r / 50); })},
+                       65536);
+    ok &= run_case("one row per block", {fill(every_type(), 300, 0, every100,
+                                              [&](size_t, size_t) { return (int32_t)rng(); })},
+                   sizeof(int32_t) * 8);
+    Segment narrow;
+    narrow.fields = {{NULL, -1, "x", TB_I16, 0, 0, 0, NULL, 0}};
+    ok &= run_case("schema change", {fill(every_type(), 1000, 0, every100,
+                                          [](size_t r, size_t) { return (int32_t)r; }),
+                                     fill(narrow, 1000, 100000, every100,
+                                          [](size_t r, size_t) { return (int32_t)-r; })}, 65536);
+
+    // Commit markers: every block passes as written, none with a flipped
+    // bit, a zeroed tail (unwritten clusters), the start of the next one
+    // or from another file (a deleted log's leftovers)
+    auto drive = fill(every_type(), 3000, 0, every100, [&](size_t, size_t) { return (int32_t)(rng() % 100); });
+    Packed p = pack({drive}, 65536), other = pack({drive}, 65536, NONCE + 1);
+    bool caught = p.file.size() >= 2 * LF_BLOCK_SIZE;
+    for (size_t b = 0; b + LF_BLOCK_SIZE <= other.file.size(); b += LF_BLOCK_SIZE) {
+        if (lf_block_ok(&other.file[b], NONCE)) caught = false;
+    }
+    for (size_t b = 0; b + LF_BLOCK_SIZE <= p.file.size(); b += LF_BLOCK_SIZE) {
+        uint8_t *block = &p.file[b];
+        if (!lf_block_ok(block, NONCE)) caught = false;
+        for (int k = 0; k < 256; k++) {
+            size_t at = rng() % LF_BLOCK_SIZE;
+            uint8_t bit = (uint8_t)(1u << (rng() % 8));
+            block[at] ^= bit;
+            if (lf_block_ok(block, NONCE)) caught = false;
+            block[at] ^= bit;
+        }
+        std::vector<uint8_t> torn(block, block + LF_BLOCK_SIZE);
+        memset(&torn[LF_BLOCK_SIZE / 2], 0, LF_BLOCK_SIZE / 2);
+        if (lf_block_ok(torn.data(), NONCE)) caught = false;
+        if (b + 2 * LF_BLOCK_SIZE <= p.file.size()) {
+            memcpy(&torn[LF_BLOCK_SIZE / 2], block + LF_BLOCK_SIZE, LF_BLOCK_SIZE / 2);
+            if (lf_block_ok(torn.data(), NONCE)) caught = false;
+        }
+    }
+    printf("  %-28s %s\n", "torn blocks caught", caught ? "ok" : "FAILED");
+    ok &= caught;
+    return ok;
+}
+
+/* ══════════════════════════════════════════════════════════════
+ * DRIVES
+ * ══════════════════════════════════════════════════════════════*/
+
+// A drive built from the real record: city/highway speed, warming
+// engine, noisy battery readings, loop timing jitter
+static std::vector<Segment> simulated_drive(double hours, unsigned hz) {
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0, 1);
+    VehicleData d;
+    ObdScheduler obd;
+    obd_sched_init(&obd, true);
+    TbValue v[TB_MAX_VALUES];
+    std::vector<Segment> segs(1);
+    size_t rows = (size_t)(hours * 3600 * hz);
+    uint32_t t = 0;
+    for (size_t r = 0; r < rows; r++) {
+        double s = (double)r / hz;
+        t += 1000 / hz + (rng() % 5 == 0 ? rng() % 4 : 0);
+        d.speed = (int)fmax(0, 60 + 45 * sin(s / 240) + 15 * sin(s / 17));
+        d.rpm = d.speed ? 900 + d.speed * 28 + (int)(40 * noise(rng)) : 800;
+        d.throttle = (int)fmax(0, 20 + 15 * sin(s / 9));
+        d.load = d.throttle + 10;
+        d.ect = (int)fmin(90, 20 + s / 12);
+        d.intakeAirTemp = 25;
+        d.oilTemp = (int)fmin(100, 20 + s / 15);
+        d.fuelLevel = 80.0f - (float)s / 300;
+        d.fuelRate = 2.0f + d.speed * 0.05f;
+        d.maf = d.rpm * 0.006f;
+        d.timingAdv = 10.0f + (d.rpm % 7) * 0.5f;
+        d.o2Voltage = 0.45f + 0.3f * (float)sin(s * 3);
+        d.fuelPressure = 300;
+        d.battV = 13.8f + 0.02f * noise(rng);
+        d.battI = 20.0f + 0.1f * noise(rng);
+        d.tempT1 = d.tempT2 = (int)fmin(45, 25 + s / 120);
+        d.tempAmb = 24;
+        d.targetCurrent = 20.0f;
+        int n = tb_collect(v, TB_MAX_VALUES, &d, &obd, true, 28000, mb_slaves, MB_SLAVE_COUNT);
+        if (n > TB_MAX_VALUES) {
+            fprintf(stderr, "record has %d fields, TB_MAX_VALUES is %d\n", n, TB_MAX_VALUES);
+            exit(1);
+        }
+        if (segs[0].fields.empty()) segs[0].fields.assign(v, v + n);
+        segs[0].ts.push_back(t);
+        std::vector<int32_t> row(n);
+        for (int k = 0; k < n; k++) row[k] = v[k].raw;
+        segs[0].rows.push_back(row);
+    }
+    return segs;
+}
+
+// Bytes the 14-column CSV logger wrote per row, roughly
+static const double CSV_ROW_BYTES = 80;
+
+static bool bench(const char *name, const std::vector<Segment> &drive) {
+    size_t rows = 0, plain = 0, values = 0;
+    for (const Segment &s : drive) {
+        size_t rowBytes = 0;
+        for (const TbValue &f : s.fields) rowBytes += tb_type_width(f.type);
+        size_t cap = lf_capacity(rowBytes);
+        rows += s.ts.size();
+        values += s.ts.size() * (s.fields.size() + 1);
+        plain += LF_BLOCK_SIZE * (1 + (s.ts.size() + cap - 1) / cap);
+    }
+    Packed p = pack(drive, 65536);
+    std::vector<Segment> out;
+    std::string why = "block doesn't decode";
+    double decodeNs = 0;
+    bool ok = unpack(p.file.data(), p.file.size(), &out, &decodeNs) && same(typed(drive), out, &why);
+    double seconds = drive.empty() || drive.back().ts.empty() ? 0
+                   : (drive.back().ts.back() - drive.front().ts.front()) / 1000.0;
+    printf("%s: %zu rows, %zu fields, %.1f h\n", name, rows, drive.empty() ? 0 : drive[0].fields.size(),
+           seconds / 3600);
+    printf("  plain   %10zu bytes  %7.2f MB/h\n", plain, seconds ? plain / seconds * 3600 / 1e6 : 0);
+    printf("  packed  %10zu bytes  %7.2f MB/h  %.1fx smaller, %.2f bytes/row (csv ~%.0f for 14 fields)\n",
+           p.file.size(), seconds ? p.file.size() / seconds * 3600 / 1e6 : 0,
+           (double)plain / p.file.size(), (double)p.file.size() / rows, CSV_ROW_BYTES);
+    printf("  pack    %.1f ns/value, unpack %.1f ns/value, round trip %s\n",
+           p.packNs / values, decodeNs / values, ok ? "ok" : why.c_str());
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<const char *> files;
+    double hours = 1;
+    unsigned hz = 10;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a == "--hours" && v)        { hours = atof(v); i++; }
+        else if (a == "--hz" && v)      { hz = (unsigned)atoi(v); i++; }
+        else if (a[0] != '-')           files.push_back(argv[i]);
+        else {
+            fprintf(stderr, "usage: %s [FILE.dlg ...] [--hours H] [--hz N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!hz || hz > 1000) hz = 10;
+
+    bool ok = self_test();
+    if (files.empty()) {
+        char name[48];
+        snprintf(name, sizeof(name), "simulated drive (%u Hz)", hz);
+        ok &= bench(name, simulated_drive(hours, hz));
+    }
+    for (const char *path : files) {
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            perror(path);
+            return 1;
+        }
+        std::vector<uint8_t> data;
+        uint8_t buf[65536];
+        for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) data.insert(data.end(), buf, buf + n);
+        fclose(f);
+        std::vector<Segment> drive;
+        if (!unpack(data.data(), data.size(), &drive)) {
+            fprintf(stderr, "%s: unreadable block\n", path);
+            ok = false;
+            continue;
+        }
+        ok &= bench(path, drive);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,373 @@
+/**
+ * @file log_convert.cpp
+ * Convert binary SD logs (/logs/NNNN.dlg, see log_format.h) to CSV or
+ * Parquet
+ *
+ * Usage:
+ *   ./log_convert FILE [options]
+ *     --out PATH        Output file (default: stdout, CSV only)
+ *     --parquet         Write Parquet (needs a build with Arrow/Parquet)
+ *     --from MS         First ts_ms to include
+ *     --to MS           Last ts_ms to include
+ *     --raw             Fixed point raw values instead of scaled ones
+ *     --info            Print the block layout instead of converting
+ *
+ * The file is mmap'd and read block by block. With --from/--to, the
+ * time index next to it (NNNN.idx) is binary searched for the first
+ * block and the schema it needs, and reading stops at the first indexed
+ * block past --to. Without one the block index at the end of a cleanly
+ * closed file is used, and failing that the block headers. The
+ * output has one column per field key across every schema in the range;
+ * cells of fields a schema doesn't have are left empty.
+ */
+
+#include <Arduino.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "log_format.h"
+
+#ifdef LOG_CONVERT_PARQUET
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <parquet/arrow/writer.h>
+#endif
+
+struct LogFile {
+    const uint8_t *data = NULL;
+    size_t blocks = 0;
+    std::vector<uint8_t> idx;               // NNNN.idx, if there is one
+    uint32_t nonce = 0;                     // From the first block; seeds the commit markers
+    const uint8_t *block(size_t i) const { return data + i * LF_BLOCK_SIZE; }
+    uint32_t magic(size_t i) const { return lf_get_le(block(i), 4); }
+};
+
+static bool idx_entry(const LogFile &f, uint32_t i, LfIdxEntry *e) {
+    if ((size_t)(i + 1) * LF_IDX_ENTRY > f.idx.size()) return false;
+    lf_get_idx(f.idx.data() + (size_t)i * LF_IDX_ENTRY, e);
+    return e->block < f.blocks && e->schemaBlock < f.blocks;
+}
+
+static void load_idx(LogFile *f, const char *path) {
+    std::string p = path;
+    size_t dot = p.rfind('.');
+    if (dot == std::string::npos || p.compare(dot, std::string::npos, ".dlg") != 0) return;
+    FILE *in = fopen((p.substr(0, dot) + ".idx").c_str(), "rb");
+    if (!in) return;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) f->idx.insert(f->idx.end(), buf, buf + n);
+    fclose(in);
+}
+
+// Last block known to start at or before ts, from an index if there is
+// one; *schema is the SCHEMA it needs when the .idx says so
+static size_t first_block(const LogFile &f, uint32_t from, size_t *schema) {
+    uint32_t count = f.idx.size() / LF_IDX_ENTRY;
+    if (count) {
+        LfIdxEntry e;
+        uint32_t n = lf_idx_find(count, from, [&](uint32_t i, LfIdxEntry *x) {
+            return idx_entry(f, i, x);
+        });
+        if (!n || !idx_entry(f, n - 1, &e)) return 0;
+        *schema = e.schemaBlock;
+        return e.block;
+    }
+    if (!f.blocks || f.magic(f.blocks - 1) != LF_MAGIC_INDEX ||
+        !lf_block_ok(f.block(f.blocks - 1), f.nonce)) {
+        return 0;
+    }
+    LfHeader h;
+    lf_get_header(f.block(f.blocks - 1), &h);
+    const uint8_t *e = f.block(f.blocks - 1) + LF_HEADER_SIZE;
+    size_t lo = 0, hi = std::min<size_t>(h.count, LF_INDEX_MAX);
+    while (lo < hi) {                       // First entry with t_first > from
+        size_t mid = (lo + hi) / 2;
+        if (lf_get_le(e + 8 * mid + 4, 4) <= from) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo ? lf_get_le(e + 8 * (lo - 1), 4) : 0;
+}
+
+// Where reading can stop for rows up to ts: the first indexed block past it
+static size_t end_block(const LogFile &f, uint32_t to) {
+    uint32_t count = f.idx.size() / LF_IDX_ENTRY;
+    LfIdxEntry e;
+    uint32_t n = lf_idx_find(count, to, [&](uint32_t i, LfIdxEntry *x) {
+        return idx_entry(f, i, x);
+    });
+    return n < count && idx_entry(f, n, &e) ? e.block : f.blocks;
+}
+
+// A SCHEMA block of this file, not one a deleted log left in its clusters
+static bool own_schema(const LogFile &f, size_t i, LfSchema *s) {
+    return lf_parse_schema(f.block(i), s) && s->nonce == f.nonce;
+}
+
+// The schema in effect at block i: the nearest SCHEMA block before it
+static bool schema_at(const LogFile &f, size_t i, LfSchema *s, size_t *at) {
+    for (size_t k = i + 1; k-- > 0;) {
+        if (f.magic(k) == LF_MAGIC_SCHEMA && own_schema(f, k, s)) {
+            *at = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string format_value(const LfField *fd, int64_t raw, bool rawOut) {
+    char buf[64];
+    if (fd->type == TB_ENUM && fd->names && !rawOut) {
+        const char *p = fd->names, *end = fd->names + fd->namesLen;
+        for (int64_t k = 0; p < end; k++) {
+            const char *bar = (const char *)memchr(p, '|', end - p);
+            if (!bar) bar = end;
+            if (k == raw) return std::string(p, bar - p);
+            p = bar + 1;
+        }
+    }
+    if (rawOut || !fd->decimals) {
+        snprintf(buf, sizeof(buf), "%lld", (long long)raw);
+    } else {
+        static const double scale[] = {1, 10, 100, 1000};
+        snprintf(buf, sizeof(buf), "%.*f", fd->decimals,
+                 raw / scale[fd->decimals < 4 ? fd->decimals : 3]);
+    }
+    return buf;
+}
+
+static void print_info(const LogFile &f) {
+    uint32_t lastSeq = 0, gaps = 0;
+    unsigned long rows = 0;
+    for (size_t i = 0; i < f.blocks; i++) {
+        LfHeader h;
+        lf_get_header(f.block(i), &h);
+        if (!lf_block_ok(f.block(i), f.nonce)) {
+            printf("block %zu: torn, corrupt or another file's (commit marker doesn't match)\n", i);
+            continue;
+        }
+        if (i && h.seq != lastSeq + 1) gaps += h.seq - lastSeq - 1;
+        lastSeq = h.seq;
+        if (h.magic == LF_MAGIC_SCHEMA) {
+            LfSchema s;
+            if (own_schema(f, i, &s)) {
+                printf("block %zu: schema %04x, %d fields\n", i, s.id, s.fields);
+            } else {
+                printf("block %zu: bad schema\n", i);
+            }
+        } else if (h.magic == LF_MAGIC_DATA) {
+            rows += h.count;
+        } else if (h.magic == LF_MAGIC_INDEX) {
+            printf("block %zu: index, %u entries, 1 per %u data blocks\n", i, h.count, h.cap);
+        } else {
+            printf("block %zu: unknown magic %08x\n", i, h.magic);
+        }
+    }
+    printf("%zu blocks, %lu rows, %u blocks dropped\n", f.blocks, rows, gaps);
+    uint32_t count = f.idx.size() / LF_IDX_ENTRY;
+    LfIdxEntry first, last;
+    if (count && idx_entry(f, 0, &first) && idx_entry(f, count - 1, &last)) {
+        printf("time index: %u entries, %u..%u ms, blocks %u..%u\n", count,
+               first.tFirst, last.tFirst, first.block, last.block);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s FILE [--out PATH] [--parquet] [--from MS] [--to MS] [--raw] [--info]\n",
+                argv[0]);
+        return 1;
+    }
+    const char *path = argv[1];
+    const char *outPath = NULL;
+    bool parquet = false, rawOut = false, info = false;
+    uint32_t from = 0, to = UINT32_MAX;
+    for (int i = 2; i < argc; i++) {
+        std::string a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a == "--out" && v)          { outPath = v; i++; }
+        else if (a == "--from" && v)    { from = strtoul(v, NULL, 10); i++; }
+        else if (a == "--to" && v)      { to = strtoul(v, NULL, 10); i++; }
+        else if (a == "--parquet")      parquet = true;
+        else if (a == "--raw")          rawOut = true;
+        else if (a == "--info")         info = true;
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+#ifndef LOG_CONVERT_PARQUET
+    if (parquet) {
+        fprintf(stderr, "Built without Parquet support (Arrow/Parquet not found by CMake)\n");
+        return 1;
+    }
+#endif
+    if (parquet && !outPath) {
+        fprintf(stderr, "--parquet needs --out\n");
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return 1;
+    }
+    LogFile f;
+    f.blocks = st.st_size / LF_BLOCK_SIZE;  // A torn last block is ignored
+    if (!f.blocks) {
+        fprintf(stderr, "%s: no complete blocks\n", path);
+        return 1;
+    }
+    void *map = mmap(NULL, f.blocks * LF_BLOCK_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise(map, f.blocks * LF_BLOCK_SIZE, MADV_SEQUENTIAL);
+    f.data = (const uint8_t *)map;
+    f.nonce = lf_nonce_of(f.block(0));
+    load_idx(&f, path);
+
+    if (info) {
+        print_info(f);
+        return 0;
+    }
+
+    // Pass 1: blocks in range, starting with the schema in effect at the
+    // first one, and the union of their columns
+    size_t schemaBlock = SIZE_MAX;
+    size_t start = first_block(f, from, &schemaBlock), stop = end_block(f, to);
+    LfSchema schema;
+    if (schemaBlock != SIZE_MAX && !own_schema(f, schemaBlock, &schema)) {
+        schemaBlock = SIZE_MAX;
+    }
+    if (schemaBlock == SIZE_MAX && !schema_at(f, start, &schema, &schemaBlock)) {
+        start = schemaBlock = 0;
+    }
+    std::vector<std::string> columns;
+    std::map<std::string, size_t> columnOf;
+    std::vector<size_t> range;
+    auto addSchema = [&](size_t i) {
+        LfSchema s;
+        if (!own_schema(f, i, &s)) return;
+        for (int k = 0; k < s.fields; k++) {
+            if (columnOf.emplace(s.field[k].key, columns.size()).second) {
+                columns.push_back(s.field[k].key);
+            }
+        }
+        range.push_back(i);
+    };
+    if (schemaBlock < start) addSchema(schemaBlock);
+    for (size_t i = start; i < stop; i++) {
+        LfHeader h;
+        lf_get_header(f.block(i), &h);
+        if (h.magic == LF_MAGIC_SCHEMA) {
+            addSchema(i);
+        } else if (h.magic == LF_MAGIC_DATA && h.count) {
+            if (h.tLast < from) continue;
+            if (h.tFirst > to) break;
+            range.push_back(i);
+        }
+    }
+
+    // Pass 2: rows, each block decoded column by column
+    std::vector<std::string> cells(columns.size());
+    std::vector<int> fieldColumn;
+    std::vector<int64_t> values;
+    bool haveSchema = false;
+    unsigned long rows = 0, skipped = 0;
+
+#ifdef LOG_CONVERT_PARQUET
+    arrow::Int64Builder tsCol;
+    std::vector<arrow::DoubleBuilder> valueCols(columns.size());
+#endif
+    FILE *out = NULL;
+    if (!parquet) {
+        out = outPath ? fopen(outPath, "w") : stdout;
+        if (!out) {
+            perror(outPath);
+            return 1;
+        }
+        fputs("ts_ms", out);
+        for (const std::string &c : columns) fprintf(out, ",%s", c.c_str());
+        fputc('\n', out);
+    }
+
+    for (size_t i : range) {
+        const uint8_t *b = f.block(i);
+        LfHeader h;
+        lf_get_header(b, &h);
+        if (h.magic == LF_MAGIC_SCHEMA) {
+            haveSchema = lf_parse_schema(b, &schema);
+            fieldColumn.assign(schema.fields, 0);
+            for (int k = 0; k < schema.fields; k++) fieldColumn[k] = columnOf[schema.field[k].key];
+            continue;
+        }
+        values.resize((size_t)(schema.fields + 1) * h.count);
+        int n = haveSchema ? lf_read_block(b, &schema, values.data()) : -1;
+        if (n < 0) {
+            skipped++;
+            continue;
+        }
+        auto raw = [&](int k, int r) { return values[(size_t)(k + 1) * n + r]; };
+        for (int r = 0; r < n; r++) {
+            uint32_t ts = (uint32_t)values[r];
+            if (ts < from || ts > to) continue;
+            rows++;
+#ifdef LOG_CONVERT_PARQUET
+            if (parquet) {
+                std::vector<bool> set(columns.size(), false);
+                PARQUET_THROW_NOT_OK(tsCol.Append(ts));
+                for (int k = 0; k < schema.fields; k++) {
+                    const LfField *fd = &schema.field[k];
+                    static const double scale[] = {1, 10, 100, 1000};
+                    double v = (double)raw(k, r);
+                    if (!rawOut) v /= scale[fd->decimals < 4 ? fd->decimals : 3];
+                    PARQUET_THROW_NOT_OK(valueCols[fieldColumn[k]].Append(v));
+                    set[fieldColumn[k]] = true;
+                }
+                for (size_t c = 0; c < columns.size(); c++) {
+                    if (!set[c]) PARQUET_THROW_NOT_OK(valueCols[c].AppendNull());
+                }
+                continue;
+            }
+#endif
+            for (std::string &c : cells) c.clear();
+            for (int k = 0; k < schema.fields; k++) {
+                cells[fieldColumn[k]] = format_value(&schema.field[k], raw(k, r), rawOut);
+            }
+            fprintf(out, "%lu", (unsigned long)ts);
+            for (const std::string &c : cells) {
+                fputc(',', out);
+                fputs(c.c_str(), out);
+            }
+            fputc('\n', out);
+        }
+    }
+
+#ifdef LOG_CONVERT_PARQUET
+    if (parquet) {
+        std::vector<std::shared_ptr<arrow::Field>> fields = {arrow::field("ts_ms", arrow::int64())};
+        std::vector<std::shared_ptr<arrow::Array>> arrays(1);
+        PARQUET_THROW_NOT_OK(tsCol.Finish(&arrays[0]));
+        for (size_t c = 0; c < columns.size(); c++) {
+            fields.push_back(arrow::field(columns[c], arrow::float64()));
+            arrays.emplace_back();
+            PARQUET_THROW_NOT_OK(valueCols[c].Finish(&arrays.back()));
+        }
+        std::shared_ptr<arrow::Table> table = arrow::Table::Make(arrow::schema(fields), arrays);
+        std::shared_ptr<arrow::io::FileOutputStream> file;
+        PARQUET_ASSIGN_OR_THROW(file, arrow::io::FileOutputStream::Open(outPath));
+        PARQUET_THROW_NOT_OK(parquet::arrow::WriteTable(*table, arrow::default_memory_pool(), file, 65536));
+    }
+#endif
+    if (out && out != stdout) fclose(out);
+    fprintf(stderr, "%lu rows, %zu columns%s\n", rows, columns.size(),
+            skipped ? ", some blocks without a schema skipped" : "");
+    return 0;
+}
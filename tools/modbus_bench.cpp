@@ -0,0 +1,118 @@
+/**
+ * @file modbus_bench.cpp
+ * Host build of the firmware Modbus master (modbus_master.h) for
+ * load and latency measurements against charger_sim or a real bus
+ *
+ * Usage:
+ *   ./modbus_bench PORT [options]
+ *     --addr N          Slave to poll (repeatable, default 1)
+ *     --count N         Transactions to run (default 1000)
+ *     --timeout MS      Per-transaction timeout (default 150)
+ *     --baud B          Line rate for real serial ports (default 9600)
+ *
+ * Each transaction is one profile block read, exactly as mb_poll()
+ * issues it on the device. Prints transactions/s, latency percentiles
+ * and the master's error counters.
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "modbus_devices.h"
+
+static speed_t to_speed(unsigned long baud) {
+    switch (baud) {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        default:     return B9600;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s PORT [--addr N] [--count N] [--timeout MS] [--baud B]\n", argv[0]);
+        return 1;
+    }
+    const char *path = argv[1];
+    std::vector<uint8_t> addrs;
+    unsigned long count = 1000, timeoutMs = 150, baud = 9600;
+
+    for (int i = 2; i < argc; i++) {
+        std::string a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a == "--addr" && v)         { addrs.push_back((uint8_t)strtol(v, NULL, 0)); i++; }
+        else if (a == "--count" && v)   { count = strtoul(v, NULL, 10); i++; }
+        else if (a == "--timeout" && v) { timeoutMs = strtoul(v, NULL, 10); i++; }
+        else if (a == "--baud" && v)    { baud = strtoul(v, NULL, 10); i++; }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (addrs.empty()) addrs.push_back(0x01);
+
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    host_set_raw(fd);
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfsetspeed(&tio, to_speed(baud));
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    // Same slave/profile structures the firmware uses
+    std::vector<ModbusSlave> slaves(addrs.size());
+    for (size_t i = 0; i < addrs.size(); i++) {
+        slaves[i].addr = addrs[i];
+        slaves[i].profile = &PROFILE_WG_BC900M;
+        slaves[i].pollMs = 0;
+        slaves[i].timeoutMs = (uint16_t)timeoutMs;
+    }
+
+    Stream port(fd);
+    mb_begin(&port, slaves.data(), (int)slaves.size());
+    mb_set_timing(baud, false, 0);
+
+    std::vector<double> okLatency;
+    okLatency.reserve(count);
+    uint64_t worstUs = 0;
+    uint64_t t0 = host_now_us();
+
+    for (unsigned long n = 0; n < count; n++) {
+        ModbusSlave *s = &slaves[n % slaves.size()];
+        uint64_t start = host_now_us();
+        bool ok = mb_poll_slave(s);
+        uint64_t us = host_now_us() - start;
+        worstUs = std::max(worstUs, us);
+        if (ok) okLatency.push_back(us / 1000.0);
+    }
+
+    double elapsed = (host_now_us() - t0) / 1e6;
+    std::sort(okLatency.begin(), okLatency.end());
+    auto pct = [&](double p) {
+        if (okLatency.empty()) return 0.0;
+        return okLatency[std::min(okLatency.size() - 1, (size_t)(p * okLatency.size()))];
+    };
+
+    printf("transactions: %lu in %.2f s  (%.1f/s, %.1f ok/s)\n", count, elapsed,
+           count / elapsed, okLatency.size() / elapsed);
+    printf("latency ms:   p50 %.2f  p90 %.2f  p99 %.2f  worst %.2f (incl. failures)\n",
+           pct(0.50), pct(0.90), pct(0.99), worstUs / 1000.0);
+    printf("errors:       timeouts %u  crc %u  exceptions %u  frame %u\n",
+           mb_stats.timeouts, mb_stats.crcErrors, mb_stats.exceptions, mb_stats.frameErrors);
+    for (const ModbusSlave &s : slaves) {
+        printf("slave 0x%02X:   %u polls, %u errors, T1=%.0fC I=%.2fA\n",
+               s.addr, s.polls, s.errors, s.values[4], s.values[3]);
+    }
+
+    close(fd);
+    return mb_stats.ok > 0 ? 0 : 2;
+}
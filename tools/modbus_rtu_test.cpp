@@ -0,0 +1,198 @@
+/**
+ * @file modbus_rtu_test.cpp
+ * Host checks for the Modbus RTU codec (modbus_rtu.h)
+ *
+ * Usage:
+ *   ./modbus_rtu_test
+ *
+ * CRC16 against published vectors and the bitwise reference, every
+ * builder through the matching parser, truncated frames (MB_INCOMPLETE
+ * at every length short of the whole), a flipped bit in each byte
+ * (MB_ERR_CRC or MB_ERR_FRAME, never MB_OK) and exception responses.
+ * Also the master's t3.5 inter-frame gap (mb_set_timing()). Any failure
+ * exits with status 1.
+ */
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "modbus_master.h"
+
+static int failures = 0;
+
+static void check(const char *name, bool ok) {
+    printf("  %-44s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+// The CRC as main.cpp computed it before the table (without the byte swap)
+static uint16_t crc_bitwise(const uint8_t *buf, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int j = 0; j < 8; j++) crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+// Every prefix of a good frame is incomplete, and a flipped bit anywhere never parses
+template <typename Parse>
+static bool truncated_and_flipped(const uint8_t *frame, size_t len, Parse parse) {
+    uint8_t buf[MB_MAX_ADU];
+    ModbusFrame f;
+    for (size_t n = 0; n < len; n++) {
+        if (parse(frame, n, &f) != MB_INCOMPLETE) return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            memcpy(buf, frame, len);
+            buf[i] ^= (uint8_t)(1 << bit);
+            if (parse(buf, len, &f) == MB_OK) return false;
+        }
+    }
+    return true;
+}
+
+static void crc_vectors() {
+    printf("crc16:\n");
+    const uint8_t check9[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    const uint8_t read10[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+    const uint8_t write1[] = {0x01, 0x06, 0x00, 0x01, 0x00, 0x03};
+    check("\"123456789\" = 0x4B37", mb_crc16(check9, sizeof(check9)) == 0x4B37);
+    check("01 03 00 00 00 0A -> C5 CD", mb_crc16(read10, sizeof(read10)) == 0xCDC5);
+    check("01 06 00 01 00 03 -> 98 0B", mb_crc16(write1, sizeof(write1)) == 0x0B98);
+    check("empty input = 0xFFFF", mb_crc16(read10, 0) == 0xFFFF);
+
+    uint8_t buf[MB_MAX_ADU];
+    uint32_t x = 12345;
+    bool same = true;
+    for (size_t len = 0; len <= sizeof(buf); len++) {
+        for (size_t i = 0; i < len; i++) {
+            x = x * 1103515245u + 12345u;
+            buf[i] = (uint8_t)(x >> 16);
+        }
+        same &= mb_crc16(buf, len) == crc_bitwise(buf, len);
+    }
+    check("table = bitwise, lengths 0..256", same);
+
+    uint8_t frame[8];
+    memcpy(frame, read10, sizeof(read10));
+    size_t n = mb_append_crc(frame, sizeof(read10));
+    check("append then check", n == 8 && frame[6] == 0xC5 && frame[7] == 0xCD && mb_check_crc(frame, n));
+    check("check rejects < 4 bytes", !mb_check_crc(frame, 3));
+}
+
+static void master_side() {
+    printf("requests (builder -> mb_parse_request):\n");
+    uint8_t buf[MB_MAX_ADU];
+    ModbusFrame f;
+    auto parseReq = [](const uint8_t *b, size_t n, ModbusFrame *o) { return mb_parse_request(b, n, o); };
+
+    size_t n = mb_build_read(buf, sizeof(buf), 0x11, MB_FC_READ_HOLDING, 0x006B, 3);
+    check("0x03 read", n == 8 && mb_parse_request(buf, n, &f) == MB_OK && f.slave == 0x11 &&
+                           f.function == 0x03 && f.addr == 0x006B && f.count == 3);
+    check("0x03 request length", mb_request_length(buf, n) == 8);
+    check("0x03 truncated / flipped", truncated_and_flipped(buf, n, parseReq));
+
+    n = mb_build_read(buf, sizeof(buf), 0x02, MB_FC_READ_INPUT, 0x1000, MB_MAX_READ_REGS);
+    check("0x04 read, 125 registers", n == 8 && mb_parse_request(buf, n, &f) == MB_OK &&
+                                      f.function == 0x04 && f.count == MB_MAX_READ_REGS);
+    check("read of 0 / 126 registers refused",
+          !mb_build_read(buf, sizeof(buf), 1, MB_FC_READ_INPUT, 0, 0) &&
+          !mb_build_read(buf, sizeof(buf), 1, MB_FC_READ_INPUT, 0, MB_MAX_READ_REGS + 1));
+    check("read with function 0x06 refused", !mb_build_read(buf, sizeof(buf), 1, MB_FC_WRITE_SINGLE, 0, 1));
+    check("read into 7 bytes refused", !mb_build_read(buf, 7, 1, MB_FC_READ_HOLDING, 0, 1));
+
+    n = mb_build_write_single(buf, sizeof(buf), 0x01, 0x0001, 0x0003);
+    check("0x06 write", n == 8 && mb_parse_request(buf, n, &f) == MB_OK && f.function == 0x06 &&
+                            f.addr == 1 && f.value == 3 && buf[6] == 0x98 && buf[7] == 0x0B);
+    check("0x06 truncated / flipped", truncated_and_flipped(buf, n, parseReq));
+
+    uint16_t regs[MB_MAX_WRITE_REGS];
+    for (int i = 0; i < MB_MAX_WRITE_REGS; i++) regs[i] = (uint16_t)(0xA500 + i);
+    n = mb_build_write_multiple(buf, sizeof(buf), 0x07, 0x0200, regs, MB_MAX_WRITE_REGS);
+    bool same = n == 9 + 2 * MB_MAX_WRITE_REGS && mb_parse_request(buf, n, &f) == MB_OK &&
+                f.function == 0x10 && f.addr == 0x0200 && f.count == MB_MAX_WRITE_REGS;
+    for (int i = 0; same && i < MB_MAX_WRITE_REGS; i++) same = mb_reg(&f, i) == regs[i];
+    check("0x10 write, 123 registers", same);
+    check("0x10 request length", mb_request_length(buf, n) == n && mb_request_length(buf, 6) == 0);
+    check("0x10 truncated / flipped", truncated_and_flipped(buf, n, parseReq));
+    check("0x10 of 124 registers refused",
+          !mb_build_write_multiple(buf, sizeof(buf), 1, 0, regs, MB_MAX_WRITE_REGS + 1));
+    buf[1] = 0x2B;
+    check("unknown function is a frame error", mb_parse_request(buf, n, &f) == MB_ERR_FRAME);
+}
+
+static void slave_side() {
+    printf("responses (builder -> mb_parse_response):\n");
+    uint8_t buf[MB_MAX_ADU];
+    ModbusFrame f;
+    uint16_t regs[MB_MAX_READ_REGS];
+    for (int i = 0; i < MB_MAX_READ_REGS; i++) regs[i] = (uint16_t)(i * 257);
+
+    static const int COUNTS[] = {1, 14, MB_MAX_READ_REGS};
+    for (int count : COUNTS) {
+        size_t n = mb_build_read_response(buf, sizeof(buf), 0x11, MB_FC_READ_HOLDING, regs, count);
+        bool ok = n == mb_response_length(MB_FC_READ_HOLDING, count) &&
+                  mb_parse_response(buf, n, 0x11, MB_FC_READ_HOLDING, &f) == MB_OK && f.count == count;
+        for (int i = 0; ok && i < count; i++) ok = mb_reg(&f, i) == regs[i];
+        char name[48];
+        snprintf(name, sizeof(name), "0x03 response, %d registers", count);
+        check(name, ok);
+        auto parse = [](const uint8_t *b, size_t len, ModbusFrame *o) {
+            return mb_parse_response(b, len, 0x11, MB_FC_READ_HOLDING, o);
+        };
+        snprintf(name, sizeof(name), "0x03 response, %d: truncated / flipped", count);
+        check(name, truncated_and_flipped(buf, n, parse));
+    }
+    size_t n = mb_build_read_response(buf, sizeof(buf), 0x11, MB_FC_READ_HOLDING, regs, 2);
+    check("response from another slave", mb_parse_response(buf, n, 0x12, MB_FC_READ_HOLDING, &f) == MB_ERR_FRAME);
+    check("response to another function", mb_parse_response(buf, n, 0x11, MB_FC_READ_INPUT, &f) == MB_ERR_FRAME);
+    buf[2] = 3;
+    check("odd byte count is a frame error", mb_parse_response(buf, n, 0x11, MB_FC_READ_HOLDING, &f) == MB_ERR_FRAME);
+
+    n = mb_build_write_response(buf, sizeof(buf), 0x01, MB_FC_WRITE_SINGLE, 0x0001, 0x0003);
+    check("0x06 echo", n == mb_response_length(MB_FC_WRITE_SINGLE, 1) &&
+                           mb_parse_response(buf, n, 0x01, MB_FC_WRITE_SINGLE, &f) == MB_OK &&
+                           f.addr == 1 && f.value == 3);
+    n = mb_build_write_response(buf, sizeof(buf), 0x01, MB_FC_WRITE_MULTIPLE, 0x0200, 10);
+    check("0x10 echo", mb_parse_response(buf, n, 0x01, MB_FC_WRITE_MULTIPLE, &f) == MB_OK &&
+                           f.addr == 0x0200 && f.count == 10);
+    auto parse10 = [](const uint8_t *b, size_t len, ModbusFrame *o) {
+        return mb_parse_response(b, len, 0x01, MB_FC_WRITE_MULTIPLE, o);
+    };
+    check("0x10 echo truncated / flipped", truncated_and_flipped(buf, n, parse10));
+
+    n = mb_build_exception(buf, sizeof(buf), 0x0A, MB_FC_READ_INPUT, MB_EX_ILLEGAL_ADDRESS);
+    check("exception", n == MB_EXCEPTION_LEN &&
+                           mb_parse_response(buf, n, 0x0A, MB_FC_READ_INPUT, &f) == MB_ERR_EXCEPTION &&
+                           f.function == MB_FC_READ_INPUT && f.exception == MB_EX_ILLEGAL_ADDRESS);
+    check("exception, 4 bytes: incomplete", mb_parse_response(buf, 4, 0x0A, MB_FC_READ_INPUT, &f) == MB_INCOMPLETE);
+    buf[2] ^= 1;
+    check("exception, bad CRC", mb_parse_response(buf, n, 0x0A, MB_FC_READ_INPUT, &f) == MB_ERR_CRC);
+}
+
+// 3.5 characters of 10 (8N1) or 11 (8E1) bits; fixed 1750 µs above 19200
+static void frame_gap() {
+    printf("t3.5 gap (mb_set_timing):\n");
+    mb_set_timing(9600, false, 0);
+    check("9600 8N1 = 3646 us", mb_gap_us == 3646);
+    mb_set_timing(9600, true, 0);
+    check("9600 8E1 = 4011 us", mb_gap_us == 4011);
+    mb_set_timing(19200, false, 0);
+    check("19200 8N1 = 1823 us", mb_gap_us == 1823);
+    mb_set_timing(115200, false, 0);
+    check("115200 = 1750 us", mb_gap_us == 1750);
+    mb_set_timing(9600, false, 5000);
+    check("explicit gap kept", mb_gap_us == 5000);
+}
+
+int main() {
+    crc_vectors();
+    master_side();
+    slave_side();
+    frame_gap();
+    printf("%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}